@@ -0,0 +1,133 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../libportquery/source/Network.h"
+#include "../libportquery/source/PacketRing.h"
+
+
+using namespace PortQuery;
+
+
+// Compares the two ways the SYN environment can collect replies, a recv per packet off of a raw socket and
+// reading blocks in place out of a PacketRing. Bursts of datagrams are sent over loopback, and once they have
+// all arrived only the time spent draining them is measured. Only one receiver is open at a time, so neither pays
+// for the other's copies. Requires CAP_NET_RAW.
+static constexpr size_t BURST_SIZE = 1024;
+static constexpr int RECEIVE_BUFFER_SIZE = 1 << 22;
+
+// Where the protocol sits in the IP header, both paths look at it so both have to touch the packet
+static constexpr size_t PROTOCOL_OFFSET = 9;
+
+
+static void sendBurst(const int fd, const sockaddr_in& target) {
+
+    static const std::vector<struct mmsghdr> messages = [&] () {
+
+        static char payload[64] = { };
+        static struct iovec vector = { payload, sizeof(payload) };
+        std::vector<struct mmsghdr> burst(BURST_SIZE);
+        for (auto& message : burst) {
+
+            message.msg_hdr.msg_name = const_cast<sockaddr_in*>(&target);
+            message.msg_hdr.msg_namelen = sizeof(target);
+            message.msg_hdr.msg_iov = &vector;
+            message.msg_hdr.msg_iovlen = 1;
+        }
+
+        return burst;
+    }();
+
+    size_t sent = 0;
+    while (sent < messages.size()) {
+
+        const int count = sendmmsg(fd, const_cast<struct mmsghdr*>(messages.data()) + sent,
+                static_cast<unsigned int>(messages.size() - sent), 0);
+        sent += count > 0 ? static_cast<size_t>(count) : 0;
+    }
+
+    // Long enough for every datagram to land and for the ring to retire the block they went into
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+}
+
+
+template <typename Drain>
+static double measure(const size_t bursts, const int fd, const sockaddr_in& target, Drain drain, size_t& received) {
+
+    std::chrono::duration<double, std::nano> elapsed(0);
+    received = 0;
+    for (size_t burst = 0; burst < bursts; burst++) {
+
+        sendBurst(fd, target);
+        const auto began = std::chrono::steady_clock::now();
+        received += drain();
+        elapsed += std::chrono::steady_clock::now() - began;
+    }
+
+    return elapsed.count() / static_cast<double>(std::max<size_t>(received, 1));
+}
+
+
+int main(int argc, char** argv) {
+
+    const size_t bursts = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200;
+    const int sender = socket(AF_INET, SOCK_DGRAM, 0);
+    const sockaddr_in target = makeSocketAddress(*parseIPv4Address("127.0.0.1"), 9);
+
+    size_t recvCount = 0;
+    double recvCost = 0.0;
+    {
+        const int rawFD = socket(AF_INET, SOCK_RAW | SOCK_NONBLOCK, IPPROTO_UDP);
+        if (-1 == rawFD) {
+
+            std::cerr << "Raw sockets require CAP_NET_RAW" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        setsockopt(rawFD, SOL_SOCKET, SO_RCVBUFFORCE, &RECEIVE_BUFFER_SIZE, sizeof(RECEIVE_BUFFER_SIZE));
+        recvCost = measure(bursts, sender, target, [&] () {
+
+            size_t count = 0;
+            uint8_t packet[256];
+            while (0 < recv(rawFD, packet, sizeof(packet), 0)) {
+                count += IPPROTO_UDP == packet[PROTOCOL_OFFSET] ? 1 : 0;
+            }
+
+            return count;
+        }, recvCount);
+
+        close(rawFD);
+    }
+
+    size_t ringCount = 0;
+    double ringCost = 0.0;
+    {
+        PacketRing ring;
+        ringCost = measure(bursts, sender, target, [&] () {
+
+            // The ring also sees the port unreachable errors coming back, those are read but not counted, so the
+            // ring pays for them in its cost per packet
+            size_t count = 0;
+            ring.receive([&] (const uint8_t* packet, const size_t, const std::chrono::nanoseconds) {
+                count += IPPROTO_UDP == packet[PROTOCOL_OFFSET] ? 1 : 0;
+            });
+
+            return count;
+        }, ringCount);
+    }
+
+    close(sender);
+    std::cout << "path\tpackets\tns/packet" << std::endl;
+    std::cout << "recv\t" << recvCount << "\t" << recvCost << std::endl;
+    std::cout << "ring\t" << ringCount << "\t" << ringCost << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,175 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <vector>
+
+#include "../libportquery/source/TimingWheel.h"
+
+
+using namespace PortQuery;
+using Clock = TimingWheel::Clock;
+
+
+// Replays the deadline traffic of a scan against both the timing wheel and the priority queue the reactors used
+// before it. A window of probes is kept in flight, every probe sent schedules a deadline, most are answered well
+// before it comes up and the rest time out. The heap can't remove a deadline, so like the old reactors it
+// leaves answered ones in place and skips them by generation once they make it to the top.
+struct Workload {
+
+    size_t m_window;
+    size_t m_probes;
+    double m_answered;
+};
+
+
+struct Deadline {
+
+    Clock::time_point m_expiry;
+    uint32_t m_slot;
+    uint32_t m_generation;
+
+    bool operator>(const Deadline& other) const {
+
+        return m_expiry > other.m_expiry;
+    }
+};
+
+
+struct Slot {
+
+    uint32_t m_generation = 0;
+    TimingWheel::Handle m_timer = TimingWheel::INVALID_HANDLE;
+    bool m_active = false;
+};
+
+
+// Every probe sent is given a timeout between 50ms and 2s and is answered (or not) within the window. The
+// simulated clock moves 10us per probe, expiring anything due every 64 probes the same way the reactor polls.
+static constexpr auto PROBE_INTERVAL = std::chrono::microseconds(10);
+static constexpr size_t PROBES_PER_POLL = 64;
+
+
+template <typename Schedule, typename Cancel, typename Expire>
+static double replay(const Workload& workload, Schedule schedule, Cancel cancel, Expire expire) {
+
+    std::mt19937 generator(1);
+    std::uniform_int_distribution<int> timeouts(50, 2000);
+    std::uniform_real_distribution<double> answers(0.0, 1.0);
+    std::vector<Slot> slots(workload.m_window);
+
+    const Clock::time_point start = Clock::now();
+    Clock::time_point now = start;
+    const auto began = std::chrono::steady_clock::now();
+    for (size_t probe = 0; probe < workload.m_probes; probe++) {
+
+        now += PROBE_INTERVAL;
+        Slot& slot = slots[probe % slots.size()];
+        const uint32_t index = static_cast<uint32_t>(probe % slots.size());
+        if (slot.m_active && answers(generator) < workload.m_answered) {
+            cancel(index, slot);
+        }
+
+        slot.m_active = true;
+        slot.m_generation++;
+        schedule(index, slot, now + std::chrono::milliseconds(timeouts(generator)));
+
+        if (0 == probe % PROBES_PER_POLL) {
+            expire(now, slots);
+        }
+    }
+
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - began;
+    return elapsed.count() / static_cast<double>(workload.m_probes);
+}
+
+
+static double replayWheel(const Workload& workload) {
+
+    TimingWheel wheel(std::chrono::milliseconds(1), Clock::now());
+    std::vector<uint64_t> expired;
+
+    return replay(workload,
+        [&](const uint32_t index, Slot& slot, const Clock::time_point expiry) {
+
+            if (TimingWheel::INVALID_HANDLE != slot.m_timer) {
+                wheel.cancel(slot.m_timer);
+            }
+
+            slot.m_timer = wheel.schedule(expiry, (static_cast<uint64_t>(slot.m_generation) << 32) | index);
+        },
+        [&](const uint32_t, Slot& slot) {
+
+            wheel.cancel(slot.m_timer);
+            slot.m_timer = TimingWheel::INVALID_HANDLE;
+            slot.m_active = false;
+        },
+        [&](const Clock::time_point now, std::vector<Slot>& slots) {
+
+            expired.clear();
+            wheel.advance(now, expired);
+            for (const uint64_t payload : expired) {
+
+                Slot& slot = slots[static_cast<uint32_t>(payload)];
+                slot.m_timer = TimingWheel::INVALID_HANDLE;
+                slot.m_active = false;
+            }
+        });
+}
+
+
+static double replayHeap(const Workload& workload, size_t& peak) {
+
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> deadlines;
+    peak = 0;
+
+    return replay(workload,
+        [&](const uint32_t index, Slot& slot, const Clock::time_point expiry) {
+
+            deadlines.push(Deadline{expiry, index, slot.m_generation});
+            peak = std::max(peak, deadlines.size());
+        },
+        [&](const uint32_t, Slot& slot) {
+
+            slot.m_active = false;
+        },
+        [&](const Clock::time_point now, std::vector<Slot>& slots) {
+
+            while (!deadlines.empty() && deadlines.top().m_expiry <= now) {
+
+                const Deadline deadline = deadlines.top();
+                deadlines.pop();
+
+                Slot& slot = slots[deadline.m_slot];
+                if (slot.m_active && slot.m_generation == deadline.m_generation) {
+                    slot.m_active = false;
+                }
+            }
+        });
+}
+
+
+int main(int argc, char** argv) {
+
+    const size_t probes = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4000000;
+    const Workload workloads[] = {
+        { 1024, probes, 0.9 },
+        { 65536, probes, 0.9 },
+        { 65536, probes, 0.1 },
+    };
+
+    std::cout << "window\tanswered\twheel ns/probe\theap ns/probe\theap peak" << std::endl;
+    for (const Workload& workload : workloads) {
+
+        size_t peak = 0;
+        const double wheel = replayWheel(workload);
+        const double heap = replayHeap(workload, peak);
+        std::cout << workload.m_window << "\t" << workload.m_answered << "\t\t" << wheel << "\t\t" << heap << "\t\t"
+            << peak << std::endl;
+    }
+
+    return 0;
+}
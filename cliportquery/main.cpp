@@ -1,5 +1,9 @@
 #include <iostream>
 #include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#include <exception>
+#include <optional>
 
 #include "ArgumentParser.h"
 #include "PortQuery.h"
@@ -22,16 +26,109 @@ struct STDOutput {
 };
 
 
+struct ColumnPrinter {
+
+    std::string operator()(const uint16_t port) const {
+        return std::to_string(port);
+    }
+
+    std::string operator()(const PortQuery::PQ_QUERY_RESULT result) const {
+        switch (result) {
+            case PortQuery::PQ_QUERY_RESULT::OPEN:
+                return "OPEN";
+            case PortQuery::PQ_QUERY_RESULT::CLOSED:
+                return "CLOSED";
+            case PortQuery::PQ_QUERY_RESULT::REJECTED:
+                return "REJECTED";
+            default:
+                return "UNKNOWN";
+        }
+    }
+
+    // In milliseconds, nothing was measured if it is zero
+    std::string operator()(const PortQuery::PQ_LATENCY latency) const {
+
+        if (PortQuery::PQ_LATENCY::zero() == latency) {
+            return "-";
+        }
+
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.3fms", static_cast<double>(latency.count()) / 1000.0);
+        return buffer;
+    }
+
+    // Dotted quad, the address comes in host byte order
+    std::string operator()(const PortQuery::PQ_HOST host) const {
+
+        return std::to_string(host.m_address >> 24) + "." + std::to_string((host.m_address >> 16) & 0xFF) + "." +
+            std::to_string((host.m_address >> 8) & 0xFF) + "." + std::to_string(host.m_address & 0xFF);
+    }
+
+    // Only inferred rows are marked, a probed port is the normal case
+    std::string operator()(const PortQuery::PQ_INFERRED inferred) const {
+        return inferred ? "INFERRED" : "-";
+    }
+
+    // Escaped so that a banner can't break up the row, or the terminal
+    std::string operator()(const PortQuery::PQ_BANNER banner) const {
+
+        std::string escaped;
+        for (const char c : banner) {
+
+            if ('\\' == c) {
+                escaped += "\\\\";
+            }
+
+            else if ('\r' == c) {
+                escaped += "\\r";
+            }
+
+            else if ('\n' == c) {
+                escaped += "\\n";
+            }
+
+            else if ('\t' == c) {
+                escaped += "\\t";
+            }
+
+            else if (c < 0x20 || c > 0x7E) {
+
+                char buffer[8];
+                std::snprintf(buffer, sizeof(buffer), "\\x%02X", static_cast<unsigned char>(c));
+                escaped += buffer;
+            }
+
+            else {
+                escaped += c;
+            }
+        }
+
+        return escaped;
+    }
+};
+
+
 class QueryContext {
 
+    public:
+
+        void printRow(const PortQuery::PQ_ROW& row) {
+
+            std::string rowString;
+            for (const auto& column : row) {
 
+                rowString += std::visit(ColumnPrinter{}, column) + "\t";
+            }
+
+            STDOutput::output(rowString + "\n");
+        }
 };
 
 
-void QueryCallback(std::any callbackContext, std::vector<uint16_t> columns) {
+void QueryCallback(std::any callbackContext, PortQuery::PQ_ROW columns) {
 
     QueryContext* context = std::any_cast<QueryContext*>(callbackContext);
-    UNUSED(columns);
+    context->printRow(columns);
 }
 
 
@@ -39,10 +136,27 @@ int main(int argc, char* args[]) {
 
     ArgumentParser<STDOutput> parser(argc, args);
     parser.addCommand<int>("--timeout", "duration in seconds to wait on a response", 2);
-    parser.addCommand<int>("--threads", "number of threads to use (0 = number of processors on the machine", 0);
-
-    // this should be increased by default
-    parser.addCommand<int>("--delay", "duration (in milliseconds) after scanning a port to wait until scanning another", 0);
+    parser.addCommand<int>("--threads", "number of threads to split the sweep over, each with its own reactor and core (0 = one per processor)", 0);
+    parser.addCommand<int>("--delay", "least duration (in milliseconds) between two probes, caps the rate found automatically (0 = no cap)", 0);
+    parser.addCommand<int>("--burst", "number of datagrams sent (or replies read) with a single system call", 64);
+    parser.addCommand<int>("--bannerbytes", "most bytes of a banner kept for the BANNER column", 256);
+    parser.addCommand<int>("--bannerwait", "duration (in milliseconds) an open port is given to send its banner", 1000);
+    parser.addCommand<int>("--breaker", "silent TCP probes in a row before the rest of a host is sampled and inferred closed (0 = probe every port)", 128);
+    parser.addCommand<int>("--breakersample", "once a host is inferred closed, probe one of every this many of its ports", 256);
+    parser.addCommand<int>("--hostlimit", "most ports of a single host in flight at once (0 = no limit)", 1024);
+    parser.addCommand<int>("--subnetlimit", "most ports of a single /24 in flight at once (0 = no limit)", 2048);
+    parser.addCommandList<std::string>("--targets", "files of addresses, CIDR blocks or ranges to sweep as well as the FROM clause, one to a line (- for stdin)");
+    parser.addCommandList<std::string>("--exclude", "addresses or CIDR blocks which are never probed");
+    parser.addCommand<std::string>("--excludefile", "file of addresses or CIDR blocks which are never probed, one to a line", "");
+    parser.addCommandList<std::string>("--source", "local addresses to spread connects over, each adds a full range of ephemeral ports");
+    parser.addCommand<std::string>("--nameserver", "name server (address or address:port) to look up hostnames in the FROM clause with (default is from /etc/resolv.conf)", "");
+    parser.addCommand<std::string>("--shard", "sweep only slice i of n (i/n, counting from 0), runs of every slice between them cover the sweep once", "");
+    parser.addCommand<std::string>("--seed", "seed for the order probes go out in, the same seed repeats a run (default is random)", "");
+    parser.addCommandFlag("--uring", "probe ports through io_uring instead of epoll");
+    parser.addCommandFlag("--syn", "half open SYN scan over a raw socket (requires CAP_NET_RAW)");
+    parser.addCommandFlag("--ring", "read SYN scan replies out of a memory mapped packet ring");
+    parser.addCommandFlag("--nodiscovery", "sweep every target, even those which don't answer the liveness check");
+    parser.addCommandFlag("--stats", "print how the scan was limited once it is done");
 
     if(!parser.parse()) {
 
@@ -52,14 +166,146 @@ int main(int argc, char* args[]) {
     const std::string queryString = parser.getQueryString();
     const int timeout = parser.getCommand<int>("--timeout");
     const int threadCount = parser.getCommand<int>("--threads");
+    const int delayMS = parser.getCommand<int>("--delay");
 
     std::unique_ptr<QueryContext> context = std::make_unique<QueryContext>(QueryContext{});
+    PortQuery::PQConn pq{ QueryCallback, context.get(), timeout, threadCount, delayMS };
+    if (parser.getCommandFlag("--uring")) {
+
+        pq.setBackend(PortQuery::PQ_BACKEND::CONNECT_IO_URING);
+    }
+
+    else if (parser.getCommandFlag("--syn")) {
+
+        pq.setBackend(PortQuery::PQ_BACKEND::SYN_RAW);
+    }
+
+    pq.setBurstSize(parser.getCommand<int>("--burst"));
+    pq.setReceiveRing(parser.getCommandFlag("--ring"));
+    pq.setHostDiscovery(!parser.getCommandFlag("--nodiscovery"));
+    pq.setBannerLength(static_cast<size_t>(std::max(parser.getCommand<int>("--bannerbytes"), 1)));
+    pq.setBannerWait(parser.getCommand<int>("--bannerwait"));
+    pq.setBreakerThreshold(static_cast<size_t>(std::max(parser.getCommand<int>("--breaker"), 0)));
+    pq.setBreakerSampling(static_cast<size_t>(std::max(parser.getCommand<int>("--breakersample"), 1)));
+    pq.setHostLimit(static_cast<size_t>(std::max(parser.getCommand<int>("--hostlimit"), 0)));
+    pq.setSubnetLimit(static_cast<size_t>(std::max(parser.getCommand<int>("--subnetlimit"), 0)));
+    const std::string seed = parser.getCommand<std::string>("--seed");
+    if (!seed.empty()) {
+
+        try {
+            pq.setSeed(std::stoull(seed, nullptr, 0));
+        }
+        catch (std::exception&) {
+
+            STDOutput::output("ERROR: Invalid seed: " + seed + "\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    const std::string shard = parser.getCommand<std::string>("--shard");
+    if (!shard.empty()) {
+
+        // stoul skips white space, takes a sign and stops at the first thing which isn't a digit, so "-1" would
+        // wrap around and "1x" would pass for 1. Both halves have to be digits and nothing else
+        const auto parseCount = [] (const std::string& count) -> std::optional<size_t> {
+
+            if (count.empty() || std::string::npos != count.find_first_not_of("0123456789")) {
+                return std::nullopt;
+            }
+
+            try {
+
+                size_t length = 0;
+                const unsigned long value = std::stoul(count, &length);
+                return count.size() == length ? std::optional<size_t>(value) : std::nullopt;
+            }
+            catch (std::exception&) {
+                return std::nullopt;
+            }
+        };
+
+        const size_t slash = shard.find('/');
+        const std::optional<size_t> partition = std::string::npos != slash ? parseCount(shard.substr(0, slash)) :
+            std::nullopt;
+        const std::optional<size_t> partitionCount = std::string::npos != slash ? parseCount(shard.substr(slash + 1)) :
+            std::nullopt;
+        const bool valid = partition && partitionCount && pq.setPartition(*partition, *partitionCount);
+
+        if (!valid) {
 
-//    PortQuery pq{ QueryCallback, context.get(), timeout, threadCount};
+            STDOutput::output("ERROR: Invalid shard: " + shard + "\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    const std::string nameServer = parser.getCommand<std::string>("--nameserver");
+    if (!nameServer.empty()) {
+
+        const size_t colon = nameServer.find(':');
+        int port = 53;
+        try {
+            port = std::string::npos == colon ? port : std::stoi(nameServer.substr(colon + 1));
+        }
+        catch (std::exception&) {
+            port = -1;
+        }
 
-//    pq.execute("cool");
-    const char ugh[] = "coool";
- //   pq.execute(ugh);
+        if (port <= 0 || port > 65535 || !pq.setNameServer(nameServer.substr(0, colon), static_cast<uint16_t>(port))) {
+
+            STDOutput::output("ERROR: Invalid name server: " + nameServer + "\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (const std::string& targetFile : parser.getCommandList<std::string>("--targets")) {
+        pq.addTargetFile(targetFile);
+    }
+
+    for (const std::string& exclusion : parser.getCommandList<std::string>("--exclude")) {
+
+        if (!pq.addExclusion(exclusion)) {
+
+            STDOutput::output("ERROR: " + pq.getErrorString() + "\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    const std::string exclusionFile = parser.getCommand<std::string>("--excludefile");
+    if (!exclusionFile.empty() && !pq.addExclusionFile(exclusionFile)) {
+
+        STDOutput::output("ERROR: " + pq.getErrorString() + "\n");
+        return EXIT_FAILURE;
+    }
+
+    for (const std::string& source : parser.getCommandList<std::string>("--source")) {
+
+        if (!pq.addSourceAddress(source)) {
+
+            STDOutput::output("ERROR: " + pq.getErrorString() + "\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!pq.execute(queryString)) {
+
+        STDOutput::output("ERROR: " + pq.getErrorString() + "\n");
+        return EXIT_FAILURE;
+    }
+
+    // Statistics go to stderr so that the results can still be piped on their own
+    const PortQuery::PQ_SCAN_STATS statistics = pq.getScanStatistics();
+    if (parser.getCommandFlag("--stats") || 0 != statistics.m_descriptorStalls || 0 != statistics.m_portStalls ||
+            0 != statistics.m_inferredPorts || 0 != statistics.m_hostsDown || 0 != statistics.m_malformedTargets) {
+
+        std::cerr << "in flight window: " << statistics.m_maxInFlight << ", descriptor limit: " << 
+            statistics.m_descriptorLimit << ", waits for a descriptor: " << statistics.m_descriptorStalls << "\n";
+        std::cerr << "local ports in use at most: " << statistics.m_peakPortsInUse << ", local port limit: " <<
+            statistics.m_portLimit << ", waits for a local port: " << statistics.m_portStalls << "\n";
+        std::cerr << "ports inferred closed without a probe: " << statistics.m_inferredPorts << ", hosts down and skipped: " <<
+            statistics.m_hostsDown << "\n";
+        std::cerr << "probe order seed: " << pq.getSeed() << ", target file lines skipped: " <<
+            statistics.m_malformedTargets << ", waits on the host and subnet limits: " << statistics.m_limitWaits << "\n";
+    }
 
-    return 0;
+    return EXIT_SUCCESS;
 }
@@ -1,10 +1,14 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
 #include <functional>
 #include <any>
 #include <variant>
 #include <memory>
+#include <chrono>
 
 
 namespace PortQuery {
@@ -15,28 +19,82 @@ namespace PortQuery {
             REJECTED = 2
         };
 
-    using PQ_COLUMN = std::variant<uint16_t, PQ_QUERY_RESULT>;
+    // The different mechanisms which can be used to probe ports
+    enum class PQ_BACKEND {
+            CONNECT_EPOLL = 0,
+            CONNECT_IO_URING = 1,
+            SYN_RAW = 2
+        };
+
+    // How the last scan went, see PQConn::getScanStatistics
+    struct PQ_SCAN_STATS {
+
+        // The most probes the backend would keep in flight at once, after taking the descriptor limit into account
+        size_t m_maxInFlight = 0;
+
+        // The limit on open descriptors the scan ran under, zero if it isn't known
+        size_t m_descriptorLimit = 0;
+
+        // The number of times a probe had to wait for another to finish because the process was out of
+        // descriptors. Non zero means a higher limit (ulimit -n) would let the scan run faster
+        size_t m_descriptorStalls = 0;
+
+        // The most local ports connects may hold at once (zero if unknown), the most they actually held, and
+        // the number of times a connect had to wait for a port. Waits mean more source addresses would help
+        size_t m_portLimit = 0;
+        size_t m_peakPortsInUse = 0;
+        size_t m_portStalls = 0;
+
+        // The number of ports reported as closed without being probed, because their host had stopped answering
+        size_t m_inferredPorts = 0;
+
+        // The number of times the sweep had to wait on a probe to finish because every probe left to send was
+        // held back by the per host or per subnet limit. A lot of them means the limits are what set the pace
+        size_t m_limitWaits = 0;
+
+        // The number of targets which didn't answer the liveness check and were left out of the sweep
+        size_t m_hostsDown = 0;
+
+        // Lines in target files which didn't hold an address, block or range, they were passed over
+        size_t m_malformedTargets = 0;
+    };
+
+    // The round trip a port's TCP probe took, from the kernel's timestamps rather than the scanner's clock.
+    // Zero when nothing was measured, a port which never answered or a backend which couldn't time the answer
+    using PQ_LATENCY = std::chrono::microseconds;
+
+    // Whatever an open port sent first once the connection was made, empty if it sent nothing in time. This is
+    // a view into a buffer the library reuses, it is only valid until the callback returns
+    using PQ_BANNER = std::string_view;
+
+    // True when the port was never probed, the circuit breaker had already given up on a silent host and the
+    // results were filled in as closed
+    using PQ_INFERRED = bool;
+
+    // The target the row is about, an IPv4 address in host byte order (10.0.0.1 is 0x0A000001)
+    struct PQ_HOST {
+
+        uint32_t m_address;
+    };
+
+    using PQ_COLUMN = std::variant<uint16_t, PQ_QUERY_RESULT, PQ_LATENCY, PQ_BANNER, PQ_INFERRED, PQ_HOST>;
     using PQ_ROW = std::vector<PQ_COLUMN>;
     using PQCallback = std::function<void(std::any, PQ_ROW)>;
 
 
     class SelectStatement;
+    class ExclusionSet;
+    class DNSResolver;
 
     class PQConn {
 
         public:
 
             using PQ_PORT = uint16_t;
-            enum PQ_QUERY_RESULT { 
-                OPEN = 0,
-                CLOSED = 1,
-                REJECTED = 2
-            };
-
-            using PQ_COLUMN = std::variant<PQ_PORT, PQ_QUERY_RESULT>;
-            using PQ_ROW = std::vector<PQ_COLUMN>;
-            using PQCallback = std::function<void(std::any, PQ_ROW)>;
 
+            // The sweep is split over threadCount shards, each a thread pinned to its own core with its own reactor
+            // and slice of the ports (zero is one per core). With more than one the callback is still only ever
+            // called by one thread at a time, but not always the same one
             PQConn(PQCallback const callback=nullptr, 
                     const std::any context=nullptr, 
                     const int timeout=TIMEOUT_DEFAULT,
@@ -68,11 +126,123 @@ namespace PortQuery {
                 m_timeout = timeout;
             }
 
+            void setBackend(const PQ_BACKEND backend) {
+
+                m_backend = backend;
+            }
+
+            // The number of datagrams handed to the kernel (or read back) at once by backends which batch them
+            void setBurstSize(const int burstSize) {
+
+                m_burstSize = burstSize;
+            }
+
+            // SYN scans read replies out of a memory mapped packet ring rather than off of the raw socket
+            void setReceiveRing(const bool enabled) {
+
+                m_receiveRing = enabled;
+            }
+
+            // Banners are read until this many bytes have come in, or whatever the port sent first if that is less
+            void setBannerLength(const size_t bannerLength) {
+
+                m_bannerLength = bannerLength;
+            }
+
+            // How long an open port is given to send its banner
+            void setBannerWait(const int bannerWaitMS) {
+
+                m_bannerWaitMS = bannerWaitMS;
+            }
+
+            // A host which lets this many TCP probes in a row time out is treated as dropping everything, only
+            // one of its ports in every breakerSampling is probed from then on and the rest are reported as
+            // closed (see the INFERRED column). Zero turns this off and probes every port
+            void setBreakerThreshold(const size_t breakerThreshold) {
+
+                m_breakerThreshold = breakerThreshold;
+            }
+
+            void setBreakerSampling(const size_t breakerSampling) {
+
+                m_breakerSampling = breakerSampling;
+            }
+
+            // The most ports of any one host, and of any one /24, which may be in flight at once. Hosts take turns
+            // sending within those limits, so a slow host can't take up the whole window. Zero is no limit
+            void setHostLimit(const size_t hostLimit) {
+
+                m_hostLimit = hostLimit;
+            }
+
+            void setSubnetLimit(const size_t subnetLimit) {
+
+                m_subnetLimit = subnetLimit;
+            }
+
+            // Before any ports are swept every target gets a quick liveness check (see HostDiscovery), and targets
+            // which don't answer it are skipped. Turning this off sweeps every target regardless
+            void setHostDiscovery(const bool enabled) {
+
+                m_hostDiscovery = enabled;
+            }
+
+            // Probes go out in an order scrambled by the seed (see CyclicPermutation), the same seed and targets
+            // give the same order every time. Without one each run picks its own
+            void setSeed(const uint64_t seed) {
+
+                m_seed = seed;
+                m_seeded = true;
+            }
+
+            // The seed the last run went with, whether it was set or picked at random
+            uint64_t getSeed() const {
+
+                return m_seed;
+            }
+
+            // Splits the sweep over partitionCount separate runs and only sweeps this one's share, partition counts
+            // from zero. Every (host, port) pair falls in exactly one partition, decided by the pair alone, so runs
+            // on different machines need nothing in common but the query and the count to cover the sweep between
+            // them without overlap. Returns false if the partition isn't one of the count
+            bool setPartition(const size_t partition, const size_t partitionCount);
+
+            // Connects go out from each of the added addresses in turn, spreading them over more local ports.
+            // Returns false if the address isn't a valid IPv4 address
+            bool addSourceAddress(const std::string& address);
+
+            // Sweeps the targets in a file (one address, block or range to a line, "-" for stdin) as well as those
+            // in the FROM clause, the same as naming it in the clause as @path. The file is read as the sweep goes
+            // rather than up front. Files added this way are dropped when the query is finalized
+            void addTargetFile(const std::string& path) {
+
+                m_targetFiles.push_back(path);
+            }
+
+            // Hostnames in the FROM clause are looked up with this name server (port 53 unless given) rather than
+            // the first one in /etc/resolv.conf. The answers are cached for as long as their TTL allows, for every
+            // run after on this connection. Returns false if the address isn't a valid IPv4 address
+            bool setNameServer(const std::string& address, const uint16_t port=53);
+
+            // Addresses and CIDR blocks which are never probed, however they come up in the FROM clause. They
+            // stay in place for every run after. Returns false if the entry isn't an address or CIDR block
+            bool addExclusion(const std::string& exclusion);
+
+            // Adds every entry in a blocklist file, one address or CIDR block to a line. Anything after a # is
+            // a comment. Returns false if the file can't be read or an entry is malformed, the entries on the
+            // lines before it are kept
+            bool addExclusionFile(const std::string& path);
+
             std::string getErrorString() const {
 
                 return m_errorString;
             }
 
+            PQ_SCAN_STATS getScanStatistics() const {
+
+                return m_scanStatistics;
+            }
+
         private:
 
             static constexpr int TIMEOUT_DEFAULT = 2;
@@ -80,10 +250,45 @@ namespace PortQuery {
             static constexpr int THREADCOUNT_DEFAULT = 0;
             int m_threadCount;
 
-            // this should be increased
+            // The least time between two probes, zero leaves the rate entirely up to the environment
             static constexpr int DELAYMS_DEFAULT = 0;
             int m_delayMS;
 
+            static constexpr int BURSTSIZE_DEFAULT = 64;
+            int m_burstSize = BURSTSIZE_DEFAULT;
+
+            PQ_BACKEND m_backend = PQ_BACKEND::CONNECT_EPOLL;
+            std::vector<uint32_t> m_sourceAddresses;
+            std::unique_ptr<ExclusionSet> m_exclusions;
+
+            // Null until a name server is set, the system resolver (and its cache) is shared by every connection
+            std::shared_ptr<DNSResolver> m_resolver;
+            std::vector<std::string> m_targetFiles;
+            bool m_receiveRing = false;
+
+            static constexpr size_t BANNERLENGTH_DEFAULT = 256;
+            size_t m_bannerLength = BANNERLENGTH_DEFAULT;
+            static constexpr int BANNERWAITMS_DEFAULT = 1000;
+            int m_bannerWaitMS = BANNERWAITMS_DEFAULT;
+
+            static constexpr size_t BREAKERTHRESHOLD_DEFAULT = 128;
+            size_t m_breakerThreshold = BREAKERTHRESHOLD_DEFAULT;
+            static constexpr size_t BREAKERSAMPLING_DEFAULT = 256;
+            size_t m_breakerSampling = BREAKERSAMPLING_DEFAULT;
+
+            static constexpr size_t HOSTLIMIT_DEFAULT = 1024;
+            size_t m_hostLimit = HOSTLIMIT_DEFAULT;
+            static constexpr size_t SUBNETLIMIT_DEFAULT = 2048;
+            size_t m_subnetLimit = SUBNETLIMIT_DEFAULT;
+
+            bool m_hostDiscovery = true;
+
+            size_t m_partition = 0;
+            size_t m_partitionCount = 1;
+
+            uint64_t m_seed = 0;
+            bool m_seeded = false;
+
             PQCallback m_userCallback;
             std::any m_userContext;
 
@@ -91,5 +296,6 @@ namespace PortQuery {
             using SOSQLSelectStatement = std::unique_ptr<SelectStatement>;
             SOSQLSelectStatement m_selectStatement;
             std::string m_errorString;
+            PQ_SCAN_STATS m_scanStatistics;
     };
 }
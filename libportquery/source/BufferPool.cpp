@@ -0,0 +1,51 @@
+#include "BufferPool.h"
+
+
+namespace PortQuery {
+
+    BufferPool::BufferPool(const size_t bufferSize, const size_t bufferCount) : m_bufferSize(bufferSize),
+        m_storage(new char[bufferSize * bufferCount]) {
+
+        // Handed out lowest first, so a lightly used pool only ever touches the start of the allocation
+        m_freeBuffers.reserve(bufferCount);
+        for (size_t index = bufferCount; index > 0; index--) {
+            m_freeBuffers.push_back(static_cast<Handle>(index - 1));
+        }
+    }
+
+    BufferPool::Handle BufferPool::acquire(void) {
+
+        if (m_freeBuffers.empty()) {
+            return INVALID_HANDLE;
+        }
+
+        const Handle handle = m_freeBuffers.back();
+        m_freeBuffers.pop_back();
+        return handle;
+    }
+
+    void BufferPool::release(const Handle handle) {
+
+        m_freeBuffers.push_back(handle);
+    }
+
+    char* BufferPool::getData(const Handle handle) {
+
+        return m_storage.get() + static_cast<size_t>(handle) * m_bufferSize;
+    }
+
+    const char* BufferPool::getData(const Handle handle) const {
+
+        return m_storage.get() + static_cast<size_t>(handle) * m_bufferSize;
+    }
+
+    size_t BufferPool::getBufferSize(void) const {
+
+        return m_bufferSize;
+    }
+
+    size_t BufferPool::getAvailable(void) const {
+
+        return m_freeBuffers.size();
+    }
+}
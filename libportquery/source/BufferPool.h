@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <vector>
+
+
+namespace PortQuery {
+
+    // A fixed number of equally sized buffers carved out of a single allocation, handed out by index. Nothing is
+    // allocated after construction, acquiring and releasing a buffer is a push or pop on the free list. Used to
+    // read banners straight into memory which outlives the probe, so the bytes can be handed to the caller as a
+    // view rather than copied into a string for every row.
+    class BufferPool {
+
+        public:
+
+            using Handle = uint32_t;
+
+            static constexpr Handle INVALID_HANDLE = std::numeric_limits<Handle>::max();
+
+            BufferPool(const size_t bufferSize, const size_t bufferCount);
+            BufferPool(const BufferPool&) = delete;
+            BufferPool& operator=(const BufferPool&) = delete;
+
+            // INVALID_HANDLE if every buffer is in use
+            Handle acquire(void);
+            void release(const Handle handle);
+
+            char* getData(const Handle handle);
+            const char* getData(const Handle handle) const;
+            size_t getBufferSize(void) const;
+            size_t getAvailable(void) const;
+
+        private:
+
+            size_t m_bufferSize;
+            std::unique_ptr<char[]> m_storage;
+            std::vector<Handle> m_freeBuffers;
+    };
+}
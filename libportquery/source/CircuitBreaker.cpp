@@ -0,0 +1,69 @@
+#include <algorithm>
+
+#include "CircuitBreaker.h"
+
+
+namespace PortQuery {
+
+    CircuitBreaker::CircuitBreaker(const size_t threshold, const size_t sampleInterval) :
+        m_threshold(threshold), m_sampleInterval(std::max<size_t>(sampleInterval, 1)) { }
+
+    bool CircuitBreaker::shouldProbe(const uint32_t address, const uint16_t port) {
+
+        if (0 == m_threshold) {
+            return true;
+        }
+
+        // The first port after tripping is left alone, the sample comes at the end of each interval
+        Host& host = m_hosts[address];
+        if (host.m_tripped && ++host.m_sinceSample < m_sampleInterval) {
+
+            m_inferred++;
+            return false;
+        }
+
+        host.m_sinceSample = 0;
+        m_inFlight[getKey(address, port)] = ++host.m_sent;
+        return true;
+    }
+
+    void CircuitBreaker::addResult(const uint32_t address, const uint16_t port, const bool answered) {
+
+        const auto probeIter = m_inFlight.find(getKey(address, port));
+        if (m_inFlight.end() == probeIter) {
+            return;
+        }
+
+        const uint64_t sequence = probeIter->second;
+        m_inFlight.erase(probeIter);
+
+        Host& host = m_hosts[address];
+        if (answered) {
+
+            host.m_lastAnswered = std::max(host.m_lastAnswered, sequence);
+            host.m_silentRun = 0;
+            host.m_tripped = false;
+            return;
+        }
+
+        if (sequence > host.m_lastAnswered && ++host.m_silentRun >= m_threshold) {
+            host.m_tripped = true;
+        }
+    }
+
+    bool CircuitBreaker::isTripped(const uint32_t address) const {
+
+        const auto hostIter = m_hosts.find(address);
+        return m_hosts.end() != hostIter && hostIter->second.m_tripped;
+    }
+
+    void CircuitBreaker::forgetHost(const uint32_t address) {
+
+        m_hosts.erase(address);
+    }
+
+    size_t CircuitBreaker::getInferredCount(void) const {
+
+        return m_inferred;
+    }
+}
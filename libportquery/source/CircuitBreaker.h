@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+
+
+namespace PortQuery {
+
+    // Watches how each host answers. A host which lets a long run of ports time out without a word is most
+    // likely behind a firewall dropping everything, waiting out the timeout on each of its remaining ports
+    // would find nothing. Once the run gets long enough the breaker trips, and from then on only one port in
+    // every sample interval is probed to confirm the host is still silent, the rest are reported closed without
+    // going on the network. Any answer at all from the host closes the breaker again.
+    class CircuitBreaker {
+
+        public:
+
+            // A threshold of zero never trips
+            CircuitBreaker(const size_t threshold=THRESHOLD_DEFAULT, const size_t sampleInterval=SAMPLE_INTERVAL_DEFAULT);
+
+            // Whether the port should be probed, false means it can be inferred as closed. Every port which is
+            // probed has to be reported back through addResult
+            bool shouldProbe(const uint32_t address, const uint16_t port);
+
+            // Reports how a probed port went, answered is anything other than a timeout
+            void addResult(const uint32_t address, const uint16_t port, const bool answered);
+
+            bool isTripped(const uint32_t address) const;
+
+            // Drops everything kept about the host, for once the sweep is done with it. Every probe to it has to
+            // have been reported by then
+            void forgetHost(const uint32_t address);
+
+            // The number of ports shouldProbe turned away, over every host
+            size_t getInferredCount(void) const;
+
+            static constexpr size_t THRESHOLD_DEFAULT = 128;
+            static constexpr size_t SAMPLE_INTERVAL_DEFAULT = 256;
+
+        private:
+
+            struct Host {
+
+                // Probes to the host are numbered in the order they went out. Timeouts come back long after
+                // the answers to probes sent at the same time, so silence from a probe sent before the last
+                // answer says nothing about the host now
+                uint64_t m_sent = 0;
+                uint64_t m_lastAnswered = 0;
+
+                size_t m_silentRun = 0;
+                size_t m_sinceSample = 0;
+                bool m_tripped = false;
+            };
+
+            static uint64_t getKey(const uint32_t address, const uint16_t port) {
+
+                return (static_cast<uint64_t>(address) << 16) | port;
+            }
+
+            size_t m_threshold;
+            size_t m_sampleInterval;
+            size_t m_inferred = 0;
+            std::unordered_map<uint32_t, Host> m_hosts;
+
+            // The number each probe in flight went out with
+            std::unordered_map<uint64_t, uint64_t> m_inFlight;
+    };
+}
@@ -0,0 +1,129 @@
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "CyclicPermutation.h"
+
+
+namespace PortQuery {
+
+    // SplitMix64, spreads a seed (or a seed plus a counter) out over all 64 bits
+    static uint64_t mixSeed(uint64_t value) {
+
+        value += 0x9E3779B97F4A7C15ULL;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+        return value ^ (value >> 31);
+    }
+
+    // Trial division is plenty below 2^32, there are only 2^16 candidate divisors
+    static bool isPrime(const uint64_t value) {
+
+        if (value < 4) {
+            return value > 1;
+        }
+
+        if (0 == value % 2 || 0 == value % 3) {
+            return false;
+        }
+
+        for (uint64_t divisor = 5; divisor * divisor <= value; divisor += 6) {
+
+            if (0 == value % divisor || 0 == value % (divisor + 2)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    static std::vector<uint64_t> getPrimeFactors(uint64_t value) {
+
+        std::vector<uint64_t> factors;
+        for (uint64_t divisor = 2; divisor * divisor <= value; divisor++) {
+
+            if (0 == value % divisor) {
+
+                factors.push_back(divisor);
+                while (0 == value % divisor) {
+                    value /= divisor;
+                }
+            }
+        }
+
+        if (value > 1) {
+            factors.push_back(value);
+        }
+
+        return factors;
+    }
+
+    static uint64_t powerModulo(uint64_t base, uint64_t exponent, const uint64_t modulus) {
+
+        uint64_t result = 1;
+        base %= modulus;
+        while (exponent > 0) {
+
+            if (exponent & 1) {
+                result = result * base % modulus;
+            }
+
+            base = base * base % modulus;
+            exponent >>= 1;
+        }
+
+        return result;
+    }
+
+
+    CyclicPermutation::CyclicPermutation(const uint64_t size, const uint64_t seed) : m_size(size), m_done(0 == size) {
+
+        if (size > MAX_SIZE) {
+            throw std::invalid_argument("Permutation space is too large: " + std::to_string(size));
+        }
+
+        m_prime = size + 1;
+        while (!isPrime(m_prime)) {
+            m_prime++;
+        }
+
+        // g generates the whole group unless g^((p-1)/q) is 1 for one of the prime factors q of p-1. Generators
+        // make up a fair share of the group, a few steps on from a random candidate is enough to find one
+        const uint64_t order = m_prime - 1;
+        const std::vector<uint64_t> factors = getPrimeFactors(order);
+        const uint64_t mixed = mixSeed(seed);
+        m_generator = m_prime > 2 ? 2 + mixed % (m_prime - 2) : 1;
+        for (bool generator = false; !generator;) {
+
+            generator = true;
+            for (const uint64_t factor : factors) {
+
+                if (1 == powerModulo(m_generator, order / factor, m_prime)) {
+
+                    generator = false;
+                    m_generator = m_generator + 1 < m_prime ? m_generator + 1 : 2;
+                    break;
+                }
+            }
+        }
+
+        m_first = 1 + mixSeed(mixed) % order;
+        m_current = m_first;
+    }
+
+    std::optional<uint64_t> CyclicPermutation::next(void) {
+
+        while (!m_done) {
+
+            // Elements start at 1, and anything past the end of the space is only there to make p prime
+            const uint64_t element = m_current;
+            m_current = m_current * m_generator % m_prime;
+            m_done = m_first == m_current;
+            if (element - 1 < m_size) {
+                return element - 1;
+            }
+        }
+
+        return std::nullopt;
+    }
+}
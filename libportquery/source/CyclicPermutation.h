@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+
+namespace PortQuery {
+
+    // Visits every index in [0, size) exactly once in a scrambled order, the way zmap orders its probes. The
+    // multiplicative group of integers modulo a prime p is cyclic, so repeatedly multiplying by a generator g
+    // walks through every element 1..p-1 before coming back around. p is the first prime above size and the
+    // handful of elements which land past the end are skipped. The walk only needs the current element, however
+    // big the space. The generator and the starting point come from the seed, the same seed gives the same order
+    class CyclicPermutation {
+
+        public:
+
+            // Sizes go up to 2^31, which keeps p under 2^32 and every product inside 64 bits. Throws
+            // std::invalid_argument past that
+            CyclicPermutation(const uint64_t size, const uint64_t seed);
+
+            // The next index, nothing once every one of them has been visited
+            std::optional<uint64_t> next(void);
+
+            static constexpr uint64_t MAX_SIZE = static_cast<uint64_t>(1) << 31;
+
+        private:
+
+            uint64_t m_size;
+            uint64_t m_prime;
+            uint64_t m_generator;
+            uint64_t m_first;
+            uint64_t m_current;
+            bool m_done;
+    };
+}
@@ -0,0 +1,460 @@
+#include <system_error>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <cctype>
+#include <cerrno>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "DNSResolver.h"
+#include "Network.h"
+
+
+namespace PortQuery {
+
+    static constexpr size_t HEADER_SIZE = 12;
+    static constexpr uint16_t TYPE_A = 1;
+    static constexpr uint16_t TYPE_SOA = 6;
+    static constexpr uint16_t CLASS_IN = 1;
+    static constexpr uint16_t RCODE_NXDOMAIN = 3;
+
+    static uint16_t readUint16(const uint8_t* const data) {
+
+        return static_cast<uint16_t>((data[0] << 8) | data[1]);
+    }
+
+    static uint32_t readUint32(const uint8_t* const data) {
+
+        return (static_cast<uint32_t>(readUint16(data)) << 16) | readUint16(data + 2);
+    }
+
+    // A TTL with the top bit set is treated as zero (RFC 2181)
+    static std::chrono::seconds readTTL(const uint8_t* const data) {
+
+        const uint32_t ttl = readUint32(data);
+        return std::chrono::seconds(ttl > 0x7FFFFFFF ? 0 : ttl);
+    }
+
+    // Names are matched case insensitively and the trailing dot of a fully qualified name is optional
+    static std::string normalizeName(const std::string& name) {
+
+        std::string normalized = name;
+        if (!normalized.empty() && '.' == normalized.back()) {
+            normalized.pop_back();
+        }
+
+        std::transform(normalized.begin(), normalized.end(), normalized.begin(),
+                [] (const unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return normalized;
+    }
+
+    // A recursive query for the name's A record
+    static std::vector<uint8_t> encodeQuery(const std::string& name, const uint16_t id) {
+
+        std::vector<uint8_t> query = {
+            static_cast<uint8_t>(id >> 8), static_cast<uint8_t>(id),
+            0x01, 0x00,     // Recursion desired
+            0x00, 0x01,     // One question
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+        size_t start = 0;
+        while (start < name.size()) {
+
+            const size_t end = std::min(name.find('.', start), name.size());
+            query.push_back(static_cast<uint8_t>(end - start));
+            query.insert(query.end(), name.begin() + static_cast<std::ptrdiff_t>(start),
+                    name.begin() + static_cast<std::ptrdiff_t>(end));
+            start = end + 1;
+        }
+
+        query.insert(query.end(), { 0x00, 0x00, TYPE_A, 0x00, CLASS_IN });
+        return query;
+    }
+
+    // The offset just past the name starting at offset, nothing if it runs off the end. The name itself is never
+    // needed, so a compression pointer is simply stepped over rather than followed
+    static std::optional<size_t> skipName(const uint8_t* const reply, const size_t length, size_t offset) {
+
+        while (offset < length) {
+
+            const uint8_t label = reply[offset];
+            if (0 == label) {
+                return offset + 1;
+            }
+
+            if (0xC0 == (label & 0xC0)) {
+                return offset + 2 <= length ? std::optional<size_t>(offset + 2) : std::nullopt;
+            }
+
+            offset += label + 1;
+        }
+
+        return std::nullopt;
+    }
+
+
+    DNSResolver::DNSResolver(const uint32_t server, const uint16_t port, const std::chrono::milliseconds timeout) :
+        m_server(server), m_port(port), m_timeout(timeout) { }
+
+    std::shared_ptr<DNSResolver> DNSResolver::getSystemResolver(void) {
+
+        static const std::shared_ptr<DNSResolver> resolver = [] () {
+
+            std::optional<uint32_t> server;
+            std::ifstream resolvConf("/etc/resolv.conf");
+            std::string line;
+            while (!server && std::getline(resolvConf, line)) {
+
+                std::istringstream fields(line);
+                std::string keyword;
+                std::string address;
+                fields >> keyword >> address;
+
+                // IPv6 name servers are passed over, the client only speaks IPv4
+                if ("nameserver" == keyword) {
+                    server = parseIPv4Address(address);
+                }
+            }
+
+            const std::shared_ptr<DNSResolver> systemResolver = std::make_shared<DNSResolver>(
+                    server ? *server : *parseIPv4Address("127.0.0.1"));
+            systemResolver->loadHostsFile("/etc/hosts");
+            return systemResolver;
+        }();
+
+        return resolver;
+    }
+
+    bool DNSResolver::isHostname(const std::string_view name) {
+
+        const std::string_view trimmed = !name.empty() && '.' == name.back() ? name.substr(0, name.size() - 1) : name;
+        if (trimmed.empty() || trimmed.size() > 253) {
+            return false;
+        }
+
+        bool letter = false;
+        size_t labelLength = 0;
+        for (const char c : trimmed) {
+
+            if ('.' == c) {
+
+                if (0 == labelLength) {
+                    return false;
+                }
+
+                labelLength = 0;
+                continue;
+            }
+
+            if (!std::isalnum(static_cast<unsigned char>(c)) && '-' != c && '_' != c) {
+                return false;
+            }
+
+            letter = letter || std::isalpha(static_cast<unsigned char>(c));
+            if (++labelLength > 63) {
+                return false;
+            }
+        }
+
+        return letter && 0 != labelLength;
+    }
+
+    std::vector<std::optional<uint32_t>> DNSResolver::resolve(const std::vector<std::string>& names) {
+
+        // A name which comes up more than once is only looked up once
+        std::vector<std::string> normalized;
+        std::vector<std::string> misses;
+        std::unordered_map<std::string, size_t> missIndices;
+        std::vector<std::optional<uint32_t>> addresses(names.size());
+        {
+            const std::lock_guard<std::mutex> lock(m_cacheMutex);
+            const Clock::time_point now = Clock::now();
+            for (size_t index = 0; index < names.size(); index++) {
+
+                normalized.push_back(normalizeName(names[index]));
+                const auto host = m_hosts.find(normalized.back());
+                if (m_hosts.end() != host) {
+
+                    addresses[index] = host->second;
+                    continue;
+                }
+
+                const auto entry = m_cache.find(normalized.back());
+                if (m_cache.end() != entry && entry->second.m_expires > now) {
+
+                    addresses[index] = entry->second.m_address;
+                    continue;
+                }
+
+                if (missIndices.emplace(normalized.back(), misses.size()).second) {
+                    misses.push_back(normalized.back());
+                }
+            }
+        }
+
+        if (misses.empty()) {
+            return addresses;
+        }
+
+        // The cache isn't held while the queries are out, other lookups can still be answered from it
+        const std::vector<Answer> answers = lookup(misses);
+        const std::lock_guard<std::mutex> lock(m_cacheMutex);
+        const Clock::time_point now = Clock::now();
+        m_queryCount += misses.size();
+        for (size_t miss = 0; miss < misses.size(); miss++) {
+            store(misses[miss], answers[miss], now);
+        }
+
+        for (size_t index = 0; index < names.size(); index++) {
+
+            const auto miss = missIndices.find(normalized[index]);
+            if (missIndices.end() != miss) {
+                addresses[index] = answers[miss->second].m_address;
+            }
+        }
+
+        return addresses;
+    }
+
+    size_t DNSResolver::getQueryCount(void) const {
+
+        const std::lock_guard<std::mutex> lock(m_cacheMutex);
+        return m_queryCount;
+    }
+
+
+    // Works out what a reply says about the query it answers. Nothing if it isn't a reply to the query at all,
+    // a stray or spoofed datagram with the right ID still has to repeat the question word for word
+    std::optional<DNSResolver::Answer> DNSResolver::parseReply(const uint8_t* const reply, const size_t length,
+            const std::vector<uint8_t>& query) {
+
+        const size_t questionLength = query.size() - HEADER_SIZE;
+        if (length < query.size() || 0 == (reply[2] & 0x80) || reply[0] != query[0] || reply[1] != query[1] ||
+                1 != readUint16(reply + 4) || !std::equal(query.begin() + HEADER_SIZE, query.end(), reply + HEADER_SIZE,
+                    [] (const uint8_t lhs, const uint8_t rhs) { return std::tolower(lhs) == std::tolower(rhs); })) {
+
+            return std::nullopt;
+        }
+
+        const uint8_t rcode = reply[3] & 0x0F;
+        if (0 != rcode && RCODE_NXDOMAIN != rcode) {
+            return Answer{};
+        }
+
+        // The answer may be a chain of CNAMEs ending in the address, it can only be kept as long as every link
+        size_t offset = HEADER_SIZE + questionLength;
+        std::chrono::seconds ttl = TTL_MAX;
+        std::optional<uint32_t> address;
+        const uint16_t answerCount = readUint16(reply + 6);
+        const uint16_t authorityCount = readUint16(reply + 8);
+        for (uint32_t record = 0; record < static_cast<uint32_t>(answerCount) + authorityCount; record++) {
+
+            const std::optional<size_t> fields = skipName(reply, length, offset);
+            if (!fields || *fields + 10 > length) {
+                break;
+            }
+
+            const uint16_t type = readUint16(reply + *fields);
+            const uint16_t recordClass = readUint16(reply + *fields + 2);
+            const std::chrono::seconds recordTTL = readTTL(reply + *fields + 4);
+            const size_t dataOffset = *fields + 10;
+            const size_t dataLength = readUint16(reply + *fields + 8);
+            if (dataOffset + dataLength > length) {
+                break;
+            }
+
+            offset = dataOffset + dataLength;
+            if (record < answerCount) {
+
+                ttl = std::min(ttl, recordTTL);
+                if (!address && TYPE_A == type && CLASS_IN == recordClass && 4 == dataLength) {
+                    address = readUint32(reply + dataOffset);
+                }
+
+                continue;
+            }
+
+            // A name with no address is remembered for as long as the SOA of its zone says (RFC 2308), the
+            // lesser of the record's own TTL and its minimum field
+            const std::optional<size_t> rname = skipName(reply, dataOffset + dataLength, dataOffset);
+            const std::optional<size_t> serial = rname ? skipName(reply, dataOffset + dataLength, *rname) : std::nullopt;
+            if (!address && TYPE_SOA == type && serial && *serial + 20 <= dataOffset + dataLength) {
+
+                const std::chrono::seconds minimum = readTTL(reply + *serial + 16);
+                return Answer{std::nullopt, std::min({recordTTL, minimum, NEGATIVE_TTL_MAX})};
+            }
+        }
+
+        if (!address) {
+            return Answer{};
+        }
+
+        return Answer{address, ttl};
+    }
+
+
+    void DNSResolver::loadHostsFile(const std::string& path) {
+
+        // An address followed by its names, the first entry for a name wins
+        std::ifstream hosts(path);
+        std::string line;
+        while (std::getline(hosts, line)) {
+
+            std::istringstream fields(line.substr(0, line.find('#')));
+            std::string field;
+            fields >> field;
+            const std::optional<uint32_t> address = parseIPv4Address(field);
+            while (address && fields >> field) {
+                m_hosts.emplace(normalizeName(field), *address);
+            }
+        }
+    }
+
+    std::vector<DNSResolver::Answer> DNSResolver::lookup(const std::vector<std::string>& names) {
+
+        const int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (-1 == fd) {
+
+            throw std::system_error(errno, std::generic_category(), "Unable to create DNS socket");
+        }
+
+        // Connected, so that only the name server's replies are ever read back
+        const sockaddr_in server = makeSocketAddress(m_server, m_port);
+        if (-1 == connect(fd, reinterpret_cast<const sockaddr*>(&server), sizeof(server))) {
+
+            const int error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), "Unable to connect to name server");
+        }
+
+        struct Query {
+
+            size_t m_index;
+            std::vector<uint8_t> m_message;
+            size_t m_attempts;
+            Clock::time_point m_deadline;
+        };
+
+        const auto transmit = [&] (Query& query, const Clock::time_point now) {
+
+            // A full socket buffer is no different to a lost datagram, the query goes again once it times out
+            send(fd, query.m_message.data(), query.m_message.size(), 0);
+            query.m_attempts++;
+            query.m_deadline = now + m_timeout;
+        };
+
+        // IDs start somewhere random so they can't be guessed, and are never shared by two queries in flight
+        std::random_device randomDevice;
+        uint16_t nextID = static_cast<uint16_t>(randomDevice());
+        std::unordered_map<uint16_t, Query> inFlight;
+        std::vector<Answer> answers(names.size());
+        size_t next = 0;
+
+        try {
+
+            uint8_t reply[4096];
+            while (next < names.size() || !inFlight.empty()) {
+
+                Clock::time_point now = Clock::now();
+                for (; next < names.size() && inFlight.size() < IN_FLIGHT_MAX; next++, nextID++) {
+
+                    while (inFlight.count(nextID)) {
+                        nextID++;
+                    }
+
+                    Query& query = inFlight[nextID] = Query{next, encodeQuery(names[next], nextID), 0, now};
+                    transmit(query, now);
+                }
+
+                Clock::time_point deadline = Clock::time_point::max();
+                for (const auto& [id, query] : inFlight) {
+                    deadline = std::min(deadline, query.m_deadline);
+                }
+
+                const auto wait = std::max(std::chrono::ceil<std::chrono::milliseconds>(deadline - now),
+                        std::chrono::milliseconds::zero());
+                struct pollfd pollDescriptor = { fd, POLLIN, 0 };
+                if (-1 == poll(&pollDescriptor, 1, static_cast<int>(wait.count())) && EINTR != errno) {
+
+                    throw std::system_error(errno, std::generic_category(), "Unable to wait on DNS socket");
+                }
+
+                ssize_t received;
+                while (-1 != (received = recv(fd, reply, sizeof(reply), 0))) {
+
+                    const auto query = static_cast<size_t>(received) < HEADER_SIZE ? inFlight.end() :
+                        inFlight.find(readUint16(reply));
+                    if (inFlight.end() == query) {
+                        continue;
+                    }
+
+                    const std::optional<Answer> answer = parseReply(reply, static_cast<size_t>(received), query->second.m_message);
+                    if (answer) {
+
+                        answers[query->second.m_index] = *answer;
+                        inFlight.erase(query);
+                    }
+                }
+
+                // A refusal is the port unreachable coming back, there is no name server there to wait on
+                if (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno) {
+
+                    throw std::system_error(errno, std::generic_category(), "Unable to reach name server");
+                }
+
+                now = Clock::now();
+                for (auto query = inFlight.begin(); inFlight.end() != query;) {
+
+                    if (query->second.m_deadline > now) {
+
+                        query++;
+                    }
+
+                    else if (query->second.m_attempts < ATTEMPTS) {
+
+                        transmit(query->second, now);
+                        query++;
+                    }
+
+                    else {
+
+                        query = inFlight.erase(query);
+                    }
+                }
+            }
+        }
+        catch (...) {
+
+            close(fd);
+            throw;
+        }
+
+        close(fd);
+        return answers;
+    }
+
+    void DNSResolver::store(const std::string& name, const Answer& answer, const Clock::time_point now) {
+
+        if (std::chrono::seconds::zero() == answer.m_ttl) {
+            return;
+        }
+
+        // Expired entries are only cleared out once the cache fills up, and if that isn't enough it starts over
+        if (m_cache.size() >= CACHE_SIZE_MAX) {
+
+            for (auto entry = m_cache.begin(); m_cache.end() != entry;) {
+                entry = entry->second.m_expires <= now ? m_cache.erase(entry) : std::next(entry);
+            }
+
+            if (m_cache.size() >= CACHE_SIZE_MAX) {
+                m_cache.clear();
+            }
+        }
+
+        m_cache[name] = CacheEntry{answer.m_address, now + answer.m_ttl};
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+
+namespace PortQuery {
+
+    // Looks up the IPv4 address of hostnames named as targets. A plain UDP DNS client rather than getaddrinfo,
+    // which blocks on one name at a time: every name goes out at once over a single socket (up to a window of
+    // queries in flight), so thousands of names cost a few round trips rather than thousands of them. Queries
+    // which go unanswered are sent again a couple of times before the name is given up on.
+    //
+    // Answers are cached for as long as their TTL allows, names which don't exist as long as the zone's SOA
+    // allows. A resolver is meant to be kept around and shared, the cache is what makes a second lookup of the
+    // same names free. Safe to use from more than one thread, lookups in flight don't hold up each other
+    class DNSResolver {
+
+        public:
+
+            using Clock = std::chrono::steady_clock;
+
+            static constexpr uint16_t PORT_DEFAULT = 53;
+            static constexpr std::chrono::milliseconds TIMEOUT_DEFAULT{1000};
+
+            // The name server is an IPv4 address in host byte order
+            DNSResolver(const uint32_t server, const uint16_t port=PORT_DEFAULT,
+                    const std::chrono::milliseconds timeout=TIMEOUT_DEFAULT);
+
+            // Shared by everything which doesn't name a server of its own. Uses the first name server in
+            // /etc/resolv.conf, or 127.0.0.1 without one, and answers the names in /etc/hosts without asking it
+            static std::shared_ptr<DNSResolver> getSystemResolver(void);
+
+            // True if the target looks like a hostname rather than an address, block or range. A name has at
+            // least one letter in it, so nothing all numbers is ever sent off to be looked up
+            static bool isHostname(const std::string_view name);
+
+            // An address for each of the names, in the same order, nothing for the names which didn't resolve.
+            // Throws std::system_error if the name server can't be reached at all
+            std::vector<std::optional<uint32_t>> resolve(const std::vector<std::string>& names);
+
+            // The queries which have gone out to the name server, rather than being answered from the cache
+            size_t getQueryCount(void) const;
+
+        private:
+
+            static constexpr size_t IN_FLIGHT_MAX = 256;
+            static constexpr size_t ATTEMPTS = 3;
+
+            // However long an answer says it can be kept, it is looked up again after a day. A name which doesn't
+            // exist is looked up again after at most three hours, as RFC 2308 suggests
+            static constexpr std::chrono::seconds TTL_MAX{24 * 60 * 60};
+            static constexpr std::chrono::seconds NEGATIVE_TTL_MAX{3 * 60 * 60};
+            static constexpr size_t CACHE_SIZE_MAX = 1 << 16;
+
+            struct Answer {
+
+                std::optional<uint32_t> m_address;
+
+                // Zero for an answer which can't be cached (a timeout, a server failure)
+                std::chrono::seconds m_ttl{0};
+            };
+
+            struct CacheEntry {
+
+                std::optional<uint32_t> m_address;
+                Clock::time_point m_expires;
+            };
+
+            // Nothing if the datagram isn't a reply to the query
+            static std::optional<Answer> parseReply(const uint8_t* const reply, const size_t length,
+                    const std::vector<uint8_t>& query);
+
+            // Names in a hosts file are answered from it for as long as the resolver is around
+            void loadHostsFile(const std::string& path);
+
+            std::vector<Answer> lookup(const std::vector<std::string>& names);
+            void store(const std::string& name, const Answer& answer, const Clock::time_point now);
+
+            uint32_t m_server;
+            uint16_t m_port;
+            std::chrono::milliseconds m_timeout;
+
+            mutable std::mutex m_cacheMutex;
+            std::unordered_map<std::string, CacheEntry> m_cache;
+            std::unordered_map<std::string, uint32_t> m_hosts;
+            size_t m_queryCount = 0;
+    };
+}
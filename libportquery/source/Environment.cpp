@@ -1,26 +1,133 @@
+#include <algorithm>
+
 #include "Environment.h"
+#include "UringEnvironment.h"
+#include "SYNEnvironment.h"
 
 
 namespace PortQuery {
 
-    GeneratorFunction EnvironmentFactory::m_generator = defaultGenerator;
+    GeneratorFunction EnvironmentFactory::m_generator = nullptr;
 
     void EnvironmentFactory::setGenerator(const GeneratorFunction generator) {
 
         m_generator = generator;
     }
 
-    EnvironmentPtr EnvironmentFactory::createEnvironment(const unsigned int threadCount) {
+    void EnvironmentFactory::resetGenerator(void) {
+
+        m_generator = nullptr;
+    }
+
+    EnvironmentPtr EnvironmentFactory::createEnvironment(const unsigned int threadCount, const PQ_BACKEND backend) {
+
+        if (nullptr != m_generator) {
+            return m_generator(threadCount);
+        }
+
+        switch (backend) {
+            case PQ_BACKEND::CONNECT_IO_URING:
+                return uringGenerator(threadCount);
+            case PQ_BACKEND::SYN_RAW:
+                return synGenerator(threadCount);
+            case PQ_BACKEND::CONNECT_EPOLL:
+            default:
+                return networkGenerator(threadCount);
+        }
+    }
+
+    EnvironmentPtr EnvironmentFactory::networkGenerator(const int threadCount) {
+
+        EnvironmentPtr out = std::make_shared<NetworkEnvironment>(threadCount);
+        return out;
+    }
+
+    EnvironmentPtr EnvironmentFactory::uringGenerator(const int threadCount) {
+
+        EnvironmentPtr out = std::make_shared<UringEnvironment>(threadCount);
+        return out;
+    }
+
+    EnvironmentPtr EnvironmentFactory::synGenerator(const int threadCount) {
+
+        EnvironmentPtr out = std::make_shared<SYNEnvironment>(threadCount);
+        return out;
+    }
+
+
+    void ResultCollector::expectScan(const uint32_t address, const uint16_t port, const NetworkProtocol protocols) {
 
-        return m_generator(threadCount);
+        if (NetworkProtocol::NONE == protocols) {
+
+            m_completedRows.push_back(ScanRow{address, port, protocols});
+            return;
+        }
+
+        m_pendingRows[getKey(address, port)] = ScanRow{address, port, protocols};
+    }
+
+    void ResultCollector::addResult(const ProbeResult& result) {
+
+        const auto rowIter = m_pendingRows.find(getKey(result.m_address, result.m_port));
+        if (m_pendingRows.end() == rowIter) {
+            return;
+        }
+
+        ScanRow& row = rowIter->second;
+        if (NetworkProtocol::TCP == result.m_protocol) {
+            row.m_TCPResult = result.m_result;
+        }
+
+        else if (NetworkProtocol::UDP == result.m_protocol) {
+            row.m_UDPResult = result.m_result;
+        }
+
+        if (PQ_LATENCY::zero() != result.m_latency) {
+            row.m_latency = result.m_latency;
+        }
+
+        if (BufferPool::INVALID_HANDLE != result.m_banner) {
+
+            row.m_banner = result.m_banner;
+            row.m_bannerLength = result.m_bannerLength;
+        }
+
+        row.m_pendingProtocols = static_cast<NetworkProtocol>(
+                static_cast<int>(row.m_pendingProtocols) & ~static_cast<int>(result.m_protocol));
+        if (NetworkProtocol::NONE == row.m_pendingProtocols) {
+
+            m_completedRows.push_back(row);
+            m_pendingRows.erase(rowIter);
+        }
+    }
+
+    bool ResultCollector::popCompleted(ScanRow& row) {
+
+        if (m_completedRows.empty()) {
+            return false;
+        }
+
+        row = m_completedRows.front();
+        m_completedRows.pop_front();
+        return true;
     }
 
 
+    bool IEnvironment::getNextScanResult(const bool) {
+
+        return false;
+    }
+
     void IEnvironment::setProtocolsToScan(const NetworkProtocol protocols) {
 
         m_protocolsToScan = protocols;
     }
 
+    NetworkProtocol IEnvironment::getProtocolsToScan(void) const {
+
+        return m_protocolsToScan;
+    }
+
     void IEnvironment::setPort(const uint16_t port) {
 
         m_port = port;
@@ -31,10 +138,223 @@ namespace PortQuery {
         return m_port;
     }
 
+    void IEnvironment::setAddress(const uint32_t address) {
+
+        m_address = address;
+    }
+
+    uint32_t IEnvironment::getAddress(void) const {
+
+        return m_address;
+    }
+
+    void IEnvironment::setTimeout(const int timeout) {
+
+        m_timeout = timeout;
+    }
+
+    int IEnvironment::getTimeout(void) const {
+
+        return m_timeout;
+    }
+
+    void IEnvironment::setMaxRate(const double) { }
+
+    void IEnvironment::setBurstSize(const int) { }
+
+    void IEnvironment::addSourceAddress(const uint32_t) { }
+
+    void IEnvironment::addTargets(const std::vector<uint32_t>&) { }
+
+    void IEnvironment::releaseTargets(const std::vector<uint32_t>&) { }
+
+    void IEnvironment::setReceiveRing(const bool) { }
+
+    void IEnvironment::setMeasureLatency(const bool) { }
+
+    void IEnvironment::setBannerCapture(const size_t, const std::chrono::milliseconds) { }
+
+    PQ_SCAN_STATS IEnvironment::getScanStatistics(void) const {
+
+        return PQ_SCAN_STATS{};
+    }
+
+    void IEnvironment::setScanResult(const NetworkProtocol protocol, const PQ_QUERY_RESULT result) {
+
+        if (NetworkProtocol::TCP == protocol) {
+            m_TCPResult = result;
+        }
+
+        else if (NetworkProtocol::UDP == protocol) {
+            m_UDPResult = result;
+        }
+    }
+
+    void IEnvironment::loadScanRow(const ScanRow& row) {
+
+        setAddress(row.m_address);
+        setPort(row.m_port);
+        setScanResult(NetworkProtocol::TCP, row.m_TCPResult);
+        setScanResult(NetworkProtocol::UDP, row.m_UDPResult);
+        setLatency(row.m_latency);
+
+        if (BufferPool::INVALID_HANDLE != m_banner) {
+            m_bannerPool->release(m_banner);
+        }
+
+        m_banner = row.m_banner;
+        m_bannerLength = row.m_bannerLength;
+        m_inferred = row.m_inferred;
+    }
+
+    BufferPool& IEnvironment::createBannerPool(const size_t length, const size_t count) {
+
+        // Rows still holding a buffer from an earlier pool would hand it back to the wrong one
+        if (BufferPool::INVALID_HANDLE != m_banner) {
+
+            m_bannerPool->release(m_banner);
+            m_banner = BufferPool::INVALID_HANDLE;
+        }
+
+        m_bannerPool = std::make_unique<BufferPool>(length, count);
+        return *m_bannerPool;
+    }
+
+    PQ_QUERY_RESULT IEnvironment::getScanResult(const NetworkProtocol protocol) const {
+
+        if (NetworkProtocol::TCP == protocol) {
+            return m_TCPResult;
+        }
+
+        else if (NetworkProtocol::UDP == protocol) {
+            return m_UDPResult;
+        }
+
+        return PQ_QUERY_RESULT::CLOSED;
+    }
+
+    void IEnvironment::setLatency(const PQ_LATENCY latency) {
+
+        m_latency = latency;
+    }
+
+    PQ_LATENCY IEnvironment::getLatency(void) const {
+
+        return m_latency;
+    }
+
+    PQ_BANNER IEnvironment::getBanner(void) const {
+
+        if (BufferPool::INVALID_HANDLE == m_banner) {
+            return PQ_BANNER();
+        }
+
+        return PQ_BANNER(m_bannerPool->getData(m_banner), m_bannerLength);
+    }
+
+    void IEnvironment::inferScanResult(void) {
+
+        ScanRow row{getAddress(), getPort(), NetworkProtocol::NONE};
+        row.m_inferred = true;
+        loadScanRow(row);
+    }
+
+    bool IEnvironment::isInferred(void) const {
+
+        return m_inferred;
+    }
+
+
     bool NetworkEnvironment::scanPort(void) {
 
+        const NetworkProtocol protocols = getProtocolsToScan() & (NetworkProtocol::TCP | NetworkProtocol::UDP);
+        m_collector.expectScan(getAddress(), getPort(), protocols);
+        if (NetworkProtocol::TCP == (protocols & NetworkProtocol::TCP)) {
+
+            m_engine.submitTCPProbe(getAddress(), getPort());
+        }
+
+        if (NetworkProtocol::UDP == (protocols & NetworkProtocol::UDP)) {
+
+            m_engine.submitUDPProbe(getAddress(), getPort());
+        }
+
         return true;
     };
-}
 
+    bool NetworkEnvironment::getNextScanResult(const bool blocking) {
+
+        // Only poll the engine when the caller is willing to wait, results which came in while the engine
+        // was making room for new probes are still picked up without a system call
+        ScanRow row;
+        while (!m_collector.popCompleted(row)) {
+
+            ProbeResult result;
+            bool collected = false;
+            while (m_engine.popResult(result)) {
+
+                m_collector.addResult(result);
+                collected = true;
+            }
+
+            if (collected) {
+                continue;
+            }
+
+            else if (!blocking || 0 == m_engine.getInFlight()) {
+                return false;
+            }
+
+            m_engine.poll(true);
+        }
+
+        loadScanRow(row);
+        return true;
+    }
+
+    void NetworkEnvironment::setTimeout(const int timeout) {
+
+        IEnvironment::setTimeout(timeout);
+        m_engine.setTimeout(std::chrono::seconds(timeout));
+    }
+
+    void NetworkEnvironment::setMaxRate(const double rate) {
+
+        m_engine.setMaxRate(rate);
+    }
+
+    void NetworkEnvironment::setBurstSize(const int burstSize) {
 
+        m_engine.setBurstSize(static_cast<size_t>(std::max(burstSize, 1)));
+    }
+
+    void NetworkEnvironment::addSourceAddress(const uint32_t address) {
+
+        m_engine.addSourceAddress(address);
+    }
+
+    void NetworkEnvironment::releaseTargets(const std::vector<uint32_t>& targets) {
+
+        for (const uint32_t target : targets) {
+            m_engine.forgetHost(target);
+        }
+    }
+
+    void NetworkEnvironment::setMeasureLatency(const bool enabled) {
+
+        m_engine.setMeasureLatency(enabled);
+    }
+
+    void NetworkEnvironment::setBannerCapture(const size_t length, const std::chrono::milliseconds wait) {
+
+        // Every probe in flight can be reading a banner while just as many finished ones wait to be reported,
+        // plus the row the caller is looking at
+        const size_t window = m_engine.getStatistics().m_maxInFlight;
+        m_engine.setBannerCapture(&createBannerPool(length, 2 * window + 1), wait);
+    }
+
+    PQ_SCAN_STATS NetworkEnvironment::getScanStatistics(void) const {
+
+        return m_engine.getStatistics();
+    }
+}
@@ -2,26 +2,158 @@
 
 #include <cstdint>
 #include <memory>
-
+#include <algorithm>
+#include <chrono>
+#include <string_view>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+
+#include "BufferPool.h"
 #include "Network.h"
-#include "ThreadPool.h"
+#include "PortQuery.h"
+#include "ScanEngine.h"
 
 
 namespace PortQuery {
 
 
+    // A port which has been (or is being) scanned along with the result of every protocol that was requested
+    struct ScanRow {
+
+        uint32_t m_address;
+        uint16_t m_port;
+
+        // The protocols which have not reported a result yet
+        NetworkProtocol m_pendingProtocols;
+
+        // Protocols which were not scanned are reported as closed
+        PQ_QUERY_RESULT m_TCPResult = PQ_QUERY_RESULT::CLOSED;
+        PQ_QUERY_RESULT m_UDPResult = PQ_QUERY_RESULT::CLOSED;
+        PQ_LATENCY m_latency = PQ_LATENCY::zero();
+        BufferPool::Handle m_banner = BufferPool::INVALID_HANDLE;
+        uint32_t m_bannerLength = 0;
+
+        // Filled in by the circuit breaker rather than probed
+        bool m_inferred = false;
+    };
+
+
+    // Probes for each protocol complete independently of one another, this stitches the results back together
+    // and hands out a row once every protocol requested for a port has reported
+    class ResultCollector {
+
+        public:
+
+            void expectScan(const uint32_t address, const uint16_t port, const NetworkProtocol protocols);
+            void addResult(const ProbeResult& result);
+            bool popCompleted(ScanRow& row);
+
+        private:
+
+            static uint64_t getKey(const uint32_t address, const uint16_t port) {
+
+                return (static_cast<uint64_t>(address) << 16) | port;
+            }
+
+            std::unordered_map<uint64_t, ScanRow> m_pendingRows;
+            std::deque<ScanRow> m_completedRows;
+    };
+
+
+    // The environment is both the interface to the network and the "current row" that expressions are
+    // evaluated against. Before scanning, the port is set and the pre network evaluation is done. After scanning,
+    // getNextScanResult positions the environment on a completed port so the post network evaluation can be done.
     class IEnvironment {
 
         public:
 
+            virtual ~IEnvironment() = default;
+
+            // Submits the current port for scanning. This does not need to wait on the result, completed ports
+            // are retrieved through getNextScanResult
             virtual bool scanPort(void) = 0;
+
+            // Positions the environment on the next port which has finished scanning. If blocking is set this
+            // waits on outstanding scans. Returns false when there is nothing (left) to report
+            virtual bool getNextScanResult(const bool blocking);
+
             virtual void setProtocolsToScan(const NetworkProtocol protocols);
+            virtual NetworkProtocol getProtocolsToScan(void) const;
             virtual void setPort(const uint16_t port);
             virtual uint16_t getPort(void) const;
+            virtual void setAddress(const uint32_t address);
+            virtual uint32_t getAddress(void) const;
+            virtual void setTimeout(const int timeout);
+            virtual int getTimeout(void) const;
+
+            // In probes per second, zero means no limit other than what the network can take. Environments which
+            // don't touch the network ignore this
+            virtual void setMaxRate(const double rate);
+
+            // The number of datagrams to send (or replies to read) with a single system call, for environments
+            // which batch them
+            virtual void setBurstSize(const int burstSize);
+
+            // Adds a local address for connects to go out from, environments which don't connect ignore this
+            virtual void addSourceAddress(const uint32_t address);
+
+            // The sweep hands over each chunk of targets before probing any of them, and hands it back once every
+            // probe to them has finished. Environments which filter replies in the kernel let through replies from
+            // every chunk in between, and whatever an environment keeps per host is dropped once it is handed back
+            virtual void addTargets(const std::vector<uint32_t>& targets);
+            virtual void releaseTargets(const std::vector<uint32_t>& targets);
+
+            // Reads replies out of a memory mapped packet ring instead of a socket, for environments which
+            // receive raw packets
+            virtual void setReceiveRing(const bool enabled);
+
+            // Asks for the round trip of every answer to be taken from kernel timestamps, environments which
+            // can't time answers leave the latency at zero
+            virtual void setMeasureLatency(const bool enabled);
+
+            // Keeps what every open port sends first, up to length bytes and waiting no longer than wait for it.
+            // Environments which never complete a connection leave the banner empty
+            virtual void setBannerCapture(const size_t length, const std::chrono::milliseconds wait);
+            virtual PQ_SCAN_STATS getScanStatistics(void) const;
+            virtual void setScanResult(const NetworkProtocol protocol, const PQ_QUERY_RESULT result);
+            virtual PQ_QUERY_RESULT getScanResult(const NetworkProtocol protocol) const;
+            virtual void setLatency(const PQ_LATENCY latency);
+            virtual PQ_LATENCY getLatency(void) const;
+
+            // Points into the row's buffer, valid until the environment moves on to another row
+            virtual PQ_BANNER getBanner(void) const;
+
+            // Positions the environment on the current port without probing it, every protocol is reported as
+            // closed and the row is flagged as inferred
+            virtual void inferScanResult(void);
+            virtual bool isInferred(void) const;
+
+        protected:
+
+            // Positions the environment on a completed row. The buffer holding the previous row's banner is
+            // handed back to the pool
+            void loadScanRow(const ScanRow& row);
+
+            // Banners are read into buffers from this pool, every buffer which is handed out comes back through
+            // loadScanRow
+            BufferPool& createBannerPool(const size_t length, const size_t count);
 
         private:
             uint16_t m_port;
+            uint32_t m_address;
+            int m_timeout;
             NetworkProtocol m_protocolsToScan;
+
+            // Protocols which were not scanned are reported as closed
+            PQ_QUERY_RESULT m_TCPResult = PQ_QUERY_RESULT::CLOSED;
+            PQ_QUERY_RESULT m_UDPResult = PQ_QUERY_RESULT::CLOSED;
+            PQ_LATENCY m_latency = PQ_LATENCY::zero();
+            bool m_inferred = false;
+
+            std::unique_ptr<BufferPool> m_bannerPool;
+            BufferPool::Handle m_banner = BufferPool::INVALID_HANDLE;
+            uint32_t m_bannerLength = 0;
     };
 
 
@@ -33,12 +165,26 @@ namespace PortQuery {
 
         public:
 
-            NetworkEnvironment(const int threadCount) : m_threadPool(threadCount) { }
+            // The thread count is the number of environments scanning side by side, the engine takes its share
+            NetworkEnvironment(const int threadCount) :
+                m_engine(ScanEngine::MAX_IN_FLIGHT_DEFAULT, static_cast<size_t>(std::max(threadCount, 1))),
+                m_threadCount(threadCount) { }
             virtual bool scanPort(void) override;
+            virtual bool getNextScanResult(const bool blocking) override;
+            virtual void setTimeout(const int timeout) override;
+            virtual void setMaxRate(const double rate) override;
+            virtual void setBurstSize(const int burstSize) override;
+            virtual void addSourceAddress(const uint32_t address) override;
+            virtual void releaseTargets(const std::vector<uint32_t>& targets) override;
+            virtual void setMeasureLatency(const bool enabled) override;
+            virtual void setBannerCapture(const size_t length, const std::chrono::milliseconds wait) override;
+            virtual PQ_SCAN_STATS getScanStatistics(void) const override;
 
         private:
 
-            ThreadPool m_threadPool;
+            ScanEngine m_engine;
+            ResultCollector m_collector;
+            int m_threadCount;
     };
 
 
@@ -46,15 +192,18 @@ namespace PortQuery {
 
         public:
 
+             // A generator which has been set takes precedence over the backend requested when creating an environment
              static void setGenerator(const GeneratorFunction generator);
-             static EnvironmentPtr createEnvironment(const unsigned int threadCount);
+             static void resetGenerator(void);
+             static EnvironmentPtr createEnvironment(const unsigned int threadCount, 
+                     const PQ_BACKEND backend=PQ_BACKEND::CONNECT_EPOLL);
 
-        private:
-            static EnvironmentPtr defaultGenerator(const int threadCount) {
+             // The generators for each of the backends, these can also be handed to setGenerator directly
+             static EnvironmentPtr networkGenerator(const int threadCount);
+             static EnvironmentPtr uringGenerator(const int threadCount);
+             static EnvironmentPtr synGenerator(const int threadCount);
 
-                EnvironmentPtr out = std::make_shared<NetworkEnvironment>(threadCount);
-                return out;
-            }
+        private:
 
             static GeneratorFunction m_generator;
     };
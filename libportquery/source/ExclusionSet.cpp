@@ -0,0 +1,165 @@
+#include <algorithm>
+
+#include "ExclusionSet.h"
+#include "Network.h"
+
+
+namespace PortQuery {
+
+    // The number of leading bits two prefixes share, up to limit
+    static uint32_t getCommonLength(const uint32_t lhs, const uint32_t rhs, const uint32_t limit) {
+
+        const uint32_t difference = lhs ^ rhs;
+        const uint32_t common = 0 == difference ? 32 : static_cast<uint32_t>(__builtin_clz(difference));
+        return std::min(common, limit);
+    }
+
+
+    ExclusionSet::ExclusionSet() {
+
+        addNode(0, 0, false);
+    }
+
+    bool ExclusionSet::addExclusion(const std::string& exclusion) {
+
+        const size_t slash = exclusion.find('/');
+        const std::optional<uint32_t> address = parseIPv4Address(exclusion.substr(0, slash));
+        if (!address) {
+            return false;
+        }
+
+        const std::optional<uint32_t> length = std::string::npos == slash ? 32 :
+            parsePrefixLength(exclusion.substr(slash + 1));
+        if (!length) {
+            return false;
+        }
+
+        insert(*address & getMask(*length), *length);
+        return true;
+    }
+
+    bool ExclusionSet::contains(const uint32_t address) const {
+
+        return getExcludedThrough(address).has_value();
+    }
+
+    std::optional<uint32_t> ExclusionSet::getExcludedThrough(const uint32_t address) const {
+
+        uint32_t index = 0;
+        while (NO_CHILD != index) {
+
+            const Node& node = m_nodes[index];
+            if ((address & getMask(node.m_length)) != node.m_prefix) {
+                return std::nullopt;
+            }
+
+            if (node.m_excluded) {
+                return node.m_prefix | ~getMask(node.m_length);
+            }
+
+            if (32 == node.m_length) {
+                return std::nullopt;
+            }
+
+            index = node.m_children[getBit(address, node.m_length)];
+        }
+
+        return std::nullopt;
+    }
+
+    std::optional<uint32_t> ExclusionSet::getNextExcluded(const uint32_t address) const {
+
+        return findNextExcluded(0, address);
+    }
+
+    std::optional<uint32_t> ExclusionSet::findNextExcluded(const uint32_t index, const uint32_t address) const {
+
+        // Subtrees which end before the address are passed over whole, so only the path down to the address
+        // branches off into anything, and the first subtree to the right of it ends the search
+        const Node& node = m_nodes[index];
+        const uint32_t last = node.m_prefix | ~getMask(node.m_length);
+        if (last < address) {
+            return std::nullopt;
+        }
+
+        if (node.m_excluded) {
+            return std::max(node.m_prefix, address);
+        }
+
+        for (const uint32_t child : node.m_children) {
+
+            if (NO_CHILD != child) {
+
+                const std::optional<uint32_t> next = findNextExcluded(child, address);
+                if (next) {
+                    return next;
+                }
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    bool ExclusionSet::empty(void) const {
+
+        return !m_nodes[0].m_excluded && NO_CHILD == m_nodes[0].m_children[0] && NO_CHILD == m_nodes[0].m_children[1];
+    }
+
+    void ExclusionSet::insert(const uint32_t prefix, const uint32_t length) {
+
+        uint32_t index = 0;
+        while (true) {
+
+            // Already inside an excluded block
+            if (m_nodes[index].m_excluded) {
+                return;
+            }
+
+            // Everything underneath is covered by the new block now. The nodes are left where they are, they
+            // just can't be reached any more
+            if (m_nodes[index].m_length == length) {
+
+                m_nodes[index].m_excluded = true;
+                m_nodes[index].m_children[0] = NO_CHILD;
+                m_nodes[index].m_children[1] = NO_CHILD;
+                return;
+            }
+
+            const uint32_t bit = getBit(prefix, m_nodes[index].m_length);
+            const uint32_t child = m_nodes[index].m_children[bit];
+            if (NO_CHILD == child) {
+
+                const uint32_t leaf = addNode(prefix, length, true);
+                m_nodes[index].m_children[bit] = leaf;
+                return;
+            }
+
+            const uint32_t childLength = m_nodes[child].m_length;
+            const uint32_t common = getCommonLength(prefix, m_nodes[child].m_prefix, std::min(length, childLength));
+            if (common == childLength) {
+
+                index = child;
+                continue;
+            }
+
+            // The new block and the child part ways (or the new block ends) partway along the child's prefix,
+            // a node goes in at the point they split
+            const uint32_t split = addNode(prefix & getMask(common), common, common == length);
+            if (common != length) {
+
+                const uint32_t leaf = addNode(prefix, length, true);
+                m_nodes[split].m_children[getBit(m_nodes[child].m_prefix, common)] = child;
+                m_nodes[split].m_children[getBit(prefix, common)] = leaf;
+            }
+
+            m_nodes[index].m_children[bit] = split;
+            return;
+        }
+    }
+
+    uint32_t ExclusionSet::addNode(const uint32_t prefix, const uint32_t length, const bool excluded) {
+
+        m_nodes.push_back(Node{prefix, length, excluded, { NO_CHILD, NO_CHILD }});
+        return static_cast<uint32_t>(m_nodes.size() - 1);
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <optional>
+
+
+namespace PortQuery {
+
+    // Addresses which must never be probed, given as addresses or CIDR blocks. Blocklists run to tens of
+    // thousands of blocks, so they are kept in a path compressed binary trie (a PATRICIA tree) rather than
+    // checked one by one. A node only exists where blocks branch apart or one ends, and a lookup follows a
+    // single path from the root, at most one step for each bit of the longest prefix. A block which falls
+    // inside another one already excluded adds nothing, and one which covers blocks already there replaces them
+    class ExclusionSet {
+
+        public:
+
+            ExclusionSet();
+
+            // Returns false if the entry is neither an address nor a CIDR block
+            bool addExclusion(const std::string& exclusion);
+
+            bool contains(const uint32_t address) const;
+
+            // The last address of the excluded block the address falls in, nothing if it isn't excluded. Lets a
+            // walk over a range skip the whole block in one step
+            std::optional<uint32_t> getExcludedThrough(const uint32_t address) const;
+
+            // The first excluded address at or after the one given, nothing if there are none left. Every address
+            // in between is known to be clear without looking each one up
+            std::optional<uint32_t> getNextExcluded(const uint32_t address) const;
+
+            bool empty(void) const;
+
+        private:
+
+            static constexpr uint32_t NO_CHILD = ~static_cast<uint32_t>(0);
+
+            struct Node {
+
+                uint32_t m_prefix;
+                uint32_t m_length;
+                bool m_excluded;
+
+                // Indexed by the first bit past the prefix
+                uint32_t m_children[2];
+            };
+
+            void insert(const uint32_t prefix, const uint32_t length);
+            std::optional<uint32_t> findNextExcluded(const uint32_t index, const uint32_t address) const;
+            uint32_t addNode(const uint32_t prefix, const uint32_t length, const bool excluded);
+
+            static uint32_t getMask(const uint32_t length) {
+
+                return 0 == length ? 0 : ~static_cast<uint32_t>(0) << (32 - length);
+            }
+
+            static uint32_t getBit(const uint32_t address, const uint32_t position) {
+
+                return (address >> (31 - position)) & 1;
+            }
+
+            // Nodes refer to each other by index, m_nodes[0] is the root and stands for the whole address space
+            std::vector<Node> m_nodes;
+    };
+}
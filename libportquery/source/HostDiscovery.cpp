@@ -0,0 +1,304 @@
+#include <system_error>
+#include <algorithm>
+#include <cerrno>
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip_icmp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "HostDiscovery.h"
+#include "Network.h"
+
+
+namespace PortQuery {
+
+    // A connection and a refusal both mean something is there, any other error means nothing answered
+    static bool isAnswer(const int error) {
+
+        return 0 == error || ECONNREFUSED == error;
+    }
+
+
+    HostDiscovery::HostDiscovery(const std::chrono::milliseconds timeout) : m_timeout(timeout), m_ICMPFD(-1),
+        m_rawICMP(false), m_echoID(static_cast<uint16_t>(getpid())), m_unresolved(0) {
+
+        const size_t descriptorLimit = raiseDescriptorLimit();
+        m_batchSize = 0 == descriptorLimit ? BATCH_SIZE_MAX : std::clamp<size_t>(
+                (descriptorLimit - std::min(descriptorLimit, RESERVED_DESCRIPTORS)) / DESCRIPTORS_PER_HOST, 1, BATCH_SIZE_MAX);
+
+        m_epollFD = epoll_create1(EPOLL_CLOEXEC);
+        if (-1 == m_epollFD) {
+
+            throw std::system_error(errno, std::generic_category(), "Unable to create epoll instance");
+        }
+
+        // Echoes are a bonus, discovery goes ahead without them when neither kind of socket is allowed
+        m_ICMPFD = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_ICMP);
+        if (-1 == m_ICMPFD) {
+
+            m_ICMPFD = socket(AF_INET, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_ICMP);
+            m_rawICMP = -1 != m_ICMPFD;
+        }
+
+        struct epoll_event event = { };
+        event.events = EPOLLIN;
+        event.data.u64 = ICMP_EVENT;
+        if (-1 != m_ICMPFD && -1 == epoll_ctl(m_epollFD, EPOLL_CTL_ADD, m_ICMPFD, &event)) {
+
+            close(m_ICMPFD);
+            m_ICMPFD = -1;
+        }
+    }
+
+    HostDiscovery::~HostDiscovery() {
+
+        if (-1 != m_ICMPFD) {
+            close(m_ICMPFD);
+        }
+
+        close(m_epollFD);
+    }
+
+    std::vector<uint32_t> HostDiscovery::findLiveHosts(const std::vector<uint32_t>& targets) {
+
+        std::vector<uint32_t> liveHosts;
+        std::vector<Host> batch;
+        for (size_t start = 0; start < targets.size(); start += m_batchSize) {
+
+            batch.clear();
+            const size_t end = std::min(targets.size(), start + m_batchSize);
+            for (size_t target = start; target < end; target++) {
+                batch.push_back(Host{targets[target]});
+            }
+
+            runBatch(batch);
+            for (const Host& host : batch) {
+
+                if (host.m_alive) {
+                    liveHosts.push_back(host.m_address);
+                }
+            }
+        }
+
+        return liveHosts;
+    }
+
+    void HostDiscovery::runBatch(std::vector<Host>& batch) {
+
+        std::unordered_map<uint32_t, uint32_t> indices;
+        m_unresolved = batch.size();
+        for (uint32_t index = 0; index < batch.size(); index++) {
+
+            Host& host = batch[index];
+            indices.emplace(host.m_address, index);
+            for (const uint16_t port : TCP_PORTS) {
+
+                if (!host.m_alive) {
+                    openProbe(host, index, SOCK_STREAM, port);
+                }
+            }
+
+            if (!host.m_alive) {
+                openProbe(host, index, SOCK_DGRAM, UDP_PORT);
+            }
+
+            if (!host.m_alive) {
+                sendEcho(host, static_cast<uint16_t>(index));
+            }
+
+            // Every probe failed on the spot, there is no route to the host
+            if (0 == host.m_pending) {
+                resolve(host);
+            }
+        }
+
+        using Clock = std::chrono::steady_clock;
+        const Clock::time_point deadline = Clock::now() + m_timeout;
+        struct epoll_event events[BATCH_SIZE_MAX];
+        while (m_unresolved > 0) {
+
+            const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now());
+            if (remaining <= std::chrono::milliseconds::zero()) {
+                break;
+            }
+
+            const int count = epoll_wait(m_epollFD, events, BATCH_SIZE_MAX, static_cast<int>(remaining.count()));
+            if (-1 == count && EINTR != errno) {
+
+                throw std::system_error(errno, std::generic_category(), "Unable to wait on epoll instance");
+            }
+
+            for (int event = 0; event < count; event++) {
+
+                if (ICMP_EVENT == events[event].data.u64) {
+
+                    receiveEchoReplies(batch, indices);
+                    continue;
+                }
+
+                const uint32_t index = static_cast<uint32_t>(events[event].data.u64 >> 32);
+                const int fd = static_cast<int>(events[event].data.u64 & 0xFFFFFFFF);
+                handleProbeEvent(batch[index], fd, events[event].events);
+            }
+        }
+
+        for (Host& host : batch) {
+            closeProbes(host);
+        }
+    }
+
+    void HostDiscovery::openProbe(Host& host, const uint32_t index, const int type, const uint16_t port) {
+
+        const int fd = socket(AF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (-1 == fd) {
+
+            throw std::system_error(errno, std::generic_category(), "Unable to create discovery socket");
+        }
+
+        // Connecting a datagram socket doesn't send anything, the empty datagram after it does
+        const sockaddr_in target = makeSocketAddress(host.m_address, port);
+        int result = connect(fd, reinterpret_cast<const sockaddr*>(&target), sizeof(target));
+        if (SOCK_DGRAM == type && 0 == result) {
+            result = static_cast<int>(send(fd, nullptr, 0, 0));
+        }
+
+        const int error = -1 == result ? errno : 0;
+        if (SOCK_STREAM == type ? isAnswer(error) : ECONNREFUSED == error) {
+
+            close(fd);
+            markAlive(host);
+            return;
+        }
+
+        if (EINPROGRESS != error && 0 != error) {
+
+            close(fd);
+            return;
+        }
+
+        struct epoll_event event = { };
+        event.events = SOCK_STREAM == type ? EPOLLOUT : EPOLLIN;
+        event.data.u64 = (static_cast<uint64_t>(index) << 32) | static_cast<uint32_t>(fd);
+        if (-1 == epoll_ctl(m_epollFD, EPOLL_CTL_ADD, fd, &event)) {
+
+            const int error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), "Unable to register discovery probe with epoll");
+        }
+
+        host.m_fds.push_back(fd);
+        host.m_pending++;
+    }
+
+    void HostDiscovery::sendEcho(Host& host, const uint16_t sequence) {
+
+        if (-1 == m_ICMPFD) {
+            return;
+        }
+
+        // Ping sockets fill in the identifier and checksum themselves, for a raw socket they have to be right
+        struct icmphdr echo = { };
+        echo.type = ICMP_ECHO;
+        echo.un.echo.id = htons(m_echoID);
+        echo.un.echo.sequence = htons(sequence);
+        echo.checksum = computeChecksum(0, reinterpret_cast<const uint8_t*>(&echo), sizeof(echo));
+
+        const sockaddr_in target = makeSocketAddress(host.m_address, 0);
+        if (sizeof(echo) == sendto(m_ICMPFD, &echo, sizeof(echo), 0, reinterpret_cast<const sockaddr*>(&target),
+                    sizeof(target))) {
+
+            host.m_pending++;
+        }
+    }
+
+    void HostDiscovery::handleProbeEvent(Host& host, const int fd, const uint32_t events) {
+
+        // The host may have answered another probe earlier on in the same batch of events
+        if (host.m_fds.end() == std::find(host.m_fds.begin(), host.m_fds.end(), fd)) {
+            return;
+        }
+
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length);
+
+        // A datagram socket is only readable without an error when the target sent something back
+        if (isAnswer(error) && (0 != error || 0 == (events & EPOLLERR))) {
+
+            markAlive(host);
+            return;
+        }
+
+        failProbe(host, fd);
+    }
+
+    void HostDiscovery::receiveEchoReplies(std::vector<Host>& batch, const std::unordered_map<uint32_t, uint32_t>& indices) {
+
+        uint8_t packet[512];
+        sockaddr_in source = { };
+        socklen_t length = sizeof(source);
+        ssize_t received;
+        while (0 < (received = recvfrom(m_ICMPFD, packet, sizeof(packet), 0, reinterpret_cast<sockaddr*>(&source), &length))) {
+
+            length = sizeof(source);
+            size_t offset = 0;
+            if (m_rawICMP) {
+                offset = static_cast<size_t>(4 * (packet[0] & 0xF));
+            }
+
+            if (static_cast<size_t>(received) < offset + sizeof(struct icmphdr)) {
+                continue;
+            }
+
+            // A raw socket sees every ICMP message on the machine, including the echoes going out over loopback
+            struct icmphdr reply;
+            std::copy(packet + offset, packet + offset + sizeof(reply), reinterpret_cast<uint8_t*>(&reply));
+            if (ICMP_ECHOREPLY != reply.type || (m_rawICMP && htons(m_echoID) != reply.un.echo.id)) {
+                continue;
+            }
+
+            const auto indexIter = indices.find(ntohl(source.sin_addr.s_addr));
+            if (indices.end() != indexIter && !batch[indexIter->second].m_alive) {
+                markAlive(batch[indexIter->second]);
+            }
+        }
+    }
+
+    void HostDiscovery::markAlive(Host& host) {
+
+        resolve(host);
+        host.m_alive = true;
+        host.m_pending = 0;
+        closeProbes(host);
+    }
+
+    void HostDiscovery::failProbe(Host& host, const int fd) {
+
+        close(fd);
+        host.m_fds.erase(std::find(host.m_fds.begin(), host.m_fds.end(), fd));
+        if (0 == --host.m_pending) {
+            resolve(host);
+        }
+    }
+
+    void HostDiscovery::resolve(Host& host) {
+
+        if (!host.m_resolved) {
+
+            host.m_resolved = true;
+            m_unresolved--;
+        }
+    }
+
+    void HostDiscovery::closeProbes(Host& host) {
+
+        for (const int fd : host.m_fds) {
+            close(fd);
+        }
+
+        host.m_fds.clear();
+    }
+}
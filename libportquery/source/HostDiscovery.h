@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <vector>
+#include <unordered_map>
+
+
+namespace PortQuery {
+
+    // Works out which targets are up before any of their ports are swept, so addresses nobody is using don't
+    // each cost a sweep full of timeouts. Every target in a batch is sent a few cheap probes at once:
+    //
+    // - TCP connects to ports which are commonly open. A completed handshake and a reset both mean something
+    //   answered.
+    // - A datagram on a connected UDP socket to a port which is almost certainly closed. The port unreachable
+    //   error which comes back is reported on the socket as ECONNREFUSED.
+    // - An ICMP echo, over an unprivileged ping socket where net.ipv4.ping_group_range allows it and a raw socket
+    //   otherwise. Without either, hosts are only found through TCP and UDP.
+    //
+    // The first answer marks a host as up and the rest of its probes are dropped. A host is down once every probe
+    // has failed (host or network unreachable), or the timeout passes without an answer.
+    class HostDiscovery {
+
+        public:
+
+            HostDiscovery(const std::chrono::milliseconds timeout);
+            ~HostDiscovery();
+
+            HostDiscovery(const HostDiscovery&) = delete;
+            HostDiscovery &operator=(const HostDiscovery&) = delete;
+
+            // The targets which answered, in the order they were given
+            std::vector<uint32_t> findLiveHosts(const std::vector<uint32_t>& targets);
+
+        private:
+
+            static constexpr uint16_t TCP_PORTS[] = { 80, 443, 22 };
+
+            // Where traceroute starts, by convention nothing listens up here
+            static constexpr uint16_t UDP_PORT = 33434;
+
+            // Every host in a batch holds a descriptor per TCP port and one for UDP, batches are kept small
+            // enough to fit under the descriptor limit with some to spare
+            static constexpr size_t DESCRIPTORS_PER_HOST = sizeof(TCP_PORTS) / sizeof(TCP_PORTS[0]) + 1;
+            static constexpr size_t RESERVED_DESCRIPTORS = 64;
+            static constexpr size_t BATCH_SIZE_MAX = 256;
+
+            // Marks the ICMP socket's events apart from the probes, which carry the host's index in the batch
+            static constexpr uint64_t ICMP_EVENT = ~static_cast<uint64_t>(0);
+
+            struct Host {
+
+                uint32_t m_address;
+                std::vector<int> m_fds = {};
+
+                // Probes which could still answer, counting an echo which went out
+                size_t m_pending = 0;
+                bool m_alive = false;
+
+                // Either up, or out of probes
+                bool m_resolved = false;
+            };
+
+            void runBatch(std::vector<Host>& batch);
+            void openProbe(Host& host, const uint32_t index, const int type, const uint16_t port);
+            void sendEcho(Host& host, const uint16_t sequence);
+            void handleProbeEvent(Host& host, const int fd, const uint32_t events);
+            void receiveEchoReplies(std::vector<Host>& batch, const std::unordered_map<uint32_t, uint32_t>& indices);
+            void markAlive(Host& host);
+            void failProbe(Host& host, const int fd);
+            void resolve(Host& host);
+            void closeProbes(Host& host);
+
+            std::chrono::milliseconds m_timeout;
+            size_t m_batchSize;
+            int m_epollFD;
+            int m_ICMPFD;
+
+            // Raw sockets hand over the IP header as well, ping sockets only the ICMP message
+            bool m_rawICMP;
+            uint16_t m_echoID;
+
+            // Hosts in the current batch which are neither up nor out of probes
+            size_t m_unresolved;
+    };
+}
@@ -0,0 +1,200 @@
+#include <system_error>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "IOUring.h"
+
+
+namespace PortQuery {
+
+    static int setupRing(const unsigned int entries, io_uring_params* parameters) {
+
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, parameters));
+    }
+
+    static int enterRing(const int ringFD, const unsigned int submitCount, const unsigned int waitCount,
+            const unsigned int flags, const io_uring_getevents_arg* argument=nullptr) {
+
+        return static_cast<int>(syscall(__NR_io_uring_enter, ringFD, submitCount, waitCount, flags, argument,
+                    nullptr == argument ? 0 : sizeof(*argument)));
+    }
+
+    static void* mapRing(const int ringFD, const size_t size, const off_t offset) {
+
+        void* ring = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFD, offset);
+        if (MAP_FAILED == ring) {
+
+            throw std::system_error(errno, std::generic_category(), "Unable to map io_uring");
+        }
+
+        return ring;
+    }
+
+    template <typename T> static T* ringPointer(void* ring, const uint32_t offset) {
+
+        return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+    }
+
+
+    IOUring::IOUring(const unsigned int entries) : m_localTail(0) {
+
+        io_uring_params parameters;
+        std::memset(&parameters, 0, sizeof(parameters));
+        m_ringFD = setupRing(entries, &parameters);
+        if (-1 == m_ringFD) {
+
+            throw std::system_error(errno, std::generic_category(), "Unable to create io_uring");
+        }
+
+        m_submissionRingSize = parameters.sq_off.array + parameters.sq_entries * sizeof(unsigned int);
+        m_completionRingSize = parameters.cq_off.cqes + parameters.cq_entries * sizeof(io_uring_cqe);
+
+        // Newer kernels map both rings with a single call
+        if (parameters.features & IORING_FEAT_SINGLE_MMAP) {
+
+            m_submissionRingSize = std::max(m_submissionRingSize, m_completionRingSize);
+            m_submissionRing = mapRing(m_ringFD, m_submissionRingSize, IORING_OFF_SQ_RING);
+            m_completionRing = m_submissionRing;
+            m_completionRingSize = 0;
+        }
+
+        else {
+
+            m_submissionRing = mapRing(m_ringFD, m_submissionRingSize, IORING_OFF_SQ_RING);
+            m_completionRing = mapRing(m_ringFD, m_completionRingSize, IORING_OFF_CQ_RING);
+        }
+
+        m_submissionEntriesSize = parameters.sq_entries * sizeof(io_uring_sqe);
+        m_submissionEntries = static_cast<io_uring_sqe*>(mapRing(m_ringFD, m_submissionEntriesSize, IORING_OFF_SQES));
+
+        m_submissionHead = ringPointer<unsigned int>(m_submissionRing, parameters.sq_off.head);
+        m_submissionTail = ringPointer<unsigned int>(m_submissionRing, parameters.sq_off.tail);
+        m_submissionArray = ringPointer<unsigned int>(m_submissionRing, parameters.sq_off.array);
+        m_submissionMask = *ringPointer<unsigned int>(m_submissionRing, parameters.sq_off.ring_mask);
+        m_submissionEntryCount = parameters.sq_entries;
+
+        m_completionHead = ringPointer<unsigned int>(m_completionRing, parameters.cq_off.head);
+        m_completionTail = ringPointer<unsigned int>(m_completionRing, parameters.cq_off.tail);
+        m_completionEntries = ringPointer<io_uring_cqe>(m_completionRing, parameters.cq_off.cqes);
+        m_completionMask = *ringPointer<unsigned int>(m_completionRing, parameters.cq_off.ring_mask);
+        m_completionEntryCount = parameters.cq_entries;
+
+        m_localTail = *m_submissionTail;
+    }
+
+    IOUring::~IOUring() {
+
+        munmap(m_submissionEntries, m_submissionEntriesSize);
+        munmap(m_submissionRing, m_submissionRingSize);
+        if (0 != m_completionRingSize) {
+            munmap(m_completionRing, m_completionRingSize);
+        }
+
+        close(m_ringFD);
+    }
+
+    unsigned int IOUring::getSubmissionSpace(void) const {
+
+        return m_submissionEntryCount - (m_localTail - __atomic_load_n(m_submissionHead, __ATOMIC_ACQUIRE));
+    }
+
+    unsigned int IOUring::getSubmissionCapacity(void) const {
+
+        return m_submissionEntryCount;
+    }
+
+    unsigned int IOUring::getCompletionCapacity(void) const {
+
+        return m_completionEntryCount;
+    }
+
+    unsigned int IOUring::getPendingSubmissions(void) const {
+
+        return m_localTail - *m_submissionTail;
+    }
+
+    io_uring_sqe* IOUring::getSubmissionEntry(void) {
+
+        // The kernel advances the head as it consumes entries
+        const auto isFull = [this] () {
+            return m_localTail - __atomic_load_n(m_submissionHead, __ATOMIC_ACQUIRE) >= m_submissionEntryCount;
+        };
+
+        if (isFull()) {
+
+            submit(0);
+            if (isFull()) {
+                throw std::runtime_error("Unable to flush io_uring submission ring");
+            }
+        }
+
+        const unsigned int index = m_localTail & m_submissionMask;
+        io_uring_sqe* entry = &m_submissionEntries[index];
+        std::memset(entry, 0, sizeof(*entry));
+        m_submissionArray[index] = index;
+        m_localTail++;
+        return entry;
+    }
+
+    void IOUring::submit(const unsigned int waitCount) {
+
+        submit(waitCount, nullptr);
+    }
+
+    void IOUring::submit(const unsigned int waitCount, const std::chrono::nanoseconds timeout) {
+
+        const std::chrono::nanoseconds remaining = std::max(timeout, std::chrono::nanoseconds(0));
+        const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(remaining);
+        const __kernel_timespec timespec{seconds.count(), (remaining - seconds).count()};
+        submit(waitCount, &timespec);
+    }
+
+    void IOUring::submit(const unsigned int waitCount, const __kernel_timespec* timeout) {
+
+        const unsigned int submitCount = getPendingSubmissions();
+        __atomic_store_n(m_submissionTail, m_localTail, __ATOMIC_RELEASE);
+        if (0 == submitCount && 0 == waitCount) {
+            return;
+        }
+
+        unsigned int flags = 0 != waitCount ? IORING_ENTER_GETEVENTS : 0;
+        io_uring_getevents_arg argument;
+        std::memset(&argument, 0, sizeof(argument));
+        if (nullptr != timeout) {
+
+            argument.ts = reinterpret_cast<uint64_t>(timeout);
+            flags |= IORING_ENTER_EXT_ARG;
+        }
+
+        while (-1 == enterRing(m_ringFD, submitCount, waitCount, flags, nullptr == timeout ? nullptr : &argument)) {
+
+            // The completion ring is full, the caller needs to reap before anything else can be submitted. Running
+            // out the clock on a timed wait is just as normal
+            if (EBUSY == errno || EAGAIN == errno || ETIME == errno) {
+                return;
+            }
+
+            else if (EINTR != errno) {
+                throw std::system_error(errno, std::generic_category(), "Unable to enter io_uring");
+            }
+        }
+    }
+
+    bool IOUring::popCompletion(io_uring_cqe& completion) {
+
+        const unsigned int head = *m_completionHead;
+        if (head == __atomic_load_n(m_completionTail, __ATOMIC_ACQUIRE)) {
+
+            return false;
+        }
+
+        completion = m_completionEntries[head & m_completionMask];
+        __atomic_store_n(m_completionHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+
+
+namespace PortQuery {
+
+    // A minimal wrapper around the raw io_uring system calls, just enough to queue up submissions and reap
+    // completions. Submissions are batched, nothing is handed to the kernel until submit is called (or the
+    // submission ring has filled up), and completions are reaped straight out of the shared ring without
+    // a system call.
+    class IOUring {
+
+        public:
+
+            IOUring(const unsigned int entries);
+            ~IOUring();
+
+            IOUring(const IOUring&) = delete;
+            IOUring &operator=(const IOUring&) = delete;
+
+            // Returns a zeroed submission entry, flushing the submission ring to the kernel first if it is full
+            io_uring_sqe* getSubmissionEntry(void);
+
+            // Hands every queued submission entry to the kernel. If waitCount is non zero, this blocks until at
+            // least that many completions are available
+            void submit(const unsigned int waitCount);
+
+            // The same, but gives up waiting once the timeout has passed
+            void submit(const unsigned int waitCount, const std::chrono::nanoseconds timeout);
+
+            bool popCompletion(io_uring_cqe& completion);
+
+            // The number of entries which can be queued before the submission ring has to be flushed. Linked
+            // chains should check this first, a chain which is split across two submissions is not linked
+            unsigned int getSubmissionSpace(void) const;
+            unsigned int getSubmissionCapacity(void) const;
+            unsigned int getCompletionCapacity(void) const;
+
+        private:
+
+            unsigned int getPendingSubmissions(void) const;
+            void submit(const unsigned int waitCount, const __kernel_timespec* timeout);
+
+            int m_ringFD;
+
+            void* m_submissionRing;
+            size_t m_submissionRingSize;
+            void* m_completionRing;
+            size_t m_completionRingSize;
+            io_uring_sqe* m_submissionEntries;
+            size_t m_submissionEntriesSize;
+
+            // Pointers into the shared rings
+            unsigned int* m_submissionHead;
+            unsigned int* m_submissionTail;
+            unsigned int* m_submissionArray;
+            unsigned int m_submissionMask;
+            unsigned int m_submissionEntryCount;
+
+            unsigned int* m_completionHead;
+            unsigned int* m_completionTail;
+            io_uring_cqe* m_completionEntries;
+            unsigned int m_completionMask;
+            unsigned int m_completionEntryCount;
+
+            // The local copy of the submission tail, entries between the shared tail and this are queued
+            // up but have not been made visible to the kernel
+            unsigned int m_localTail;
+    };
+}
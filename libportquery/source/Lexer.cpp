@@ -27,6 +27,10 @@ namespace PortQuery {
             {"PORT",     ColumnToken{ ColumnToken::PORT }},
             {"TCP",      ColumnToken{ ColumnToken::TCP }},
             {"UDP",      ColumnToken{ ColumnToken::UDP }},
+            {"LATENCY",  ColumnToken{ ColumnToken::LATENCY }},
+            {"BANNER",   ColumnToken{ ColumnToken::BANNER }},
+            {"INFERRED", ColumnToken{ ColumnToken::INFERRED }},
+            {"HOST",     ColumnToken{ ColumnToken::HOST }},
         };
 
         auto keywordMapIter = keywordMap.find(lexeme);
@@ -91,7 +95,7 @@ namespace PortQuery {
 
         if (reachedTokenEnd()) {
 
-            return UserToken{std::string(m_tokenStart, m_currentChar)};
+            return UserToken{getOriginalLexeme()};
         }
 
         // failure path, this is an error token
@@ -114,7 +118,7 @@ namespace PortQuery {
             if (std::holds_alternative<EOFToken>(keywordToken)) {
 
                 // this is not really an EOFToken, EOFToken is just used in this method to say "token not found"
-                return UserToken{lexeme};
+                return UserToken{getOriginalLexeme()};
             }
 
             return keywordToken;
@@ -244,6 +248,11 @@ namespace PortQuery {
             // this could return a keyword, a column, a User, or an error token
             return scanAlphaToken();
         }
+
+        // A file of targets in the FROM clause, this can only be a User token
+        else if ('@' == *m_currentChar) {
+            return scanUserToken();
+        }
         
         // nothing else matches, return error case.
         return scanErrorToken();
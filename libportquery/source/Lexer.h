@@ -105,7 +105,11 @@ namespace PortQuery {
 
             PORT,
             TCP,
-            UDP
+            UDP,
+            LATENCY,
+            BANNER,
+            INFERRED,
+            HOST
         };
 
         Column m_column;
@@ -171,7 +175,7 @@ namespace PortQuery {
 
     class Lexer { 
         public:
-            Lexer(const std::string queryString) : m_queryString{std::move(queryString)} {
+            Lexer(const std::string queryString) : m_originalString{queryString}, m_queryString{std::move(queryString)} {
                 std::transform(m_queryString.begin(), m_queryString.end(), m_queryString.begin(), toupper);
                 m_tokenStart = m_queryString.cbegin();
                 m_currentChar = m_queryString.cbegin();
@@ -211,6 +215,13 @@ namespace PortQuery {
             // against, so this can be transitioned to from both scanAlphaToken and scanNumericToken routines
             Token scanUserToken();
 
+            // The current lexeme as it was written in the query, before it was upper cased
+            std::string getOriginalLexeme() const {
+
+                const auto start = m_tokenStart - m_queryString.cbegin();
+                return m_originalString.substr(start, m_currentChar - m_tokenStart);
+            }
+
             // Some characters are not whitespace, but can also legitimately terminate a character
             // Essentially this includes all the punctuation tokens. This could be expanded in the future to include
             // comparison token characters
@@ -229,6 +240,10 @@ namespace PortQuery {
 
             }
 
+            // The query as it was given. Keywords are matched case insensitively but user tokens (hostnames,
+            // file paths) keep the case they were written in, so they are cut out of this copy instead
+            std::string m_originalString;
+
             // This query string represents the SQL query to be scanned
             std::string m_queryString;
 
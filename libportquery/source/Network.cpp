@@ -1,15 +1,150 @@
+#include <cstdlib>
+#include <fstream>
+
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
 
 #include "Network.h"
-/*
-bool Network::isValidAddress(const std::string& potentialURL) {
-    
-    struct sockaddr_in socketAddress = { };
-    if (1 == inet_pton(AF_INET, potentialURL.c_str(), &(socketAddress.sin_addr)) ) {
-        return true;
+
+
+namespace PortQuery {
+
+    std::optional<uint32_t> parseIPv4Address(const std::string& address) {
+
+        struct in_addr networkAddress = { };
+        if (1 == inet_pton(AF_INET, address.c_str(), &networkAddress)) {
+
+            return ntohl(networkAddress.s_addr);
+        }
+
+        return std::nullopt;
     }
 
-    return false;
-}
+    std::string formatIPv4Address(const uint32_t address) {
+
+        char buffer[INET_ADDRSTRLEN] = { };
+        struct in_addr networkAddress = { htonl(address) };
+        inet_ntop(AF_INET, &networkAddress, buffer, sizeof(buffer));
+        return std::string(buffer);
+    }
+
+    std::optional<uint32_t> parsePrefixLength(const std::string& prefix) {
+
+        // strtoul accepts signs and leading white space, a prefix length is nothing but digits
+        if (prefix.empty() || prefix.size() > 2 || std::string::npos != prefix.find_first_not_of("0123456789")) {
+            return std::nullopt;
+        }
+
+        const unsigned long length = std::strtoul(prefix.c_str(), nullptr, 10);
+        if (length > 32) {
+            return std::nullopt;
+        }
+
+        return static_cast<uint32_t>(length);
+    }
+
+    sockaddr_in makeSocketAddress(const uint32_t address, const uint16_t port) {
+
+        struct sockaddr_in socketAddress = { };
+        socketAddress.sin_family = AF_INET;
+        socketAddress.sin_port = htons(port);
+        socketAddress.sin_addr.s_addr = htonl(address);
+        return socketAddress;
+    }
+
+    size_t raiseDescriptorLimit(void) {
+
+        struct rlimit limit = { };
+        if (-1 == getrlimit(RLIMIT_NOFILE, &limit)) {
+            return 0;
+        }
+
+        // Only the soft limit can be raised without privileges, and only as far as the hard limit
+        if (limit.rlim_cur < limit.rlim_max) {
+
+            const rlim_t current = limit.rlim_cur;
+            limit.rlim_cur = limit.rlim_max;
+            if (-1 == setrlimit(RLIMIT_NOFILE, &limit)) {
+                limit.rlim_cur = current;
+            }
+        }
+
+        return RLIM_INFINITY == limit.rlim_cur ? static_cast<size_t>(-1) : static_cast<size_t>(limit.rlim_cur);
+    }
 
-*/
+    size_t getEphemeralPortCount(void) {
+
+        std::ifstream range("/proc/sys/net/ipv4/ip_local_port_range");
+        size_t low = 0;
+        size_t high = 0;
+        if (!(range >> low >> high) || high < low) {
+            return 0;
+        }
+
+        return high - low + 1;
+    }
+
+    bool prepareConnectSocket(const int fd, const uint32_t sourceAddress) {
+
+        const struct linger abortive = { 1, 0 };
+        if (-1 == setsockopt(fd, SOL_SOCKET, SO_LINGER, &abortive, sizeof(abortive))) {
+            return false;
+        }
+
+        else if (INADDR_ANY == sourceAddress) {
+            return true;
+        }
+
+        const int enable = 1;
+        const sockaddr_in source = makeSocketAddress(sourceAddress, 0);
+        return -1 != setsockopt(fd, SOL_IP, IP_BIND_ADDRESS_NO_PORT, &enable, sizeof(enable)) &&
+            -1 != bind(fd, reinterpret_cast<const sockaddr*>(&source), sizeof(source));
+    }
+
+    std::chrono::microseconds getHandshakeRTT(const int fd) {
+
+        // Right after the handshake the smoothed RTT is just the one sample the SYN-ACK gave
+        struct tcp_info info = { };
+        socklen_t length = sizeof(info);
+        if (-1 == getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &length)) {
+            return std::chrono::microseconds::zero();
+        }
+
+        return std::chrono::microseconds(info.tcpi_rtt);
+    }
+
+    bool isSelfConnected(const int fd) {
+
+        sockaddr_in local = { };
+        sockaddr_in peer = { };
+        socklen_t localLength = sizeof(local);
+        socklen_t peerLength = sizeof(peer);
+        if (-1 == getsockname(fd, reinterpret_cast<sockaddr*>(&local), &localLength) ||
+                -1 == getpeername(fd, reinterpret_cast<sockaddr*>(&peer), &peerLength)) {
+            return false;
+        }
+
+        return local.sin_port == peer.sin_port && local.sin_addr.s_addr == peer.sin_addr.s_addr;
+    }
+
+    uint16_t computeChecksum(const uint32_t sum, const uint8_t* data, const size_t length) {
+
+        uint64_t total = sum;
+        for (size_t index = 0; index + 1 < length; index += 2) {
+
+            total += (static_cast<uint16_t>(data[index]) << 8) | data[index + 1];
+        }
+
+        if (length & 1) {
+            total += static_cast<uint16_t>(data[length - 1]) << 8;
+        }
+
+        while (total >> 16) {
+            total = (total & 0xFFFF) + (total >> 16);
+        }
+
+        return htons(static_cast<uint16_t>(~total));
+    }
+}
@@ -1,8 +1,14 @@
 #pragma once
 
 #include <string>
+#include <chrono>
 #include <type_traits>
 #include <memory>
+#include <optional>
+#include <cstdint>
+#include <cstddef>
+
+#include <netinet/in.h>
 
 
 template<typename T> struct EnableBinaryOperators {
@@ -45,3 +51,40 @@ template <> struct EnableBinaryOperators<NetworkProtocol> {
     static const bool m_enable = true;
 };
 
+
+
+namespace PortQuery {
+
+    // IPv4 addresses are passed around the library in host byte order, this makes it easy to iterate over a range
+    // of addresses. They are only converted to network byte order when a socket address is constructed.
+    std::optional<uint32_t> parseIPv4Address(const std::string& address);
+    std::string formatIPv4Address(const uint32_t address);
+
+    // The length after the slash in a CIDR block, 0 to 32
+    std::optional<uint32_t> parsePrefixLength(const std::string& prefix);
+    sockaddr_in makeSocketAddress(const uint32_t address, const uint16_t port);
+
+    // Every probe in flight costs a descriptor. This raises the soft limit on open descriptors as far as the
+    // hard limit allows and returns the limit in effect afterwards, zero if it couldn't be read
+    size_t raiseDescriptorLimit(void);
+
+    // The number of local ports the kernel hands out to connects without an explicit bind, zero if unknown
+    size_t getEphemeralPortCount(void);
+
+    // Readies a TCP socket for a connect probe. Closing it sends a reset instead of leaving it in TIME_WAIT, and
+    // with a source address (anything but INADDR_ANY) it is bound to that address while the port is left for
+    // connect to pick, so the same local port can be shared by connects to different targets
+    bool prepareConnectSocket(const int fd, const uint32_t sourceAddress);
+
+    // The round trip of a connected socket's handshake. The kernel times the SYN-ACK against its own timestamp of
+    // the SYN, so this is free of however long the scanner took to notice the connect finishing. Zero if unknown
+    std::chrono::microseconds getHandshakeRTT(const int fd);
+
+    // A connect to a loopback port nobody is listening on can be handed that very port as its local port, and
+    // then connects to itself (TCP simultaneous open). That looks just like an open port
+    bool isSelfConnected(const int fd);
+
+    // The internet checksum (RFC 1071) of data, with sum (a partial sum of a pseudo header, or zero) folded in.
+    // Returned in network byte order, ready to be written into the header
+    uint16_t computeChecksum(const uint32_t sum, const uint8_t* data, const size_t length);
+}
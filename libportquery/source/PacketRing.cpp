@@ -0,0 +1,89 @@
+#include <system_error>
+#include <cerrno>
+
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "PacketRing.h"
+
+
+namespace PortQuery {
+
+    PacketRing::PacketRing(const size_t blockSize, const size_t blockCount) : m_ring(nullptr),
+        m_blockSize(blockSize), m_blockCount(blockCount), m_currentBlock(0) {
+
+        m_fd = socket(AF_PACKET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, htons(ETH_P_IP));
+        if (-1 == m_fd) {
+
+            throw std::system_error(errno, std::generic_category(), "Unable to create packet socket");
+        }
+
+        const int version = TPACKET_V3;
+        struct tpacket_req3 request = { };
+        request.tp_block_size = static_cast<unsigned int>(m_blockSize);
+        request.tp_block_nr = static_cast<unsigned int>(m_blockCount);
+        request.tp_frame_size = FRAME_SIZE;
+        request.tp_frame_nr = static_cast<unsigned int>(m_blockSize / FRAME_SIZE * m_blockCount);
+        request.tp_retire_blk_tov = BLOCK_TIMEOUT_MS;
+
+        if (-1 == setsockopt(m_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) ||
+                -1 == setsockopt(m_fd, SOL_PACKET, PACKET_RX_RING, &request, sizeof(request))) {
+
+            const int error = errno;
+            close(m_fd);
+            throw std::system_error(error, std::generic_category(), "Unable to set up packet ring");
+        }
+
+        void* ring = mmap(nullptr, m_blockSize * m_blockCount, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                m_fd, 0);
+        if (MAP_FAILED == ring) {
+
+            const int error = errno;
+            close(m_fd);
+            throw std::system_error(error, std::generic_category(), "Unable to map packet ring");
+        }
+
+        m_ring = static_cast<uint8_t*>(ring);
+    }
+
+    PacketRing::~PacketRing() {
+
+        munmap(m_ring, m_blockSize * m_blockCount);
+        close(m_fd);
+    }
+
+    int PacketRing::getFD(void) const {
+
+        return m_fd;
+    }
+
+    bool PacketRing::isBlockReady(void) const {
+
+        // The status is written by the kernel after the block's contents, it has to be read before them
+        return 0 != (__atomic_load_n(&getBlock()->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER);
+    }
+
+    const struct tpacket_block_desc* PacketRing::getBlock(void) const {
+
+        return reinterpret_cast<const struct tpacket_block_desc*>(m_ring + m_currentBlock * m_blockSize);
+    }
+
+    void PacketRing::releaseBlock(void) {
+
+        auto* block = reinterpret_cast<struct tpacket_block_desc*>(m_ring + m_currentBlock * m_blockSize);
+        __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        m_currentBlock = (m_currentBlock + 1) % m_blockCount;
+    }
+
+    bool PacketRing::isOutgoing(const struct tpacket3_hdr* header) {
+
+        // The link layer address follows the header, on loopback every packet shows up once going out and once
+        // coming back in
+        const auto* address = reinterpret_cast<const struct sockaddr_ll*>(reinterpret_cast<const uint8_t*>(header) +
+                TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+        return PACKET_OUTGOING == address->sll_pkttype;
+    }
+}
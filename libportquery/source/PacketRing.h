@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <cstddef>
+
+#include <linux/if_packet.h>
+
+
+namespace PortQuery {
+
+    // A TPACKET_V3 receive ring on an AF_PACKET socket. The kernel writes every IPv4 packet the host receives
+    // straight into memory shared with the process, batched into blocks, and the blocks are read in place. There
+    // is no copy and no system call per packet, the socket is only polled when the ring has run dry.
+    //
+    // Packets start at the IP header (the socket is SOCK_DGRAM), and ones the host sent itself are skipped.
+    //
+    // Requires CAP_NET_RAW.
+    class PacketRing {
+
+        public:
+
+            PacketRing(const size_t blockSize=BLOCK_SIZE_DEFAULT, const size_t blockCount=BLOCK_COUNT_DEFAULT);
+            ~PacketRing();
+            PacketRing(const PacketRing&) = delete;
+            PacketRing& operator=(const PacketRing&) = delete;
+
+            // For polling, readable whenever the kernel has handed over a block
+            int getFD(void) const;
+
+            // Calls handler(const uint8_t* packet, size_t length, std::chrono::nanoseconds received) for every packet
+            // in the blocks the kernel has handed over, then hands them back. The time is the kernel's (software)
+            // timestamp of the packet, CLOCK_REALTIME. Returns the number of packets seen
+            template <typename Handler>
+            size_t receive(Handler&& handler) {
+
+                size_t count = 0;
+                while (isBlockReady()) {
+
+                    const auto* block = getBlock();
+                    const uint8_t* position = reinterpret_cast<const uint8_t*>(block) +
+                        block->hdr.bh1.offset_to_first_pkt;
+
+                    for (uint32_t packet = 0; packet < block->hdr.bh1.num_pkts; packet++) {
+
+                        const auto* header = reinterpret_cast<const struct tpacket3_hdr*>(position);
+                        if (!isOutgoing(header)) {
+
+                            handler(position + header->tp_net, static_cast<size_t>(header->tp_snaplen),
+                                    std::chrono::seconds(header->tp_sec) + std::chrono::nanoseconds(header->tp_nsec));
+                            count++;
+                        }
+
+                        position += header->tp_next_offset;
+                    }
+
+                    releaseBlock();
+                }
+
+                return count;
+            }
+
+        private:
+
+            // 16 blocks of 256KiB matches the receive buffer the raw socket asked for. A block is handed over
+            // once it is full or has been open this long, so a trickle of replies isn't held up any longer
+            static constexpr size_t BLOCK_SIZE_DEFAULT = 1 << 18;
+            static constexpr size_t BLOCK_COUNT_DEFAULT = 16;
+            static constexpr size_t FRAME_SIZE = 1 << 11;
+            static constexpr unsigned int BLOCK_TIMEOUT_MS = 1;
+
+            bool isBlockReady(void) const;
+            const struct tpacket_block_desc* getBlock(void) const;
+            void releaseBlock(void);
+            static bool isOutgoing(const struct tpacket3_hdr* header);
+
+            int m_fd;
+            uint8_t* m_ring;
+            size_t m_blockSize;
+            size_t m_blockCount;
+            size_t m_currentBlock;
+    };
+}
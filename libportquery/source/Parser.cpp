@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <stdexcept>
 
 #include "Parser.h"
 
@@ -81,10 +82,25 @@ namespace PortQuery {
         switch (c.m_column) {
             case ColumnToken::PORT:
                 prefix += "PORT";
+                break;
             case ColumnToken::TCP:
                 prefix += "TCP";
+                break;
             case ColumnToken::UDP:
                 prefix += "UDP";
+                break;
+            case ColumnToken::LATENCY:
+                prefix += "LATENCY";
+                break;
+            case ColumnToken::BANNER:
+                prefix += "BANNER";
+                break;
+            case ColumnToken::INFERRED:
+                prefix += "INFERRED";
+                break;
+            case ColumnToken::HOST:
+                prefix += "HOST";
+                break;
             default:
                 prefix += "UNKNOWN COLUMN TOKEN";
             }
@@ -139,7 +155,7 @@ namespace PortQuery {
 
 
         SelectSet selectedSet = parseSelectSetQuantifier();
-        std::string tableReference = parseTableReference();
+        std::vector<std::string> tableReferences = parseTableReferences();
         SOSQLExpression tableExpression = parseTableExpression();
 
         // parse end here, check for EOF and semicolon
@@ -156,7 +172,7 @@ namespace PortQuery {
             throw std::invalid_argument("Invalid token type specified after complete query: " + getTokenString(t));
         }
 
-        return std::move(std::make_unique<SelectStatement>(SelectStatement{selectedSet, tableReference, std::move(tableExpression)}));
+        return std::move(std::make_unique<SelectStatement>(SelectStatement{selectedSet, std::move(tableReferences), std::move(tableExpression)}));
     }
 
 
@@ -333,7 +349,7 @@ namespace PortQuery {
     }
 
 
-    std::string Parser::parseTableReference() {
+    std::vector<std::string> Parser::parseTableReferences() {
 
         const Token t = m_lexer.nextToken();
         if (!MATCH_KEYWORD<KeywordToken::FROM>(t)) {
@@ -341,11 +357,24 @@ namespace PortQuery {
             throw std::invalid_argument(exceptionString);
         }
 
-        return std::visit(overloaded {
-                [=] (UserToken u)  { return u.m_UserToken; },
-                [=] (auto t) -> std::string { 
-                    throw std::invalid_argument("Invalid token following FROM keyword: " + getTokenString(t)); } 
-                }, 
-            m_lexer.nextToken());
+        // Any number of targets separated by commas. Blocks and ranges (10.0.0.0/16, 10.0.0.1-10.0.0.50) scan
+        // as a single user token, they are only picked apart when the targets are built
+        std::vector<std::string> tableReferences;
+        for (bool moreTargets = true; moreTargets;) {
+
+            tableReferences.push_back(std::visit(overloaded {
+                    [=] (UserToken u)  { return u.m_UserToken; },
+                    [=] (auto t) -> std::string { 
+                        throw std::invalid_argument("Invalid token in FROM target list: " + getTokenString(t)); } 
+                    }, 
+                m_lexer.nextToken()));
+
+            moreTargets = MATCH<PunctuationToken<','>>(m_lexer.peek());
+            if (moreTargets) {
+                m_lexer.nextToken();
+            }
+        }
+
+        return tableReferences;
     }
 }
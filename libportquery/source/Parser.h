@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <memory>
 #include <tuple>
 
@@ -30,7 +31,7 @@ namespace PortQuery {
             SelectSet parseSelectSetQuantifier();
             SelectSet parseSelectList();
 
-            std::string parseTableReference();
+            std::vector<std::string> parseTableReferences();
 
             SOSQLExpression parseTableExpression();
             SOSQLExpression parseORExpression();
@@ -1,12 +1,31 @@
 #include <iostream>
-#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <system_error>
+#include <optional>
+#include <mutex>
+#include <random>
 #include <thread>
 
+#include <pthread.h>
+#include <sched.h>
+
 #include "Statement.h"
 #include "PortQuery.h"
 #include "Parser.h"
 #include "Network.h"
 #include "Environment.h"
+#include "CircuitBreaker.h"
+#include "ProbeScheduler.h"
+#include "HostDiscovery.h"
+#include "TargetSet.h"
+#include "TargetFeed.h"
+#include "CyclicPermutation.h"
+#include "ExclusionSet.h"
+#include "DNSResolver.h"
 
 
 namespace PortQuery { 
@@ -36,39 +55,431 @@ namespace PortQuery {
     }
 
 
-    bool PQConn::run() {
+    // Runs the post network evaluation against the row the environment is on, handing it to the user if it matches
+    static void reportRow(SelectStatement& statement, EnvironmentPtr env, const PQCallback& callback,
+            const std::any& context) {
+
+        if (statement.postNetworkEval(env) && callback) {
+
+            callback(context, statement.getSelectedColumns(env));
+        }
+    }
+
+
+    // Reports the port the environment is on once it has finished scanning, letting the breaker know how it went
+    // and the scheduler that its slot is free
+    static void reportScanResult(SelectStatement& statement, EnvironmentPtr env, const PQCallback& callback,
+            const std::any& context, CircuitBreaker& breaker, ProbeScheduler& scheduler) {
+
+        const bool answered = PQ_QUERY_RESULT::CLOSED != env->getScanResult(NetworkProtocol::TCP) ||
+            PQ_QUERY_RESULT::CLOSED != env->getScanResult(NetworkProtocol::UDP);
+        breaker.addResult(env->getAddress(), env->getPort(), answered);
+        scheduler.completeProbe(env->getAddress());
+        reportRow(statement, env, callback, context);
+    }
 
-        // should this throw error if no userprovided callback is present?
 
-        EnvironmentPtr env = EnvironmentFactory::createEnvironment(m_threadCount);
-        env->setProtocolsToScan(m_selectStatement->collectRequiredProtocols());
+    // Drains every port the environment has finished scanning
+    static void reportScanResults(SelectStatement& statement, EnvironmentPtr env, const PQCallback& callback,
+            const std::any& context, CircuitBreaker& breaker, ProbeScheduler& scheduler, const bool blocking) {
+
+        while (env->getNextScanResult(blocking)) {
+            reportScanResult(statement, env, callback, context, breaker, scheduler);
+        }
+    }
+
+
+    // The cores the process is allowed to run on, a thread count of zero runs a shard on each of them
+    static std::vector<int> getAllowedCores(void) {
+
+        std::vector<int> cores;
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (0 == sched_getaffinity(0, sizeof(allowed), &allowed)) {
+
+            for (int core = 0; core < CPU_SETSIZE; core++) {
+
+                if (CPU_ISSET(core, &allowed)) {
+                    cores.push_back(core);
+                }
+            }
+        }
+
+        return cores;
+    }
+
+
+    // Adds up what every shard's environment saw, the descriptor limit is the process's and is the same for all
+    static void mergeStatistics(PQ_SCAN_STATS& total, const PQ_SCAN_STATS& shard) {
+
+        total.m_maxInFlight += shard.m_maxInFlight;
+        total.m_descriptorLimit = std::max(total.m_descriptorLimit, shard.m_descriptorLimit);
+        total.m_descriptorStalls += shard.m_descriptorStalls;
+        total.m_portLimit += shard.m_portLimit;
+        total.m_peakPortsInUse += shard.m_peakPortsInUse;
+        total.m_portStalls += shard.m_portStalls;
+        total.m_inferredPorts += shard.m_inferredPorts;
+        total.m_limitWaits += shard.m_limitWaits;
+    }
+
+
+    // The ports the WHERE clause doesn't rule out before anything goes out. Only the port is known that early,
+    // so this is the same for every target and is worked out once rather than for each of them
+    static std::vector<uint16_t> getCandidatePorts(SelectStatement& statement, EnvironmentPtr env) {
 
         static constexpr uint32_t MAX_PORT = static_cast<uint16_t>(-1);
+        std::vector<uint16_t> ports;
         for (uint32_t port = 0; port <= MAX_PORT; port++) {
 
-            env->setPort(port);
-            if (Tristate::FALSE_STATE != m_selectStatement->attemptPreNetworkEval(env)) {
+            env->setPort(static_cast<uint16_t>(port));
+            if (Tristate::FALSE_STATE != statement.attemptPreNetworkEval(env)) {
+                ports.push_back(static_cast<uint16_t>(port));
+            }
+        }
+
+        return ports;
+    }
+
+
+    // Whether the pair is in this run's slice of the sweep, when the sweep is split over separate runs. Only the
+    // address and port go into it, not the seed or the order the pairs come in, so runs which know nothing of
+    // each other (on other machines, with other seeds, finding other hosts up) still split the pairs the same way
+    static bool isInPartition(const uint32_t address, const uint16_t port, const size_t partition,
+            const size_t partitionCount) {
+
+        if (1 == partitionCount) {
+            return true;
+        }
+
+        // The splitmix64 finalizer, so that neighbouring addresses and ports land in unrelated slices
+        uint64_t key = (static_cast<uint64_t>(address) << 16) | port;
+        key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9;
+        key = (key ^ (key >> 27)) * 0x94D049BB133111EB;
+        key ^= key >> 31;
+        return partition == key % partitionCount;
+    }
+
+
+    // Sweeps one shard's slice of the (target, port) space, every port of every shardCount-th target in each
+    // chunk starting at shard. The shard owns the environment it is handed, and with it the reactor, the sockets
+    // and the timers, so nothing on the way to the network is shared with the other shards. A host only ever
+    // belongs to one shard, so what is learned about it (the breaker, the RTT estimate, UDP pacing) is never
+    // split between them. Only the rows which match go through the callback.
+    //
+    // The pairs in the shard's part of each chunk are visited in an order scrambled by the seed, rather than a
+    // host at a time and its ports in order, so each host only sees a trickle of the probes and the load is
+    // spread over every target the shard has. The scheduler
+    // then has the last word on when each probe goes, holding back hosts and subnets which are at their limit.
+    // Pairs outside of the run's partition are passed over, what is left is still visited in the same order
+    static PQ_SCAN_STATS sweepShard(SelectStatement& statement, EnvironmentPtr env, TargetFeed& feed,
+            CircuitBreaker& breaker, ProbeScheduler& scheduler, const size_t shard, const size_t shardCount,
+            const size_t partition, const size_t partitionCount, const uint64_t seed, const PQCallback& callback,
+            const std::any& context, const std::atomic<bool>& stopping) {
+
+        // Probes held back by the limits pile up in the scheduler, past this many the sweep stops adding more
+        // until some of those in flight have finished
+        static constexpr size_t PENDING_PROBES_MAX = 1 << 16;
+
+        const std::vector<uint16_t> ports = getCandidatePorts(statement, env);
+        const auto sendProbes = [&] () {
+
+            for (std::optional<ProbeScheduler::Probe> probe; (probe = scheduler.nextProbe());) {
+
+                // Reporting results moves the environment on to other rows, so the address is set every time.
+                // The breaker is asked as late as possible, it may have tripped while the probe was held back
+                env->setAddress(probe->m_address);
+                env->setPort(probe->m_port);
+                if (!breaker.shouldProbe(probe->m_address, probe->m_port)) {
+
+                    scheduler.completeProbe(probe->m_address);
+                    env->inferScanResult();
+                    reportRow(statement, env, callback, context);
+                    continue;
+                }
 
                 env->scanPort();
-                std::this_thread::sleep_for(std::chrono::milliseconds(m_delayMS));
+                reportScanResults(statement, env, callback, context, breaker, scheduler, false);
+            }
+        };
+
+        // An environment with nothing left outstanding can't be what the scheduler is waiting on
+        size_t limitWaits = 0;
+        const auto waitForProbe = [&] () {
+
+            limitWaits++;
+            if (env->getNextScanResult(true)) {
+                reportScanResult(statement, env, callback, context, breaker, scheduler);
+            }
+
+            else {
+                scheduler.clearInFlight();
+            }
+
+            sendProbes();
+        };
+
+        // A chunk goes back to the environment once every probe to it has finished, which is usually a chunk or
+        // two after the last of them was added. The feed is done with it long before that
+        std::deque<std::vector<uint32_t>> retiring;
+        const auto retireChunks = [&] () {
+
+            for (auto chunkIter = retiring.begin(); retiring.end() != chunkIter;) {
+
+                if (!std::all_of(chunkIter->begin(), chunkIter->end(),
+                            [&] (const uint32_t target) { return scheduler.isIdle(target); })) {
+
+                    chunkIter++;
+                    continue;
+                }
+
+                for (const uint32_t target : *chunkIter) {
+                    breaker.forgetHost(target);
+                }
+
+                env->releaseTargets(*chunkIter);
+                chunkIter = retiring.erase(chunkIter);
+            }
+        };
+
+        const std::vector<uint32_t>* targets;
+        for (size_t chunk = 0; !stopping && nullptr != (targets = feed.getChunk(chunk)); chunk++) {
+
+            // Taking every shardCount-th target spreads the live ones (and the /24s) evenly over the shards
+            std::vector<uint32_t> hosts;
+            for (size_t position = shard; position < targets->size(); position += shardCount) {
+                hosts.push_back((*targets)[position]);
+            }
+
+            env->addTargets(hosts);
+            CyclicPermutation order(hosts.size() * ports.size(), seed + chunk);
+            for (std::optional<uint64_t> pair; !stopping && (pair = order.next());) {
+
+                const uint32_t target = hosts[*pair % hosts.size()];
+                const uint16_t port = ports[*pair / hosts.size()];
+                if (!isInPartition(target, port, partition, partitionCount)) {
+                    continue;
+                }
+
+                scheduler.addProbe(target, port);
+                sendProbes();
+                while (!stopping && scheduler.getPendingCount() >= PENDING_PROBES_MAX) {
+                    waitForProbe();
+                }
             }
+
+            retiring.push_back(std::move(hosts));
+            feed.releaseChunk(chunk);
+            retireChunks();
         }
 
-        /*
+        while (!stopping && scheduler.getPendingCount() > 0) {
+            waitForProbe();
+        }
 
-        for (uint32_t port = 0; port <= MAX_PORT; port++) {
+        reportScanResults(statement, env, callback, context, breaker, scheduler, true);
+        PQ_SCAN_STATS statistics = env->getScanStatistics();
+        statistics.m_inferredPorts = breaker.getInferredCount();
+        statistics.m_limitWaits = limitWaits;
+        return statistics;
+    }
+
+
+    bool PQConn::run() {
+
+        // should this throw error if no userprovided callback is present?
+        if (!m_selectStatement) {
+
+            m_errorString = "No query has been prepared";
+            return false;
+        }
+
+        TargetSet targets;
+        targets.setExclusions(m_exclusions.get());
+        std::vector<std::string> hostnames;
+        for (const std::string& tableReference : m_selectStatement->getTableReferences()) {
+
+            if (DNSResolver::isHostname(tableReference)) {
+
+                hostnames.push_back(tableReference);
+                continue;
+            }
+
+            if (!targets.addTarget(tableReference)) {
+
+                m_errorString = "Unable to resolve table reference: " + tableReference;
+                return false;
+            }
+        }
+
+        // Every name is looked up at once, a FROM clause full of them costs a few round trips rather than one each
+        if (!hostnames.empty()) {
+
+            const std::shared_ptr<DNSResolver> resolver = m_resolver ? m_resolver : DNSResolver::getSystemResolver();
+            std::vector<std::optional<uint32_t>> addresses;
+            try {
+
+                addresses = resolver->resolve(hostnames);
+            }
+            catch (std::system_error& e) {
+
+                m_errorString = e.what();
+                return false;
+            }
 
-            env->setPort(port);
-            if (m_selectStatement->postNetworkEval(env)) {
+            for (size_t hostname = 0; hostname < hostnames.size(); hostname++) {
 
-                // call back here. m_selectStatement->getCurrentRepresentation()
+                if (!addresses[hostname]) {
 
+                    m_errorString = "Unable to resolve table reference: " + hostnames[hostname];
+                    return false;
+                }
+
+                targets.addAddress(*addresses[hostname]);
             }
+        }
+
+        for (const std::string& targetFile : m_targetFiles) {
 
+            if (!targets.addTargetFile(targetFile)) {
+
+                m_errorString = "Unable to open target file: " + targetFile;
+                return false;
+            }
         }
 
-        */
+        try {
+
+            const std::vector<int> cores = getAllowedCores();
+            const size_t shardCount = m_threadCount > 0 ? static_cast<size_t>(m_threadCount) :
+                std::max<size_t>(cores.size(), 1);
+
+            // Every shard sets up its own environment the same way, splitting the rate cap between them
+            const NetworkProtocol protocols = m_selectStatement->collectRequiredProtocols();
+            const auto createEnvironment = [&] () {
+
+                EnvironmentPtr env = EnvironmentFactory::createEnvironment(static_cast<unsigned int>(shardCount), m_backend);
+                env->setProtocolsToScan(protocols);
+                env->setTimeout(m_timeout);
+
+                // The delay is only a ceiling now, the environment works out how fast it can go on its own
+                env->setMaxRate(m_delayMS > 0 ? 1000.0 / m_delayMS / static_cast<double>(shardCount) : 0.0);
+                env->setBurstSize(m_burstSize);
+                env->setReceiveRing(m_receiveRing);
+                env->setMeasureLatency(m_selectStatement->isLatencyRequested());
+                if (m_selectStatement->isBannerRequested()) {
+                    env->setBannerCapture(m_bannerLength, std::chrono::milliseconds(m_bannerWaitMS));
+                }
+
+                for (const uint32_t source : m_sourceAddresses) {
+                    env->addSourceAddress(source);
+                }
+
+                return env;
+            };
+
+            // Silence only means something for TCP, a UDP port which drops the probe may well be open
+            const bool tcp = NetworkProtocol::TCP == (protocols & NetworkProtocol::TCP);
+            const size_t breakerThreshold = tcp ? m_breakerThreshold : 0;
+
+            // A host belongs to a single shard, which can go up to the host's limit and the breaker's threshold
+            // on its own. The hosts of a /24 are spread over every shard, so each keeps to its share of that limit
+            const size_t hostLimit = m_hostLimit;
+            const size_t subnetLimit = 0 == m_subnetLimit ? 0 : std::max<size_t>(m_subnetLimit / shardCount, 1);
+            std::atomic<bool> stopping = false;
+
+            // Targets which are down would only time out on every port, the shards only ever see the live ones
+            std::optional<HostDiscovery> discovery;
+            if (m_hostDiscovery) {
+                discovery.emplace(std::chrono::seconds(m_timeout));
+            }
+
+            TargetFeed feed(targets.begin(), discovery ? &*discovery : nullptr, shardCount);
+
+            // A run without a seed of its own gets a fresh order every time, getSeed hands back the one it used
+            if (!m_seeded) {
+
+                std::random_device randomDevice;
+                m_seed = (static_cast<uint64_t>(randomDevice()) << 32) | randomDevice();
+            }
+
+            m_scanStatistics = PQ_SCAN_STATS{};
+            if (1 == shardCount) {
+
+                CircuitBreaker breaker(breakerThreshold, m_breakerSampling);
+                ProbeScheduler scheduler(hostLimit, subnetLimit);
+                m_scanStatistics = sweepShard(*m_selectStatement, createEnvironment(), feed, breaker, scheduler, 0, 1,
+                        m_partition, m_partitionCount, m_seed, m_userCallback, m_userContext, stopping);
+            }
+
+            else {
+
+                // Shards only meet when a row is handed to the user, who gets them one at a time
+                std::mutex callbackMutex;
+                const PQCallback callback = [&] (std::any context, PQ_ROW row) {
+
+                    const std::lock_guard<std::mutex> lock(callbackMutex);
+                    if (m_userCallback) {
+                        m_userCallback(context, std::move(row));
+                    }
+                };
+
+                std::vector<PQ_SCAN_STATS> statistics(shardCount);
+                std::vector<std::exception_ptr> errors(shardCount);
+                std::vector<std::thread> threads;
+                for (size_t shard = 0; shard < shardCount; shard++) {
+
+                    threads.emplace_back([&, shard] () {
+
+                        // Failing to pin is harmless, the shard runs wherever the scheduler puts it
+                        if (!cores.empty()) {
+
+                            cpu_set_t core;
+                            CPU_ZERO(&core);
+                            CPU_SET(cores[shard % cores.size()], &core);
+                            pthread_setaffinity_np(pthread_self(), sizeof(core), &core);
+                        }
 
+                        try {
+
+                            CircuitBreaker breaker(breakerThreshold, m_breakerSampling);
+                            ProbeScheduler scheduler(hostLimit, subnetLimit);
+                            statistics[shard] = sweepShard(*m_selectStatement, createEnvironment(), feed,
+                                    breaker, scheduler, shard, shardCount, m_partition, m_partitionCount, m_seed,
+                                    callback, m_userContext, stopping);
+                        }
+                        catch (...) {
+
+                            errors[shard] = std::current_exception();
+                            stopping = true;
+                            feed.stop();
+                        }
+                    });
+                }
+
+                for (size_t shard = 0; shard < shardCount; shard++) {
+
+                    threads[shard].join();
+                    mergeStatistics(m_scanStatistics, statistics[shard]);
+                }
+
+                for (const std::exception_ptr& error : errors) {
+
+                    if (error) {
+                        std::rethrow_exception(error);
+                    }
+                }
+            }
+
+            m_scanStatistics.m_hostsDown = feed.getHostsDown();
+            m_scanStatistics.m_malformedTargets = targets.getMalformedCount();
+        }
+        catch (std::runtime_error& e) {
+
+            m_errorString = e.what();
+            return false;
+        }
+
+        m_errorString.clear();
         return true;
     }
 
@@ -76,6 +487,7 @@ namespace PortQuery {
     bool PQConn::finalize() {
 
         m_errorString.clear();
+        m_targetFiles.clear();
         if (m_selectStatement) {
 
             m_selectStatement.reset();
@@ -95,6 +507,89 @@ namespace PortQuery {
         return false;
     }
 
+    bool PQConn::addSourceAddress(const std::string& address) {
+
+        const std::optional<uint32_t> source = parseIPv4Address(address);
+        if (!source) {
+
+            m_errorString = "Invalid source address: " + address;
+            return false;
+        }
+
+        m_sourceAddresses.push_back(*source);
+        return true;
+    }
+
+    bool PQConn::setPartition(const size_t partition, const size_t partitionCount) {
+
+        if (0 == partitionCount || partition >= partitionCount) {
+
+            m_errorString = "Invalid partition: " + std::to_string(partition) + "/" + std::to_string(partitionCount);
+            return false;
+        }
+
+        m_partition = partition;
+        m_partitionCount = partitionCount;
+        return true;
+    }
+
+    bool PQConn::setNameServer(const std::string& address, const uint16_t port) {
+
+        const std::optional<uint32_t> server = parseIPv4Address(address);
+        if (!server) {
+
+            m_errorString = "Invalid name server address: " + address;
+            return false;
+        }
+
+        m_resolver = std::make_shared<DNSResolver>(*server, port);
+        return true;
+    }
+
+    bool PQConn::addExclusion(const std::string& exclusion) {
+
+        if (!m_exclusions) {
+            m_exclusions = std::make_unique<ExclusionSet>();
+        }
+
+        if (!m_exclusions->addExclusion(exclusion)) {
+
+            m_errorString = "Invalid exclusion: " + exclusion;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool PQConn::addExclusionFile(const std::string& path) {
+
+        std::ifstream file(path);
+        if (!file) {
+
+            m_errorString = "Unable to open exclusion file: " + path;
+            return false;
+        }
+
+        std::string line;
+        for (size_t lineNumber = 1; std::getline(file, line); lineNumber++) {
+
+            line = line.substr(0, line.find('#'));
+            const size_t start = line.find_first_not_of(" \t\r");
+            if (std::string::npos == start) {
+                continue;
+            }
+
+            const std::string exclusion = line.substr(start, line.find_last_not_of(" \t\r") - start + 1);
+            if (!addExclusion(exclusion)) {
+
+                m_errorString = "Invalid exclusion on line " + std::to_string(lineNumber) + " of " + path + ": " + exclusion;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
     PQConn::PQConn(PQCallback const callback, const std::any context, const int timeout, const int threadCount,
                   const int delayMS) : 
         m_userCallback(callback), m_userContext(context), m_timeout(timeout), m_threadCount(threadCount),
@@ -0,0 +1,137 @@
+#include <iterator>
+
+#include "ProbeScheduler.h"
+
+
+namespace PortQuery {
+
+    ProbeScheduler::ProbeScheduler(const size_t hostLimit, const size_t subnetLimit) : m_hostLimit(hostLimit),
+        m_subnetLimit(subnetLimit) { }
+
+    void ProbeScheduler::addProbe(const uint32_t address, const uint16_t port) {
+
+        Host& host = m_hosts[address];
+        host.m_ports.push_back(port);
+        m_pending++;
+        if (HostState::IDLE == host.m_state) {
+            makeReady(address, host);
+        }
+    }
+
+    std::optional<ProbeScheduler::Probe> ProbeScheduler::nextProbe(void) {
+
+        while (!m_ready.empty()) {
+
+            const uint32_t address = m_ready.front();
+            m_ready.pop_front();
+            Host& host = m_hosts.at(address);
+            Subnet& subnet = m_subnets[address & SUBNET_MASK];
+            if (0 != m_subnetLimit && subnet.m_inFlight >= m_subnetLimit) {
+
+                host.m_state = HostState::SUBNET_FULL;
+                subnet.m_waiting.push_back(address);
+                continue;
+            }
+
+            const uint16_t port = host.m_ports.front();
+            host.m_ports.pop_front();
+            host.m_inFlight++;
+            subnet.m_inFlight++;
+            m_pending--;
+            m_inFlight++;
+
+            // Back of the line for its next turn
+            if (host.m_ports.empty()) {
+                host.m_state = HostState::IDLE;
+            }
+
+            else {
+                makeReady(address, host);
+            }
+
+            return Probe{address, port};
+        }
+
+        return std::nullopt;
+    }
+
+    void ProbeScheduler::completeProbe(const uint32_t address) {
+
+        const auto hostIter = m_hosts.find(address);
+        if (m_hosts.end() == hostIter || 0 == hostIter->second.m_inFlight) {
+            return;
+        }
+
+        Host& host = hostIter->second;
+        host.m_inFlight--;
+        m_inFlight--;
+        if (HostState::HOST_FULL == host.m_state) {
+            makeReady(address, host);
+        }
+
+        // The slot goes to whichever host has been waiting on the subnet longest
+        const auto subnetIter = m_subnets.find(address & SUBNET_MASK);
+        Subnet& subnet = subnetIter->second;
+        subnet.m_inFlight--;
+        if (!subnet.m_waiting.empty()) {
+
+            const uint32_t waiting = subnet.m_waiting.front();
+            subnet.m_waiting.pop_front();
+            makeReady(waiting, m_hosts.at(waiting));
+        }
+
+        if (0 == subnet.m_inFlight && subnet.m_waiting.empty()) {
+            m_subnets.erase(subnetIter);
+        }
+
+        if (HostState::IDLE == host.m_state && 0 == host.m_inFlight) {
+            m_hosts.erase(hostIter);
+        }
+    }
+
+    void ProbeScheduler::clearInFlight(void) {
+
+        for (auto hostIter = m_hosts.begin(); m_hosts.end() != hostIter;) {
+
+            Host& host = hostIter->second;
+            host.m_inFlight = 0;
+            if (HostState::HOST_FULL == host.m_state || HostState::SUBNET_FULL == host.m_state) {
+
+                host.m_state = HostState::READY;
+                m_ready.push_back(hostIter->first);
+            }
+
+            hostIter = HostState::IDLE == host.m_state ? m_hosts.erase(hostIter) : std::next(hostIter);
+        }
+
+        m_subnets.clear();
+        m_inFlight = 0;
+    }
+
+    size_t ProbeScheduler::getPendingCount(void) const {
+
+        return m_pending;
+    }
+
+    size_t ProbeScheduler::getInFlight(void) const {
+
+        return m_inFlight;
+    }
+
+    bool ProbeScheduler::isIdle(const uint32_t address) const {
+
+        return m_hosts.end() == m_hosts.find(address);
+    }
+
+    void ProbeScheduler::makeReady(const uint32_t address, Host& host) {
+
+        if (0 != m_hostLimit && host.m_inFlight >= m_hostLimit) {
+
+            host.m_state = HostState::HOST_FULL;
+            return;
+        }
+
+        host.m_state = HostState::READY;
+        m_ready.push_back(address);
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <optional>
+#include <unordered_map>
+
+
+namespace PortQuery {
+
+    // Decides which probe goes out next when several hosts are being swept at once. Probes queue up per host and
+    // hosts take turns, one probe each, so a host which is slow to answer can't hold every slot in the window
+    // while the rest wait. On top of that no host may have more than a set number of ports in flight, and no /24
+    // more than another, so a single machine or a small network never sees the whole window aimed at it (and an
+    // IDS or rate limit in front of it has no reason to trip). A host at its limit sits out its turns until one
+    // of its probes finishes, and the other hosts carry on in the meantime.
+    class ProbeScheduler {
+
+        public:
+
+            struct Probe {
+
+                uint32_t m_address;
+                uint16_t m_port;
+            };
+
+            // A limit of zero is no limit
+            ProbeScheduler(const size_t hostLimit=HOST_LIMIT_DEFAULT, const size_t subnetLimit=SUBNET_LIMIT_DEFAULT);
+
+            void addProbe(const uint32_t address, const uint16_t port);
+
+            // The next probe to send, which then counts as in flight until it is completed. Nothing if every
+            // probe still waiting is held back by a limit, or there are none
+            std::optional<Probe> nextProbe(void);
+
+            // Every probe handed out by nextProbe has to come back through here once it has finished
+            void completeProbe(const uint32_t address);
+
+            // Forgets every probe in flight, as if they had all finished. For when whatever was sending them
+            // has nothing outstanding any more
+            void clearInFlight(void);
+
+            // Probes added which haven't been handed out yet
+            size_t getPendingCount(void) const;
+            size_t getInFlight(void) const;
+
+            // True if the host has no probes waiting or in flight
+            bool isIdle(const uint32_t address) const;
+
+            static constexpr size_t HOST_LIMIT_DEFAULT = 1024;
+            static constexpr size_t SUBNET_LIMIT_DEFAULT = 2048;
+            static constexpr uint32_t SUBNET_MASK = 0xFFFFFF00;
+
+        private:
+
+            // A host is in exactly one place: nowhere with nothing to send, taking turns in m_ready, waiting on
+            // its own probes, or waiting in its subnet's queue for the subnet to have a slot free
+            enum class HostState { IDLE, READY, HOST_FULL, SUBNET_FULL };
+
+            struct Host {
+
+                std::deque<uint16_t> m_ports;
+                size_t m_inFlight = 0;
+                HostState m_state = HostState::IDLE;
+            };
+
+            struct Subnet {
+
+                size_t m_inFlight = 0;
+                std::deque<uint32_t> m_waiting;
+            };
+
+            void makeReady(const uint32_t address, Host& host);
+
+            size_t m_hostLimit;
+            size_t m_subnetLimit;
+
+            std::unordered_map<uint32_t, Host> m_hosts;
+            std::unordered_map<uint32_t, Subnet> m_subnets;
+            std::deque<uint32_t> m_ready;
+            size_t m_pending = 0;
+            size_t m_inFlight = 0;
+    };
+}
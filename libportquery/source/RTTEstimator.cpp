@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <cmath>
+
+#include "RTTEstimator.h"
+
+
+namespace PortQuery {
+
+    void RTTEstimator::Estimate::update(const double sample) {
+
+        if (!m_valid) {
+
+            m_smoothed = sample;
+            m_deviation = sample / 2.0;
+            m_valid = true;
+            return;
+        }
+
+        // The deviation has to be updated first, it uses the old smoothed value
+        m_deviation = 0.75 * m_deviation + 0.25 * std::fabs(m_smoothed - sample);
+        m_smoothed = 0.875 * m_smoothed + 0.125 * sample;
+    }
+
+    double RTTEstimator::Estimate::getTimeout(void) const {
+
+        return m_smoothed + std::max(CLOCK_GRANULARITY, 4.0 * m_deviation);
+    }
+
+
+    RTTEstimator::RTTEstimator(const std::chrono::milliseconds floor, const std::chrono::milliseconds ceiling) :
+        m_floor(floor), m_ceiling(ceiling) { }
+
+    void RTTEstimator::setFloor(const std::chrono::milliseconds floor) {
+
+        m_floor = floor;
+    }
+
+    void RTTEstimator::setCeiling(const std::chrono::milliseconds ceiling) {
+
+        m_ceiling = ceiling;
+    }
+
+    std::chrono::milliseconds RTTEstimator::getCeiling(void) const {
+
+        return m_ceiling;
+    }
+
+    void RTTEstimator::addSample(const uint32_t address, const Clock::duration rtt) {
+
+        const double sample = std::chrono::duration<double, std::micro>(rtt).count();
+        m_hosts[address].update(sample);
+        m_global.update(sample);
+    }
+
+    std::chrono::milliseconds RTTEstimator::getTimeout(const uint32_t address) const {
+
+        const auto hostIter = m_hosts.find(address);
+        if (m_hosts.end() != hostIter) {
+            return clamp(hostIter->second.getTimeout());
+        }
+
+        else if (m_global.m_valid) {
+            return clamp(m_global.getTimeout());
+        }
+
+        return m_ceiling;
+    }
+
+    void RTTEstimator::forgetHost(const uint32_t address) {
+
+        m_hosts.erase(address);
+    }
+
+    bool RTTEstimator::hasSamples(void) const {
+
+        return m_global.m_valid;
+    }
+
+    std::chrono::milliseconds RTTEstimator::clamp(const double timeout) const {
+
+        const std::chrono::milliseconds rounded(static_cast<std::chrono::milliseconds::rep>(std::ceil(timeout / 1000.0)));
+        return std::min(m_ceiling, std::max(m_floor, rounded));
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <unordered_map>
+
+
+namespace PortQuery {
+
+    // Tracks round trip times per host the same way TCP does (RFC 6298), a smoothed RTT and a smoothed mean
+    // deviation, and turns them into a timeout for the next probe to that host. Hosts which haven't answered
+    // anything yet borrow the estimate built from every sample seen so far, and until there is at least one
+    // sample the ceiling is used.
+    class RTTEstimator {
+
+        public:
+
+            using Clock = std::chrono::steady_clock;
+
+            RTTEstimator(const std::chrono::milliseconds floor=MIN_TIMEOUT_DEFAULT,
+                    const std::chrono::milliseconds ceiling=MAX_TIMEOUT_DEFAULT);
+
+            void setFloor(const std::chrono::milliseconds floor);
+            void setCeiling(const std::chrono::milliseconds ceiling);
+            std::chrono::milliseconds getCeiling(void) const;
+
+            void addSample(const uint32_t address, const Clock::duration rtt);
+            std::chrono::milliseconds getTimeout(const uint32_t address) const;
+
+            // Drops the host's own estimate, for once nothing more will be sent to it. Its samples stay in the
+            // global estimate
+            void forgetHost(const uint32_t address);
+
+            // False until the first sample comes in, every timeout handed out before that is just the ceiling
+            bool hasSamples(void) const;
+
+        private:
+
+            static constexpr std::chrono::milliseconds MIN_TIMEOUT_DEFAULT = std::chrono::milliseconds(100);
+            static constexpr std::chrono::milliseconds MAX_TIMEOUT_DEFAULT = std::chrono::seconds(2);
+
+            // The resolution of the timers the reactors wait on
+            static constexpr double CLOCK_GRANULARITY = 1000.0;
+
+            struct Estimate {
+
+                // In microseconds
+                double m_smoothed = 0.0;
+                double m_deviation = 0.0;
+                bool m_valid = false;
+
+                void update(const double sample);
+                double getTimeout(void) const;
+            };
+
+            std::chrono::milliseconds clamp(const double timeout) const;
+
+            std::chrono::milliseconds m_floor;
+            std::chrono::milliseconds m_ceiling;
+            Estimate m_global;
+            std::unordered_map<uint32_t, Estimate> m_hosts;
+    };
+}
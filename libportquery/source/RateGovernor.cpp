@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <cmath>
+
+#include "RateGovernor.h"
+
+
+namespace PortQuery {
+
+    RateGovernor::RateGovernor(const size_t maxWindow) : m_maxWindow(static_cast<double>(maxWindow)),
+        m_window(m_maxWindow), m_maxRate(0.0), m_smoothedRTT(0.0), m_replied(false),
+        m_consecutiveTimeouts(0) { }
+
+    void RateGovernor::setMaxRate(const double rate) {
+
+        m_maxRate = rate;
+        updateRate();
+    }
+
+    size_t RateGovernor::getWindow(void) const {
+
+        return static_cast<size_t>(m_window);
+    }
+
+    bool RateGovernor::tryAcquire(const Clock::time_point now, const size_t inFlight) {
+
+        return inFlight < getWindow() && m_bucket.tryConsume(now);
+    }
+
+    void RateGovernor::release(void) {
+
+        m_bucket.refund();
+    }
+
+    RateGovernor::Clock::time_point RateGovernor::getNextSend(const Clock::time_point now, const size_t inFlight) {
+
+        if (inFlight >= getWindow()) {
+            return Clock::time_point::max();
+        }
+
+        return m_bucket.getNextAvailable(now);
+    }
+
+    void RateGovernor::onReply(void) {
+
+        m_replied = true;
+        m_consecutiveTimeouts = 0;
+
+        // A window's worth of answers comes back every round trip, so this adds one probe per round trip
+        m_window = std::min(m_window + 1.0 / m_window, m_maxWindow);
+    }
+
+    void RateGovernor::onLoss(const Clock::time_point now) {
+
+        decrease(now, MIN_WINDOW);
+    }
+
+    void RateGovernor::onTimeout(const Clock::time_point now) {
+
+        // A host which has never answered is most likely filtering everything, there is nothing to back off from
+        if (!m_replied || ++m_consecutiveTimeouts < std::max(MIN_WINDOW, m_window / 2.0)) {
+            return;
+        }
+
+        m_consecutiveTimeouts = 0;
+        if (m_window > TIMEOUT_MIN_WINDOW) {
+            decrease(now, TIMEOUT_MIN_WINDOW);
+        }
+    }
+
+    void RateGovernor::decrease(const Clock::time_point now, const double floor) {
+
+        // Every probe lost to the same congestion is noticed within about a round trip of the first, only the
+        // first of them should count
+        const std::chrono::duration<double> sinceDecrease = now - m_lastDecrease;
+        if (sinceDecrease.count() < m_smoothedRTT) {
+            return;
+        }
+
+        m_lastDecrease = now;
+        m_window = std::max(floor, m_window / 2.0);
+        updateRate();
+    }
+
+    void RateGovernor::addRTTSample(const Clock::duration rtt) {
+
+        const double sample = std::chrono::duration<double>(rtt).count();
+        m_smoothedRTT = 0.0 == m_smoothedRTT ? sample : 0.875 * m_smoothedRTT + 0.125 * sample;
+        updateRate();
+    }
+
+    void RateGovernor::updateRate(void) {
+
+        double rate = 0.0;
+        if (m_smoothedRTT > 0.0) {
+            rate = PACING_GAIN * m_window / m_smoothedRTT;
+        }
+
+        if (m_maxRate > 0.0) {
+            rate = 0.0 == rate ? m_maxRate : std::min(rate, m_maxRate);
+        }
+
+        // Resetting the bucket for every sample would cost more than the pacing saves, small changes are ignored
+        const double current = m_bucket.getRate();
+        if (0.0 != current && std::fabs(rate - current) < current / 8.0) {
+            return;
+        }
+
+        // Allow about ten milliseconds worth of probes out at once, the reactors don't wake up any more often
+        m_bucket.setRate(rate);
+        m_bucket.setBurst(std::max(1.0, rate / 100.0));
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <chrono>
+
+#include "TokenBucket.h"
+
+
+namespace PortQuery {
+
+    // Decides when the next probe is allowed to go out, so that a scan runs as fast as the network in between
+    // can take without anyone having to tune a delay by hand. Two limits are combined:
+    //
+    // A congestion window, the number of probes allowed in flight. It starts out fully open, is halved on loss and
+    // grows back by one probe every round trip while answers keep coming in (AIMD, the same as TCP). A loss is a
+    // probe which had to be sent again and was then answered. A timeout on its own can't tell a filtered port from
+    // a dropped probe, so only a long run of them from a host which has been answering counts as loss, and even
+    // then the window is never brought below TIMEOUT_MIN_WINDOW.
+    //
+    // A token bucket which spreads the window out over a round trip instead of sending it in one burst. It also
+    // enforces the maximum rate if one has been set.
+    class RateGovernor {
+
+        public:
+
+            using Clock = std::chrono::steady_clock;
+
+            RateGovernor(const size_t maxWindow);
+
+            // In probes per second, zero means there is no maximum
+            void setMaxRate(const double rate);
+
+            // Returns true, and takes a token, if a probe can go out now with inFlight probes outstanding
+            bool tryAcquire(const Clock::time_point now, const size_t inFlight);
+
+            // Hands back the token from tryAcquire when the probe couldn't go out after all
+            void release(void);
+
+            // The earliest a probe could go out, or the maximum time point if the window is full and only an
+            // answer (or a timeout) will open it back up
+            Clock::time_point getNextSend(const Clock::time_point now, const size_t inFlight);
+
+            void onReply(void);
+            void onLoss(const Clock::time_point now);
+            void onTimeout(const Clock::time_point now);
+            void addRTTSample(const Clock::duration rtt);
+
+            size_t getWindow(void) const;
+
+        private:
+
+            static constexpr double MIN_WINDOW = 4.0;
+            static constexpr double TIMEOUT_MIN_WINDOW = 64.0;
+
+            // Pacing at exactly a window per round trip would leave no room for the window to grow
+            static constexpr double PACING_GAIN = 2.0;
+
+            void decrease(const Clock::time_point now, const double floor);
+            void updateRate(void);
+
+            double m_maxWindow;
+            double m_window;
+            double m_maxRate;
+
+            // In seconds, zero until the first sample
+            double m_smoothedRTT;
+
+            bool m_replied;
+            size_t m_consecutiveTimeouts;
+            Clock::time_point m_lastDecrease;
+            TokenBucket m_bucket;
+    };
+}
@@ -0,0 +1,191 @@
+#include <system_error>
+#include <cerrno>
+
+#include <netinet/in.h>
+#include <netinet/ip_icmp.h>
+#include <sys/socket.h>
+
+#include "ReplyFilter.h"
+
+
+namespace PortQuery {
+
+    namespace {
+
+        // Offsets into the IP header
+        constexpr uint32_t FRAGMENT_OFFSET = 6;
+        constexpr uint32_t PROTOCOL_OFFSET = 9;
+        constexpr uint32_t SOURCE_ADDRESS_OFFSET = 12;
+        constexpr uint32_t FRAGMENT_MASK = 0x1FFF;
+
+        // Offsets past the IP header. ICMP errors quote the IP header of the datagram which caused them, probes
+        // never carry IP options so it is always 20 bytes long
+        constexpr uint32_t DESTINATION_PORT_OFFSET = 2;
+        constexpr uint32_t QUOTED_DESTINATION_OFFSET = 8 + 16;
+
+        // Only the headers are ever looked at, there is no point copying more than this
+        constexpr uint32_t ACCEPT_LENGTH = 256;
+
+        // Jumps are only a byte long in classic BPF, so the program is laid out in sections and the jumps between
+        // them are worked out once every section is in place
+        enum Label : int {
+            NEXT = -1,
+            TCP_SECTION,
+            UDP_SECTION,
+            ICMP_SECTION,
+            ACCEPT,
+            REJECT,
+            LABEL_COUNT
+        };
+
+        class ProgramBuilder {
+
+            public:
+
+                void statement(const uint16_t code, const uint32_t value) {
+
+                    m_program.push_back(BPF_STMT(code, value));
+                }
+
+                void jump(const uint16_t code, const uint32_t value, const Label onTrue, const Label onFalse) {
+
+                    m_fixups.push_back(Fixup{m_program.size(), onTrue, onFalse});
+                    m_program.push_back(BPF_JUMP(code, value, 0, 0));
+                }
+
+                void jumpAlways(const Label target) {
+
+                    m_fixups.push_back(Fixup{m_program.size(), target, NEXT});
+                    m_program.push_back(BPF_STMT(BPF_JMP | BPF_JA, 0));
+                }
+
+                void label(const Label label) {
+
+                    m_labels[label] = m_program.size();
+                }
+
+                std::vector<struct sock_filter> finish(void) {
+
+                    for (const Fixup& fixup : m_fixups) {
+
+                        struct sock_filter& instruction = m_program[fixup.m_index];
+                        if (BPF_JA == BPF_OP(instruction.code)) {
+                            instruction.k = getOffset(fixup.m_index, fixup.m_onTrue);
+                            continue;
+                        }
+
+                        instruction.jt = static_cast<uint8_t>(getOffset(fixup.m_index, fixup.m_onTrue));
+                        instruction.jf = static_cast<uint8_t>(getOffset(fixup.m_index, fixup.m_onFalse));
+                    }
+
+                    return m_program;
+                }
+
+            private:
+
+                struct Fixup {
+
+                    size_t m_index;
+                    Label m_onTrue;
+                    Label m_onFalse;
+                };
+
+                uint32_t getOffset(const size_t index, const Label label) const {
+
+                    return NEXT == label ? 0 : static_cast<uint32_t>(m_labels[label] - index - 1);
+                }
+
+                std::vector<struct sock_filter> m_program;
+                std::vector<Fixup> m_fixups;
+                size_t m_labels[LABEL_COUNT] = { };
+        };
+
+        // Falls through if the address in the accumulator is one of the targets
+        void matchTarget(ProgramBuilder& builder, const ReplyFilterSpec& spec) {
+
+            builder.jump(BPF_JMP | BPF_JGE | BPF_K, spec.m_firstAddress, NEXT, REJECT);
+            builder.jump(BPF_JMP | BPF_JGT | BPF_K, spec.m_lastAddress, REJECT, NEXT);
+        }
+
+        // Accepts if the destination port past the IP header is the local port, the index register has to hold
+        // the length of the IP header
+        void matchLocalPort(ProgramBuilder& builder, const ReplyFilterSpec& spec) {
+
+            if (0 == spec.m_localPort) {
+
+                builder.jumpAlways(ACCEPT);
+                return;
+            }
+
+            builder.statement(BPF_LD | BPF_H | BPF_IND, DESTINATION_PORT_OFFSET);
+            builder.jump(BPF_JMP | BPF_JEQ | BPF_K, spec.m_localPort, ACCEPT, REJECT);
+        }
+    }
+
+    std::vector<struct sock_filter> buildReplyFilter(const ReplyFilterSpec& spec) {
+
+        const bool tcp = NetworkProtocol::TCP == (spec.m_protocols & NetworkProtocol::TCP);
+        const bool udp = NetworkProtocol::UDP == (spec.m_protocols & NetworkProtocol::UDP);
+
+        ProgramBuilder builder;
+        builder.statement(BPF_LD | BPF_H | BPF_ABS, FRAGMENT_OFFSET);
+        builder.jump(BPF_JMP | BPF_JSET | BPF_K, FRAGMENT_MASK, REJECT, NEXT);
+
+        builder.statement(BPF_LD | BPF_B | BPF_ABS, PROTOCOL_OFFSET);
+        if (tcp) {
+            builder.jump(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_TCP, TCP_SECTION, NEXT);
+        }
+
+        if (udp) {
+
+            builder.jump(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, UDP_SECTION, NEXT);
+            builder.jump(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_ICMP, ICMP_SECTION, NEXT);
+        }
+
+        builder.jumpAlways(REJECT);
+
+        if (tcp) {
+
+            builder.label(TCP_SECTION);
+            builder.statement(BPF_LD | BPF_W | BPF_ABS, SOURCE_ADDRESS_OFFSET);
+            matchTarget(builder, spec);
+            builder.statement(BPF_LDX | BPF_B | BPF_MSH, 0);
+            matchLocalPort(builder, spec);
+        }
+
+        if (udp) {
+
+            builder.label(UDP_SECTION);
+            builder.statement(BPF_LD | BPF_W | BPF_ABS, SOURCE_ADDRESS_OFFSET);
+            matchTarget(builder, spec);
+            builder.statement(BPF_LDX | BPF_B | BPF_MSH, 0);
+            matchLocalPort(builder, spec);
+
+            // The error can come from any router along the way, it is the datagram it quotes which has to have
+            // been sent to a target
+            builder.label(ICMP_SECTION);
+            builder.statement(BPF_LDX | BPF_B | BPF_MSH, 0);
+            builder.statement(BPF_LD | BPF_B | BPF_IND, 0);
+            builder.jump(BPF_JMP | BPF_JEQ | BPF_K, ICMP_DEST_UNREACH, NEXT, REJECT);
+            builder.statement(BPF_LD | BPF_W | BPF_IND, QUOTED_DESTINATION_OFFSET);
+            matchTarget(builder, spec);
+            builder.jumpAlways(ACCEPT);
+        }
+
+        builder.label(ACCEPT);
+        builder.statement(BPF_RET | BPF_K, ACCEPT_LENGTH);
+        builder.label(REJECT);
+        builder.statement(BPF_RET | BPF_K, 0);
+        return builder.finish();
+    }
+
+    void attachReplyFilter(const int fd, const std::vector<struct sock_filter>& program) {
+
+        const struct sock_fprog filter = { static_cast<unsigned short>(program.size()),
+            const_cast<struct sock_filter*>(program.data()) };
+        if (-1 == setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &filter, sizeof(filter))) {
+
+            throw std::system_error(errno, std::generic_category(), "Unable to attach reply filter");
+        }
+    }
+}
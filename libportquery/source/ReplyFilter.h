@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <linux/filter.h>
+
+#include "Network.h"
+
+
+namespace PortQuery {
+
+    // What a reply has to look like to be worth waking the scanner for. Addresses are in host byte order.
+    struct ReplyFilterSpec {
+
+        NetworkProtocol m_protocols;
+
+        // The targets being scanned, replies from anywhere else are dropped
+        uint32_t m_firstAddress;
+        uint32_t m_lastAddress;
+
+        // The local port probes go out from, zero lets replies to any port through
+        uint16_t m_localPort;
+    };
+
+    // Builds a classic BPF program for a socket which hands over packets starting at the IP header (a raw socket,
+    // or a SOCK_DGRAM packet socket). It only passes what could be a reply to a probe. For TCP that means segments
+    // from a target to the local port. For UDP it means datagrams from a target to the local port, and ICMP
+    // destination unreachable errors about a datagram sent to a target. Fragments after the first are always
+    // dropped, they don't carry the headers being matched.
+    std::vector<struct sock_filter> buildReplyFilter(const ReplyFilterSpec& spec);
+
+    // Replaces whatever filter the socket had, throws on failure
+    void attachReplyFilter(const int fd, const std::vector<struct sock_filter>& program);
+}
@@ -0,0 +1,698 @@
+#include <system_error>
+#include <algorithm>
+#include <random>
+#include <cstring>
+#include <cerrno>
+
+#include <arpa/inet.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <linux/errqueue.h>
+#include <linux/filter.h>
+#include <linux/net_tstamp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "SYNEnvironment.h"
+#include "ReplyFilter.h"
+
+
+namespace PortQuery {
+
+    static uint64_t rotateLeft(const uint64_t value, const int bits) {
+
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    // SipHash-2-4 over a single 64 bit word. Fast enough to compute for every packet sent and received, and
+    // unpredictable enough that a reply can't be forged without having seen the probe
+    static uint64_t sipHash(const uint64_t key[2], const uint64_t message) {
+
+        uint64_t v0 = 0x736f6d6570736575ULL ^ key[0];
+        uint64_t v1 = 0x646f72616e646f6dULL ^ key[1];
+        uint64_t v2 = 0x6c7967656e657261ULL ^ key[0];
+        uint64_t v3 = 0x7465646279746573ULL ^ key[1];
+
+        const auto round = [&] () {
+            v0 += v1; v1 = rotateLeft(v1, 13); v1 ^= v0; v0 = rotateLeft(v0, 32);
+            v2 += v3; v3 = rotateLeft(v3, 16); v3 ^= v2;
+            v0 += v3; v3 = rotateLeft(v3, 21); v3 ^= v0;
+            v2 += v1; v1 = rotateLeft(v1, 17); v1 ^= v2; v2 = rotateLeft(v2, 32);
+        };
+
+        const uint64_t lengthWord = static_cast<uint64_t>(sizeof(message)) << 56;
+        v3 ^= message; round(); round(); v0 ^= message;
+        v3 ^= lengthWord; round(); round(); v0 ^= lengthWord;
+        v2 ^= 0xff; round(); round(); round(); round();
+        return v0 ^ v1 ^ v2 ^ v3;
+    }
+
+
+    static uint64_t getProbeKey(const uint32_t address, const uint16_t port) {
+
+        return (static_cast<uint64_t>(address) << 16) | port;
+    }
+
+    // The software timestamp out of a message read with SO_TIMESTAMPING enabled, zero if it doesn't carry one
+    static std::chrono::nanoseconds getSoftwareTimestamp(struct msghdr& message) {
+
+        for (struct cmsghdr* header = CMSG_FIRSTHDR(&message); nullptr != header; header = CMSG_NXTHDR(&message, header)) {
+
+            if (SOL_SOCKET == header->cmsg_level && SCM_TIMESTAMPING == header->cmsg_type) {
+
+                struct scm_timestamping timestamps;
+                std::memcpy(&timestamps, CMSG_DATA(header), sizeof(timestamps));
+                return std::chrono::seconds(timestamps.ts[0].tv_sec) + std::chrono::nanoseconds(timestamps.ts[0].tv_nsec);
+            }
+        }
+
+        return std::chrono::nanoseconds::zero();
+    }
+
+
+    SYNEnvironment::SYNEnvironment(const int threadCount) : m_filterValid(false), m_filterFirst(0), m_filterLast(0),
+        m_filterProtocols(NetworkProtocol::NONE), m_outstanding(0), m_provisionalReplaced(false),
+        m_governor(MAX_WINDOW), m_measureLatency(false), m_nextTimestampID(0), m_threadCount(threadCount) {
+
+        m_rawFD = socket(AF_INET, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+        if (-1 == m_rawFD) {
+
+            throw std::system_error(errno, std::generic_category(), "Unable to create raw socket for SYN scan");
+        }
+
+        // Replies come in about as fast as probes go out, so the default buffer is far too small. Forcing the
+        // size needs CAP_NET_ADMIN, fall back to whatever the system maximum allows otherwise
+        if (-1 == setsockopt(m_rawFD, SOL_SOCKET, SO_RCVBUFFORCE, &RECEIVE_BUFFER_SIZE, sizeof(RECEIVE_BUFFER_SIZE))) {
+            setsockopt(m_rawFD, SOL_SOCKET, SO_RCVBUF, &RECEIVE_BUFFER_SIZE, sizeof(RECEIVE_BUFFER_SIZE));
+        }
+
+        m_reservationFD = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+        sockaddr_in reservation = makeSocketAddress(INADDR_ANY, 0);
+        socklen_t reservationLength = sizeof(reservation);
+        if (-1 == m_reservationFD || -1 == bind(m_reservationFD, reinterpret_cast<sockaddr*>(&reservation), reservationLength) ||
+                -1 == getsockname(m_reservationFD, reinterpret_cast<sockaddr*>(&reservation), &reservationLength)) {
+
+            const int error = errno;
+            close(m_rawFD);
+            if (-1 != m_reservationFD) {
+                close(m_reservationFD);
+            }
+
+            throw std::system_error(error, std::generic_category(), "Unable to reserve source port for SYN scan");
+        }
+
+        m_sourcePort = ntohs(reservation.sin_port);
+
+        std::random_device randomDevice;
+        std::uniform_int_distribution<uint64_t> distribution;
+        m_key[0] = distribution(randomDevice);
+        m_key[1] = distribution(randomDevice);
+    }
+
+    SYNEnvironment::~SYNEnvironment() {
+
+        close(m_rawFD);
+        close(m_reservationFD);
+    }
+
+    uint32_t SYNEnvironment::computeCookie(const uint32_t address, const uint16_t port) const {
+
+        const uint64_t message = (static_cast<uint64_t>(address) << 32) | (static_cast<uint64_t>(port) << 16) | m_sourcePort;
+        return static_cast<uint32_t>(sipHash(m_key, message));
+    }
+
+    uint32_t SYNEnvironment::getSourceAddress(const uint32_t address) {
+
+        const auto sourceIter = m_sourceAddresses.find(address);
+        if (m_sourceAddresses.end() != sourceIter) {
+            return sourceIter->second;
+        }
+
+        // Connecting a datagram socket doesn't send anything, but it does make the kernel pick the
+        // address it would route through, which is needed for the checksum
+        const int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        sockaddr_in target = makeSocketAddress(address, m_sourcePort);
+        socklen_t length = sizeof(target);
+        if (-1 == fd || -1 == connect(fd, reinterpret_cast<sockaddr*>(&target), length) ||
+                -1 == getsockname(fd, reinterpret_cast<sockaddr*>(&target), &length)) {
+
+            const int error = errno;
+            if (-1 != fd) {
+                close(fd);
+            }
+
+            throw std::system_error(error, std::generic_category(), "Unable to find route to " + formatIPv4Address(address));
+        }
+
+        close(fd);
+        const uint32_t sourceAddress = ntohl(target.sin_addr.s_addr);
+        m_sourceAddresses.emplace(address, sourceAddress);
+        return sourceAddress;
+    }
+
+    bool SYNEnvironment::scanPort(void) {
+
+        const NetworkProtocol protocols = getProtocolsToScan() & NetworkProtocol::TCP;
+        m_collector.expectScan(getAddress(), getPort(), protocols);
+        updateReplyFilter(protocols, getAddress());
+
+        if (NetworkProtocol::TCP == protocols) {
+
+            waitToSend();
+            sendSYN(getAddress(), getPort());
+        }
+
+        return true;
+    }
+
+    void SYNEnvironment::setTimeout(const int timeout) {
+
+        IEnvironment::setTimeout(timeout);
+        m_estimator.setCeiling(std::chrono::seconds(timeout));
+    }
+
+    void SYNEnvironment::setMaxRate(const double rate) {
+
+        m_governor.setMaxRate(rate);
+    }
+
+    void SYNEnvironment::setReceiveRing(const bool enabled) {
+
+        if (enabled == (nullptr != m_ring)) {
+            return;
+        }
+
+        // The reply filter goes on whichever socket replies will be read from
+        m_filterValid = false;
+        if (!enabled) {
+
+            m_ring.reset();
+            setsockopt(m_rawFD, SOL_SOCKET, SO_DETACH_FILTER, nullptr, 0);
+            return;
+        }
+
+        // Replies still get queued on the raw socket as well unless it is told to drop everything, and nothing
+        // would ever read them
+        m_ring = std::make_unique<PacketRing>();
+        struct sock_filter dropAll = BPF_STMT(BPF_RET | BPF_K, 0);
+        const struct sock_fprog program = { 1, &dropAll };
+        if (-1 == setsockopt(m_rawFD, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program))) {
+
+            m_ring.reset();
+            throw std::system_error(errno, std::generic_category(), "Unable to filter raw socket");
+        }
+
+        // Whatever made it to the raw socket before the filter went on is still in its queue
+        uint8_t packet[256];
+        while (0 < recv(m_rawFD, packet, sizeof(packet), 0)) { }
+    }
+
+    void SYNEnvironment::setMeasureLatency(const bool enabled) {
+
+        if (enabled == m_measureLatency) {
+            return;
+        }
+
+        // Timestamps are numbered from zero again whenever numbering is switched on. The packet itself isn't
+        // needed back, the number is enough to find the SYN
+        const int flags = !enabled ? 0 : SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE |
+            SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+        if (-1 == setsockopt(m_rawFD, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags))) {
+
+            throw std::system_error(errno, std::generic_category(), "Unable to enable timestamps on raw socket");
+        }
+
+        m_measureLatency = enabled;
+        m_nextTimestampID = 0;
+        m_pendingTimestamps.clear();
+        m_sentTimestamps.clear();
+    }
+
+    int SYNEnvironment::getReceiveFD(void) const {
+
+        return nullptr != m_ring ? m_ring->getFD() : m_rawFD;
+    }
+
+    void SYNEnvironment::addTargets(const std::vector<uint32_t>& targets) {
+
+        if (targets.empty()) {
+            return;
+        }
+
+        const auto [first, last] = std::minmax_element(targets.begin(), targets.end());
+        m_chunkFirsts.insert(*first);
+        m_chunkLasts.insert(*last);
+        updateReplyFilter(getProtocolsToScan() & NetworkProtocol::TCP);
+    }
+
+    void SYNEnvironment::releaseTargets(const std::vector<uint32_t>& targets) {
+
+        if (targets.empty()) {
+            return;
+        }
+
+        for (const uint32_t target : targets) {
+
+            m_sourceAddresses.erase(target);
+            m_pendingPorts.erase(target);
+            m_timedProbes.erase(target);
+            m_estimator.forgetHost(target);
+        }
+
+        const auto [first, last] = std::minmax_element(targets.begin(), targets.end());
+        const auto firstIter = m_chunkFirsts.find(*first);
+        const auto lastIter = m_chunkLasts.find(*last);
+        if (m_chunkFirsts.end() == firstIter || m_chunkLasts.end() == lastIter) {
+            return;
+        }
+
+        // The filter is cut back to the chunks which are left, with none left it stays as it is until the next
+        m_chunkFirsts.erase(firstIter);
+        m_chunkLasts.erase(lastIter);
+        if (!m_chunkFirsts.empty() && (*m_chunkFirsts.begin() > m_filterFirst || *m_chunkLasts.rbegin() < m_filterLast)) {
+
+            m_filterValid = false;
+            updateReplyFilter(getProtocolsToScan() & NetworkProtocol::TCP);
+        }
+    }
+
+    void SYNEnvironment::updateReplyFilter(const NetworkProtocol protocols, const std::optional<uint32_t> address) {
+
+        uint32_t first = address.value_or(static_cast<uint32_t>(-1));
+        uint32_t last = address.value_or(0);
+        if (!m_chunkFirsts.empty()) {
+
+            first = std::min(first, *m_chunkFirsts.begin());
+            last = std::max(last, *m_chunkLasts.rbegin());
+        }
+
+        if (first > last) {
+            return;
+        }
+
+        // A filter which already lets all of it through is left alone
+        else if (m_filterValid && protocols == m_filterProtocols && first >= m_filterFirst && last <= m_filterLast) {
+            return;
+        }
+
+        attachReplyFilter(getReceiveFD(), buildReplyFilter(ReplyFilterSpec{protocols, first, last, m_sourcePort}));
+        m_filterValid = true;
+        m_filterFirst = first;
+        m_filterLast = last;
+        m_filterProtocols = protocols;
+    }
+
+    void SYNEnvironment::waitToSend(void) {
+
+        while (!m_governor.tryAcquire(Clock::now(), m_outstanding)) {
+
+            const bool received = receiveReplies();
+            if (expireDeadlines(Clock::now()) || received) {
+                continue;
+            }
+
+            const Clock::time_point now = Clock::now();
+            struct pollfd pollDescriptor = { getReceiveFD(), POLLIN, 0 };
+            if (-1 == ::poll(&pollDescriptor, 1, getWaitTime(now, m_governor.getNextSend(now, m_outstanding))) &&
+                    EINTR != errno) {
+
+                throw std::system_error(errno, std::generic_category(), "Unable to wait on raw socket");
+            }
+        }
+    }
+
+    void SYNEnvironment::sendSYN(const uint32_t address, const uint16_t port) {
+
+        transmitSYN(address, port);
+
+        std::vector<bool>& pending = m_pendingPorts[address];
+        if (pending.empty()) {
+            pending.resize(static_cast<size_t>(static_cast<uint16_t>(-1)) + 1);
+        }
+
+        pending[port] = true;
+        m_outstanding++;
+
+        const Clock::time_point now = Clock::now();
+        TimedProbe& timed = m_timedProbes[address];
+        if (!timed.m_active) {
+            timed = TimedProbe{port, now, true};
+        }
+
+        const std::chrono::milliseconds timeout = m_estimator.getTimeout(address);
+        const Deadline deadline{now, timeout, address, port, 0, !m_estimator.hasSamples()};
+        scheduleDeadline(deadline);
+        if (deadline.m_provisional) {
+            m_provisionalDeadlines.push_back(deadline);
+        }
+    }
+
+    void SYNEnvironment::addSample(const uint32_t address, const Clock::duration rtt) {
+
+        m_estimator.addSample(address, rtt);
+        m_governor.addRTTSample(rtt);
+        if (m_provisionalReplaced) {
+            return;
+        }
+
+        for (const Deadline& provisional : m_provisionalDeadlines) {
+
+            const std::chrono::milliseconds timeout = m_estimator.getTimeout(provisional.m_address);
+            scheduleDeadline(Deadline{provisional.m_sent, timeout, provisional.m_address, provisional.m_port, 0, false});
+        }
+
+        m_provisionalDeadlines = std::vector<Deadline>();
+        m_provisionalReplaced = true;
+    }
+
+    void SYNEnvironment::transmitSYN(const uint32_t address, const uint16_t port) {
+
+        // The kernel fills in the IP header, only the TCP header is written
+        struct tcphdr header;
+        std::memset(&header, 0, sizeof(header));
+        header.source = htons(m_sourcePort);
+        header.dest = htons(port);
+        header.seq = htonl(computeCookie(address, port));
+        header.doff = sizeof(header) / 4;
+        header.syn = 1;
+        header.window = htons(1024);
+
+        // The pseudo header, source address, destination address, protocol and TCP length
+        const uint32_t sourceAddress = getSourceAddress(address);
+        const uint32_t pseudoSum = (sourceAddress >> 16) + (sourceAddress & 0xFFFF) + (address >> 16) +
+            (address & 0xFFFF) + IPPROTO_TCP + sizeof(header);
+        header.check = computeChecksum(pseudoSum, reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+
+        const sockaddr_in target = makeSocketAddress(address, 0);
+        while (-1 == sendto(m_rawFD, &header, sizeof(header), 0, reinterpret_cast<const sockaddr*>(&target), sizeof(target))) {
+
+            // The send buffer is full, make room by processing replies while the queue drains
+            if (EAGAIN == errno || ENOBUFS == errno) {
+
+                receiveReplies();
+                struct pollfd pollDescriptor = { m_rawFD, POLLOUT, 0 };
+                ::poll(&pollDescriptor, 1, 1);
+                continue;
+            }
+
+            // Anything else means the probe never made it out, which is indistinguishable from silence
+            return;
+        }
+
+        // A SYN which fails to go out doesn't use up a number
+        if (m_measureLatency) {
+
+            m_pendingTimestamps.emplace_back(m_nextTimestampID++, getProbeKey(address, port));
+
+            // Something between here and the device is dropping timestamps, don't wait on them forever
+            if (m_pendingTimestamps.size() > MAX_WINDOW) {
+                m_pendingTimestamps.pop_front();
+            }
+        }
+    }
+
+    bool SYNEnvironment::markAnswered(const uint32_t address, const uint16_t port) {
+
+        const auto pendingIter = m_pendingPorts.find(address);
+        if (m_pendingPorts.end() == pendingIter || !pendingIter->second[port]) {
+            return false;
+        }
+
+        pendingIter->second[port] = false;
+        m_outstanding--;
+        return true;
+    }
+
+    bool SYNEnvironment::receiveReplies(void) {
+
+        // A SYN is always timestamped before its reply can arrive, so they have to be matched up first
+        if (m_measureLatency) {
+            receiveSendTimestamps();
+        }
+
+        if (nullptr != m_ring) {
+
+            return 0 != m_ring->receive([this] (const uint8_t* packet, const size_t length,
+                        const std::chrono::nanoseconds received) {
+
+                handleReply(packet, length, received);
+            });
+        }
+
+        bool received = false;
+        uint8_t packet[256];
+        uint8_t control[CMSG_SPACE(sizeof(struct scm_timestamping))];
+        struct iovec vector = { packet, sizeof(packet) };
+        struct msghdr message = { };
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+
+        for (;;) {
+
+            // recvmsg shrinks the control length to what it filled in
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            const ssize_t length = recvmsg(m_rawFD, &message, 0);
+            if (length <= 0) {
+                break;
+            }
+
+            handleReply(packet, static_cast<size_t>(length), getSoftwareTimestamp(message));
+            received = true;
+        }
+
+        return received;
+    }
+
+    void SYNEnvironment::receiveSendTimestamps(void) {
+
+        // Only the control messages are wanted, the packet itself is never handed back
+        static constexpr size_t CONTROL_SIZE = CMSG_SPACE(sizeof(struct scm_timestamping)) +
+            CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(sockaddr_in));
+
+        struct mmsghdr messages[TIMESTAMP_BATCH_SIZE];
+        uint8_t controls[TIMESTAMP_BATCH_SIZE][CONTROL_SIZE];
+        int received = TIMESTAMP_BATCH_SIZE;
+        while (TIMESTAMP_BATCH_SIZE == received) {
+
+            std::memset(messages, 0, sizeof(messages));
+            for (size_t index = 0; index < TIMESTAMP_BATCH_SIZE; index++) {
+
+                messages[index].msg_hdr.msg_control = controls[index];
+                messages[index].msg_hdr.msg_controllen = CONTROL_SIZE;
+            }
+
+            received = recvmmsg(m_rawFD, messages, TIMESTAMP_BATCH_SIZE, MSG_ERRQUEUE | MSG_DONTWAIT, nullptr);
+            for (int index = 0; index < received; index++) {
+
+                struct msghdr& message = messages[index].msg_hdr;
+                const std::chrono::nanoseconds sent = getSoftwareTimestamp(message);
+                for (struct cmsghdr* header = CMSG_FIRSTHDR(&message); nullptr != header;
+                        header = CMSG_NXTHDR(&message, header)) {
+
+                    if (SOL_IP != header->cmsg_level || IP_RECVERR != header->cmsg_type) {
+                        continue;
+                    }
+
+                    struct sock_extended_err error;
+                    std::memcpy(&error, CMSG_DATA(header), sizeof(error));
+                    if (SO_EE_ORIGIN_TIMESTAMPING != error.ee_origin) {
+                        continue;
+                    }
+
+                    // Numbers with no timestamp were dropped before reaching the device, the SYNs never went out
+                    while (!m_pendingTimestamps.empty() &&
+                            static_cast<int32_t>(m_pendingTimestamps.front().first - error.ee_data) < 0) {
+
+                        m_pendingTimestamps.pop_front();
+                    }
+
+                    if (!m_pendingTimestamps.empty() && error.ee_data == m_pendingTimestamps.front().first) {
+
+                        m_sentTimestamps[m_pendingTimestamps.front().second] = sent;
+                        m_pendingTimestamps.pop_front();
+                    }
+                }
+            }
+        }
+    }
+
+    PQ_LATENCY SYNEnvironment::takeLatency(const uint64_t key, const std::chrono::nanoseconds received) {
+
+        const auto sentIter = m_sentTimestamps.find(key);
+        if (m_sentTimestamps.end() == sentIter) {
+            return PQ_LATENCY::zero();
+        }
+
+        const std::chrono::nanoseconds sent = sentIter->second;
+        m_sentTimestamps.erase(sentIter);
+        if (std::chrono::nanoseconds::zero() == sent || received <= sent) {
+            return PQ_LATENCY::zero();
+        }
+
+        return std::chrono::duration_cast<PQ_LATENCY>(received - sent);
+    }
+
+    void SYNEnvironment::handleReply(const uint8_t* packet, const size_t length, const std::chrono::nanoseconds received) {
+
+        if (length < sizeof(struct iphdr)) {
+            return;
+        }
+
+        struct iphdr ipHeader;
+        std::memcpy(&ipHeader, packet, sizeof(ipHeader));
+        const size_t ipHeaderLength = ipHeader.ihl * 4;
+        if (IPPROTO_TCP != ipHeader.protocol || length < ipHeaderLength + sizeof(struct tcphdr)) {
+            return;
+        }
+
+        struct tcphdr tcpHeader;
+        std::memcpy(&tcpHeader, packet + ipHeaderLength, sizeof(tcpHeader));
+        if (m_sourcePort != ntohs(tcpHeader.dest) || !tcpHeader.ack) {
+            return;
+        }
+
+        // Every genuine reply acknowledges the cookie that was sent to that address and port
+        const uint32_t address = ntohl(ipHeader.saddr);
+        const uint16_t port = ntohs(tcpHeader.source);
+        if (computeCookie(address, port) + 1 != ntohl(tcpHeader.ack_seq)) {
+            return;
+        }
+
+        PQ_QUERY_RESULT result;
+        if (tcpHeader.rst) {
+            result = PQ_QUERY_RESULT::REJECTED;
+        }
+
+        else if (tcpHeader.syn) {
+            result = PQ_QUERY_RESULT::OPEN;
+        }
+
+        else {
+            return;
+        }
+
+        const auto timedIter = m_timedProbes.find(address);
+        if (m_timedProbes.end() != timedIter && timedIter->second.m_active && port == timedIter->second.m_port) {
+
+            addSample(address, Clock::now() - timedIter->second.m_sent);
+            timedIter->second.m_active = false;
+        }
+
+        // Retransmitted SYN-ACKs are dropped here
+        if (!markAnswered(address, port)) {
+            return;
+        }
+
+        m_governor.onReply();
+        const uint64_t key = getProbeKey(address, port);
+        PQ_LATENCY latency = m_measureLatency ? takeLatency(key, received) : PQ_LATENCY::zero();
+        if (0 != m_retransmitted.erase(key)) {
+
+            m_governor.onLoss(Clock::now());
+            latency = PQ_LATENCY::zero();
+        }
+
+        m_collector.addResult(ProbeResult{address, port, NetworkProtocol::TCP, result, latency});
+    }
+
+    void SYNEnvironment::scheduleDeadline(const Deadline& deadline) {
+
+        uint32_t index = static_cast<uint32_t>(m_deadlines.size());
+        if (m_freeDeadlines.empty()) {
+            m_deadlines.push_back(deadline);
+        }
+
+        else {
+
+            index = m_freeDeadlines.back();
+            m_freeDeadlines.pop_back();
+            m_deadlines[index] = deadline;
+        }
+
+        m_timers.schedule(deadline.m_sent + deadline.m_timeout, index);
+    }
+
+    bool SYNEnvironment::expireDeadlines(const Clock::time_point now) {
+
+        m_expired.clear();
+        m_timers.advance(now, m_expired);
+
+        bool expired = false;
+        for (const uint64_t index : m_expired) {
+
+            const Deadline deadline = m_deadlines[index];
+            m_freeDeadlines.push_back(static_cast<uint32_t>(index));
+            if (deadline.m_provisional && m_provisionalReplaced) {
+                continue;
+            }
+
+            // A timed probe which never came back can't be timed, let the next SYN to the host be timed instead
+            const auto timedIter = m_timedProbes.find(deadline.m_address);
+            if (m_timedProbes.end() != timedIter && deadline.m_port == timedIter->second.m_port) {
+                timedIter->second.m_active = false;
+            }
+
+            const auto pendingIter = m_pendingPorts.find(deadline.m_address);
+            const bool answered = m_pendingPorts.end() == pendingIter || !pendingIter->second[deadline.m_port];
+            if (!answered && 0 == deadline.m_attempt && deadline.m_timeout < m_estimator.getCeiling()) {
+
+                // The same cookie goes out again, so a late answer to the first SYN still counts
+                transmitSYN(deadline.m_address, deadline.m_port);
+                m_retransmitted.insert(getProbeKey(deadline.m_address, deadline.m_port));
+                const std::chrono::milliseconds timeout = std::min(deadline.m_timeout * 2, m_estimator.getCeiling());
+                scheduleDeadline(Deadline{now, timeout, deadline.m_address, deadline.m_port, 1, false});
+                continue;
+            }
+
+            if (markAnswered(deadline.m_address, deadline.m_port)) {
+
+                m_retransmitted.erase(getProbeKey(deadline.m_address, deadline.m_port));
+                m_sentTimestamps.erase(getProbeKey(deadline.m_address, deadline.m_port));
+                m_governor.onTimeout(now);
+                m_collector.addResult(ProbeResult{deadline.m_address, deadline.m_port, NetworkProtocol::TCP,
+                        PQ_QUERY_RESULT::CLOSED});
+                expired = true;
+            }
+        }
+
+        return expired;
+    }
+
+    int SYNEnvironment::getWaitTime(const Clock::time_point now, const Clock::time_point wakeup) const {
+
+        const Clock::time_point expiry = std::min(wakeup, m_timers.getNextExpiry());
+        if (Clock::time_point::max() == expiry) {
+            return -1;
+        }
+
+        const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(expiry - now);
+        return static_cast<int>(std::max<std::chrono::milliseconds::rep>(remaining.count(), 0));
+    }
+
+    bool SYNEnvironment::getNextScanResult(const bool blocking) {
+
+        ScanRow row;
+        while (!m_collector.popCompleted(row)) {
+
+            const bool received = receiveReplies();
+            if (expireDeadlines(Clock::now()) || received) {
+                continue;
+            }
+
+            else if (!blocking || 0 == m_outstanding) {
+                return false;
+            }
+
+            struct pollfd pollDescriptor = { getReceiveFD(), POLLIN, 0 };
+            if (-1 == ::poll(&pollDescriptor, 1, getWaitTime(Clock::now())) && EINTR != errno) {
+
+                throw std::system_error(errno, std::generic_category(), "Unable to wait on raw socket");
+            }
+        }
+
+        loadScanRow(row);
+        return true;
+    }
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <memory>
+#include <deque>
+#include <optional>
+#include <set>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "Environment.h"
+#include "PacketRing.h"
+#include "RTTEstimator.h"
+#include "RateGovernor.h"
+#include "TimingWheel.h"
+
+
+namespace PortQuery {
+
+    // An environment which performs half open scans. SYNs are crafted by hand and written to a raw socket, and
+    // replies are read back off of the same socket. A SYN-ACK maps to OPEN, a RST maps to REJECTED and silence
+    // maps to CLOSED. The handshake is never completed, the kernel answers the SYN-ACK with a reset on its own.
+    //
+    // No state is kept for validating replies. The sequence number of every SYN is a keyed hash of the target
+    // address, target port and source port, so a reply is genuine if it acknowledges that hash plus one.
+    //
+    // Timeouts come from the round trip times seen so far (see RTTEstimator). Only one SYN per host is timed at
+    // once, the same way TCP times one segment per round trip. A port which times out is sent one more SYN with
+    // double the timeout before it is reported as closed.
+    //
+    // SYNs go out as fast as a RateGovernor allows, an answer to a retransmitted SYN counts as a lost probe.
+    //
+    // A classic BPF program on the receiving socket drops everything which isn't a TCP segment from a target to the
+    // source port in the kernel, so the scanner is only woken for replies. It lets through the span of addresses
+    // covering every chunk of targets the sweep hasn't handed back yet, so it is rebuilt about once a chunk rather
+    // than for every SYN, and a chunk still finishing up keeps getting its replies while the next one starts.
+    // A target outside of every chunk widens the span to take it in.
+    //
+    // Replies are read off of the raw socket one at a time by default. With the receive ring enabled they are
+    // read in blocks out of a PacketRing instead, and the raw socket is only used for sending.
+    //
+    // When asked to measure latency, the kernel timestamps every SYN as the device takes it and every reply as it
+    // comes in, the latency is the difference between the two. Timestamps for SYNs come back in batches on the raw
+    // socket's error queue. Answers to a retransmitted SYN aren't timed, there's no telling which SYN they answer.
+    //
+    // Requires CAP_NET_RAW.
+    class SYNEnvironment : public IEnvironment {
+
+        public:
+
+            using Clock = std::chrono::steady_clock;
+
+            SYNEnvironment(const int threadCount);
+            ~SYNEnvironment();
+
+            virtual bool scanPort(void) override;
+            virtual bool getNextScanResult(const bool blocking) override;
+            virtual void setTimeout(const int timeout) override;
+            virtual void setMaxRate(const double rate) override;
+            virtual void setReceiveRing(const bool enabled) override;
+            virtual void setMeasureLatency(const bool enabled) override;
+            virtual void addTargets(const std::vector<uint32_t>& targets) override;
+            virtual void releaseTargets(const std::vector<uint32_t>& targets) override;
+
+        private:
+
+            static constexpr int RECEIVE_BUFFER_SIZE = 1 << 22;
+
+            // Nothing is kept per SYN other than a deadline, so the window can be much larger than for connects
+            static constexpr size_t MAX_WINDOW = 1 << 16;
+
+            // The number of send timestamps read off of the error queue with a single system call
+            static constexpr size_t TIMESTAMP_BATCH_SIZE = 64;
+
+            struct Deadline {
+
+                Clock::time_point m_sent;
+                std::chrono::milliseconds m_timeout;
+                uint32_t m_address;
+                uint16_t m_port;
+                uint8_t m_attempt;
+
+                // Set if the SYN went out before there was any RTT estimate, so it was given the ceiling
+                bool m_provisional;
+            };
+
+            struct TimedProbe {
+
+                uint16_t m_port;
+                Clock::time_point m_sent;
+                bool m_active = false;
+            };
+
+            uint32_t computeCookie(const uint32_t address, const uint16_t port) const;
+            uint32_t getSourceAddress(const uint32_t address);
+            void sendSYN(const uint32_t address, const uint16_t port);
+
+            // Handles replies and timeouts until the governor lets another SYN go out
+            void waitToSend(void);
+            void transmitSYN(const uint32_t address, const uint16_t port);
+            bool receiveReplies(void);
+
+            // The descriptor replies arrive on, the ring's if there is one
+            int getReceiveFD(void) const;
+            // Rebuilds the filter if it doesn't cover the chunks (and the address, if one is given) or is for other
+            // protocols
+            void updateReplyFilter(const NetworkProtocol protocols, const std::optional<uint32_t> address=std::nullopt);
+            void handleReply(const uint8_t* packet, const size_t length, const std::chrono::nanoseconds received);
+
+            // Matches the send timestamps the kernel has queued up with the SYNs they belong to
+            void receiveSendTimestamps(void);
+
+            // The time between the last SYN sent to a port and a reply received at the given time, zero if the SYN
+            // was never timestamped. Forgets the SYN either way
+            PQ_LATENCY takeLatency(const uint64_t key, const std::chrono::nanoseconds received);
+            void scheduleDeadline(const Deadline& deadline);
+            bool expireDeadlines(const Clock::time_point now);
+            void addSample(const uint32_t address, const Clock::duration rtt);
+            int getWaitTime(const Clock::time_point now, const Clock::time_point wakeup=Clock::time_point::max()) const;
+
+            // Records that an answer was seen for a port, returns false if it wasn't waiting on one (it had
+            // already been answered, or the host has been released since)
+            bool markAnswered(const uint32_t address, const uint16_t port);
+
+            int m_rawFD;
+            std::unique_ptr<PacketRing> m_ring;
+
+            // What the filter on the receiving socket currently lets through
+            bool m_filterValid;
+            uint32_t m_filterFirst;
+            uint32_t m_filterLast;
+            NetworkProtocol m_filterProtocols;
+
+            // The lowest and highest address of every chunk handed over and not yet handed back
+            std::multiset<uint32_t> m_chunkFirsts;
+            std::multiset<uint32_t> m_chunkLasts;
+
+            // A regular socket is bound to the source port, this keeps the kernel from handing the port out
+            // to someone else while the scan is running
+            int m_reservationFD;
+            uint16_t m_sourcePort;
+
+            // The key for the cookie hash, chosen at random for every environment
+            uint64_t m_key[2];
+
+            // Everything kept per host is dropped once the sweep releases the host, there are never more than a
+            // few chunks' worth of them. Deadlines for a released host's ports can still be in the wheel, so ports
+            // are marked while they wait on an answer rather than once they have one
+            std::unordered_map<uint32_t, uint32_t> m_sourceAddresses;
+
+            // A bit per port for every host being scanned, set while the port is waiting on an answer
+            std::unordered_map<uint32_t, std::vector<bool>> m_pendingPorts;
+            size_t m_outstanding;
+
+            // The wheel hands back an index into the deadlines, free entries are reused before it grows
+            TimingWheel m_timers;
+            std::vector<Deadline> m_deadlines;
+            std::vector<uint32_t> m_freeDeadlines;
+            std::vector<uint64_t> m_expired;
+
+            std::unordered_map<uint32_t, TimedProbe> m_timedProbes;
+            RTTEstimator m_estimator;
+
+            // Once the first sample comes in, every provisional deadline is replaced by one based on the estimate
+            // and the originals are skipped when they expire
+            std::vector<Deadline> m_provisionalDeadlines;
+            bool m_provisionalReplaced;
+
+            RateGovernor m_governor;
+
+            // The ports (keyed the same way as results are) which have been sent a second SYN
+            std::unordered_set<uint64_t> m_retransmitted;
+
+            // The kernel numbers send timestamps in the order the SYNs went out. These are the number the next SYN
+            // will get, the port (keyed the same way as results are) every number still expected belongs to, and the
+            // send time of every port which is still waiting on an answer. Times are CLOCK_REALTIME, as the kernel
+            // stamps them
+            bool m_measureLatency;
+            uint32_t m_nextTimestampID;
+            std::deque<std::pair<uint32_t, uint64_t>> m_pendingTimestamps;
+            std::unordered_map<uint64_t, std::chrono::nanoseconds> m_sentTimestamps;
+
+            ResultCollector m_collector;
+            int m_threadCount;
+    };
+}
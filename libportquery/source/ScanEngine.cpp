@@ -0,0 +1,1065 @@
+#include <system_error>
+#include <algorithm>
+#include <cerrno>
+
+#include <linux/errqueue.h>
+#include <netinet/ip_icmp.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "ScanEngine.h"
+#include "UDPPayloads.h"
+
+
+namespace PortQuery {
+
+    static PQ_QUERY_RESULT getResultFromError(const int error) {
+
+        switch (error) {
+            case 0:
+                return PQ_QUERY_RESULT::OPEN;
+            case ECONNREFUSED:
+                return PQ_QUERY_RESULT::REJECTED;
+            default:
+                // unreachable hosts, timeouts signaled by the kernel, etc. all look the same as silence
+                return PQ_QUERY_RESULT::CLOSED;
+        }
+    }
+
+    // Translates a message read off of a socket's error queue into a result
+    static PQ_QUERY_RESULT getResultFromErrorMessage(struct msghdr& message) {
+
+        PQ_QUERY_RESULT result = PQ_QUERY_RESULT::CLOSED;
+        for (struct cmsghdr* header = CMSG_FIRSTHDR(&message); nullptr != header; header = CMSG_NXTHDR(&message, header)) {
+
+            if (SOL_IP != header->cmsg_level || IP_RECVERR != header->cmsg_type) {
+                continue;
+            }
+
+            // Only port unreachable means something is there refusing the datagram, host unreachable, admin
+            // prohibited and friends mean the probe was filtered somewhere along the way
+            const struct sock_extended_err* error = reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(header));
+            if (SO_EE_ORIGIN_ICMP == error->ee_origin && ICMP_DEST_UNREACH == error->ee_type &&
+                    ICMP_PORT_UNREACH == error->ee_code) {
+
+                result = PQ_QUERY_RESULT::REJECTED;
+            }
+        }
+
+        return result;
+    }
+
+    // With IP_RECVERR set, every ICMP error is also left pending on the socket and handed to whichever call comes
+    // next, sends included. These say nothing about the call itself, the error is on the error queue as well
+    static bool isPendingICMPError(const int error) {
+
+        return ECONNREFUSED == error || EHOSTUNREACH == error || ENETUNREACH == error || EHOSTDOWN == error ||
+            ENOPROTOOPT == error || EPROTO == error || EACCES == error || EMSGSIZE == error;
+    }
+
+    static uint64_t getProbeKey(const uint32_t address, const uint16_t port) {
+
+        return (static_cast<uint64_t>(address) << 16) | port;
+    }
+
+
+    ScanEngine::ScanEngine(const size_t maxInFlight, const size_t shares) : m_UDPFD(-1),
+        m_descriptorLimit(raiseDescriptorLimit()), m_descriptorStalls(0), m_nextSource(0),
+        m_ephemeralPorts(getEphemeralPortCount() / std::max<size_t>(shares, 1)),
+        m_portLimit(m_ephemeralPorts), m_portStallLimit(0), m_portsInUse(0), m_peakPortsInUse(0), m_portStalls(0),
+        m_measureLatency(false), m_bannerPool(nullptr), m_bannerWait(0), m_governor(0), m_sendPending(false),
+        m_queuedCount(0), m_provisionalCount(0), m_submissions(0) {
+
+        const size_t windowSize = getWindowSize(maxInFlight, m_descriptorLimit, shares);
+        m_governor = RateGovernor(windowSize);
+        m_probes.resize(windowSize);
+        setBurstSize(BURST_SIZE_DEFAULT);
+
+        m_epollFD = epoll_create1(EPOLL_CLOEXEC);
+        if (-1 == m_epollFD) {
+
+            throw std::system_error(errno, std::generic_category(), "Unable to create epoll instance");
+        }
+
+        // Hand out the lowest slots first, purely cosmetic but it makes debugging easier
+        m_freeSlots.reserve(m_probes.size());
+        m_socketPool.reserve(m_probes.size());
+        for (size_t slot = m_probes.size(); slot > 0; slot--) {
+
+            m_freeSlots.push_back(slot - 1);
+            m_probes[slot - 1].m_fd = -1;
+            m_probes[slot - 1].m_provisional = false;
+            m_probes[slot - 1].m_holdsPort = false;
+            m_probes[slot - 1].m_waitingForPort = false;
+            m_probes[slot - 1].m_generation = 0;
+            m_probes[slot - 1].m_timer = TimingWheel::INVALID_HANDLE;
+            m_probes[slot - 1].m_banner = BufferPool::INVALID_HANDLE;
+            m_probes[slot - 1].m_readingBanner = false;
+        }
+    }
+
+    ScanEngine::~ScanEngine() {
+
+        for (auto& probe : m_probes) {
+
+            if (-1 != probe.m_fd && m_UDPFD != probe.m_fd) {
+                close(probe.m_fd);
+            }
+        }
+
+        for (const int fd : m_socketPool) {
+            close(fd);
+        }
+
+        if (-1 != m_UDPFD) {
+            close(m_UDPFD);
+        }
+
+        close(m_epollFD);
+    }
+
+    size_t ScanEngine::getWindowSize(const size_t maxInFlight, const size_t descriptorLimit, const size_t shares) {
+
+        // An unknown limit is left for openSlot to run into
+        if (0 == descriptorLimit) {
+            return maxInFlight;
+        }
+
+        const size_t available = descriptorLimit - std::min(descriptorLimit, RESERVED_DESCRIPTORS);
+        return std::max<size_t>(1, std::min(maxInFlight, available / std::max<size_t>(shares, 1)));
+    }
+
+    PQ_SCAN_STATS ScanEngine::getStatistics(void) const {
+
+        return PQ_SCAN_STATS{m_probes.size(), m_descriptorLimit, m_descriptorStalls, m_portLimit, m_peakPortsInUse,
+            m_portStalls};
+    }
+
+    void ScanEngine::setTimeout(const std::chrono::milliseconds timeout) {
+
+        m_estimator.setCeiling(timeout);
+    }
+
+    void ScanEngine::setMaxRate(const double rate) {
+
+        m_governor.setMaxRate(rate);
+    }
+
+    void ScanEngine::setBurstSize(const size_t burstSize) {
+
+        flushSendBatch();
+        m_burstSize = std::max<size_t>(burstSize, 1);
+        m_messages.resize(m_burstSize);
+        m_vectors.resize(m_burstSize);
+        m_addresses.resize(m_burstSize);
+
+        m_receiveBuffer.resize(m_burstSize * RECEIVE_SLOT_SIZE);
+        m_controlBuffer.resize(m_burstSize * CONTROL_SLOT_SIZE);
+    }
+
+    void ScanEngine::addSourceAddress(const uint32_t address) {
+
+        m_sourceAddresses.push_back(address);
+        m_portLimit = m_ephemeralPorts * m_sourceAddresses.size();
+        m_portStallLimit = 0;
+    }
+
+    size_t ScanEngine::getInFlight(void) const {
+
+        return getActiveProbes() + m_queuedCount;
+    }
+
+    size_t ScanEngine::getActiveProbes(void) const {
+
+        return m_probes.size() - m_freeSlots.size();
+    }
+
+    void ScanEngine::setMeasureLatency(const bool enabled) {
+
+        m_measureLatency = enabled;
+    }
+
+    void ScanEngine::setBannerCapture(BufferPool* const pool, const std::chrono::milliseconds wait) {
+
+        m_bannerPool = pool;
+        m_bannerWait = wait;
+    }
+
+    bool ScanEngine::isRateLimited(const uint32_t address) const {
+
+        const auto hostIter = m_UDPHosts.find(address);
+        return m_UDPHosts.end() != hostIter && hostIter->second.m_rateLimited;
+    }
+
+    void ScanEngine::forgetHost(const uint32_t address) {
+
+        m_estimator.forgetHost(address);
+        const auto hostIter = m_UDPHosts.find(address);
+        if (m_UDPHosts.end() == hostIter) {
+            return;
+        }
+
+        if (hostIter->second.m_rateLimited) {
+            m_rateLimitedHosts.erase(std::find(m_rateLimitedHosts.begin(), m_rateLimitedHosts.end(), address));
+        }
+
+        m_UDPHosts.erase(hostIter);
+    }
+
+    bool ScanEngine::popResult(ProbeResult& result) {
+
+        if (m_results.empty()) {
+            return false;
+        }
+
+        result = m_results.front();
+        m_results.pop_front();
+        return true;
+    }
+
+    bool ScanEngine::openSlot(const int type, uint32_t& slot) {
+
+        if (SOCK_DGRAM == type && -1 == m_UDPFD) {
+
+            // Created the first time it is needed, a TCP only scan never pays for it
+            const int enable = 1;
+            m_UDPFD = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            struct epoll_event event = { };
+            event.events = EPOLLIN;
+            event.data.u64 = makeEventData(UDP_SOCKET_EVENT, 0);
+            if (-1 == m_UDPFD || -1 == setsockopt(m_UDPFD, SOL_IP, IP_RECVERR, &enable, sizeof(enable)) ||
+                    -1 == epoll_ctl(m_epollFD, EPOLL_CTL_ADD, m_UDPFD, &event)) {
+
+                throw std::system_error(errno, std::generic_category(), "Unable to create UDP probe socket");
+            }
+
+            // Replies to a whole sweep can land between two polls, forcing the size needs CAP_NET_ADMIN
+            if (-1 == setsockopt(m_UDPFD, SOL_SOCKET, SO_RCVBUFFORCE, &RECEIVE_BUFFER_SIZE, sizeof(RECEIVE_BUFFER_SIZE))) {
+                setsockopt(m_UDPFD, SOL_SOCKET, SO_RCVBUF, &RECEIVE_BUFFER_SIZE, sizeof(RECEIVE_BUFFER_SIZE));
+            }
+        }
+
+        // Every port connects are holding on to is in use by a probe in flight, one of those has to finish first
+        const size_t portLimit = 0 != m_portStallLimit ? m_portStallLimit : m_portLimit;
+        if (SOCK_STREAM == type && 0 != portLimit && m_portsInUse >= portLimit) {
+
+            m_portStalls++;
+            return false;
+        }
+
+        int fd = m_UDPFD;
+        if (SOCK_STREAM == type && !m_socketPool.empty()) {
+
+            fd = m_socketPool.back();
+            m_socketPool.pop_back();
+        }
+
+        else if (SOCK_STREAM == type) {
+            fd = createTCPSocket();
+        }
+
+        if (-1 == fd) {
+
+            // Running out of descriptors is only fatal if there is nothing in flight that could give one back
+            if ((EMFILE != errno && ENFILE != errno) || m_freeSlots.size() == m_probes.size()) {
+                throw std::system_error(errno, std::generic_category(), "Unable to create probe socket");
+            }
+
+            m_descriptorStalls++;
+            return false;
+        }
+
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+
+        Probe& probe = m_probes[slot];
+        probe.m_fd = fd;
+        probe.m_protocol = SOCK_STREAM == type ? NetworkProtocol::TCP : NetworkProtocol::UDP;
+        probe.m_generation++;
+        return true;
+    }
+
+    uint32_t ScanEngine::acquireSlot(const int type) {
+
+        uint32_t slot = 0;
+        m_sendPending = true;
+        for (bool opened = false; !opened;) {
+
+            if (!m_freeSlots.empty() && m_governor.tryAcquire(Clock::now(), getActiveProbes())) {
+
+                // Nothing goes out while the process is short of descriptors or local ports, so the token goes
+                // back rather than those stalls holding the rate down as well
+                opened = openSlot(type, slot);
+                if (!opened) {
+                    m_governor.release();
+                }
+            }
+
+            if (!opened) {
+                poll(true);
+            }
+        }
+
+        m_sendPending = false;
+        return slot;
+    }
+
+    void ScanEngine::releaseSlot(const uint32_t slot) {
+
+        Probe& probe = m_probes[slot];
+        if (m_UDPFD == probe.m_fd) {
+
+            const auto probeIter = m_UDPProbes.find(getProbeKey(probe.m_address, probe.m_port));
+            if (m_UDPProbes.end() != probeIter && slot == probeIter->second) {
+                m_UDPProbes.erase(probeIter);
+            }
+        }
+
+        else if (recycleSocket(probe.m_fd)) {
+            m_socketPool.push_back(probe.m_fd);
+        }
+
+        releasePort(probe);
+        probe.m_waitingForPort = false;
+        probe.m_readingBanner = false;
+        if (BufferPool::INVALID_HANDLE != probe.m_banner) {
+
+            m_bannerPool->release(probe.m_banner);
+            probe.m_banner = BufferPool::INVALID_HANDLE;
+        }
+
+        if (TimingWheel::INVALID_HANDLE != probe.m_timer) {
+
+            m_timers.cancel(probe.m_timer);
+            probe.m_timer = TimingWheel::INVALID_HANDLE;
+        }
+
+        probe.m_fd = -1;
+        if (probe.m_provisional) {
+
+            probe.m_provisional = false;
+            m_provisionalCount--;
+        }
+        m_freeSlots.push_back(slot);
+    }
+
+    bool ScanEngine::recycleSocket(const int fd) {
+
+        // Disconnecting aborts a handshake which is still going and resets a connection which was made, either way
+        // the socket is left unbound and can connect again. The reset leaves an error pending, which would
+        // otherwise be reported for the next connect
+        const struct sockaddr unspecified = { AF_UNSPEC, { } };
+        int error = 0;
+        socklen_t errorLength = sizeof(error);
+        if (-1 == connect(fd, &unspecified, sizeof(unspecified)) ||
+                -1 == getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &errorLength)) {
+
+            // Closing the descriptor also removes it from the epoll set
+            close(fd);
+            return false;
+        }
+
+        return true;
+    }
+
+    int ScanEngine::createTCPSocket(void) {
+
+        const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (-1 == fd) {
+            return -1;
+        }
+
+        // Recycled sockets stay bound to their address, so the source addresses only take turns on new ones
+        uint32_t source = INADDR_ANY;
+        if (!m_sourceAddresses.empty()) {
+            source = m_sourceAddresses[m_nextSource++ % m_sourceAddresses.size()];
+        }
+
+        if (!prepareConnectSocket(fd, source)) {
+
+            const int error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), "Unable to set up probe socket from " + 
+                    formatIPv4Address(source));
+        }
+
+        return fd;
+    }
+
+    void ScanEngine::releasePort(Probe& probe) {
+
+        if (probe.m_holdsPort) {
+
+            probe.m_holdsPort = false;
+            m_portsInUse--;
+            m_portStallLimit = 0;
+        }
+    }
+
+    void ScanEngine::prepareProbe(const uint32_t slot, const uint32_t address, const uint16_t port, 
+            const uint8_t attempt, const bool paced) {
+
+        Probe& probe = m_probes[slot];
+        probe.m_address = address;
+        probe.m_port = port;
+        probe.m_attempt = attempt;
+        probe.m_paced = paced;
+        probe.m_latency = PQ_LATENCY::zero();
+        probe.m_timeout = m_estimator.getTimeout(address);
+        probe.m_provisional = !m_estimator.hasSamples();
+        m_provisionalCount += probe.m_provisional ? 1 : 0;
+    }
+
+    void ScanEngine::addSample(const uint32_t slot) {
+
+        const Probe& probe = m_probes[slot];
+        const Clock::time_point now = Clock::now();
+        m_estimator.addSample(probe.m_address, now - probe.m_sent);
+        m_governor.addRTTSample(now - probe.m_sent);
+        m_governor.onReply();
+
+        // An answer to a retry means the first probe (or its answer) went missing. Paced probes are the exception,
+        // those were held back by the host's ICMP rate limit rather than lost along the way
+        if (probe.m_attempt > 0 && !probe.m_paced) {
+            m_governor.onLoss(now);
+        }
+
+        if (0 == m_provisionalCount) {
+            return;
+        }
+
+        // Everything sent before the first answer came back is waiting on the ceiling, move them up to the estimate
+        for (uint32_t index = 0; index < m_probes.size(); index++) {
+
+            Probe& provisional = m_probes[index];
+            if (-1 == provisional.m_fd || !provisional.m_provisional) {
+                continue;
+            }
+
+            provisional.m_provisional = false;
+            provisional.m_timeout = m_estimator.getTimeout(provisional.m_address);
+            if (TimingWheel::INVALID_HANDLE != provisional.m_timer && !provisional.m_waitingForPort &&
+                    !provisional.m_readingBanner) {
+                scheduleDeadline(index, provisional.m_sent + provisional.m_timeout);
+            }
+        }
+
+        m_provisionalCount = 0;
+    }
+
+    void ScanEngine::watchProbe(const uint32_t slot, const uint32_t events) {
+
+        armProbe(slot, events);
+        Probe& probe = m_probes[slot];
+        probe.m_sent = Clock::now();
+        scheduleDeadline(slot, probe.m_sent + probe.m_timeout);
+    }
+
+    void ScanEngine::armProbe(const uint32_t slot, const uint32_t events) {
+
+        // Sockets stay registered between probes, only a brand new one has to be added. One shot keeps a socket
+        // which is sitting in the pool from reporting anything until it is armed again
+        Probe& probe = m_probes[slot];
+        struct epoll_event event = { };
+        event.events = events | EPOLLONESHOT;
+        event.data.u64 = makeEventData(slot, probe.m_generation);
+        if (-1 == epoll_ctl(m_epollFD, EPOLL_CTL_MOD, probe.m_fd, &event) &&
+                (ENOENT != errno || -1 == epoll_ctl(m_epollFD, EPOLL_CTL_ADD, probe.m_fd, &event))) {
+
+            const int error = errno;
+            completeProbe(slot, PQ_QUERY_RESULT::CLOSED);
+            throw std::system_error(error, std::generic_category(), "Unable to register probe with epoll");
+        }
+    }
+
+    void ScanEngine::pollPeriodically(void) {
+
+        if (0 == ++m_submissions % SUBMISSIONS_PER_POLL) {
+            poll(false);
+        }
+    }
+
+    void ScanEngine::submitTCPProbe(const uint32_t address, const uint16_t port) {
+
+        const uint32_t slot = acquireSlot(SOCK_STREAM);
+        prepareProbe(slot, address, port, 0, false);
+        startTCPProbe(slot);
+        pollPeriodically();
+    }
+
+    void ScanEngine::startTCPProbe(const uint32_t slot) {
+
+        Probe& probe = m_probes[slot];
+        const sockaddr_in target = makeSocketAddress(probe.m_address, probe.m_port);
+        const int result = connect(probe.m_fd, reinterpret_cast<const sockaddr*>(&target), sizeof(target));
+        if (-1 == result && EADDRNOTAVAIL == errno && m_portsInUse > 0) {
+
+            // Something other than this scan is holding ports too, hold off on new connects until one of ours is
+            // handed back (whoever else has them may have let go by then as well) and try this one again
+            m_portStalls++;
+            m_portStallLimit = m_portsInUse;
+            probe.m_waitingForPort = true;
+            scheduleDeadline(slot, Clock::now() + PORT_RETRY_DELAY);
+            return;
+        }
+
+        else if (-1 == result && EINPROGRESS != errno) {
+
+            completeProbe(slot, getResultFromError(errno));
+            return;
+        }
+
+        probe.m_holdsPort = true;
+        m_portsInUse++;
+        m_peakPortsInUse = std::max(m_peakPortsInUse, m_portsInUse);
+        if (0 == result) {
+
+            // This can happen when connecting over loopback
+            completeConnect(slot, 0);
+            return;
+        }
+
+        watchProbe(slot, EPOLLOUT);
+    }
+
+    void ScanEngine::submitUDPProbe(const uint32_t address, const uint16_t port) {
+
+        UDPHost& host = m_UDPHosts[address];
+        if (Clock::time_point() == host.m_firstProbe) {
+            host.m_firstProbe = Clock::now();
+        }
+
+        if (!host.m_rateLimited) {
+
+            const uint32_t slot = acquireSlot(SOCK_DGRAM);
+            prepareProbe(slot, address, port, 0, false);
+            startUDPProbe(slot);
+            pollPeriodically();
+            return;
+        }
+
+        host.m_queued.push_back(QueuedProbe{port, 0});
+        m_queuedCount++;
+
+        // The queue is what keeps the caller from racing ahead of the pacing, without this every port for
+        // the host would be queued up immediately
+        while (m_queuedCount > m_probes.size()) {
+
+            poll(true);
+        }
+    }
+
+    void ScanEngine::startUDPProbe(const uint32_t slot) {
+
+        m_sendBatch.push_back(slot);
+        if (m_sendBatch.size() >= m_burstSize) {
+            flushSendBatch();
+        }
+    }
+
+    void ScanEngine::flushSendBatch(void) {
+
+        for (size_t start = 0; start < m_sendBatch.size(); start += m_burstSize) {
+
+            const size_t count = std::min(m_sendBatch.size() - start, m_burstSize);
+            for (size_t index = 0; index < count; index++) {
+
+                const Probe& probe = m_probes[m_sendBatch[start + index]];
+                const std::string_view payload = getUDPPayload(probe.m_port);
+                m_addresses[index] = makeSocketAddress(probe.m_address, probe.m_port);
+                m_vectors[index] = iovec{const_cast<char*>(payload.data()), payload.size()};
+                m_messages[index] = { };
+                m_messages[index].msg_hdr.msg_name = &m_addresses[index];
+                m_messages[index].msg_hdr.msg_namelen = sizeof(m_addresses[index]);
+                m_messages[index].msg_hdr.msg_iov = &m_vectors[index];
+                m_messages[index].msg_hdr.msg_iovlen = 1;
+            }
+
+            // A call stops short at the first datagram which fails, the rest of the burst goes out with the next
+            size_t offset = 0;
+            bool retried = false;
+            while (offset < count) {
+
+                const int sent = sendmmsg(m_UDPFD, m_messages.data() + offset, static_cast<unsigned int>(count - offset), 0);
+                if (sent > 0) {
+
+                    for (size_t index = offset; index < offset + sent; index++) {
+
+                        // Only a probe which is out can be answered, until then a late answer to an earlier
+                        // probe of the same port can't be mistaken for this one
+                        const uint32_t slot = m_sendBatch[start + index];
+                        Probe& probe = m_probes[slot];
+                        probe.m_sent = Clock::now();
+                        m_UDPProbes[getProbeKey(probe.m_address, probe.m_port)] = slot;
+                        scheduleDeadline(slot, probe.m_sent + probe.m_timeout);
+                    }
+
+                    offset += sent;
+                    retried = false;
+                    continue;
+                }
+
+                // The send buffer is full, give it a moment to drain
+                else if (EAGAIN == errno || ENOBUFS == errno) {
+
+                    struct pollfd pollDescriptor = { m_UDPFD, POLLOUT, 0 };
+                    ::poll(&pollDescriptor, 1, 1);
+                    continue;
+                }
+
+                // The first failure might be an error left over from an earlier probe, a second one in a row
+                // belongs to the datagram itself. That probe never made it out
+                else if (EINTR == errno || (!retried && isPendingICMPError(errno))) {
+
+                    retried = EINTR != errno;
+                    continue;
+                }
+
+                completeProbe(m_sendBatch[start + offset], PQ_QUERY_RESULT::CLOSED);
+                offset++;
+                retried = false;
+            }
+        }
+
+        m_sendBatch.clear();
+    }
+
+    bool ScanEngine::retryProbe(const uint32_t slot) {
+
+        Probe& probe = m_probes[slot];
+        if (probe.m_attempt > 0 || probe.m_timeout >= m_estimator.getCeiling()) {
+            return false;
+        }
+
+        // Disconnecting stops the kernel retransmitting the first SYN, and the next connect goes out from a new
+        // source port. UDP probes all go out of the same socket, there is nothing to replace
+        if (NetworkProtocol::UDP == probe.m_protocol) {
+
+            // Until the datagram is sent again, an answer to the first one has nothing to complete
+            m_UDPProbes.erase(getProbeKey(probe.m_address, probe.m_port));
+        }
+
+        else if (!recycleSocket(probe.m_fd)) {
+
+            // The old socket was closed, if a new one can't be had the probe is completed without it
+            releasePort(probe);
+            probe.m_fd = createTCPSocket();
+            if (-1 == probe.m_fd) {
+                return false;
+            }
+        }
+
+        releasePort(probe);
+
+        probe.m_generation++;
+        probe.m_attempt++;
+        probe.m_timeout = std::min(probe.m_timeout * 2, m_estimator.getCeiling());
+
+        if (NetworkProtocol::TCP == probe.m_protocol) {
+            startTCPProbe(slot);
+        }
+
+        else {
+            startUDPProbe(slot);
+        }
+
+        return true;
+    }
+
+    void ScanEngine::dispatchQueuedProbes(const Clock::time_point now) {
+
+        for (const uint32_t address : m_rateLimitedHosts) {
+
+            UDPHost& host = m_UDPHosts[address];
+            while (!host.m_queued.empty() && !m_freeSlots.empty() && host.m_pacer.tryConsume(now) &&
+                    m_governor.tryAcquire(now, getActiveProbes())) {
+
+                uint32_t slot = 0;
+                if (!openSlot(SOCK_DGRAM, slot)) {
+                    return;
+                }
+
+                const QueuedProbe queued = host.m_queued.front();
+                host.m_queued.pop_front();
+                m_queuedCount--;
+                prepareProbe(slot, address, queued.m_port, queued.m_attempt, true);
+                startUDPProbe(slot);
+            }
+        }
+    }
+
+    void ScanEngine::poll(const bool blocking) {
+
+        // With nothing in flight the only thing worth waiting on is the governor
+        if (0 == getInFlight() && !(blocking && m_sendPending)) {
+            return;
+        }
+
+        // Datagrams waiting on a full burst have to go out before there is any point in waiting on their answers
+        flushSendBatch();
+
+        // Everything which is ready gets handled before any deadlines are looked at, otherwise a busy reactor
+        // would time out probes whose answers are sitting in the ready list
+        struct epoll_event events[MAX_EVENTS];
+        int waitTime = blocking ? getWaitTime(Clock::now()) : 0;
+        int eventCount = MAX_EVENTS;
+        while (MAX_EVENTS == eventCount) {
+
+            eventCount = epoll_wait(m_epollFD, events, MAX_EVENTS, waitTime);
+            if (-1 == eventCount && EINTR != errno) {
+
+                throw std::system_error(errno, std::generic_category(), "Unable to wait on epoll instance");
+            }
+
+            for (int index = 0; index < eventCount; index++) {
+
+                // A socket which was disconnected while still armed reports it, by then the slot has moved on
+                const uint32_t slot = static_cast<uint32_t>(events[index].data.u64);
+                const uint32_t generation = static_cast<uint32_t>(events[index].data.u64 >> 32);
+                if (UDP_SOCKET_EVENT == slot || (-1 != m_probes[slot].m_fd && generation == m_probes[slot].m_generation)) {
+                    handleEvent(slot, events[index].events);
+                }
+            }
+
+            waitTime = 0;
+        }
+
+        const Clock::time_point now = Clock::now();
+        expireDeadlines(now);
+        dispatchQueuedProbes(now);
+        flushSendBatch();
+    }
+
+    int ScanEngine::getWaitTime(const Clock::time_point now) {
+
+        Clock::time_point wakeup = m_timers.getNextExpiry();
+
+        // Waking up for a paced host (or the governor) is pointless if there is no slot to send the probe from
+        if (!m_freeSlots.empty()) {
+
+            const Clock::time_point nextSend = m_governor.getNextSend(now, getActiveProbes());
+            if (m_sendPending) {
+                wakeup = std::min(wakeup, nextSend);
+            }
+
+            for (const uint32_t address : m_rateLimitedHosts) {
+
+                UDPHost& host = m_UDPHosts[address];
+                if (!host.m_queued.empty()) {
+                    wakeup = std::min(wakeup, std::max(nextSend, host.m_pacer.getNextAvailable(now)));
+                }
+            }
+        }
+
+        if (Clock::time_point::max() == wakeup) {
+            return -1;
+        }
+
+        const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(wakeup - now);
+        return static_cast<int>(std::max<std::chrono::milliseconds::rep>(remaining.count(), 0));
+    }
+
+    void ScanEngine::handleEvent(const uint32_t slot, const uint32_t events) {
+
+        if (UDP_SOCKET_EVENT == slot) {
+
+            if (events & EPOLLERR) {
+                receiveUDPErrors();
+            }
+
+            receiveUDPReplies();
+            return;
+        }
+
+        else if (m_probes[slot].m_readingBanner) {
+
+            readBanner(slot);
+            return;
+        }
+
+        int error = 0;
+        socklen_t errorLength = sizeof(error);
+        if (-1 == getsockopt(m_probes[slot].m_fd, SOL_SOCKET, SO_ERROR, &error, &errorLength)) {
+
+            error = errno;
+        }
+
+        // Both a handshake and a reset took exactly one round trip
+        if (0 == error || ECONNREFUSED == error) {
+            addSample(slot);
+        }
+
+        completeConnect(slot, error);
+    }
+
+    uint32_t ScanEngine::findUDPProbe(const sockaddr_in& target) const {
+
+        const auto probeIter = m_UDPProbes.find(getProbeKey(ntohl(target.sin_addr.s_addr), ntohs(target.sin_port)));
+        return m_UDPProbes.end() == probeIter ? UDP_SOCKET_EVENT : probeIter->second;
+    }
+
+    void ScanEngine::receiveUDPErrors(void) {
+
+        int received = static_cast<int>(m_burstSize);
+        while (static_cast<size_t>(received) == m_burstSize) {
+
+            // Errors come with the address the datagram which caused them was sent to, not where they came from
+            prepareReceiveBatch(true);
+            received = recvmmsg(m_UDPFD, m_messages.data(), static_cast<unsigned int>(m_burstSize),
+                    MSG_ERRQUEUE | MSG_DONTWAIT, nullptr);
+
+            for (int index = 0; index < received; index++) {
+
+                const uint32_t slot = findUDPProbe(m_addresses[index]);
+                if (UDP_SOCKET_EVENT == slot) {
+                    continue;
+                }
+
+                recordICMPError(m_probes[slot].m_address);
+                addSample(slot);
+                completeProbe(slot, getResultFromErrorMessage(m_messages[index].msg_hdr));
+            }
+        }
+    }
+
+    void ScanEngine::prepareReceiveBatch(const bool errors) {
+
+        for (size_t index = 0; index < m_burstSize; index++) {
+
+            m_vectors[index] = iovec{&m_receiveBuffer[index * RECEIVE_SLOT_SIZE], RECEIVE_SLOT_SIZE};
+            m_messages[index] = { };
+            m_messages[index].msg_hdr.msg_name = &m_addresses[index];
+            m_messages[index].msg_hdr.msg_namelen = sizeof(m_addresses[index]);
+            m_messages[index].msg_hdr.msg_iov = &m_vectors[index];
+            m_messages[index].msg_hdr.msg_iovlen = 1;
+            if (errors) {
+
+                m_messages[index].msg_hdr.msg_control = &m_controlBuffer[index * CONTROL_SLOT_SIZE];
+                m_messages[index].msg_hdr.msg_controllen = CONTROL_SLOT_SIZE;
+            }
+        }
+    }
+
+    void ScanEngine::receiveUDPReplies(void) {
+
+        int received = static_cast<int>(m_burstSize);
+        while (static_cast<size_t>(received) == m_burstSize) {
+
+            prepareReceiveBatch(false);
+            received = recvmmsg(m_UDPFD, m_messages.data(), static_cast<unsigned int>(m_burstSize), MSG_DONTWAIT, nullptr);
+            if (-1 == received) {
+
+                // A pending error is consumed by the call which reports it, there may still be replies behind it
+                if (EINTR == errno || isPendingICMPError(errno)) {
+
+                    received = static_cast<int>(m_burstSize);
+                    continue;
+                }
+
+                return;
+            }
+
+            for (int index = 0; index < received; index++) {
+
+                // Anything from an address and port that wasn't probed (or has already reported) is ignored
+                const uint32_t slot = findUDPProbe(m_addresses[index]);
+                if (UDP_SOCKET_EVENT != slot) {
+
+                    addSample(slot);
+                    completeProbe(slot, PQ_QUERY_RESULT::OPEN);
+                }
+            }
+        }
+    }
+
+    void ScanEngine::recordICMPError(const uint32_t address) {
+
+        UDPHost& host = m_UDPHosts[address];
+        host.m_errorCount++;
+
+        // Errors arrive at about the pacing rate, so a fixed step per error grows the rate by a fixed fraction
+        // every second no matter how fast the host is. A host whose limit was underestimated eventually gets
+        // probed at its real rate
+        if (host.m_rateLimited) {
+            setPacingRate(host, host.m_pacer.getRate() + UDP_RATE_INCREASE);
+        }
+    }
+
+    void ScanEngine::setPacingRate(UDPHost& host, const double rate) {
+
+        // Allow roughly ten milliseconds worth of probes to go out together, otherwise fast hosts would be
+        // limited by how often the reactor wakes up rather than by the rate
+        const double clamped = std::max(rate, MIN_UDP_RATE);
+        host.m_pacer.setRate(clamped);
+        host.m_pacer.setBurst(std::max(1.0, clamped / 100.0));
+    }
+
+    void ScanEngine::handleUDPTimeout(const uint32_t slot, const Clock::time_point now) {
+
+        const Probe& probe = m_probes[slot];
+        UDPHost& host = m_UDPHosts[probe.m_address];
+
+        // Silence from a host which has been answering with errors is almost certainly the rate limit kicking in.
+        // Every error so far came back at (or under) the limit, so that is where pacing starts
+        if (!host.m_rateLimited && host.m_errorCount > 0) {
+
+            const std::chrono::duration<double> elapsed = now - host.m_firstProbe;
+            host.m_rateLimited = true;
+            host.m_lastDecrease = now;
+            setPacingRate(host, host.m_errorCount / std::max(elapsed.count(), 1.0));
+            m_rateLimitedHosts.push_back(probe.m_address);
+        }
+
+        // A paced probe timing out means the pacing is still too fast. Only back off once per timeout period,
+        // every probe sent during that period was sent at the same rate
+        else if (probe.m_paced && now - host.m_lastDecrease >= m_estimator.getCeiling()) {
+
+            host.m_lastDecrease = now;
+            setPacingRate(host, host.m_pacer.getRate() / 2.0);
+        }
+
+        if (!host.m_rateLimited) {
+
+            if (!retryProbe(slot)) {
+
+                m_governor.onTimeout(now);
+                completeProbe(slot, PQ_QUERY_RESULT::CLOSED);
+            }
+
+            return;
+        }
+
+        else if (probe.m_attempt + 1 >= MAX_UDP_ATTEMPTS) {
+
+            completeProbe(slot, PQ_QUERY_RESULT::CLOSED);
+            return;
+        }
+
+        host.m_queued.push_back(QueuedProbe{probe.m_port, static_cast<uint8_t>(probe.m_attempt + 1)});
+        m_queuedCount++;
+        releaseSlot(slot);
+    }
+
+    void ScanEngine::handleTimeout(const uint32_t slot, const Clock::time_point now) {
+
+        // The port is open whether or not it had anything to say
+        if (m_probes[slot].m_readingBanner) {
+            completeProbe(slot, PQ_QUERY_RESULT::OPEN);
+        }
+
+        else if (m_probes[slot].m_waitingForPort) {
+
+            m_probes[slot].m_waitingForPort = false;
+            startTCPProbe(slot);
+        }
+
+        else if (NetworkProtocol::UDP == m_probes[slot].m_protocol) {
+            handleUDPTimeout(slot, now);
+        }
+
+        else if (!retryProbe(slot)) {
+
+            m_governor.onTimeout(now);
+            completeProbe(slot, PQ_QUERY_RESULT::CLOSED);
+        }
+    }
+
+    void ScanEngine::scheduleDeadline(const uint32_t slot, const Clock::time_point expiry) {
+
+        Probe& probe = m_probes[slot];
+        if (TimingWheel::INVALID_HANDLE != probe.m_timer) {
+            m_timers.cancel(probe.m_timer);
+        }
+
+        probe.m_timer = m_timers.schedule(expiry, makeEventData(slot, probe.m_generation));
+    }
+
+    void ScanEngine::expireDeadlines(const Clock::time_point now) {
+
+        m_expired.clear();
+        m_timers.advance(now, m_expired);
+
+        // The wheel has already let go of these, nothing may cancel them while the timeouts are being handled
+        for (const uint64_t expired : m_expired) {
+            m_probes[static_cast<uint32_t>(expired)].m_timer = TimingWheel::INVALID_HANDLE;
+        }
+
+        for (const uint64_t expired : m_expired) {
+
+            // Handling one timeout can complete another probe which expired alongside it, and even hand its slot
+            // to a new probe
+            const uint32_t slot = static_cast<uint32_t>(expired);
+            const Probe& probe = m_probes[slot];
+            if (-1 != probe.m_fd && probe.m_generation == static_cast<uint32_t>(expired >> 32)) {
+                handleTimeout(slot, now);
+            }
+        }
+    }
+
+    void ScanEngine::completeProbe(const uint32_t slot, const PQ_QUERY_RESULT result) {
+
+        // The banner's buffer goes with the result, it isn't the slot's to give back any more
+        Probe& probe = m_probes[slot];
+        m_results.push_back(ProbeResult{probe.m_address, probe.m_port, probe.m_protocol, result, probe.m_latency,
+                probe.m_banner, probe.m_bannerLength});
+        probe.m_banner = BufferPool::INVALID_HANDLE;
+        releaseSlot(slot);
+    }
+
+    void ScanEngine::completeConnect(const uint32_t slot, const int error) {
+
+        Probe& probe = m_probes[slot];
+        if (0 != error) {
+
+            completeProbe(slot, getResultFromError(error));
+            return;
+        }
+
+        // A connection to itself means nothing was listening on the port
+        if (isSelfConnected(probe.m_fd)) {
+
+            completeProbe(slot, PQ_QUERY_RESULT::REJECTED);
+            return;
+        }
+
+        // The socket is about to be closed (or recycled), the kernel's view of the handshake has to be read first
+        if (m_measureLatency) {
+            probe.m_latency = getHandshakeRTT(probe.m_fd);
+        }
+
+        if (nullptr != m_bannerPool) {
+            probe.m_banner = m_bannerPool->acquire();
+        }
+
+        if (BufferPool::INVALID_HANDLE == probe.m_banner) {
+
+            completeProbe(slot, PQ_QUERY_RESULT::OPEN);
+            return;
+        }
+
+        probe.m_bannerLength = 0;
+        probe.m_readingBanner = true;
+        armProbe(slot, EPOLLIN);
+        scheduleDeadline(slot, Clock::now() + m_bannerWait);
+    }
+
+    void ScanEngine::readBanner(const uint32_t slot) {
+
+        // Whatever the port sent first is its banner, there is no telling whether more is on the way without
+        // waiting out the deadline for every port
+        Probe& probe = m_probes[slot];
+        const ssize_t received = recv(probe.m_fd, m_bannerPool->getData(probe.m_banner),
+                m_bannerPool->getBufferSize(), MSG_DONTWAIT);
+        if (-1 == received && (EAGAIN == errno || EINTR == errno)) {
+
+            armProbe(slot, EPOLLIN);
+            return;
+        }
+
+        // A port which closed (or reset) the connection straight away is still open, it just has no banner
+        probe.m_bannerLength = received > 0 ? static_cast<uint32_t>(received) : 0;
+        completeProbe(slot, PQ_QUERY_RESULT::OPEN);
+    }
+}
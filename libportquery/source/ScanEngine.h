@@ -0,0 +1,345 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+
+#include <sys/socket.h>
+
+#include "BufferPool.h"
+#include "Network.h"
+#include "PortQuery.h"
+#include "TokenBucket.h"
+#include "RTTEstimator.h"
+#include "RateGovernor.h"
+#include "TimingWheel.h"
+
+
+namespace PortQuery {
+
+    // The outcome of a single probe, addresses are in host byte order
+    struct ProbeResult {
+
+        uint32_t m_address;
+        uint16_t m_port;
+        NetworkProtocol m_protocol;
+        PQ_QUERY_RESULT m_result;
+
+        // Only filled in when the engine was asked to measure it
+        PQ_LATENCY m_latency = PQ_LATENCY::zero();
+
+        // The banner of an open port when banners are being read, ownership of the buffer goes with the result
+        BufferPool::Handle m_banner = BufferPool::INVALID_HANDLE;
+        uint32_t m_bannerLength = 0;
+    };
+
+
+    // The scan engine is a single threaded reactor built around one epoll instance. Probes are started as
+    // non-blocking connects and many of them are kept in flight at once. The reactor is only run when
+    // the caller asks for it, either explicitly through poll or implicitly when the in flight window is full.
+    //
+    // TCP: a completed handshake maps to OPEN, a reset maps to REJECTED and anything which does not answer before
+    // the timeout maps to CLOSED.
+    //
+    // Timeouts are not fixed. Every answer is a round trip time sample for the host, and each probe waits about as
+    // long as the host has been taking to answer (see RTTEstimator), never longer than the configured timeout. A
+    // probe which times out is sent once more with double the timeout before it is given up on.
+    //
+    // Every TCP probe needs a descriptor. The soft descriptor limit is raised as far as it will go when the engine is
+    // created and the in flight window is sized to fit under it. Sockets are never closed between probes, they are
+    // disconnected (connect with AF_UNSPEC) and handed to the next probe, which also keeps them registered with
+    // epoll. If the process still runs out of descriptors, probes wait for one to come free and the stall is
+    // counted in the statistics rather than the probe failing.
+    //
+    // How fast probes go out is up to a RateGovernor, which shrinks the in flight window when probes are lost and
+    // paces them over the round trip time. Submitting a probe runs the reactor until the governor lets it go.
+    //
+    // UDP: every probe goes out of a single unconnected socket with IP_RECVERR set, so the ICMP errors for every
+    // probe are queued on that socket's error queue along with the address the probe was sent to. Datagrams are
+    // sent with sendmmsg in bursts, and replies and errors are read back with recvmmsg, so the number of system
+    // calls per probe is a small fraction of one. A reply maps to OPEN, ICMP port unreachable maps to REJECTED and
+    // anything else (other ICMP errors, silence) maps to CLOSED.
+    //
+    // Most hosts rate limit ICMP errors (on Linux, net.ipv4.icmp_ratelimit allows a short burst and then one per
+    // second), so a fast UDP sweep sees a handful of rejections and then silence for everything else. Once a host
+    // which has been sending errors lets a probe time out, it is treated as rate limited: further probes are paced
+    // to the error rate seen so far and the probes which timed out are sent again.
+    class ScanEngine {
+
+        public:
+
+            using Clock = std::chrono::steady_clock;
+
+            // The window is the smaller of maxInFlight and what the descriptor limit allows. Engines running side by
+            // side in one process (see PQConn::run) each get an even share of the descriptors and local ports
+            ScanEngine(const size_t maxInFlight=MAX_IN_FLIGHT_DEFAULT, const size_t shares=1);
+            ~ScanEngine();
+
+            ScanEngine(const ScanEngine&) = delete;
+            ScanEngine &operator=(const ScanEngine&) = delete;
+
+            // The longest any single probe will wait for an answer
+            void setTimeout(const std::chrono::milliseconds timeout);
+
+            // In probes per second, zero means as fast as the governor allows
+            void setMaxRate(const double rate);
+
+            // The number of datagrams sent, or replies read, with a single system call
+            void setBurstSize(const size_t burstSize);
+
+            // Connects go out from each source address in turn, every address brings a full range of ephemeral
+            // ports with it. Without any the kernel picks the address from the route
+            void addSourceAddress(const uint32_t address);
+
+            // Results for connects which complete carry the round trip of the handshake, as the kernel measured it.
+            // It costs one extra system call per open port so it is off by default
+            void setMeasureLatency(const bool enabled);
+
+            // Open ports are given up to wait to send something once connected, and whatever they send first
+            // is read into a buffer from the pool and handed over with the result. Ports which send nothing, or
+            // which complete when the pool has nothing left, come back without a banner. nullptr turns this off
+            void setBannerCapture(BufferPool* const pool, const std::chrono::milliseconds wait);
+
+            // Starts a connect to the provided address and port. If the in flight window is full or the governor is
+            // holding probes back, the reactor is run until it can go out. This never waits on the probe itself.
+            void submitTCPProbe(const uint32_t address, const uint16_t port);
+
+            // Sends a datagram to the provided address and port, carrying the well known payload for the port if
+            // there is one. Probes to hosts which are being paced are queued instead, and the reactor is run if the
+            // queue grows larger than the in flight window. Datagrams are held back until a burst's worth has
+            // built up or the reactor runs.
+            void submitUDPProbe(const uint32_t address, const uint16_t port);
+
+            // Runs a single iteration of the reactor. If blocking is set, this waits until at least
+            // one event has been processed or the earliest outstanding probe has timed out
+            void poll(const bool blocking);
+
+            // Retrieves a completed probe, returns false if no probes have completed since the last call
+            bool popResult(ProbeResult& result);
+
+            // Includes UDP probes which are queued up waiting on a rate limited host
+            size_t getInFlight(void) const;
+
+            bool isRateLimited(const uint32_t address) const;
+
+            // Drops the host's round trip estimate and UDP error accounting, for once nothing more will be sent to
+            // it and every probe to it has completed
+            void forgetHost(const uint32_t address);
+
+            PQ_SCAN_STATS getStatistics(void) const;
+
+            static constexpr size_t MAX_IN_FLIGHT_DEFAULT = 4096;
+
+        private:
+
+            // Left over for everything else in the process, standard streams, the epoll instance, the UDP socket,
+            // whatever the caller has open
+            static constexpr size_t RESERVED_DESCRIPTORS = 64;
+            static constexpr size_t BURST_SIZE_DEFAULT = 64;
+            static constexpr int MAX_EVENTS = 256;
+            static constexpr int RECEIVE_BUFFER_SIZE = 1 << 22;
+
+            // Replies are only read to see that they arrived, anything past the first few bytes is thrown away.
+            // An IP_RECVERR control message is the extended error plus the address of whoever sent it
+            static constexpr size_t RECEIVE_SLOT_SIZE = 64;
+            static constexpr size_t CONTROL_SLOT_SIZE = 128;
+
+            // The epoll data for the shared UDP socket, every other event carries a slot
+            static constexpr uint32_t UDP_SOCKET_EVENT = static_cast<uint32_t>(-1);
+
+            // Answers are only timed when the reactor runs, so it is run without waiting every so many
+            // submissions. Otherwise a long burst of submissions would count towards the RTT of every answer
+            static constexpr size_t SUBMISSIONS_PER_POLL = 64;
+
+            // A UDP probe which times out against a rate limited host is sent this many times in total
+            static constexpr uint8_t MAX_UDP_ATTEMPTS = 4;
+
+            // Pacing never drops below this many probes per second, no matter how slow the errors come in
+            static constexpr double MIN_UDP_RATE = 1.0;
+
+            // How long a connect which found every local port taken waits before trying again
+            static constexpr std::chrono::milliseconds PORT_RETRY_DELAY = std::chrono::milliseconds(10);
+
+            // How much the pacing rate grows for every ICMP error received from a rate limited host
+            static constexpr double UDP_RATE_INCREASE = 0.05;
+
+            struct Probe {
+
+                // UDP probes all share the UDP socket
+                int m_fd;
+                uint32_t m_address;
+                uint16_t m_port;
+                NetworkProtocol m_protocol;
+                uint8_t m_attempt;
+
+                // Set if the probe was held back by pacing before being sent
+                bool m_paced;
+
+                Clock::time_point m_sent;
+                std::chrono::milliseconds m_timeout;
+
+                // Set if the probe went out before there was any RTT estimate, so it was given the ceiling
+                bool m_provisional;
+
+                // Set while a connect is holding a local port, and while one is waiting for a port to free up
+                bool m_holdsPort;
+                bool m_waitingForPort;
+
+                // Incremented every time the slot is reused, stale events are detected by comparing this
+                uint32_t m_generation;
+
+                // The probe's deadline, INVALID_HANDLE while it isn't waiting on one
+                TimingWheel::Handle m_timer;
+
+                // Filled in once the connect completes, set while the port is being given a chance to send its
+                // banner
+                PQ_LATENCY m_latency;
+                BufferPool::Handle m_banner;
+                uint32_t m_bannerLength;
+                bool m_readingBanner;
+            };
+
+            struct QueuedProbe {
+
+                uint16_t m_port;
+                uint8_t m_attempt;
+            };
+
+            // ICMP error accounting for every host which has been sent a UDP probe
+            struct UDPHost {
+
+                Clock::time_point m_firstProbe;
+                size_t m_errorCount = 0;
+                bool m_rateLimited = false;
+
+                // Only used once the host is rate limited
+                Clock::time_point m_lastDecrease;
+                TokenBucket m_pacer;
+                std::deque<QueuedProbe> m_queued;
+            };
+
+            static size_t getWindowSize(const size_t maxInFlight, const size_t descriptorLimit, const size_t shares);
+
+            // Claims a free slot and gives it a socket, returns false if the process is out of descriptors
+            bool openSlot(const int type, uint32_t& slot);
+            uint32_t acquireSlot(const int type);
+            void releaseSlot(const uint32_t slot);
+
+            // Takes a TCP socket back to where it was before connect was called, returns false (and closes it) if
+            // that didn't work
+            bool recycleSocket(const int fd);
+
+            // A new TCP socket bound to the next source address, -1 if the process is out of descriptors
+            int createTCPSocket(void);
+            void releasePort(Probe& probe);
+
+            void prepareProbe(const uint32_t slot, const uint32_t address, const uint16_t port, const uint8_t attempt,
+                    const bool paced);
+            void startTCPProbe(const uint32_t slot);
+            void startUDPProbe(const uint32_t slot);
+            void flushSendBatch(void);
+            void watchProbe(const uint32_t slot, const uint32_t events);
+
+            // Like watchProbe, but leaves the probe's send time and deadline alone
+            void armProbe(const uint32_t slot, const uint32_t events);
+            void pollPeriodically(void);
+
+            // Sends a probe which timed out again from the same slot with twice the timeout, returns false if the
+            // probe has already been retried or was already waiting as long as it is allowed to
+            bool retryProbe(const uint32_t slot);
+            void handleTimeout(const uint32_t slot, const Clock::time_point now);
+
+            // Samples should go through here, the first one also shortens the timeouts of provisional probes
+            void addSample(const uint32_t slot);
+
+            // Probes which have been sent and not answered, unlike getInFlight this leaves out queued UDP probes
+            size_t getActiveProbes(void) const;
+
+            void dispatchQueuedProbes(const Clock::time_point now);
+            void recordICMPError(const uint32_t address);
+            void handleUDPTimeout(const uint32_t slot, const Clock::time_point now);
+            void setPacingRate(UDPHost& host, const double rate);
+
+            void handleEvent(const uint32_t slot, const uint32_t events);
+
+            // The epoll data for a probe, the generation is included so that an event left over from the socket's
+            // previous probe can be told apart
+            static uint64_t makeEventData(const uint32_t slot, const uint32_t generation) {
+
+                return (static_cast<uint64_t>(generation) << 32) | slot;
+            }
+
+            void receiveUDPErrors(void);
+            void receiveUDPReplies(void);
+            void prepareReceiveBatch(const bool errors);
+
+            // The slot of the UDP probe sent to an address and port, or UDP_SOCKET_EVENT if there isn't one
+            uint32_t findUDPProbe(const sockaddr_in& target) const;
+            void scheduleDeadline(const uint32_t slot, const Clock::time_point expiry);
+            void expireDeadlines(const Clock::time_point now);
+            void completeProbe(const uint32_t slot, const PQ_QUERY_RESULT result);
+
+            // Completes a TCP probe whose connect returned error (zero for a handshake), unless it goes on to read
+            // a banner
+            void completeConnect(const uint32_t slot, const int error);
+            void readBanner(const uint32_t slot);
+            int getWaitTime(const Clock::time_point now);
+
+            int m_epollFD;
+            int m_UDPFD;
+            size_t m_descriptorLimit;
+            size_t m_descriptorStalls;
+
+            // Connects never hold more local ports at once than the ephemeral range (per source address) allows
+            std::vector<uint32_t> m_sourceAddresses;
+            size_t m_nextSource;
+            size_t m_ephemeralPorts;
+            size_t m_portLimit;
+
+            // Set to the ports in use when a connect finds none left because something else holds them too, and
+            // cleared again as soon as a probe hands one back, zero while connects may go up to m_portLimit
+            size_t m_portStallLimit;
+            size_t m_portsInUse;
+            size_t m_peakPortsInUse;
+            size_t m_portStalls;
+            bool m_measureLatency;
+            BufferPool* m_bannerPool;
+            std::chrono::milliseconds m_bannerWait;
+            RTTEstimator m_estimator;
+            RateGovernor m_governor;
+
+            // Set while a submission is waiting on the governor, so the reactor knows to wake up for it
+            bool m_sendPending;
+
+            std::vector<Probe> m_probes;
+            std::vector<uint32_t> m_freeSlots;
+
+            // Disconnected TCP sockets waiting for their next probe, never more than there are free slots
+            std::vector<int> m_socketPool;
+
+            // Probes waiting to go out in the next sendmmsg, and the buffers the batch is built in
+            size_t m_burstSize;
+            std::vector<uint32_t> m_sendBatch;
+            std::vector<struct mmsghdr> m_messages;
+            std::vector<struct iovec> m_vectors;
+            std::vector<sockaddr_in> m_addresses;
+            std::vector<char> m_receiveBuffer;
+            std::vector<char> m_controlBuffer;
+
+            // Keyed by address and port, the same as results are stitched back together
+            std::unordered_map<uint64_t, uint32_t> m_UDPProbes;
+
+            std::unordered_map<uint32_t, UDPHost> m_UDPHosts;
+            std::vector<uint32_t> m_rateLimitedHosts;
+            size_t m_queuedCount;
+            size_t m_provisionalCount;
+            size_t m_submissions;
+
+            // Every probe's deadline, cancelled as soon as the probe completes
+            TimingWheel m_timers;
+            std::vector<uint64_t> m_expired;
+            std::deque<ProbeResult> m_results;
+    };
+}
@@ -1,3 +1,5 @@
+#include <stdexcept>
+
 #include "Statement.h"
 #include "Parser.h"
 
@@ -26,6 +28,10 @@ namespace PortQuery {
                [] (NumericTerminal) { return "[NUMERIC TERMINAL]"; },
                [] (ProtocolTerminal) { return "[PROTOCOL Terminal]"; },
                [] (QueryResultTerminal) { return "[QUERY RESULT TERMINAL]"; },
+               [] (LatencyTerminal) { return "[LATENCY TERMINAL]"; },
+               [] (BannerTerminal) { return "[BANNER TERMINAL]"; },
+               [] (InferredTerminal) { return "[INFERRED TERMINAL]"; },
+               [] (HostTerminal) { return "[HOST TERMINAL]"; },
                // throw here?
                [] (auto) { return "[UNKNOWN TERMINAL]"; }, 
             },
@@ -155,14 +161,12 @@ namespace PortQuery {
 
     PQ_QUERY_RESULT ProtocolTerminal::getValue(EnvironmentPtr env) { 
 
-        // fix interface here.
-        return PQ_QUERY_RESULT::CLOSED;
+        return env->getScanResult(m_protocol);
     }
 
     bool ProtocolTerminal::compareValue(const ComparisonToken::OpType op, const PQ_QUERY_RESULT other, EnvironmentPtr env) {
 
-        // fix interface here.
-        return false;
+        return performCompare(op, env->getScanResult(m_protocol), other);
     }
 
     bool ProtocolTerminal::preNetworkAvailable(void) const { 
@@ -170,6 +174,46 @@ namespace PortQuery {
         return false;
     }
 
+    PQ_LATENCY LatencyTerminal::getValue(EnvironmentPtr env) {
+
+        return env->getLatency();
+    }
+
+    bool LatencyTerminal::preNetworkAvailable(void) const {
+
+        return false;
+    }
+
+    PQ_BANNER BannerTerminal::getValue(EnvironmentPtr env) {
+
+        return env->getBanner();
+    }
+
+    bool BannerTerminal::preNetworkAvailable(void) const {
+
+        return false;
+    }
+
+    PQ_INFERRED InferredTerminal::getValue(EnvironmentPtr env) {
+
+        return env->isInferred();
+    }
+
+    bool InferredTerminal::preNetworkAvailable(void) const {
+
+        return false;
+    }
+
+    PQ_HOST HostTerminal::getValue(EnvironmentPtr env) {
+
+        return PQ_HOST{env->getAddress()};
+    }
+
+    bool HostTerminal::preNetworkAvailable(void) const {
+
+        return true;
+    }
+
     SOSQLTerminal getTerminalFromToken(const Token t) {
 
         return std::visit(overloaded {
@@ -183,6 +227,14 @@ namespace PortQuery {
                                 return ProtocolTerminal{NetworkProtocol::TCP};
                             case ColumnToken::UDP:
                                 return ProtocolTerminal{NetworkProtocol::UDP};
+                            case ColumnToken::LATENCY:
+                                return LatencyTerminal{};
+                            case ColumnToken::BANNER:
+                                return BannerTerminal{};
+                            case ColumnToken::INFERRED:
+                                return InferredTerminal{};
+                            case ColumnToken::HOST:
+                                return HostTerminal{};
                             default:
                                 throw std::invalid_argument("Unable to convert unknown column token to terminal" + getExtendedTokenInfo(c));
                         }
@@ -198,6 +250,11 @@ namespace PortQuery {
         return m_left->attemptPreNetworkEval(env) || m_right->attemptPreNetworkEval(env);
     }
 
+    bool ORExpression::postNetworkEval(EnvironmentPtr env) {
+
+        return m_left->postNetworkEval(env) || m_right->postNetworkEval(env);
+    }
+
     NetworkProtocol ORExpression::collectRequiredProtocols(void) const {
 
         return m_left->collectRequiredProtocols() | m_right->collectRequiredProtocols();
@@ -211,6 +268,11 @@ namespace PortQuery {
         return m_left->attemptPreNetworkEval(env) && m_right->attemptPreNetworkEval(env);
     }
 
+    bool ANDExpression::postNetworkEval(EnvironmentPtr env) {
+
+        return m_left->postNetworkEval(env) && m_right->postNetworkEval(env);
+    }
+
     NetworkProtocol ANDExpression::collectRequiredProtocols(void) const {
 
         return m_left->collectRequiredProtocols() | m_right->collectRequiredProtocols();
@@ -224,6 +286,11 @@ namespace PortQuery {
         return !m_expr->attemptPreNetworkEval(env);
     }
 
+   bool NOTExpression::postNetworkEval(EnvironmentPtr env) {
+
+        return !m_expr->postNetworkEval(env);
+   }
+
    NetworkProtocol NOTExpression::collectRequiredProtocols(void) const {
 
         return m_expr->collectRequiredProtocols();
@@ -234,6 +301,10 @@ namespace PortQuery {
 
        return std::visit(overloaded {
                [] (const ProtocolTerminal p) { return p.m_protocol; },
+
+               // The latency is the round trip of the TCP probe, there is nothing to time without one
+               [] (const LatencyTerminal) { return NetworkProtocol::TCP; },
+               [] (const BannerTerminal) { return NetworkProtocol::TCP; },
                [] (auto) { return NetworkProtocol::NONE; }, 
             }, t);
    }
@@ -267,6 +338,16 @@ namespace PortQuery {
    }
 
 
+   bool BETWEENExpression::postNetworkEval(EnvironmentPtr env) {
+
+       return std::visit( [env] (auto&& lowerBound, auto&& upperBound, auto&& terminal) -> bool { 
+               return compare(ComparisonToken::OP_GTE, terminal, lowerBound, env) && 
+                   compare(ComparisonToken::OP_LTE, terminal, upperBound, env);
+            },
+
+        m_lowerBound, m_upperBound, m_terminal);
+   }
+
    NetworkProtocol BETWEENExpression::collectRequiredProtocols(void) const {
 
        return getProtocolFromTerminal(m_terminal);
@@ -297,6 +378,15 @@ namespace PortQuery {
  
    }
 
+   bool ComparisonExpression::postNetworkEval(EnvironmentPtr env) {
+
+       return std::visit( [&] (auto&& lhs, auto&& rhs) -> bool { 
+                return compare(m_op, lhs, rhs, env);
+            },
+
+        m_LHSTerminal, m_RHSTerminal);
+   }
+
    NetworkProtocol ComparisonExpression::collectRequiredProtocols(void) const {
 
        return getProtocolFromTerminal(m_LHSTerminal) | getProtocolFromTerminal(m_RHSTerminal);
@@ -309,6 +399,11 @@ namespace PortQuery {
        return Tristate::TRUE_STATE;
    }
 
+   bool NULLExpression::postNetworkEval(EnvironmentPtr env) {
+
+       return true;
+   }
+
    NetworkProtocol NULLExpression::collectRequiredProtocols(void) const {
 
        return NetworkProtocol::NONE;
@@ -339,9 +434,9 @@ namespace PortQuery {
    PQ_ROW SelectSet::getSelectedColumns(EnvironmentPtr env) {
 
        // yep, still in hell
-       auto compLambda = [env] (SOSQLTerminal s) -> PQ_QUERY_RESULT {
-           return std::visit( [env] (auto&& t) ->PQ_QUERY_RESULT { 
-               return PQ_QUERY_RESULT{t.getValue(env)};
+       auto compLambda = [env] (SOSQLTerminal s) -> PQ_COLUMN {
+           return std::visit( [env] (auto&& t) -> PQ_COLUMN { 
+               return PQ_COLUMN{t.getValue(env)};
             }, s); };
 
        PQ_ROW row { };
@@ -357,6 +452,21 @@ namespace PortQuery {
         return m_tableExpression->attemptPreNetworkEval(env);
     }
 
+    bool SelectStatement::postNetworkEval(EnvironmentPtr env) {
+
+        return m_tableExpression->postNetworkEval(env);
+    }
+
+    PQ_ROW SelectStatement::getSelectedColumns(EnvironmentPtr env) {
+
+        return m_selectedSet.getSelectedColumns(env);
+    }
+
+    const std::vector<std::string>& SelectStatement::getTableReferences(void) const {
+
+        return m_tableReferences;
+    }
+
     NetworkProtocol SelectStatement::collectRequiredProtocols() const {
 
         NetworkProtocol requestedProtocols = NetworkProtocol::NONE;
@@ -368,4 +478,18 @@ namespace PortQuery {
         requestedProtocols |= m_tableExpression->collectRequiredProtocols();
         return requestedProtocols;
     }
+
+    bool SelectStatement::isLatencyRequested(void) const {
+
+        return std::any_of(m_selectedSet.begin(), m_selectedSet.end(), [] (const SOSQLTerminal& t) {
+                return std::holds_alternative<LatencyTerminal>(t);
+            });
+    }
+
+    bool SelectStatement::isBannerRequested(void) const {
+
+        return std::any_of(m_selectedSet.begin(), m_selectedSet.end(), [] (const SOSQLTerminal& t) {
+                return std::holds_alternative<BannerTerminal>(t);
+            });
+    }
 }
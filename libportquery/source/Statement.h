@@ -4,6 +4,8 @@
 #include <memory>
 #include <algorithm>
 #include <tuple>
+#include <string>
+#include <vector>
 
 #include "Lexer.h"
 #include "Network.h"
@@ -23,11 +25,16 @@ namespace PortQuery {
     struct PortTerminal;
     struct QueryResultTerminal;
     struct ProtocolTerminal;
+    struct LatencyTerminal;
+    struct BannerTerminal;
+    struct InferredTerminal;
+    struct HostTerminal;
 
     struct IExpression;
     class SelectStatement;
 
-    using SOSQLTerminal = std::variant<NumericTerminal, PortTerminal, QueryResultTerminal, ProtocolTerminal>;
+    using SOSQLTerminal = std::variant<NumericTerminal, PortTerminal, QueryResultTerminal, ProtocolTerminal,
+          LatencyTerminal, BannerTerminal, InferredTerminal, HostTerminal>;
     using SOSQLExpression = std::unique_ptr<IExpression>;
     using SOSQLSelectStatement = std::unique_ptr<SelectStatement>;
 
@@ -76,10 +83,39 @@ namespace PortQuery {
         NetworkProtocol m_protocol;
     };
 
+    // Only meaningful in the select list, latencies can't be compared against anything (yet)
+    struct LatencyTerminal {
+
+        PQ_LATENCY getValue(EnvironmentPtr env);
+        bool preNetworkAvailable(void) const;
+    };
+
+    // Select list only, the same as the latency
+    struct BannerTerminal {
+
+        PQ_BANNER getValue(EnvironmentPtr env);
+        bool preNetworkAvailable(void) const;
+    };
+
+    // Select list only, whether the row was filled in by the circuit breaker instead of a probe
+    struct InferredTerminal {
+
+        PQ_INFERRED getValue(EnvironmentPtr env);
+        bool preNetworkAvailable(void) const;
+    };
+
+    // Select list only, the target the row came from. Known before anything goes out
+    struct HostTerminal {
+
+        PQ_HOST getValue(EnvironmentPtr env);
+        bool preNetworkAvailable(void) const;
+    };
+
 
     struct IExpression {
 
         virtual Tristate attemptPreNetworkEval(EnvironmentPtr env) = 0;
+        virtual bool postNetworkEval(EnvironmentPtr env) = 0;
         virtual NetworkProtocol collectRequiredProtocols(void) const = 0;
 
         virtual ~IExpression() = default;
@@ -91,6 +127,7 @@ namespace PortQuery {
         ORExpression(SOSQLExpression left, SOSQLExpression right) : m_left(std::move(left)), m_right(std::move(right)) { }
 
         virtual Tristate attemptPreNetworkEval(EnvironmentPtr env) override;
+        virtual bool postNetworkEval(EnvironmentPtr env) override;
         virtual NetworkProtocol collectRequiredProtocols(void) const override;
         SOSQLExpression m_left;
         SOSQLExpression m_right;
@@ -102,6 +139,7 @@ namespace PortQuery {
         ANDExpression(SOSQLExpression left, SOSQLExpression right) : m_left(std::move(left)), m_right(std::move(right)) { }
 
         virtual Tristate attemptPreNetworkEval(EnvironmentPtr env) override;
+        virtual bool postNetworkEval(EnvironmentPtr env) override;
         virtual NetworkProtocol collectRequiredProtocols(void) const override;
 
         SOSQLExpression m_left;
@@ -113,6 +151,7 @@ namespace PortQuery {
 
         NOTExpression(SOSQLExpression expr) : m_expr(std::move(expr)) { }
         virtual Tristate attemptPreNetworkEval(EnvironmentPtr env) override;
+        virtual bool postNetworkEval(EnvironmentPtr env) override;
         virtual NetworkProtocol collectRequiredProtocols(void) const override;
 
         SOSQLExpression m_expr;
@@ -124,6 +163,7 @@ namespace PortQuery {
         BETWEENExpression(const uint16_t lowerBound, const uint16_t upperBound, const Token t);
 
         virtual Tristate attemptPreNetworkEval(EnvironmentPtr env) override;
+        virtual bool postNetworkEval(EnvironmentPtr env) override;
         virtual NetworkProtocol collectRequiredProtocols(void) const override;
 
         SOSQLTerminal m_lowerBound;
@@ -136,6 +176,7 @@ namespace PortQuery {
 
         ComparisonExpression(const ComparisonToken::OpType op, const Token lhs, const Token rhs);
         virtual Tristate attemptPreNetworkEval(EnvironmentPtr env) override;
+        virtual bool postNetworkEval(EnvironmentPtr env) override;
         virtual NetworkProtocol collectRequiredProtocols(void) const override;
 
         ComparisonToken::OpType m_op;
@@ -146,6 +187,7 @@ namespace PortQuery {
     struct NULLExpression : IExpression {
 
         virtual Tristate attemptPreNetworkEval(EnvironmentPtr env) override;
+        virtual bool postNetworkEval(EnvironmentPtr env) override;
         virtual NetworkProtocol collectRequiredProtocols(void) const override;
     };
 
@@ -170,12 +212,23 @@ namespace PortQuery {
 
     class SelectStatement : IExpression {
         public:
-            SelectStatement(SelectSet selectedSet, std::string tableReference, SOSQLExpression tableExpression) : 
-                m_selectedSet(std::move(selectedSet)), m_tableReference(std::move(tableReference)), 
+            SelectStatement(SelectSet selectedSet, std::vector<std::string> tableReferences, SOSQLExpression tableExpression) : 
+                m_selectedSet(std::move(selectedSet)), m_tableReferences(std::move(tableReferences)), 
                 m_tableExpression(std::move(tableExpression)) { }
 
             virtual NetworkProtocol collectRequiredProtocols(void) const override;
             virtual Tristate attemptPreNetworkEval(EnvironmentPtr env) override;
+            virtual bool postNetworkEval(EnvironmentPtr env) override;
+            PQ_ROW getSelectedColumns(EnvironmentPtr env);
+
+            // Every target in the FROM clause, in the order given
+            const std::vector<std::string>& getTableReferences(void) const;
+
+            // Timing answers costs the environment extra work, it is only done when the latency is selected
+            bool isLatencyRequested(void) const;
+
+            // Likewise for banners, reading them keeps every open port's connection up a while longer
+            bool isBannerRequested(void) const;
             virtual ~SelectStatement() = default;
             SelectStatement(SelectStatement&&) = default;
             SelectStatement &operator=(SelectStatement&&) = default;
@@ -184,7 +237,7 @@ namespace PortQuery {
         private:
 
             SelectSet m_selectedSet;
-            std::string m_tableReference;
+            std::vector<std::string> m_tableReferences;
             SOSQLExpression m_tableExpression;
     };
 }
@@ -0,0 +1,108 @@
+#include <algorithm>
+
+#include "TargetFeed.h"
+
+
+namespace PortQuery {
+
+    TargetFeed::TargetFeed(const TargetSet::Iterator targets, HostDiscovery* const discovery, const size_t shardCount,
+            const size_t chunkSize) : m_targets(targets), m_discovery(discovery),
+        m_shardCount(std::max<size_t>(shardCount, 1)), m_chunkSize(std::max<size_t>(chunkSize, 1)) { }
+
+    const std::vector<uint32_t>* TargetFeed::getChunk(const size_t chunk) {
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_stopped) {
+
+            if (chunk < m_firstChunk + m_chunks.size()) {
+                return &m_chunks[chunk - m_firstChunk].m_targets;
+            }
+
+            if (m_exhausted) {
+                return nullptr;
+            }
+
+            if (m_reading || m_chunks.size() >= MAX_CHUNKS_BUFFERED) {
+
+                m_changed.wait(lock);
+                continue;
+            }
+
+            m_reading = true;
+            lock.unlock();
+
+            std::vector<uint32_t> targets;
+            std::vector<uint32_t> liveTargets;
+            try {
+
+                targets = readChunk();
+                liveTargets = nullptr == m_discovery || targets.empty() ? targets : m_discovery->findLiveHosts(targets);
+            }
+            catch (...) {
+
+                lock.lock();
+                m_reading = false;
+                m_changed.notify_all();
+                throw;
+            }
+
+            lock.lock();
+            m_reading = false;
+            if (targets.empty()) {
+                m_exhausted = true;
+            }
+
+            else {
+
+                m_hostsDown += targets.size() - liveTargets.size();
+                m_chunks.push_back(Chunk{std::move(liveTargets)});
+            }
+
+            m_changed.notify_all();
+        }
+
+        return nullptr;
+    }
+
+    void TargetFeed::releaseChunk(const size_t chunk) {
+
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        if (chunk < m_firstChunk || chunk >= m_firstChunk + m_chunks.size()) {
+            return;
+        }
+
+        // Shards walk the chunks in order, the oldest is always the first to be finished with
+        m_chunks[chunk - m_firstChunk].m_releases++;
+        while (!m_chunks.empty() && m_shardCount == m_chunks.front().m_releases) {
+
+            m_chunks.pop_front();
+            m_firstChunk++;
+        }
+
+        m_changed.notify_all();
+    }
+
+    void TargetFeed::stop(void) {
+
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopped = true;
+        m_changed.notify_all();
+    }
+
+    size_t TargetFeed::getHostsDown(void) const {
+
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        return m_hostsDown;
+    }
+
+    std::vector<uint32_t> TargetFeed::readChunk(void) {
+
+        std::vector<uint32_t> targets;
+        std::optional<uint32_t> target;
+        while (targets.size() < m_chunkSize && (target = m_targets.next())) {
+            targets.push_back(*target);
+        }
+
+        return targets;
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+#include "TargetSet.h"
+#include "HostDiscovery.h"
+
+
+namespace PortQuery {
+
+    // Hands the shards the targets to sweep, a chunk at a time, so a target set is never laid out in memory no
+    // matter how many addresses it covers. Every shard walks every chunk in order (each takes its own share of
+    // the targets), the first to ask for a chunk pulls it off the iterator and runs it through host discovery, and
+    // it is dropped once the last shard is done with it. A shard which gets too far ahead of the others waits
+    // for them to catch up rather than buffering more chunks
+    class TargetFeed {
+
+        public:
+
+            // Without discovery every target is passed through as it is
+            TargetFeed(const TargetSet::Iterator targets, HostDiscovery* const discovery, const size_t shardCount,
+                    const size_t chunkSize=CHUNK_SIZE_DEFAULT);
+
+            // The live targets in the chunk, which may be none of them. Null once the targets have run out or the
+            // feed has been stopped. Stays valid until the shard releases it
+            const std::vector<uint32_t>* getChunk(const size_t chunk);
+            void releaseChunk(const size_t chunk);
+
+            // Wakes every shard waiting on a chunk and has them all finish up, for when one of them has failed
+            void stop(void);
+
+            // The targets which were left out because they didn't answer discovery, so far
+            size_t getHostsDown(void) const;
+
+            // The most hosts discovery will check at once
+            static constexpr size_t CHUNK_SIZE_DEFAULT = 256;
+            static constexpr size_t MAX_CHUNKS_BUFFERED = 4;
+
+        private:
+
+            struct Chunk {
+
+                std::vector<uint32_t> m_targets;
+                size_t m_releases = 0;
+            };
+
+            // Pulls the next chunk off of the iterator, empty once it has run out
+            std::vector<uint32_t> readChunk(void);
+
+            TargetSet::Iterator m_targets;
+            HostDiscovery* m_discovery;
+            size_t m_shardCount;
+            size_t m_chunkSize;
+
+            mutable std::mutex m_mutex;
+            std::condition_variable m_changed;
+
+            // m_chunks.front() is chunk number m_firstChunk
+            std::deque<Chunk> m_chunks;
+            size_t m_firstChunk = 0;
+
+            // Only one shard reads from the iterator at a time, the others wait for the chunk it is reading.
+            // Discovery takes up to a timeout, so it runs without the lock held
+            bool m_reading = false;
+            bool m_exhausted = false;
+            bool m_stopped = false;
+            size_t m_hostsDown = 0;
+    };
+}
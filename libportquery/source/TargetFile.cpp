@@ -0,0 +1,143 @@
+#include <system_error>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "TargetFile.h"
+
+
+namespace PortQuery {
+
+    TargetFile::TargetFile(const std::string& path) : m_fd(STDIN_FILENO), m_ownsFD(false) {
+
+        if ("-" != path) {
+
+            m_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (-1 == m_fd) {
+                throw std::system_error(errno, std::generic_category(), "Unable to open target file " + path);
+            }
+
+            m_ownsFD = true;
+        }
+
+        // Mapping fails for anything which isn't a regular file, and for an empty one. Those are read instead
+        struct stat status = { };
+        if (0 == fstat(m_fd, &status) && S_ISREG(status.st_mode) && status.st_size > 0) {
+
+            void* const map = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, m_fd, 0);
+            if (MAP_FAILED != map) {
+
+                // The file is walked once front to back, the kernel can read ahead and drop pages behind
+                madvise(map, static_cast<size_t>(status.st_size), MADV_SEQUENTIAL);
+                m_map = static_cast<const char*>(map);
+                m_mapSize = static_cast<size_t>(status.st_size);
+                return;
+            }
+        }
+
+        m_buffer.resize(READ_BUFFER_SIZE);
+    }
+
+    TargetFile::~TargetFile() {
+
+        if (nullptr != m_map) {
+            munmap(const_cast<char*>(m_map), m_mapSize);
+        }
+
+        if (m_ownsFD) {
+            close(m_fd);
+        }
+    }
+
+    std::optional<std::string_view> TargetFile::nextEntry(void) {
+
+        static constexpr const char* WHITE_SPACE = " \t\r";
+        for (std::optional<std::string_view> line; (line = nextLine());) {
+
+            std::string_view entry = line->substr(0, line->find('#'));
+            const size_t start = entry.find_first_not_of(WHITE_SPACE);
+            if (std::string_view::npos == start) {
+                continue;
+            }
+
+            entry = entry.substr(start, entry.find_last_not_of(WHITE_SPACE) - start + 1);
+            return entry;
+        }
+
+        return std::nullopt;
+    }
+
+    std::optional<std::string_view> TargetFile::nextLine(void) {
+
+        return nullptr != m_map ? nextMappedLine() : nextReadLine();
+    }
+
+    std::optional<std::string_view> TargetFile::nextMappedLine(void) {
+
+        if (m_position >= m_mapSize) {
+            return std::nullopt;
+        }
+
+        const char* const start = m_map + m_position;
+        const size_t remaining = m_mapSize - m_position;
+        const char* const newline = static_cast<const char*>(std::memchr(start, '\n', remaining));
+        const size_t length = nullptr == newline ? remaining : static_cast<size_t>(newline - start);
+        m_position += length + 1;
+        return std::string_view(start, length);
+    }
+
+    std::optional<std::string_view> TargetFile::nextReadLine(void) {
+
+        while (true) {
+
+            char* const start = m_buffer.data() + m_bufferStart;
+            const size_t available = m_bufferEnd - m_bufferStart;
+            char* const newline = static_cast<char*>(std::memchr(start, '\n', available));
+            if (nullptr != newline) {
+
+                m_bufferStart += static_cast<size_t>(newline - start) + 1;
+                return std::string_view(start, static_cast<size_t>(newline - start));
+            }
+
+            // The last line doesn't need a newline after it
+            if (m_readAll) {
+
+                if (0 == available) {
+                    return std::nullopt;
+                }
+
+                m_bufferStart = m_bufferEnd;
+                return std::string_view(start, available);
+            }
+
+            // Move the partial line to the front to make room behind it. A line which fills the whole buffer
+            // by itself is no target anyway, it is handed back as is and fails to parse
+            if (available == m_buffer.size()) {
+
+                m_bufferStart = m_bufferEnd;
+                return std::string_view(start, available);
+            }
+
+            std::memmove(m_buffer.data(), start, available);
+            m_bufferStart = 0;
+            m_bufferEnd = available;
+
+            const ssize_t received = read(m_fd, m_buffer.data() + m_bufferEnd, m_buffer.size() - m_bufferEnd);
+            if (-1 == received) {
+
+                if (EINTR == errno) {
+                    continue;
+                }
+
+                throw std::system_error(errno, std::generic_category(), "Unable to read target file");
+            }
+
+            m_readAll = 0 == received;
+            m_bufferEnd += static_cast<size_t>(received);
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+
+
+namespace PortQuery {
+
+    // Reads targets out of a file a line at a time, so a list of millions of addresses and blocks is never held
+    // in memory all at once. A regular file is mapped in and walked front to back, anything which can't be
+    // mapped (stdin, a pipe) is read a block at a time. Either way the file is only ever read once, entries are
+    // handed out as they are reached and not kept after
+    class TargetFile {
+
+        public:
+
+            // "-" reads stdin. Throws std::system_error if the file can't be opened
+            TargetFile(const std::string& path);
+            ~TargetFile();
+
+            TargetFile(const TargetFile&) = delete;
+            TargetFile &operator=(const TargetFile&) = delete;
+
+            // The next entry with white space and comments (anything after a #) stripped, blank lines are
+            // skipped. Nothing once the end of the file is reached. Only valid until the next call
+            std::optional<std::string_view> nextEntry(void);
+
+        private:
+
+            // The next line without its newline, nothing at the end of the file
+            std::optional<std::string_view> nextLine(void);
+            std::optional<std::string_view> nextMappedLine(void);
+            std::optional<std::string_view> nextReadLine(void);
+
+            static constexpr size_t READ_BUFFER_SIZE = 64 * 1024;
+
+            int m_fd;
+            bool m_ownsFD;
+
+            const char* m_map = nullptr;
+            size_t m_mapSize = 0;
+            size_t m_position = 0;
+
+            // Unread input sits in [m_bufferStart, m_bufferEnd) when the file is being read rather than mapped
+            std::vector<char> m_buffer;
+            size_t m_bufferStart = 0;
+            size_t m_bufferEnd = 0;
+            bool m_readAll = false;
+    };
+}
@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <system_error>
+
+#include "TargetSet.h"
+#include "Network.h"
+
+
+namespace PortQuery {
+
+    std::optional<uint32_t> TargetSet::Iterator::next(void) {
+
+        while (m_current || nextRange()) {
+
+            const Range& range = *m_current;
+            if (m_offset <= static_cast<uint64_t>(range.m_last - range.m_first)) {
+
+                const uint32_t address = static_cast<uint32_t>(range.m_first + m_offset);
+                const ExclusionSet* const exclusions = m_targets->m_exclusions;
+                if (nullptr != exclusions && (address < m_clearFrom || address >= m_clearTo)) {
+
+                    // The whole excluded block goes in one step, it may well run on past the end of the range
+                    const std::optional<uint32_t> excludedThrough = exclusions->getExcludedThrough(address);
+                    if (excludedThrough) {
+
+                        m_offset = static_cast<uint64_t>(std::min(*excludedThrough, range.m_last) - range.m_first) + 1;
+                        continue;
+                    }
+
+                    const std::optional<uint32_t> nextExcluded = exclusions->getNextExcluded(address);
+                    m_clearFrom = address;
+                    m_clearTo = nextExcluded ? *nextExcluded : static_cast<uint64_t>(1) << 32;
+                }
+
+                m_offset++;
+                return address;
+            }
+
+            m_current.reset();
+        }
+
+        return std::nullopt;
+    }
+
+    bool TargetSet::Iterator::nextRange(void) {
+
+        m_offset = 0;
+        if (m_range < m_targets->m_ranges.size()) {
+
+            m_current = m_targets->m_ranges[m_range++];
+            return true;
+        }
+
+        // Files are only parsed as far as the sweep has got, a line at a time. A bad line can't fail a sweep
+        // which may be well under way by now, it is counted and passed over
+        while (m_file < m_targets->m_files.size()) {
+
+            const std::optional<std::string_view> entry = m_targets->m_files[m_file]->nextEntry();
+            if (!entry) {
+
+                m_file++;
+                continue;
+            }
+
+            m_current = parseRange(*entry);
+            if (m_current) {
+                return true;
+            }
+
+            m_targets->m_malformed++;
+        }
+
+        return false;
+    }
+
+
+    bool TargetSet::addTarget(const std::string& target) {
+
+        if (!target.empty() && '@' == target[0]) {
+            return addTargetFile(target.substr(1));
+        }
+
+        const std::optional<Range> range = parseRange(target);
+        if (!range) {
+            return false;
+        }
+
+        m_ranges.push_back(*range);
+        return true;
+    }
+
+    void TargetSet::addAddress(const uint32_t address) {
+
+        m_ranges.push_back(Range{address, address});
+    }
+
+    bool TargetSet::addTargetFile(const std::string& path) {
+
+        try {
+
+            m_files.push_back(std::make_unique<TargetFile>(path));
+        }
+        catch (std::system_error&) {
+
+            return false;
+        }
+
+        return true;
+    }
+
+    size_t TargetSet::getMalformedCount(void) const {
+
+        return m_malformed;
+    }
+
+    std::optional<TargetSet::Range> TargetSet::parseRange(const std::string_view target) {
+
+        const size_t slash = target.find('/');
+        if (std::string_view::npos != slash) {
+
+            const std::optional<uint32_t> address = parseIPv4Address(std::string(target.substr(0, slash)));
+            const std::optional<uint32_t> length = parsePrefixLength(std::string(target.substr(slash + 1)));
+            if (!address || !length) {
+                return std::nullopt;
+            }
+
+            // Any host bits in the address are ignored, 10.0.0.7/24 is the same block as 10.0.0.0/24
+            const uint32_t hostMask = 0 == *length ? ~static_cast<uint32_t>(0) :
+                (static_cast<uint32_t>(1) << (32 - *length)) - 1;
+            return Range{*address & ~hostMask, *address | hostMask};
+        }
+
+        const size_t dash = target.find('-');
+        if (std::string_view::npos != dash) {
+
+            const std::optional<uint32_t> first = parseIPv4Address(std::string(target.substr(0, dash)));
+            const std::optional<uint32_t> last = parseIPv4Address(std::string(target.substr(dash + 1)));
+            if (!first || !last || *last < *first) {
+                return std::nullopt;
+            }
+
+            return Range{*first, *last};
+        }
+
+        const std::optional<uint32_t> address = parseIPv4Address(std::string(target));
+        if (!address) {
+            return std::nullopt;
+        }
+
+        return Range{*address, *address};
+    }
+
+    void TargetSet::setExclusions(const ExclusionSet* const exclusions) {
+
+        m_exclusions = exclusions;
+    }
+
+    uint64_t TargetSet::size(void) const {
+
+        uint64_t total = 0;
+        for (const Range& range : m_ranges) {
+            total += static_cast<uint64_t>(range.m_last - range.m_first) + 1;
+        }
+
+        return total;
+    }
+
+    bool TargetSet::empty(void) const {
+
+        return m_ranges.empty() && m_files.empty();
+    }
+
+    TargetSet::Iterator TargetSet::begin(void) const {
+
+        return Iterator(*this);
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <optional>
+
+#include "ExclusionSet.h"
+#include "TargetFile.h"
+
+
+namespace PortQuery {
+
+    // The targets named in a FROM clause. Each one is a single address, a CIDR block (10.0.0.0/16) or an
+    // inclusive range (10.0.0.1-10.0.0.50), and is kept as nothing more than its first and last address, so a
+    // /8 costs no more to hold than a single host. Addresses are handed out one at a time by an Iterator, in the
+    // order they were added. Targets which overlap are not merged, an address named twice is swept twice.
+    // Addresses in the exclusion set are skipped over by the iterator, they never make it as far as a probe.
+    //
+    // Targets can also come from files (see TargetFile), which are walked after everything added directly.
+    // Nothing is read out of a file until an iterator gets to it, and then only a line at a time, so the first
+    // targets can be swept while the rest of the file is still unread. A file can only be read once, so only
+    // the first iterator to get to it sees its targets
+    class TargetSet {
+
+            struct Range {
+
+                uint32_t m_first;
+                uint32_t m_last;
+            };
+
+        public:
+
+            class Iterator {
+
+                public:
+
+                    // The next address to sweep, nothing once every target has been walked
+                    std::optional<uint32_t> next(void);
+
+                private:
+
+                    friend class TargetSet;
+                    Iterator(const TargetSet& targets) : m_targets(&targets) { }
+
+                    // Moves on to the next range or file entry, false once everything has been walked
+                    bool nextRange(void);
+
+                    const TargetSet* m_targets;
+                    size_t m_range = 0;
+                    size_t m_file = 0;
+                    std::optional<Range> m_current;
+
+                    // Offset into the current range, wide enough to step past 255.255.255.255
+                    uint64_t m_offset = 0;
+
+                    // Addresses in [m_clearFrom, m_clearTo) are known not to be excluded, only stepping outside
+                    // of it costs a lookup
+                    uint64_t m_clearFrom = 0;
+                    uint64_t m_clearTo = 0;
+            };
+
+            // Returns false if the target isn't an address, block or range. Nothing is added in that case. A
+            // target starting with @ names a file to read more targets from, @- is stdin
+            bool addTarget(const std::string& target);
+
+            // A single address in host byte order, one a hostname resolved to
+            void addAddress(const uint32_t address);
+
+            // One address, block or range to a line. Returns false if the file can't be opened
+            bool addTargetFile(const std::string& path);
+
+            // The lines read out of files so far which didn't hold a target
+            size_t getMalformedCount(void) const;
+
+            // Has to outlive the set, null for no exclusions
+            void setExclusions(const ExclusionSet* const exclusions);
+
+            // The number of addresses over every target before any are excluded, a /0 alone is 2^32. Targets in
+            // files aren't counted, they aren't known until they have been read
+            uint64_t size(void) const;
+            bool empty(void) const;
+
+            // The set has to outlive the iterators it hands out
+            Iterator begin(void) const;
+
+        private:
+
+            static std::optional<Range> parseRange(const std::string_view target);
+
+            std::vector<Range> m_ranges;
+            std::vector<std::unique_ptr<TargetFile>> m_files;
+            const ExclusionSet* m_exclusions = nullptr;
+
+            // Counted by whichever iterator reads the file
+            mutable size_t m_malformed = 0;
+    };
+}
@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <limits>
+
+#include "TimingWheel.h"
+
+
+namespace PortQuery {
+
+    TimingWheel::TimingWheel(const Clock::duration tick, const Clock::time_point start) : m_tick(tick),
+        m_start(start), m_current(0), m_freeList(INVALID_HANDLE), m_size(0) {
+
+        m_buckets.fill(INVALID_HANDLE);
+        for (auto& level : m_occupied) {
+            level.fill(0);
+        }
+    }
+
+    TimingWheel::Handle TimingWheel::schedule(const Clock::time_point expiry, const uint64_t payload) {
+
+        Handle handle = m_freeList;
+        if (INVALID_HANDLE != handle) {
+            m_freeList = m_timers[handle].m_next;
+        }
+
+        else {
+
+            handle = static_cast<Handle>(m_timers.size());
+            m_timers.emplace_back();
+        }
+
+        // The current tick has already been expired, so the earliest a timer can go off is the next one
+        constexpr uint64_t MAX_DISTANCE = (1ULL << (LEVELS * SLOT_BITS)) - 1;
+        uint64_t tick = m_current + MAX_DISTANCE;
+        if (expiry < getTime(tick)) {
+            tick = std::max(getTick(expiry + m_tick - Clock::duration(1)), m_current + 1);
+        }
+
+        Timer& timer = m_timers[handle];
+        timer.m_expiry = tick;
+        timer.m_payload = payload;
+
+        place(handle);
+        m_size++;
+        return handle;
+    }
+
+    void TimingWheel::cancel(const Handle handle) {
+
+        unlink(handle);
+        m_timers[handle].m_bucket = FREE_BUCKET;
+        m_timers[handle].m_next = m_freeList;
+        m_freeList = handle;
+        m_size--;
+    }
+
+    void TimingWheel::advance(const Clock::time_point now, std::vector<uint64_t>& expired) {
+
+        const uint64_t target = getTick(now);
+        while (m_current < target) {
+
+            // Nothing happens on the ticks in between, skip straight to the next one which does something
+            const uint64_t next = getNextTick();
+            if (next > target) {
+
+                m_current = target;
+                break;
+            }
+
+            m_current = next;
+
+            // A slot further up is due to be spread over the levels below when the current tick crosses into
+            // it. Start from the top so whatever comes down gets cascaded again if it has to.
+            for (uint32_t level = LEVELS - 1; level > 0; level--) {
+
+                if (0 == (m_current & ((1ULL << (level * SLOT_BITS)) - 1))) {
+                    cascade(level);
+                }
+            }
+
+            const uint32_t bucket = static_cast<uint32_t>(m_current & SLOT_MASK);
+            while (INVALID_HANDLE != m_buckets[bucket]) {
+
+                const Handle handle = m_buckets[bucket];
+                expired.push_back(m_timers[handle].m_payload);
+                cancel(handle);
+            }
+        }
+    }
+
+    TimingWheel::Clock::time_point TimingWheel::getNextExpiry(void) const {
+
+        const uint64_t next = getNextTick();
+        if (std::numeric_limits<uint64_t>::max() == next) {
+            return Clock::time_point::max();
+        }
+
+        return getTime(next);
+    }
+
+    size_t TimingWheel::size(void) const {
+
+        return m_size;
+    }
+
+    bool TimingWheel::empty(void) const {
+
+        return 0 == m_size;
+    }
+
+    uint64_t TimingWheel::getTick(const Clock::time_point time) const {
+
+        if (time <= m_start) {
+            return 0;
+        }
+
+        return static_cast<uint64_t>((time - m_start) / m_tick);
+    }
+
+    TimingWheel::Clock::time_point TimingWheel::getTime(const uint64_t tick) const {
+
+        return m_start + m_tick * static_cast<Clock::duration::rep>(tick);
+    }
+
+    void TimingWheel::place(const Handle handle) {
+
+        // The level is picked by how far out the timer is and the slot by its absolute tick, so a slot on a
+        // level always holds timers which come due within the same span of the level below
+        Timer& timer = m_timers[handle];
+        const uint64_t distance = timer.m_expiry - m_current;
+
+        uint32_t level = 0;
+        while (level < LEVELS - 1 && distance >= (1ULL << ((level + 1) * SLOT_BITS))) {
+            level++;
+        }
+
+        const uint32_t slot = static_cast<uint32_t>((timer.m_expiry >> (level * SLOT_BITS)) & SLOT_MASK);
+        const uint32_t bucket = level * SLOTS + slot;
+
+        timer.m_bucket = bucket;
+        timer.m_previous = INVALID_HANDLE;
+        timer.m_next = m_buckets[bucket];
+        if (INVALID_HANDLE != timer.m_next) {
+            m_timers[timer.m_next].m_previous = handle;
+        }
+
+        m_buckets[bucket] = handle;
+        m_occupied[level][slot / 64] |= 1ULL << (slot % 64);
+    }
+
+    void TimingWheel::unlink(const Handle handle) {
+
+        Timer& timer = m_timers[handle];
+        if (INVALID_HANDLE != timer.m_previous) {
+            m_timers[timer.m_previous].m_next = timer.m_next;
+        }
+
+        else {
+            m_buckets[timer.m_bucket] = timer.m_next;
+        }
+
+        if (INVALID_HANDLE != timer.m_next) {
+            m_timers[timer.m_next].m_previous = timer.m_previous;
+        }
+
+        if (INVALID_HANDLE == m_buckets[timer.m_bucket]) {
+
+            const uint32_t level = timer.m_bucket / SLOTS;
+            const uint32_t slot = timer.m_bucket % SLOTS;
+            m_occupied[level][slot / 64] &= ~(1ULL << (slot % 64));
+        }
+    }
+
+    void TimingWheel::cascade(const uint32_t level) {
+
+        const uint32_t slot = static_cast<uint32_t>((m_current >> (level * SLOT_BITS)) & SLOT_MASK);
+        const uint32_t bucket = level * SLOTS + slot;
+
+        Handle handle = m_buckets[bucket];
+        m_buckets[bucket] = INVALID_HANDLE;
+        m_occupied[level][slot / 64] &= ~(1ULL << (slot % 64));
+        while (INVALID_HANDLE != handle) {
+
+            const Handle next = m_timers[handle].m_next;
+            place(handle);
+            handle = next;
+        }
+    }
+
+    uint64_t TimingWheel::getNextTick(void) const {
+
+        if (0 == m_size) {
+            return std::numeric_limits<uint64_t>::max();
+        }
+
+        // Timers on the bottom level expire on their slot's tick, the ones above only need the wheel to stop
+        // by when their slot gets cascaded, which can come before anything on the levels below is due
+        uint64_t next = std::numeric_limits<uint64_t>::max();
+        for (uint32_t level = 0; level < LEVELS; level++) {
+
+            const uint32_t shift = level * SLOT_BITS;
+            const uint32_t distance = findOccupied(level, static_cast<uint32_t>((m_current >> shift) & SLOT_MASK));
+            if (0 != distance) {
+                next = std::min(next, ((m_current >> shift) + distance) << shift);
+            }
+        }
+
+        return next;
+    }
+
+    uint32_t TimingWheel::findOccupied(const uint32_t level, const uint32_t slot) const {
+
+        // Search the slots after this one, then wrap round to the start and finish on this slot itself
+        const auto& occupied = m_occupied[level];
+        for (uint32_t step = 0; step <= BITMAP_WORDS; step++) {
+
+            const uint32_t word = ((slot + 1) / 64 + step) % BITMAP_WORDS;
+            uint64_t bits = occupied[word];
+            if (0 == step) {
+                bits &= ~0ULL << ((slot + 1) % 64);
+            }
+
+            if (0 != bits) {
+
+                const uint32_t found = word * 64 + static_cast<uint32_t>(__builtin_ctzll(bits));
+                return (found + SLOTS - slot - 1) % SLOTS + 1;
+            }
+        }
+
+        return 0;
+    }
+}
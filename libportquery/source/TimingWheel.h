@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+
+namespace PortQuery {
+
+    // A hierarchical timing wheel (Varghese & Lauck) holding every probe deadline and retransmit time. Timers
+    // are hashed into one of four levels of 256 slots depending on how far out they are, so scheduling and
+    // cancelling are O(1) no matter how many probes are in flight, and a timer is only touched again when the
+    // wheel cascades it down a level on its way to expiring. Timers carry an opaque 64 bit payload which is
+    // handed back when they expire.
+    class TimingWheel {
+
+        public:
+
+            using Clock = std::chrono::steady_clock;
+            using Handle = uint32_t;
+
+            static constexpr Handle INVALID_HANDLE = std::numeric_limits<Handle>::max();
+
+            TimingWheel(const Clock::duration tick=TICK_DEFAULT, const Clock::time_point start=Clock::now());
+
+            // Timers never fire early, the expiry is rounded up to the next tick. Anything already in the past
+            // fires on the next call to advance. Expiries further out than the wheel spans (2^32 ticks) are
+            // clamped to the end of the wheel.
+            Handle schedule(const Clock::time_point expiry, const uint64_t payload);
+
+            // The handle has to belong to a timer which hasn't expired yet, once a timer's payload was handed
+            // out by advance its handle is free to be reused for another one
+            void cancel(const Handle handle);
+
+            // Moves the wheel up to now, appending the payload of every timer which expired on the way
+            void advance(const Clock::time_point now, std::vector<uint64_t>& expired);
+
+            // When advance next has something to do, either expire a timer or cascade a slot holding the next
+            // one down a level. Clock::time_point::max() if there are no timers at all.
+            Clock::time_point getNextExpiry(void) const;
+
+            size_t size(void) const;
+            bool empty(void) const;
+
+        private:
+
+            static constexpr Clock::duration TICK_DEFAULT = std::chrono::milliseconds(1);
+
+            static constexpr uint32_t LEVELS = 4;
+            static constexpr uint32_t SLOT_BITS = 8;
+            static constexpr uint32_t SLOTS = 1 << SLOT_BITS;
+            static constexpr uint64_t SLOT_MASK = SLOTS - 1;
+            static constexpr uint32_t BITMAP_WORDS = SLOTS / 64;
+
+            static constexpr uint32_t FREE_BUCKET = std::numeric_limits<uint32_t>::max();
+
+            struct Timer {
+
+                uint64_t m_expiry;
+                uint64_t m_payload;
+                Handle m_previous;
+                Handle m_next;
+                uint32_t m_bucket;
+            };
+
+            uint64_t getTick(const Clock::time_point time) const;
+            Clock::time_point getTime(const uint64_t tick) const;
+
+            void place(const Handle handle);
+            void unlink(const Handle handle);
+            void cascade(const uint32_t level);
+
+            // The first tick on which advance has to do something, max if the wheel is empty
+            uint64_t getNextTick(void) const;
+
+            // How many slots past the given one the next occupied slot on a level is, going round the wheel,
+            // and 0 if the level is empty
+            uint32_t findOccupied(const uint32_t level, const uint32_t slot) const;
+
+            Clock::duration m_tick;
+            Clock::time_point m_start;
+
+            // Every tick up to and including this one has been expired
+            uint64_t m_current;
+
+            std::vector<Timer> m_timers;
+            Handle m_freeList;
+            size_t m_size;
+
+            std::array<Handle, LEVELS * SLOTS> m_buckets;
+            std::array<std::array<uint64_t, BITMAP_WORDS>, LEVELS> m_occupied;
+    };
+}
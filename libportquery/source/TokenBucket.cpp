@@ -0,0 +1,70 @@
+#include <algorithm>
+
+#include "TokenBucket.h"
+
+
+namespace PortQuery {
+
+    TokenBucket::TokenBucket(const double rate, const double burst) : 
+        m_rate(rate), m_burst(burst), m_tokens(burst), m_lastRefill(Clock::now()) { }
+
+    void TokenBucket::setRate(const double rate) {
+
+        refill(Clock::now());
+        m_rate = rate;
+    }
+
+    void TokenBucket::setBurst(const double burst) {
+
+        refill(Clock::now());
+        m_burst = burst;
+        m_tokens = std::min(m_tokens, m_burst);
+    }
+
+    double TokenBucket::getRate(void) const {
+
+        return m_rate;
+    }
+
+    void TokenBucket::refill(const Clock::time_point now) {
+
+        if (now <= m_lastRefill) {
+            return;
+        }
+
+        const std::chrono::duration<double> elapsed = now - m_lastRefill;
+        m_tokens = std::min(m_burst, m_tokens + elapsed.count() * m_rate);
+        m_lastRefill = now;
+    }
+
+    bool TokenBucket::tryConsume(const Clock::time_point now) {
+
+        if (0.0 == m_rate) {
+            return true;
+        }
+
+        refill(now);
+        if (m_tokens < 1.0) {
+            return false;
+        }
+
+        m_tokens -= 1.0;
+        return true;
+    }
+
+    void TokenBucket::refund(void) {
+
+        m_tokens = std::min(m_burst, m_tokens + 1.0);
+    }
+
+    TokenBucket::Clock::time_point TokenBucket::getNextAvailable(const Clock::time_point now) {
+
+        refill(now);
+        if (0.0 == m_rate || m_tokens >= 1.0) {
+            return now;
+        }
+
+        const std::chrono::duration<double> wait((1.0 - m_tokens) / m_rate);
+        return now + std::chrono::ceil<Clock::duration>(wait);
+    }
+}
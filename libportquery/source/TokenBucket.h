@@ -0,0 +1,39 @@
+#pragma once
+
+#include <chrono>
+
+
+namespace PortQuery {
+
+    // A classic token bucket. Tokens accumulate at a fixed rate up to the burst size, and every event
+    // consumes one. A rate of zero means the bucket never runs dry.
+    class TokenBucket {
+
+        public:
+
+            using Clock = std::chrono::steady_clock;
+
+            TokenBucket(const double rate=0.0, const double burst=1.0);
+
+            void setRate(const double rate);
+            double getRate(void) const;
+            void setBurst(const double burst);
+
+            bool tryConsume(const Clock::time_point now);
+
+            // Puts back a token which was consumed for an event that didn't happen after all
+            void refund(void);
+
+            // The earliest point in time at which a token will be available
+            Clock::time_point getNextAvailable(const Clock::time_point now);
+
+        private:
+
+            void refill(const Clock::time_point now);
+
+            double m_rate;
+            double m_burst;
+            double m_tokens;
+            Clock::time_point m_lastRefill;
+    };
+}
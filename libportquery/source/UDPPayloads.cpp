@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <iterator>
+
+#include "UDPPayloads.h"
+
+
+namespace PortQuery {
+
+    using namespace std::literals::string_view_literals;
+
+    struct UDPPayload {
+
+        uint16_t m_port;
+        std::string_view m_payload;
+    };
+
+    // Sorted by port. Anything with a transaction ID uses "PQ" (or "PQRS...") so replies are easy to spot in a capture
+    static constexpr UDPPayload UDP_PAYLOADS[] = {
+
+        // DNS, a query for the root name servers
+        { 53, "PQ\x01\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00\x00\x02\x00\x01"sv },
+
+        // TFTP, a read request, answered with either the file or an error
+        { 69, "\x00\x01portquery.txt\x00octet\x00"sv },
+
+        // ONC RPC portmapper, a call to the NULL procedure
+        { 111, "r\xfe\x1d\x13\x00\x00\x00\x00\x00\x00\x00\x02\x00\x01\x86\xa0\x00\x00\x00\x02\x00\x00\x00\x00"
+            "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"sv },
+
+        // NTP, a version 4 client request
+        { 123, "\xe3\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+            "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"sv },
+
+        // NetBIOS name service, a node status request for the wildcard name
+        { 137, "PQ\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00 CKAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA\x00\x00!\x00\x01"sv },
+
+        // SNMP, a version 1 get-next of 1.3.6.1.2.1 with the community "public"
+        { 161, "0&\x02\x01\x00\x04\x06public\xa1\x19\x02\x04PQRS\x02\x01\x00\x02\x01\x00" "0\x0b"
+            "0\x09\x06\x05+\x06\x01\x02\x01\x05\x00"sv },
+
+        // XDMCP, a query with no authentication names
+        { 177, "\x00\x01\x00\x02\x00\x01\x00"sv },
+
+        // RIPv2, a request for the entire routing table
+        { 520, "\x01\x02\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x10"sv },
+
+        // OpenVPN, a client hard reset
+        { 1194, "8PQRSTUVW\x00\x00\x00\x00\x00"sv },
+
+        // SQL Server browser, a request for the instance list
+        { 1434, "\x02"sv },
+
+        // SSDP, a search for everything
+        { 1900, "M-SEARCH * HTTP/1.1\r\nHOST: 239.255.255.250:1900\r\nMAN: \"ssdp:discover\"\r\nMX: 1\r\n"
+            "ST: ssdp:all\r\n\r\n"sv },
+
+        // NFS, a call to the NULL procedure of version 3
+        { 2049, "r\xfe\x1d\x13\x00\x00\x00\x00\x00\x00\x00\x02\x00\x01\x86\xa3\x00\x00\x00\x03\x00\x00\x00\x00"
+            "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"sv },
+
+        // STUN, a binding request
+        { 3478, "\x00\x01\x00\x00!\x12\xa4" "BPortQueryTxn"sv },
+
+        // NAT-PMP, a request for the external address
+        { 5351, "\x00\x00"sv },
+
+        // mDNS, a query for every service type being advertised
+        { 5353, "\x00\x00\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00\x09_services\x07_dns-sd\x04_udp\x05local\x00"
+            "\x00\x0c\x00\x01"sv },
+
+        // LLMNR, a query for localhost
+        { 5355, "PQ\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00\x09localhost\x00\x00\x01\x00\x01"sv },
+
+        // CoAP, a GET of /.well-known/core
+        { 5683, "@\x01PQ\xbb.well-known\x04" "core"sv },
+
+        // Ubiquiti discovery
+        { 10001, "\x01\x00\x00\x00"sv },
+
+        // memcached, a stats command behind the UDP frame header
+        { 11211, "\x00\x01\x00\x00\x00\x01\x00\x00stats\r\n"sv },
+    };
+
+    std::string_view getUDPPayload(const uint16_t port) {
+
+        const auto payloadIter = std::lower_bound(std::begin(UDP_PAYLOADS), std::end(UDP_PAYLOADS), port, 
+                [] (const UDPPayload& payload, const uint16_t value) { return payload.m_port < value; });
+
+        if (std::end(UDP_PAYLOADS) == payloadIter || port != payloadIter->m_port) {
+            return std::string_view();
+        }
+
+        return payloadIter->m_payload;
+    }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+
+namespace PortQuery {
+
+    // Most UDP services silently drop a datagram they can't parse, so an empty probe to an open port looks exactly
+    // like a filtered one and has to wait out the timeout. Sending a request the service understands gets an
+    // answer back straight away.
+    //
+    // Returns the payload to send to a port, or an empty view if there is no well known payload for it
+    std::string_view getUDPPayload(const uint16_t port);
+}
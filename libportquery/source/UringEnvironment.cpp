@@ -0,0 +1,578 @@
+#include <system_error>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+
+#include "UringEnvironment.h"
+#include "UDPPayloads.h"
+
+
+namespace PortQuery {
+
+    UringEnvironment::UringEnvironment(const int threadCount) : m_governor(0), 
+        m_descriptorLimit(raiseDescriptorLimit()), m_descriptorStalls(0), m_provisionalCount(0), m_nextSource(0), 
+        m_measureLatency(false), m_bannerPool(nullptr), m_bannerWait{}, m_wakeupArmed(false), m_threadCount(threadCount),
+        m_ring(RING_ENTRIES) {
+
+        // Every chain holds a socket, so the window can't be any larger than the descriptor limit allows either.
+        // Environments running side by side each get an even share of the descriptors
+        uint32_t maxInFlight = m_ring.getCompletionCapacity() / MAX_CHAIN_LENGTH;
+        if (m_descriptorLimit > 0) {
+
+            const size_t available = m_descriptorLimit - std::min(m_descriptorLimit, RESERVED_DESCRIPTORS);
+            maxInFlight = static_cast<uint32_t>(std::max<size_t>(1, std::min<size_t>(maxInFlight,
+                            available / static_cast<size_t>(std::max(threadCount, 1)))));
+        }
+
+        m_governor = RateGovernor(maxInFlight);
+        m_probes.resize(maxInFlight);
+        m_freeSlots.reserve(maxInFlight);
+        for (uint32_t slot = maxInFlight; slot > 0; slot--) {
+
+            m_probes[slot - 1].m_fd = -1;
+            m_probes[slot - 1].m_provisional = false;
+            m_probes[slot - 1].m_provisionalDeadline = false;
+            m_probes[slot - 1].m_banner = BufferPool::INVALID_HANDLE;
+            m_freeSlots.push_back(slot - 1);
+        }
+    }
+
+    UringEnvironment::~UringEnvironment() {
+
+        if (m_freeSlots.size() == m_probes.size()) {
+            return;
+        }
+
+        // The kernel may still be writing into receive buffers, so everything outstanding is cancelled and
+        // drained before the slots go away
+        io_uring_sqe* entry = m_ring.getSubmissionEntry();
+        entry->opcode = IORING_OP_ASYNC_CANCEL;
+        entry->cancel_flags = IORING_ASYNC_CANCEL_ANY | IORING_ASYNC_CANCEL_ALL;
+        entry->user_data = CANCEL_USER_DATA;
+        entry->flags = IOSQE_CQE_SKIP_SUCCESS;
+
+        try {
+
+            while (m_freeSlots.size() != m_probes.size()) {
+
+                if (!reapCompletions()) {
+                    m_ring.submit(1);
+                }
+            }
+        }
+        catch (std::exception&) { }
+    }
+
+    bool UringEnvironment::scanPort(void) {
+
+        const NetworkProtocol protocols = getProtocolsToScan() & (NetworkProtocol::TCP | NetworkProtocol::UDP);
+        m_collector.expectScan(getAddress(), getPort(), protocols);
+
+        if (NetworkProtocol::TCP == (protocols & NetworkProtocol::TCP)) {
+
+            submitProbe(acquireSlot(SOCK_STREAM));
+        }
+
+        if (NetworkProtocol::UDP == (protocols & NetworkProtocol::UDP)) {
+
+            submitProbe(acquireSlot(SOCK_DGRAM));
+        }
+
+        return true;
+    }
+
+    void UringEnvironment::setTimeout(const int timeout) {
+
+        IEnvironment::setTimeout(timeout);
+        m_estimator.setCeiling(std::chrono::seconds(timeout));
+    }
+
+    void UringEnvironment::setMaxRate(const double rate) {
+
+        m_governor.setMaxRate(rate);
+    }
+
+    void UringEnvironment::addSourceAddress(const uint32_t address) {
+
+        m_sourceAddresses.push_back(address);
+    }
+
+    void UringEnvironment::releaseTargets(const std::vector<uint32_t>& targets) {
+
+        for (const uint32_t target : targets) {
+            m_estimator.forgetHost(target);
+        }
+    }
+
+    void UringEnvironment::setMeasureLatency(const bool enabled) {
+
+        m_measureLatency = enabled;
+    }
+
+    void UringEnvironment::setBannerCapture(const size_t length, const std::chrono::milliseconds wait) {
+
+        // Every slot can be reading a banner while just as many finished rows wait to be reported, see
+        // NetworkEnvironment
+        m_bannerPool = &createBannerPool(length, 2 * m_probes.size() + 1);
+        const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(wait);
+        const auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(wait - seconds);
+        m_bannerWait = __kernel_timespec{seconds.count(), nanoseconds.count()};
+    }
+
+    PQ_SCAN_STATS UringEnvironment::getScanStatistics(void) const {
+
+        return PQ_SCAN_STATS{m_probes.size(), m_descriptorLimit, m_descriptorStalls};
+    }
+
+    bool UringEnvironment::getNextScanResult(const bool blocking) {
+
+        ScanRow row;
+        while (!m_collector.popCompleted(row)) {
+
+            if (reapCompletions()) {
+                continue;
+            }
+
+            else if (!blocking || m_freeSlots.size() == m_probes.size()) {
+                return false;
+            }
+
+            m_ring.submit(1);
+        }
+
+        loadScanRow(row);
+        return true;
+    }
+
+    void UringEnvironment::waitToSend(void) {
+
+        Clock::time_point now = Clock::now();
+        while (m_freeSlots.empty() || !m_governor.tryAcquire(now, m_probes.size() - m_freeSlots.size())) {
+
+            if (reapCompletions()) {
+
+                now = Clock::now();
+                continue;
+            }
+
+            // A full window (or a full set of slots) only opens back up on a completion, otherwise the wait is
+            // over as soon as the governor has a token to hand out
+            const Clock::time_point nextSend = m_freeSlots.empty() ? Clock::time_point::max() :
+                m_governor.getNextSend(now, m_probes.size() - m_freeSlots.size());
+            if (Clock::time_point::max() == nextSend) {
+                m_ring.submit(1);
+            }
+
+            else {
+                m_ring.submit(1, nextSend - now);
+            }
+
+            now = Clock::now();
+        }
+    }
+
+    int UringEnvironment::createSocket(const int type) {
+
+        const int fd = socket(AF_INET, type | SOCK_CLOEXEC, 0);
+        if (-1 == fd || SOCK_STREAM != type) {
+            return fd;
+        }
+
+        // Probe sockets are closed as soon as the probe completes, without the reset every open port would leave
+        // a connection sitting in TIME_WAIT
+        uint32_t source = INADDR_ANY;
+        if (!m_sourceAddresses.empty()) {
+            source = m_sourceAddresses[m_nextSource++ % m_sourceAddresses.size()];
+        }
+
+        if (!prepareConnectSocket(fd, source)) {
+
+            const int error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), "Unable to set up probe socket from " +
+                    formatIPv4Address(source));
+        }
+
+        return fd;
+    }
+
+    uint32_t UringEnvironment::acquireSlot(const int type) {
+
+        waitToSend();
+
+        int fd = -1;
+        while (-1 == (fd = createSocket(type))) {
+
+            // Running out of descriptors is only fatal if there is nothing in flight that could give one back
+            if ((EMFILE != errno && ENFILE != errno) || m_freeSlots.size() == m_probes.size()) {
+                throw std::system_error(errno, std::generic_category(), "Unable to create probe socket");
+            }
+
+            m_descriptorStalls++;
+            if (!reapCompletions()) {
+                m_ring.submit(1);
+            }
+        }
+
+        const uint32_t slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+
+        Probe& probe = m_probes[slot];
+        probe.m_fd = fd;
+        probe.m_address = getAddress();
+        probe.m_port = getPort();
+        probe.m_protocol = SOCK_STREAM == type ? NetworkProtocol::TCP : NetworkProtocol::UDP;
+        probe.m_attempt = 0;
+        probe.m_target = makeSocketAddress(probe.m_address, probe.m_port);
+        probe.m_timeoutLength = m_estimator.getTimeout(probe.m_address);
+        probe.m_provisional = !m_estimator.hasSamples();
+        m_provisionalCount += probe.m_provisional ? 1 : 0;
+        return slot;
+    }
+
+    void UringEnvironment::submitProbe(const uint32_t slot) {
+
+        Probe& probe = m_probes[slot];
+        probe.m_result = PQ_QUERY_RESULT::CLOSED;
+        probe.m_latency = PQ_LATENCY::zero();
+        probe.m_bannerLength = 0;
+        probe.m_timedOut = false;
+        probe.m_sent = Clock::now();
+
+        const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(probe.m_timeoutLength);
+        const auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(probe.m_timeoutLength - seconds);
+        probe.m_timeout = __kernel_timespec{seconds.count(), nanoseconds.count()};
+
+        if (NetworkProtocol::TCP == probe.m_protocol) {
+            submitTCPProbe(slot);
+        }
+
+        else {
+            submitUDPProbe(slot);
+        }
+    }
+
+    bool UringEnvironment::retryProbe(const uint32_t slot) {
+
+        Probe& probe = m_probes[slot];
+        if (!probe.m_timedOut || PQ_QUERY_RESULT::CLOSED != probe.m_result || probe.m_attempt > 0 ||
+                probe.m_timeoutLength >= m_estimator.getCeiling()) {
+            return false;
+        }
+
+        const int fd = createSocket(NetworkProtocol::TCP == probe.m_protocol ? SOCK_STREAM : SOCK_DGRAM);
+        if (-1 == fd) {
+            return false;
+        }
+
+        close(probe.m_fd);
+        probe.m_fd = fd;
+        probe.m_attempt++;
+        probe.m_timeoutLength = std::min(probe.m_timeoutLength * 2, m_estimator.getCeiling());
+        submitProbe(slot);
+        return true;
+    }
+
+    void UringEnvironment::addSample(const uint32_t slot, const Clock::time_point sent) {
+
+        const Clock::time_point now = Clock::now();
+        m_estimator.addSample(m_probes[slot].m_address, now - sent);
+        m_governor.addRTTSample(now - sent);
+        m_governor.onReply();
+        if (m_probes[slot].m_attempt > 0) {
+            m_governor.onLoss(now);
+        }
+
+        if (0 == m_provisionalCount) {
+            return;
+        }
+
+        // New chains are never provisional once there is a sample, so this only ever happens once
+        for (uint32_t index = 0; index < m_probes.size(); index++) {
+
+            Probe& probe = m_probes[index];
+            if (-1 == probe.m_fd || !probe.m_provisional) {
+                continue;
+            }
+
+            probe.m_provisional = false;
+            if (Clock::time_point() != probe.m_sent) {
+
+                probe.m_timeoutLength = m_estimator.getTimeout(probe.m_address);
+                probe.m_provisionalDeadline = true;
+                m_provisionalDeadlines.push(ProvisionalDeadline{probe.m_sent + probe.m_timeoutLength, index});
+            }
+        }
+
+        m_provisionalCount = 0;
+        armWakeup(now);
+    }
+
+    void UringEnvironment::expireProvisional(const Clock::time_point now) {
+
+        while (!m_provisionalDeadlines.empty() && m_provisionalDeadlines.top().m_expiry <= now) {
+
+            const uint32_t slot = m_provisionalDeadlines.top().m_slot;
+            m_provisionalDeadlines.pop();
+
+            // The flag is cleared when the slot is released, so a reused slot is never cancelled by mistake
+            Probe& probe = m_probes[slot];
+            if (!probe.m_provisionalDeadline) {
+                continue;
+            }
+
+            // Cancelling the operation which is waiting also takes down the linked timeout. The probe is treated
+            // exactly as if the timeout had fired
+            probe.m_provisionalDeadline = false;
+            probe.m_timedOut = true;
+            io_uring_sqe* entry = m_ring.getSubmissionEntry();
+            entry->opcode = IORING_OP_ASYNC_CANCEL;
+            entry->fd = -1;
+            entry->addr = makeUserData(slot, NetworkProtocol::TCP == probe.m_protocol ? OP_CONNECT : OP_RECEIVE);
+            entry->flags = IOSQE_CQE_SKIP_SUCCESS;
+            entry->user_data = CANCEL_USER_DATA;
+        }
+    }
+
+    void UringEnvironment::armWakeup(const Clock::time_point now) {
+
+        if (m_wakeupArmed || m_provisionalDeadlines.empty()) {
+            return;
+        }
+
+        const auto remaining = std::max<std::chrono::nanoseconds>(m_provisionalDeadlines.top().m_expiry - now,
+                std::chrono::nanoseconds(0));
+        const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(remaining);
+        m_wakeupTimeout = __kernel_timespec{seconds.count(), (remaining - seconds).count()};
+
+        io_uring_sqe* entry = m_ring.getSubmissionEntry();
+        entry->opcode = IORING_OP_TIMEOUT;
+        entry->fd = -1;
+        entry->addr = reinterpret_cast<uint64_t>(&m_wakeupTimeout);
+        entry->len = 1;
+        entry->user_data = WAKEUP_USER_DATA;
+        m_wakeupArmed = true;
+    }
+
+    void UringEnvironment::prepareConnect(const uint32_t slot) {
+
+        Probe& probe = m_probes[slot];
+        io_uring_sqe* entry = m_ring.getSubmissionEntry();
+        entry->opcode = IORING_OP_CONNECT;
+        entry->fd = probe.m_fd;
+        entry->addr = reinterpret_cast<uint64_t>(&probe.m_target);
+        entry->off = sizeof(probe.m_target);
+        entry->flags = IOSQE_IO_LINK;
+        entry->user_data = makeUserData(slot, OP_CONNECT);
+    }
+
+    void UringEnvironment::prepareTimeout(const uint32_t slot) {
+
+        io_uring_sqe* entry = m_ring.getSubmissionEntry();
+        entry->opcode = IORING_OP_LINK_TIMEOUT;
+        entry->fd = -1;
+        entry->addr = reinterpret_cast<uint64_t>(&m_probes[slot].m_timeout);
+        entry->len = 1;
+        entry->user_data = makeUserData(slot, OP_TIMEOUT);
+    }
+
+    void UringEnvironment::submitTCPProbe(const uint32_t slot) {
+
+        if (m_ring.getSubmissionSpace() < 2) {
+            m_ring.submit(0);
+        }
+
+        m_probes[slot].m_outstanding = 2;
+        prepareConnect(slot);
+        prepareTimeout(slot);
+    }
+
+    void UringEnvironment::submitUDPProbe(const uint32_t slot) {
+
+        if (m_ring.getSubmissionSpace() < MAX_CHAIN_LENGTH) {
+            m_ring.submit(0);
+        }
+
+        Probe& probe = m_probes[slot];
+        probe.m_outstanding = MAX_CHAIN_LENGTH;
+        prepareConnect(slot);
+
+        // The socket is connected so no address is needed. The payload table is static, so the kernel can
+        // read straight out of it
+        const std::string_view payload = getUDPPayload(probe.m_port);
+        probe.m_sendVector = iovec{const_cast<char*>(payload.data()), payload.size()};
+        std::memset(&probe.m_sendHeader, 0, sizeof(probe.m_sendHeader));
+        probe.m_sendHeader.msg_iov = &probe.m_sendVector;
+        probe.m_sendHeader.msg_iovlen = 1;
+        io_uring_sqe* entry = m_ring.getSubmissionEntry();
+        entry->opcode = IORING_OP_SENDMSG;
+        entry->fd = probe.m_fd;
+        entry->addr = reinterpret_cast<uint64_t>(&probe.m_sendHeader);
+        entry->flags = IOSQE_IO_LINK;
+        entry->user_data = makeUserData(slot, OP_SEND);
+
+        probe.m_receiveVector = iovec{probe.m_receiveBuffer, sizeof(probe.m_receiveBuffer)};
+        std::memset(&probe.m_receiveHeader, 0, sizeof(probe.m_receiveHeader));
+        probe.m_receiveHeader.msg_iov = &probe.m_receiveVector;
+        probe.m_receiveHeader.msg_iovlen = 1;
+        entry = m_ring.getSubmissionEntry();
+        entry->opcode = IORING_OP_RECVMSG;
+        entry->fd = probe.m_fd;
+        entry->addr = reinterpret_cast<uint64_t>(&probe.m_receiveHeader);
+        entry->flags = IOSQE_IO_LINK;
+        entry->user_data = makeUserData(slot, OP_RECEIVE);
+
+        prepareTimeout(slot);
+    }
+
+    void UringEnvironment::submitBannerRead(const uint32_t slot) {
+
+        Probe& probe = m_probes[slot];
+        probe.m_banner = m_bannerPool->acquire();
+        if (BufferPool::INVALID_HANDLE == probe.m_banner) {
+            return;
+        }
+
+        if (m_ring.getSubmissionSpace() < 2) {
+            m_ring.submit(0);
+        }
+
+        // The connect chain's completions are still being counted down, this chain's are added to them
+        probe.m_outstanding += 2;
+        probe.m_bannerTimeout = m_bannerWait;
+        io_uring_sqe* entry = m_ring.getSubmissionEntry();
+        entry->opcode = IORING_OP_RECV;
+        entry->fd = probe.m_fd;
+        entry->addr = reinterpret_cast<uint64_t>(m_bannerPool->getData(probe.m_banner));
+        entry->len = static_cast<uint32_t>(m_bannerPool->getBufferSize());
+        entry->flags = IOSQE_IO_LINK;
+        entry->user_data = makeUserData(slot, OP_RECEIVE);
+
+        entry = m_ring.getSubmissionEntry();
+        entry->opcode = IORING_OP_LINK_TIMEOUT;
+        entry->fd = -1;
+        entry->addr = reinterpret_cast<uint64_t>(&probe.m_bannerTimeout);
+        entry->len = 1;
+        entry->user_data = makeUserData(slot, OP_TIMEOUT);
+    }
+
+    bool UringEnvironment::reapCompletions(void) {
+
+        bool reaped = false;
+        io_uring_cqe completion;
+        while (m_ring.popCompletion(completion)) {
+
+            handleCompletion(completion);
+            reaped = true;
+        }
+
+        return reaped;
+    }
+
+    void UringEnvironment::handleCompletion(const io_uring_cqe& completion) {
+
+        if (CANCEL_USER_DATA == completion.user_data) {
+            return;
+        }
+
+        else if (WAKEUP_USER_DATA == completion.user_data) {
+
+            const Clock::time_point now = Clock::now();
+            m_wakeupArmed = false;
+            expireProvisional(now);
+            armWakeup(now);
+            return;
+        }
+
+        const uint32_t slot = static_cast<uint32_t>(completion.user_data >> 8);
+        const Operation operation = static_cast<Operation>(completion.user_data & 0xFF);
+        Probe& probe = m_probes[slot];
+
+        // A refused connection is the only error worth recording, everything else (including being
+        // cancelled by the linked timeout) leaves the probe closed
+        if (NetworkProtocol::TCP == probe.m_protocol && OP_CONNECT == operation) {
+
+            probe.m_result = 0 == completion.res ? PQ_QUERY_RESULT::OPEN :
+                -ECONNREFUSED == completion.res ? PQ_QUERY_RESULT::REJECTED : PQ_QUERY_RESULT::CLOSED;
+
+            // A connection to itself means nothing was listening on the port
+            if (0 == completion.res && isSelfConnected(probe.m_fd)) {
+                probe.m_result = PQ_QUERY_RESULT::REJECTED;
+            }
+
+            // The socket stays open until the whole chain has completed, so the kernel still has the handshake
+            if (PQ_QUERY_RESULT::OPEN == probe.m_result && m_measureLatency) {
+                probe.m_latency = getHandshakeRTT(probe.m_fd);
+            }
+
+            if (PQ_QUERY_RESULT::OPEN == probe.m_result && nullptr != m_bannerPool) {
+                submitBannerRead(slot);
+            }
+        }
+
+        // Whatever came in before the banner's timeout, the port is open either way
+        else if (NetworkProtocol::TCP == probe.m_protocol && OP_RECEIVE == operation) {
+            probe.m_bannerLength = completion.res > 0 ? static_cast<uint32_t>(completion.res) : 0;
+        }
+
+        else if (OP_SEND == operation || OP_RECEIVE == operation) {
+
+            // ICMP port unreachable is reported on the connected socket as a refused connection
+            if (-ECONNREFUSED == completion.res) {
+                probe.m_result = PQ_QUERY_RESULT::REJECTED;
+            }
+
+            else if (OP_RECEIVE == operation && completion.res >= 0) {
+                probe.m_result = PQ_QUERY_RESULT::OPEN;
+            }
+        }
+
+        else if (OP_TIMEOUT == operation && -ETIME == completion.res) {
+            probe.m_timedOut = true;
+        }
+
+        // Every answer, a handshake, a reset, a reply or an ICMP error, took one round trip
+        if (OP_TIMEOUT != operation && PQ_QUERY_RESULT::CLOSED != probe.m_result &&
+                Clock::time_point() != probe.m_sent) {
+
+            const Clock::time_point sent = probe.m_sent;
+            probe.m_sent = Clock::time_point();
+            addSample(slot, sent);
+        }
+
+        if (0 == --probe.m_outstanding && !retryProbe(slot)) {
+
+            if (probe.m_timedOut && PQ_QUERY_RESULT::CLOSED == probe.m_result) {
+                m_governor.onTimeout(Clock::now());
+            }
+
+            // The banner's buffer goes with the result
+            m_collector.addResult(ProbeResult{probe.m_address, probe.m_port, probe.m_protocol, probe.m_result,
+                    probe.m_latency, probe.m_banner, probe.m_bannerLength});
+            probe.m_banner = BufferPool::INVALID_HANDLE;
+            releaseSlot(slot);
+        }
+    }
+
+    void UringEnvironment::releaseSlot(const uint32_t slot) {
+
+        if (BufferPool::INVALID_HANDLE != m_probes[slot].m_banner) {
+
+            m_bannerPool->release(m_probes[slot].m_banner);
+            m_probes[slot].m_banner = BufferPool::INVALID_HANDLE;
+        }
+
+        close(m_probes[slot].m_fd);
+        m_probes[slot].m_fd = -1;
+        if (m_probes[slot].m_provisional) {
+
+            m_probes[slot].m_provisional = false;
+            m_provisionalCount--;
+        }
+
+        m_probes[slot].m_provisionalDeadline = false;
+        m_freeSlots.push_back(slot);
+    }
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <queue>
+#include <vector>
+
+#include <sys/socket.h>
+#include <linux/time_types.h>
+
+#include "Environment.h"
+#include "IOUring.h"
+#include "RTTEstimator.h"
+#include "RateGovernor.h"
+
+
+namespace PortQuery {
+
+    // An environment which drives every probe through io_uring. Each probe is a linked chain of operations
+    // terminated by a linked timeout, so the kernel takes care of expiring probes that never answer.
+    //
+    // TCP: CONNECT -> LINK_TIMEOUT
+    // UDP: CONNECT -> SENDMSG -> RECVMSG -> LINK_TIMEOUT
+    //
+    // When banners are being read, a TCP probe whose connect completes goes on to a second chain which reads
+    // the banner into a buffer from the pool, RECV -> LINK_TIMEOUT.
+    //
+    // Chains are queued in user space and handed to the kernel in large batches, which keeps the number of
+    // system calls per probe down to creating and closing the socket.
+    //
+    // The timeout of each chain comes from the round trip times seen so far (see RTTEstimator). A chain whose
+    // timeout fires is sent once more with double the timeout before the probe is given up on.
+    //
+    // Chains which went out before the first answer came back were given the ceiling. Linked timeouts can't be
+    // shortened after the fact, so once there is an estimate those chains get a deadline in user space instead,
+    // driven by a single timeout operation, and are cancelled when it passes.
+    //
+    // Chains are only queued once a RateGovernor lets them go, an answer to a retried chain counts as a lost probe.
+    class UringEnvironment : public IEnvironment {
+
+        public:
+
+            UringEnvironment(const int threadCount);
+            ~UringEnvironment();
+
+            virtual bool scanPort(void) override;
+            virtual bool getNextScanResult(const bool blocking) override;
+            virtual void setTimeout(const int timeout) override;
+            virtual void setMaxRate(const double rate) override;
+            virtual void addSourceAddress(const uint32_t address) override;
+            virtual void releaseTargets(const std::vector<uint32_t>& targets) override;
+            virtual void setMeasureLatency(const bool enabled) override;
+            virtual void setBannerCapture(const size_t length, const std::chrono::milliseconds wait) override;
+            virtual PQ_SCAN_STATS getScanStatistics(void) const override;
+
+        private:
+
+            using Clock = std::chrono::steady_clock;
+
+            static constexpr unsigned int RING_ENTRIES = 4096;
+
+            // Left over for everything else in the process, see ScanEngine
+            static constexpr size_t RESERVED_DESCRIPTORS = 64;
+
+            // The longest chain (UDP) posts four completions, the in flight window is sized off of this so the
+            // completion ring can never overflow
+            static constexpr unsigned int MAX_CHAIN_LENGTH = 4;
+            static constexpr size_t RECEIVE_BUFFER_SIZE = 64;
+            static constexpr uint64_t CANCEL_USER_DATA = static_cast<uint64_t>(-1);
+            static constexpr uint64_t WAKEUP_USER_DATA = static_cast<uint64_t>(-2);
+
+            enum Operation : uint8_t {
+                OP_CONNECT,
+                OP_SEND,
+                OP_RECEIVE,
+                OP_TIMEOUT
+            };
+
+            struct Probe {
+
+                int m_fd;
+                uint32_t m_address;
+                uint16_t m_port;
+                NetworkProtocol m_protocol;
+                PQ_QUERY_RESULT m_result;
+                PQ_LATENCY m_latency;
+                BufferPool::Handle m_banner;
+                uint32_t m_bannerLength;
+                uint8_t m_attempt;
+                bool m_timedOut;
+
+                // Set if the chain went out before there was any RTT estimate, so it was given the ceiling. Once
+                // the first sample is in it is given a deadline off of the estimate instead, and the second flag is
+                // set for as long as that deadline is waiting in m_provisionalDeadlines
+                bool m_provisional;
+                bool m_provisionalDeadline;
+                Clock::time_point m_sent;
+                std::chrono::milliseconds m_timeoutLength;
+
+                // The number of completions still expected, the slot can't be reused until this reaches zero
+                unsigned int m_outstanding;
+
+                // Everything the kernel may reference while the chain is running lives in the slot
+                sockaddr_in m_target;
+                __kernel_timespec m_timeout;
+                __kernel_timespec m_bannerTimeout;
+                msghdr m_sendHeader;
+                iovec m_sendVector;
+                msghdr m_receiveHeader;
+                iovec m_receiveVector;
+                char m_receiveBuffer[RECEIVE_BUFFER_SIZE];
+            };
+
+            uint32_t acquireSlot(const int type);
+
+            // TCP sockets are bound to the next source address and close with a reset, -1 if the process is out
+            // of descriptors
+            int createSocket(const int type);
+
+            // Reaps completions until a slot is free and the governor lets another chain go out
+            void waitToSend(void);
+            void submitProbe(const uint32_t slot);
+            bool retryProbe(const uint32_t slot);
+
+            // Samples should go through here, the first one also schedules deadlines for provisional chains. The
+            // probe's own m_sent has to be cleared first, it has answered and mustn't be given a deadline
+            void addSample(const uint32_t slot, const Clock::time_point sent);
+            void expireProvisional(const Clock::time_point now);
+            void armWakeup(const Clock::time_point now);
+            void submitTCPProbe(const uint32_t slot);
+            void submitUDPProbe(const uint32_t slot);
+
+            // Chains a read of the banner onto a probe whose connect completed, if there is a buffer for it
+            void submitBannerRead(const uint32_t slot);
+            void prepareConnect(const uint32_t slot);
+            void prepareTimeout(const uint32_t slot);
+
+            bool reapCompletions(void);
+            void handleCompletion(const io_uring_cqe& completion);
+            void releaseSlot(const uint32_t slot);
+
+            static uint64_t makeUserData(const uint32_t slot, const Operation operation) {
+
+                return (static_cast<uint64_t>(slot) << 8) | operation;
+            }
+
+            std::vector<Probe> m_probes;
+            std::vector<uint32_t> m_freeSlots;
+            ResultCollector m_collector;
+            RTTEstimator m_estimator;
+            RateGovernor m_governor;
+            size_t m_descriptorLimit;
+            size_t m_descriptorStalls;
+            size_t m_provisionalCount;
+            std::vector<uint32_t> m_sourceAddresses;
+            size_t m_nextSource;
+            bool m_measureLatency;
+            BufferPool* m_bannerPool;
+            __kernel_timespec m_bannerWait;
+
+            struct ProvisionalDeadline {
+
+                Clock::time_point m_expiry;
+                uint32_t m_slot;
+
+                bool operator>(const ProvisionalDeadline& other) const {
+
+                    return m_expiry > other.m_expiry;
+                }
+            };
+
+            std::priority_queue<ProvisionalDeadline, std::vector<ProvisionalDeadline>, std::greater<ProvisionalDeadline>>
+                m_provisionalDeadlines;
+            __kernel_timespec m_wakeupTimeout;
+            bool m_wakeupArmed;
+            int m_threadCount;
+
+            // Declared last so that it is torn down before the buffers it references
+            IOUring m_ring;
+    };
+}
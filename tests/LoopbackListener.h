@@ -0,0 +1,30 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../libportquery/source/Network.h"
+
+
+// Opens a listening socket on an ephemeral loopback port for the lifetime of the object
+struct LoopbackListener {
+
+    LoopbackListener() {
+
+        m_fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = PortQuery::makeSocketAddress(*PortQuery::parseIPv4Address("127.0.0.1"), 0);
+        socklen_t length = sizeof(address);
+        bind(m_fd, reinterpret_cast<sockaddr*>(&address), length);
+        listen(m_fd, SOMAXCONN);
+        getsockname(m_fd, reinterpret_cast<sockaddr*>(&address), &length);
+        m_port = ntohs(address.sin_port);
+    }
+
+    ~LoopbackListener() {
+
+        close(m_fd);
+    }
+
+    int m_fd;
+    uint16_t m_port;
+};
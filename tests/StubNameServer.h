@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <cctype>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../libportquery/source/Network.h"
+
+
+// Answers A queries on an ephemeral loopback port for the lifetime of the object. Names which haven't been added
+// get NXDOMAIN, with an SOA allowing the answer to be cached for 30 seconds
+struct StubNameServer {
+
+    struct Record {
+
+        uint32_t m_address;
+        uint32_t m_ttl;
+    };
+
+    // With silent set queries are read but never answered, with dropFirst the first query for each name is dropped
+    StubNameServer(std::map<std::string, Record> records, const bool silent=false, const bool dropFirst=false) :
+        m_records(std::move(records)), m_silent(silent), m_dropFirst(dropFirst) {
+
+        m_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in address = PortQuery::makeSocketAddress(*PortQuery::parseIPv4Address("127.0.0.1"), 0);
+        socklen_t length = sizeof(address);
+        bind(m_fd, reinterpret_cast<sockaddr*>(&address), length);
+        getsockname(m_fd, reinterpret_cast<sockaddr*>(&address), &length);
+        m_port = ntohs(address.sin_port);
+
+        int bufferSize = 4 * 1024 * 1024;
+        setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+        m_thread = std::thread([this] () { serve(); });
+    }
+
+    ~StubNameServer() {
+
+        m_stopping = true;
+        m_thread.join();
+        close(m_fd);
+    }
+
+    void serve() {
+
+        std::map<std::string, bool> seen;
+        while (!m_stopping) {
+
+            struct pollfd pollDescriptor = { m_fd, POLLIN, 0 };
+            if (1 != poll(&pollDescriptor, 1, 20)) {
+                continue;
+            }
+
+            uint8_t query[512];
+            sockaddr_in client = { };
+            socklen_t length = sizeof(client);
+            const ssize_t received = recvfrom(m_fd, query, sizeof(query), 0, reinterpret_cast<sockaddr*>(&client), &length);
+            if (received < 17) {
+                continue;
+            }
+
+            std::string name;
+            size_t offset = 12;
+            while (offset < static_cast<size_t>(received) && 0 != query[offset]) {
+
+                name += name.empty() ? "" : ".";
+                for (size_t c = offset + 1; c <= offset + query[offset]; c++) {
+                    name += static_cast<char>(std::tolower(query[c]));
+                }
+
+                offset += query[offset] + 1;
+            }
+
+            m_queries++;
+            const bool first = !seen[name];
+            seen[name] = true;
+            if (m_silent || (m_dropFirst && first)) {
+                continue;
+            }
+
+            // The question goes back as it came, the answer points back at it
+            const auto record = m_records.find(name);
+            const bool found = m_records.end() != record;
+            std::vector<uint8_t> reply(query, query + offset + 5);
+            reply[2] = 0x81;
+            reply[3] = found ? 0x80 : 0x83;
+            reply[7] = found ? 1 : 0;
+            reply[9] = found ? 0 : 1;
+            if (found) {
+
+                const uint32_t ttl = record->second.m_ttl;
+                const uint32_t address = record->second.m_address;
+                reply.insert(reply.end(), { 0xC0, 0x0C, 0x00, 0x01, 0x00, 0x01,
+                        static_cast<uint8_t>(ttl >> 24), static_cast<uint8_t>(ttl >> 16), static_cast<uint8_t>(ttl >> 8), static_cast<uint8_t>(ttl),
+                        0x00, 0x04,
+                        static_cast<uint8_t>(address >> 24), static_cast<uint8_t>(address >> 16), static_cast<uint8_t>(address >> 8), static_cast<uint8_t>(address) });
+            }
+
+            else {
+
+                reply.insert(reply.end(), { 0x00, 0x00, 0x06, 0x00, 0x01, 0x00, 0x00, 0x00, 60, 0x00, 25,
+                        0x02, 'n', 's', 0x00, 0x00,
+                        0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x0E, 0x10, 0x00, 0x00, 0x02, 0x58, 0x00, 0x09, 0x3A, 0x80,
+                        0x00, 0x00, 0x00, 30 });
+            }
+
+            sendto(m_fd, reply.data(), reply.size(), 0, reinterpret_cast<sockaddr*>(&client), length);
+        }
+    }
+
+    std::map<std::string, Record> m_records;
+    bool m_silent;
+    bool m_dropFirst;
+
+    int m_fd;
+    uint16_t m_port;
+    std::atomic<size_t> m_queries = 0;
+    std::atomic<bool> m_stopping = false;
+    std::thread m_thread;
+};
@@ -0,0 +1,42 @@
+#include <cstring>
+#include <set>
+
+#include "gtest/gtest.h"
+#include "../libportquery/source/BufferPool.h"
+
+
+using namespace PortQuery;
+
+
+TEST(BufferPool, HandsOutEveryBufferOnce) {
+
+    BufferPool pool(64, 4);
+    EXPECT_EQ(64u, pool.getBufferSize());
+
+    std::set<BufferPool::Handle> handles;
+    for (int buffer = 0; buffer < 4; buffer++) {
+        handles.insert(pool.acquire());
+    }
+
+    EXPECT_EQ(4u, handles.size());
+    EXPECT_EQ(0u, pool.getAvailable());
+    EXPECT_EQ(BufferPool::INVALID_HANDLE, pool.acquire());
+
+    // Buffers don't overlap, filling one leaves the others alone
+    for (const BufferPool::Handle handle : handles) {
+        std::memset(pool.getData(handle), static_cast<int>(handle), pool.getBufferSize());
+    }
+
+    for (const BufferPool::Handle handle : handles) {
+
+        const char* data = pool.getData(handle);
+        EXPECT_EQ(static_cast<char>(handle), data[0]);
+        EXPECT_EQ(static_cast<char>(handle), data[pool.getBufferSize() - 1]);
+    }
+
+    // A buffer which is given back is the next one out
+    const BufferPool::Handle released = *handles.begin();
+    pool.release(released);
+    EXPECT_EQ(1u, pool.getAvailable());
+    EXPECT_EQ(released, pool.acquire());
+}
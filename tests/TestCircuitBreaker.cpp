@@ -0,0 +1,116 @@
+#include "gtest/gtest.h"
+#include "../libportquery/source/CircuitBreaker.h"
+
+
+using namespace PortQuery;
+
+
+TEST(CircuitBreaker, TripsAfterSilentRun) {
+
+    CircuitBreaker breaker(4, 8);
+    for (uint16_t port = 0; port < 3; port++) {
+
+        EXPECT_TRUE(breaker.shouldProbe(1, port));
+        breaker.addResult(1, port, false);
+    }
+
+    EXPECT_FALSE(breaker.isTripped(1));
+    EXPECT_TRUE(breaker.shouldProbe(1, 3));
+    breaker.addResult(1, 3, false);
+    EXPECT_TRUE(breaker.isTripped(1));
+
+    // Other hosts are tracked on their own
+    EXPECT_FALSE(breaker.isTripped(2));
+    EXPECT_TRUE(breaker.shouldProbe(2, 0));
+
+    // One port in every interval still goes out
+    int probed = 0;
+    for (uint16_t port = 4; port < 68; port++) {
+        probed += breaker.shouldProbe(1, port) ? 1 : 0;
+    }
+
+    EXPECT_EQ(8, probed);
+    EXPECT_EQ(56u, breaker.getInferredCount());
+}
+
+
+TEST(CircuitBreaker, AnswerResets) {
+
+    CircuitBreaker breaker(4, 8);
+    for (uint16_t port = 0; port < 3; port++) {
+
+        breaker.shouldProbe(1, port);
+        breaker.addResult(1, port, false);
+    }
+
+    // An answer part of the way through a run starts it over
+    breaker.shouldProbe(1, 3);
+    breaker.addResult(1, 3, true);
+    for (uint16_t port = 4; port < 7; port++) {
+
+        breaker.shouldProbe(1, port);
+        breaker.addResult(1, port, false);
+    }
+
+    EXPECT_FALSE(breaker.isTripped(1));
+    breaker.shouldProbe(1, 7);
+    breaker.addResult(1, 7, false);
+    EXPECT_TRUE(breaker.isTripped(1));
+
+    // A sampled port which answers closes the breaker again
+    uint16_t port = 8;
+    while (!breaker.shouldProbe(1, port)) {
+        port++;
+    }
+
+    breaker.addResult(1, port, true);
+    EXPECT_FALSE(breaker.isTripped(1));
+    EXPECT_TRUE(breaker.shouldProbe(1, port + 1));
+}
+
+
+TEST(CircuitBreaker, IgnoresTimeoutsFromBeforeAnAnswer) {
+
+    // Every probe goes out before any result is back, the way a full window does
+    CircuitBreaker breaker(4, 8);
+    for (uint16_t port = 0; port < 10; port++) {
+        EXPECT_TRUE(breaker.shouldProbe(1, port));
+    }
+
+    // The last port answers straight away, the rest only time out later
+    breaker.addResult(1, 9, true);
+    for (uint16_t port = 0; port < 9; port++) {
+        breaker.addResult(1, port, false);
+    }
+
+    EXPECT_FALSE(breaker.isTripped(1));
+}
+
+
+TEST(CircuitBreaker, ZeroThresholdNeverTrips) {
+
+    CircuitBreaker breaker(0, 8);
+    for (uint16_t port = 0; port < 1000; port++) {
+
+        EXPECT_TRUE(breaker.shouldProbe(1, port));
+        breaker.addResult(1, port, false);
+    }
+
+    EXPECT_EQ(0u, breaker.getInferredCount());
+}
+
+
+TEST(CircuitBreaker, ForgottenHostsStartOver) {
+
+    CircuitBreaker breaker(4, 8);
+    for (uint16_t port = 0; port < 4; port++) {
+
+        EXPECT_TRUE(breaker.shouldProbe(1, port));
+        breaker.addResult(1, port, false);
+    }
+
+    EXPECT_TRUE(breaker.isTripped(1));
+    breaker.forgetHost(1);
+    EXPECT_FALSE(breaker.isTripped(1));
+    EXPECT_TRUE(breaker.shouldProbe(1, 4));
+}
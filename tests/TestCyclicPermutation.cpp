@@ -0,0 +1,58 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../libportquery/source/CyclicPermutation.h"
+
+
+using namespace PortQuery;
+
+
+static std::vector<uint64_t> walk(CyclicPermutation permutation) {
+
+    std::vector<uint64_t> indices;
+    for (std::optional<uint64_t> index; (index = permutation.next());) {
+        indices.push_back(*index);
+    }
+
+    return indices;
+}
+
+
+TEST(CyclicPermutation, VisitsEveryIndexOnce) {
+
+    for (const uint64_t size : { 0, 1, 2, 3, 10, 1000, 3 * 65536 }) {
+
+        const std::vector<uint64_t> indices = walk(CyclicPermutation(size, 42));
+        ASSERT_EQ(size, indices.size()) << size;
+
+        std::vector<bool> seen(size, false);
+        for (const uint64_t index : indices) {
+
+            ASSERT_LT(index, size);
+            EXPECT_FALSE(seen[index]) << index;
+            seen[index] = true;
+        }
+    }
+}
+
+
+TEST(CyclicPermutation, SeedDecidesOrder) {
+
+    const std::vector<uint64_t> first = walk(CyclicPermutation(65536, 7));
+    EXPECT_EQ(first, walk(CyclicPermutation(65536, 7)));
+    EXPECT_NE(first, walk(CyclicPermutation(65536, 8)));
+
+    // Scrambled, consecutive indices hardly ever come out next to each other
+    size_t adjacent = 0;
+    for (size_t position = 1; position < first.size(); position++) {
+        adjacent += first[position] == first[position - 1] + 1 ? 1 : 0;
+    }
+
+    EXPECT_LT(adjacent, 64u);
+}
+
+
+TEST(CyclicPermutation, RejectsOversizedSpace) {
+
+    EXPECT_THROW(CyclicPermutation(CyclicPermutation::MAX_SIZE + 1, 0), std::invalid_argument);
+}
@@ -0,0 +1,91 @@
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "StubNameServer.h"
+#include "../libportquery/source/DNSResolver.h"
+#include "../libportquery/source/Network.h"
+
+
+using namespace PortQuery;
+
+
+static uint32_t address(const char* const text) {
+
+    return *parseIPv4Address(text);
+}
+
+
+TEST(DNSResolver, RecognizesHostnames) {
+
+    EXPECT_TRUE(DNSResolver::isHostname("www.google.com"));
+    EXPECT_TRUE(DNSResolver::isHostname("localhost."));
+    EXPECT_TRUE(DNSResolver::isHostname("_sip.example-1.org"));
+    EXPECT_FALSE(DNSResolver::isHostname("10.0.0.1"));
+    EXPECT_FALSE(DNSResolver::isHostname("10.0.0.0/8"));
+    EXPECT_FALSE(DNSResolver::isHostname("10.0.0.1-10.0.0.9"));
+    EXPECT_FALSE(DNSResolver::isHostname("@targets.txt"));
+    EXPECT_FALSE(DNSResolver::isHostname("www..com"));
+    EXPECT_FALSE(DNSResolver::isHostname(std::string(64, 'a') + ".com"));
+}
+
+
+TEST(DNSResolver, ResolvesManyNamesAtOnce) {
+
+    std::map<std::string, StubNameServer::Record> records;
+    std::vector<std::string> names;
+    for (uint32_t host = 0; host < 2000; host++) {
+
+        names.push_back("host" + std::to_string(host) + ".test");
+        records[names.back()] = StubNameServer::Record{address("10.0.0.0") + host, 300};
+    }
+
+    StubNameServer server(records);
+    DNSResolver resolver(address("127.0.0.1"), server.m_port);
+    const std::vector<std::optional<uint32_t>> addresses = resolver.resolve(names);
+    ASSERT_EQ(names.size(), addresses.size());
+    for (uint32_t host = 0; host < names.size(); host++) {
+        EXPECT_EQ(address("10.0.0.0") + host, addresses[host]) << names[host];
+    }
+
+    EXPECT_EQ(names.size(), resolver.getQueryCount());
+}
+
+
+TEST(DNSResolver, CachesForTheTTL) {
+
+    StubNameServer server({
+            { "kept.test", { address("10.0.0.1"), 300 } },
+            { "fleeting.test", { address("10.0.0.2"), 0 } } });
+
+    DNSResolver resolver(address("127.0.0.1"), server.m_port);
+    const std::vector<std::string> names = { "kept.test", "fleeting.test", "missing.test", "KEPT.test." };
+    for (int run = 0; run < 2; run++) {
+
+        const std::vector<std::optional<uint32_t>> addresses = resolver.resolve(names);
+        EXPECT_EQ(address("10.0.0.1"), addresses[0]);
+        EXPECT_EQ(address("10.0.0.2"), addresses[1]);
+        EXPECT_FALSE(addresses[2]);
+        EXPECT_EQ(address("10.0.0.1"), addresses[3]);
+    }
+
+    // Only the answer with no TTL is looked up a second time, a name which doesn't exist is cached as well
+    EXPECT_EQ(4u, server.m_queries);
+    EXPECT_EQ(4u, resolver.getQueryCount());
+}
+
+
+TEST(DNSResolver, RetriesLostQueries) {
+
+    StubNameServer server({ { "lossy.test", { address("10.0.0.3"), 300 } } }, false, true);
+    DNSResolver resolver(address("127.0.0.1"), server.m_port, std::chrono::milliseconds(100));
+    EXPECT_EQ(address("10.0.0.3"), resolver.resolve({ "lossy.test" })[0]);
+    EXPECT_EQ(2u, server.m_queries);
+
+    // A server which never answers is given up on, and nothing is cached for it
+    StubNameServer silentServer({ { "silent.test", { address("10.0.0.4"), 300 } } }, true);
+    DNSResolver silentResolver(address("127.0.0.1"), silentServer.m_port, std::chrono::milliseconds(50));
+    EXPECT_FALSE(silentResolver.resolve({ "silent.test" })[0]);
+    EXPECT_FALSE(silentResolver.resolve({ "silent.test" })[0]);
+    EXPECT_EQ(6u, silentServer.m_queries);
+}
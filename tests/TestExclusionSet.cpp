@@ -0,0 +1,122 @@
+#include <random>
+
+#include "gtest/gtest.h"
+#include "../libportquery/source/ExclusionSet.h"
+#include "../libportquery/source/TargetSet.h"
+#include "../libportquery/source/Network.h"
+
+
+using namespace PortQuery;
+
+
+static uint32_t address(const char* const text) {
+
+    return *parseIPv4Address(text);
+}
+
+
+TEST(ExclusionSet, MatchesBlocks) {
+
+    ExclusionSet exclusions;
+    EXPECT_TRUE(exclusions.empty());
+    EXPECT_TRUE(exclusions.addExclusion("10.0.0.0/8"));
+    EXPECT_TRUE(exclusions.addExclusion("192.168.1.7/24"));
+    EXPECT_TRUE(exclusions.addExclusion("192.168.2.1"));
+    EXPECT_TRUE(exclusions.addExclusion("192.168.3.0/25"));
+    EXPECT_FALSE(exclusions.empty());
+
+    EXPECT_TRUE(exclusions.contains(address("10.255.0.1")));
+    EXPECT_FALSE(exclusions.contains(address("11.0.0.0")));
+    EXPECT_TRUE(exclusions.contains(address("192.168.1.0")));
+    EXPECT_TRUE(exclusions.contains(address("192.168.1.255")));
+    EXPECT_FALSE(exclusions.contains(address("192.168.2.0")));
+    EXPECT_TRUE(exclusions.contains(address("192.168.2.1")));
+    EXPECT_FALSE(exclusions.contains(address("192.168.2.2")));
+    EXPECT_TRUE(exclusions.contains(address("192.168.3.127")));
+    EXPECT_FALSE(exclusions.contains(address("192.168.3.128")));
+
+    EXPECT_EQ(address("10.255.255.255"), exclusions.getExcludedThrough(address("10.1.2.3")));
+    EXPECT_EQ(address("192.168.2.1"), exclusions.getExcludedThrough(address("192.168.2.1")));
+    EXPECT_EQ(std::nullopt, exclusions.getExcludedThrough(address("192.168.4.1")));
+
+    EXPECT_EQ(address("10.0.0.0"), exclusions.getNextExcluded(address("9.1.1.1")));
+    EXPECT_EQ(address("192.168.2.1"), exclusions.getNextExcluded(address("192.168.1.255") + 1));
+    EXPECT_EQ(address("192.168.3.0"), exclusions.getNextExcluded(address("192.168.2.2")));
+    EXPECT_EQ(std::nullopt, exclusions.getNextExcluded(address("192.168.3.128")));
+
+    EXPECT_FALSE(exclusions.addExclusion("192.168.0.0/33"));
+    EXPECT_FALSE(exclusions.addExclusion("192.168.0/16"));
+    EXPECT_FALSE(exclusions.addExclusion("192.168.0.0/"));
+}
+
+
+TEST(ExclusionSet, WiderBlockCoversNarrowerOnes) {
+
+    ExclusionSet exclusions;
+    ASSERT_TRUE(exclusions.addExclusion("172.16.5.0/24"));
+    ASSERT_TRUE(exclusions.addExclusion("172.16.9.9"));
+    EXPECT_FALSE(exclusions.contains(address("172.16.200.1")));
+
+    ASSERT_TRUE(exclusions.addExclusion("172.16.0.0/16"));
+    EXPECT_TRUE(exclusions.contains(address("172.16.200.1")));
+    EXPECT_EQ(address("172.16.255.255"), exclusions.getExcludedThrough(address("172.16.5.1")));
+
+    ASSERT_TRUE(exclusions.addExclusion("0.0.0.0/0"));
+    EXPECT_TRUE(exclusions.contains(address("8.8.8.8")));
+}
+
+
+TEST(ExclusionSet, AgreesWithLinearScan) {
+
+    // Random blocks checked against the obvious loop over every one of them
+    std::mt19937 generator(1234);
+    std::vector<std::pair<uint32_t, uint32_t>> blocks;
+    ExclusionSet exclusions;
+    for (int block = 0; block < 2000; block++) {
+
+        const uint32_t length = 8 + generator() % 25;
+        const uint32_t mask = ~static_cast<uint32_t>(0) << (32 - length);
+        const uint32_t prefix = static_cast<uint32_t>(generator()) & mask & 0x3FFFFFFF;
+        blocks.emplace_back(prefix, mask);
+        ASSERT_TRUE(exclusions.addExclusion(formatIPv4Address(prefix) + "/" + std::to_string(length)));
+    }
+
+    for (int probe = 0; probe < 20000; probe++) {
+
+        const uint32_t target = static_cast<uint32_t>(generator()) & 0x3FFFFFFF;
+        bool excluded = false;
+        std::optional<uint32_t> nextExcluded;
+        for (const auto& [prefix, mask] : blocks) {
+
+            excluded = excluded || (target & mask) == prefix;
+            if ((prefix | ~mask) >= target) {
+                nextExcluded = std::min(nextExcluded.value_or(~0u), std::max(prefix, target));
+            }
+        }
+
+        ASSERT_EQ(excluded, exclusions.contains(target)) << formatIPv4Address(target);
+        ASSERT_EQ(nextExcluded, exclusions.getNextExcluded(target)) << formatIPv4Address(target);
+    }
+}
+
+
+TEST(ExclusionSet, TargetsSkipExcludedAddresses) {
+
+    ExclusionSet exclusions;
+    ASSERT_TRUE(exclusions.addExclusion("10.0.0.2/31"));
+    ASSERT_TRUE(exclusions.addExclusion("10.0.0.6/31"));
+
+    TargetSet targets;
+    targets.setExclusions(&exclusions);
+    ASSERT_TRUE(targets.addTarget("10.0.0.0-10.0.0.6"));
+    ASSERT_TRUE(targets.addTarget("10.0.0.3"));
+
+    std::vector<uint32_t> walked;
+    TargetSet::Iterator iterator = targets.begin();
+    for (std::optional<uint32_t> target; (target = iterator.next());) {
+        walked.push_back(*target);
+    }
+
+    EXPECT_EQ((std::vector<uint32_t>{ address("10.0.0.0"), address("10.0.0.1"), address("10.0.0.4"),
+                address("10.0.0.5") }), walked);
+}
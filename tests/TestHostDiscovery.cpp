@@ -0,0 +1,34 @@
+#include <chrono>
+
+#include "gtest/gtest.h"
+#include "../libportquery/source/HostDiscovery.h"
+#include "../libportquery/source/Network.h"
+
+
+using namespace PortQuery;
+
+
+TEST(HostDiscovery, FindsLiveHosts) {
+
+    // Loopback resets connects to closed ports, which is still an answer
+    const uint32_t loopback = *parseIPv4Address("127.0.0.1");
+    const uint32_t broadcast = *parseIPv4Address("255.255.255.255");
+
+    HostDiscovery discovery(std::chrono::seconds(2));
+    const auto began = std::chrono::steady_clock::now();
+    const std::vector<uint32_t> live = discovery.findLiveHosts({ broadcast, loopback, *parseIPv4Address("127.0.0.2") });
+
+    ASSERT_EQ(2u, live.size());
+    EXPECT_EQ(loopback, live[0]);
+    EXPECT_EQ(*parseIPv4Address("127.0.0.2"), live[1]);
+
+    // Nothing had to wait for the timeout, every host either answered or failed straight away
+    EXPECT_LT(std::chrono::steady_clock::now() - began, std::chrono::seconds(1));
+}
+
+
+TEST(HostDiscovery, NoTargets) {
+
+    HostDiscovery discovery(std::chrono::seconds(2));
+    EXPECT_TRUE(discovery.findLiveHosts({}).empty());
+}
@@ -232,7 +232,7 @@ TEST(RecognizeTokens, KeywordTokens) {
 
 TEST(RecognizeTokens, ColumnTokens) {
 
-    Lexer lexer_T1{"PORT TCP UDP"};
+    Lexer lexer_T1{"PORT TCP UDP LATENCY BANNER INFERRED HOST"};
 
     Token token_T1{lexer_T1.nextToken()}; // PORT
     ASSERT_TRUE(MATCH_COLUMN<ColumnToken::PORT>(token_T1));
@@ -243,6 +243,18 @@ TEST(RecognizeTokens, ColumnTokens) {
     Token token_T3{lexer_T1.nextToken()}; // UDP
     ASSERT_TRUE(MATCH_COLUMN<ColumnToken::UDP>(token_T3));
 
+    Token token_T4{lexer_T1.nextToken()}; // LATENCY
+    ASSERT_TRUE(MATCH_COLUMN<ColumnToken::LATENCY>(token_T4));
+
+    Token token_T5{lexer_T1.nextToken()}; // BANNER
+    ASSERT_TRUE(MATCH_COLUMN<ColumnToken::BANNER>(token_T5));
+
+    Token token_T6{lexer_T1.nextToken()}; // INFERRED
+    ASSERT_TRUE(MATCH_COLUMN<ColumnToken::INFERRED>(token_T6));
+
+    Token token_T7{lexer_T1.nextToken()}; // HOST
+    ASSERT_TRUE(MATCH_COLUMN<ColumnToken::HOST>(token_T7));
+
     Token token_T20{lexer_T1.nextToken()};
     ASSERT_TRUE(std::holds_alternative<EOFToken>(token_T20));
 };
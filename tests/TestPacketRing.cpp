@@ -0,0 +1,71 @@
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <system_error>
+
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "../libportquery/source/PacketRing.h"
+#include "../libportquery/source/Network.h"
+
+
+using namespace PortQuery;
+
+
+TEST(PacketRing, LoopbackDatagramsSeenOnce) {
+
+    std::unique_ptr<PacketRing> ring;
+    try {
+        ring = std::make_unique<PacketRing>(1 << 16, 4);
+    }
+    catch (std::system_error&) {
+        GTEST_SKIP() << "Packet rings require CAP_NET_RAW";
+    }
+
+    // Nothing has to be listening, the datagrams are picked up off of the interface either way
+    const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in source = makeSocketAddress(*parseIPv4Address("127.0.0.1"), 0);
+    socklen_t length = sizeof(source);
+    bind(fd, reinterpret_cast<sockaddr*>(&source), length);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&source), &length);
+    const sockaddr_in target = makeSocketAddress(*parseIPv4Address("127.0.0.1"), 9);
+    const char payload[] = "PacketRing";
+    for (int datagram = 0; datagram < 16; datagram++) {
+        sendto(fd, payload, sizeof(payload), 0, reinterpret_cast<const sockaddr*>(&target), sizeof(target));
+    }
+
+    // Only datagrams from this socket count, anything else could be on the interface too. They are stamped with
+    // the time they came in, which can't be far from now
+    size_t seen = 0;
+    const auto sentAround = std::chrono::system_clock::now().time_since_epoch();
+    const auto handler = [&] (const uint8_t* packet, const size_t packetLength, const std::chrono::nanoseconds received) {
+
+        struct iphdr ipHeader;
+        std::memcpy(&ipHeader, packet, sizeof(ipHeader));
+        struct udphdr udpHeader;
+        std::memcpy(&udpHeader, packet + ipHeader.ihl * 4, sizeof(udpHeader));
+        if (IPPROTO_UDP == ipHeader.protocol && source.sin_port == udpHeader.source &&
+                packetLength == ipHeader.ihl * 4 + sizeof(udpHeader) + sizeof(payload)) {
+
+            EXPECT_EQ(0, std::memcmp(payload, packet + ipHeader.ihl * 4 + sizeof(udpHeader), sizeof(payload)));
+            EXPECT_LT(std::chrono::abs(received - sentAround), std::chrono::seconds(5));
+            seen++;
+        }
+    };
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (seen < 16 && std::chrono::steady_clock::now() < deadline) {
+
+        struct pollfd pollDescriptor = { ring->getFD(), POLLIN, 0 };
+        ::poll(&pollDescriptor, 1, 10);
+        ring->receive(handler);
+    }
+
+    close(fd);
+    EXPECT_EQ(16u, seen);
+}
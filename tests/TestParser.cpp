@@ -75,6 +75,25 @@ TEST(ParseSOSQLStatements, ParseErrorStatements) {
     EXPECT_THROW(Parser("SELECT UDP, < FROM GOOGLE.COM WHERE UDP = 4;").parseSOSQLStatement(), std::invalid_argument);
     EXPECT_THROW(Parser("select * FROM FROM google.com").parseSOSQLStatement(), std::invalid_argument);
     EXPECT_THROW(Parser("Select * from TCP where UDP = 1").parseSOSQLStatement(), std::invalid_argument);
+    EXPECT_THROW(Parser("SELECT * FROM 10.0.0.1, WHERE PORT = 1").parseSOSQLStatement(), std::invalid_argument);
+    EXPECT_THROW(Parser("SELECT * FROM 10.0.0.1,, 10.0.0.2").parseSOSQLStatement(), std::invalid_argument);
+}
+
+
+TEST(ParseSOSQLStatements, ParseTargetList) {
+
+    const auto select_T1 = Parser("SELECT HOST, PORT FROM 10.0.0.0/16").parseSOSQLStatement();
+    EXPECT_EQ(std::vector<std::string>{"10.0.0.0/16"}, select_T1->getTableReferences());
+
+    const auto select_T2 = Parser("SELECT * FROM 10.0.0.1-10.0.0.50, 192.168.1.1,10.1.0.0/24 WHERE PORT = 22")
+        .parseSOSQLStatement();
+    const std::vector<std::string> targets_T2{"10.0.0.1-10.0.0.50", "192.168.1.1", "10.1.0.0/24"};
+    EXPECT_EQ(targets_T2, select_T2->getTableReferences());
+
+    // Files of targets, @- is stdin
+    const auto select_T3 = Parser("SELECT PORT FROM 10.0.0.1, @/tmp/targets.txt, @-").parseSOSQLStatement();
+    const std::vector<std::string> targets_T3{"10.0.0.1", "@/tmp/targets.txt", "@-"};
+    EXPECT_EQ(targets_T3, select_T3->getTableReferences());
 }
 
 
@@ -174,4 +193,18 @@ TEST(ParseSOSQLStatements, CollectRequiredProtocols) {
 
     const auto select_T5 = Parser("SELECT TCP FROM WWW.YAHOO.COM WHERE PORT < 40").parseSOSQLStatement();
     EXPECT_TRUE(NetworkProtocol::TCP == select_T5->collectRequiredProtocols());
+
+    // The latency is the TCP probe's, and it is only measured when asked for
+    const auto select_T6 = Parser("SELECT PORT, LATENCY FROM WWW.YAHOO.COM WHERE PORT < 40").parseSOSQLStatement();
+    EXPECT_TRUE(NetworkProtocol::TCP == select_T6->collectRequiredProtocols());
+    EXPECT_TRUE(select_T6->isLatencyRequested());
+    EXPECT_FALSE(select_T1->isLatencyRequested());
+
+    EXPECT_THROW(Parser("SELECT PORT FROM WWW.YAHOO.COM WHERE LATENCY < 40").parseSOSQLStatement(), std::invalid_argument);
+
+    // Banners come off of the TCP connection as well
+    const auto select_T7 = Parser("SELECT PORT, BANNER FROM WWW.YAHOO.COM").parseSOSQLStatement();
+    EXPECT_TRUE(NetworkProtocol::TCP == select_T7->collectRequiredProtocols());
+    EXPECT_TRUE(select_T7->isBannerRequested());
+    EXPECT_FALSE(select_T6->isBannerRequested());
 }
@@ -1,8 +1,19 @@
 #include <string>
+#include <map>
+#include <set>
+#include <thread>
+#include <atomic>
+#include <deque>
+
+#include <poll.h>
+#include <sys/socket.h>
 
 #include "gmock/gmock.h"
 #include "../libportquery/source/Environment.h"
 #include "../libportquery/include/PortQuery.h"
+#include "LoopbackListener.h"
+#include "StubNameServer.h"
+#include "TunResponder.h"
 
 using ::testing::AtLeast;
 using ::testing::_;
@@ -45,6 +56,62 @@ struct MockGenerator {
 bool MockGenerator::s_generatorSet = false;
 
 
+TEST(RunScan, LoopbackConnectScan) {
+
+    EnvironmentFactory::resetGenerator();
+    LoopbackListener listener;
+
+    std::vector<PQ_ROW> rows;
+    auto callback = [] (std::any context, PQ_ROW row) { 
+        std::any_cast<std::vector<PQ_ROW>*>(context)->push_back(row);
+    };
+
+    PQConn pq{callback, &rows};
+    const std::string port = std::to_string(listener.m_port);
+    ASSERT_TRUE(pq.execute("SELECT PORT, TCP FROM 127.0.0.1 WHERE PORT BETWEEN " + port + " AND " + port));
+    ASSERT_EQ(1, rows.size());
+    EXPECT_EQ(listener.m_port, std::get<uint16_t>(rows[0][0]));
+    EXPECT_EQ(PQ_QUERY_RESULT::OPEN, std::get<PQ_QUERY_RESULT>(rows[0][1]));
+
+    // Rows which do not satisfy the post network evaluation are not reported
+    rows.clear();
+    ASSERT_TRUE(pq.execute("SELECT PORT FROM 127.0.0.1 WHERE PORT = " + port + " AND TCP = REJECTED"));
+    EXPECT_TRUE(rows.empty());
+
+    EXPECT_FALSE(pq.execute("SELECT PORT FROM 127.0.0.300"));
+    EXPECT_EQ("Unable to resolve table reference: 127.0.0.300", pq.getErrorString());
+}
+
+
+TEST(RunScan, LoopbackUringScan) {
+
+    EnvironmentFactory::resetGenerator();
+    LoopbackListener listener;
+
+    std::vector<PQ_ROW> rows;
+    auto callback = [] (std::any context, PQ_ROW row) { 
+        std::any_cast<std::vector<PQ_ROW>*>(context)->push_back(row);
+    };
+
+    // The listener's port is open for TCP, and nothing is bound to it for UDP, so the datagram is refused
+    PQConn pq{callback, &rows};
+    pq.setBackend(PQ_BACKEND::CONNECT_IO_URING);
+    const std::string port = std::to_string(listener.m_port);
+    ASSERT_TRUE(pq.execute("SELECT PORT, TCP, UDP FROM 127.0.0.1 WHERE PORT BETWEEN " + port + " AND " + port));
+    ASSERT_EQ(1, rows.size());
+    EXPECT_EQ(listener.m_port, std::get<uint16_t>(rows[0][0]));
+    EXPECT_EQ(PQ_QUERY_RESULT::OPEN, std::get<PQ_QUERY_RESULT>(rows[0][1]));
+    EXPECT_EQ(PQ_QUERY_RESULT::REJECTED, std::get<PQ_QUERY_RESULT>(rows[0][2]));
+
+    // Selecting the backend through the generator works the same way
+    rows.clear();
+    EnvironmentFactory::setGenerator(EnvironmentFactory::uringGenerator);
+    ASSERT_TRUE(pq.execute("SELECT PORT FROM 127.0.0.1 WHERE PORT < 1024 AND TCP = OPEN"));
+    EnvironmentFactory::resetGenerator();
+    EXPECT_TRUE(std::all_of(rows.begin(), rows.end(), [] (PQ_ROW r) { return std::get<uint16_t>(r[0]) < 1024; }));
+}
+
+
 /*
 TEST(RunScan, ExpectedNoPortsSubmitted) {
 
@@ -123,3 +190,519 @@ TEST(RunScan, ExpectedAllPortsSubmitted) {
     pq.execute("SELECT * FROM WWW.GOOGLE.COM WHERE UDP = CLOSED");
 }
 */
+
+
+TEST(RunScan, LoopbackSYNScan) {
+
+    const int rawFD = socket(AF_INET, SOCK_RAW, IPPROTO_TCP);
+    if (-1 == rawFD) {
+        GTEST_SKIP() << "SYN scans require CAP_NET_RAW";
+    }
+
+    close(rawFD);
+    EnvironmentFactory::resetGenerator();
+    LoopbackListener listener;
+    uint16_t closedPort = 0;
+    {
+        LoopbackListener closed;
+        closedPort = closed.m_port;
+    }
+
+    std::map<uint16_t, PQ_QUERY_RESULT> results;
+    auto callback = [] (std::any context, PQ_ROW row) { 
+        (*std::any_cast<std::map<uint16_t, PQ_QUERY_RESULT>*>(context))[std::get<uint16_t>(row[0])] = 
+            std::get<PQ_QUERY_RESULT>(row[1]);
+    };
+
+    // Replies read off of the raw socket and out of the packet ring have to come out the same
+    for (const bool ring : { false, true }) {
+
+        results.clear();
+        PQConn pq{callback, &results, 1};
+        pq.setBackend(PQ_BACKEND::SYN_RAW);
+        pq.setReceiveRing(ring);
+        const std::string query = "SELECT PORT, TCP FROM 127.0.0.1 WHERE PORT = " + std::to_string(listener.m_port) + 
+            " OR PORT = " + std::to_string(closedPort);
+        ASSERT_TRUE(pq.execute(query)) << pq.getErrorString();
+        ASSERT_EQ(2, results.size());
+        EXPECT_EQ(PQ_QUERY_RESULT::OPEN, results[listener.m_port]);
+        EXPECT_EQ(PQ_QUERY_RESULT::REJECTED, results[closedPort]);
+    }
+}
+
+
+TEST(RunScan, SYNScanAcrossHosts) {
+
+    // Replies come back a while after their SYN, by then SYNs have gone out to plenty of other hosts and every
+    // reply still has to make it through the filter. Enough hosts for three chunks
+    TunResponder responder("pqtest0", *parseIPv4Address("10.213.0.0"), { 22 }, std::chrono::milliseconds(20));
+    const int rawFD = socket(AF_INET, SOCK_RAW, IPPROTO_TCP);
+    if (-1 != rawFD) {
+        close(rawFD);
+    }
+
+    if (-1 == rawFD || -1 == responder.m_fd) {
+        GTEST_SKIP() << "SYN scans require CAP_NET_RAW, the hosts to scan CAP_NET_ADMIN";
+    }
+
+    EnvironmentFactory::resetGenerator();
+    std::map<std::pair<uint32_t, uint16_t>, PQ_QUERY_RESULT> results;
+    auto callback = [&] (std::any, PQ_ROW row) {
+        results[{std::get<PQ_HOST>(row[0]).m_address, std::get<uint16_t>(row[1])}] = std::get<PQ_QUERY_RESULT>(row[2]);
+    };
+
+    const uint32_t first = *parseIPv4Address("10.213.0.2");
+    const uint32_t last = *parseIPv4Address("10.213.2.100");
+    for (const bool ring : { false, true }) {
+
+        results.clear();
+        PQConn pq{callback, nullptr, 1};
+        pq.setBackend(PQ_BACKEND::SYN_RAW);
+        pq.setReceiveRing(ring);
+        pq.setHostDiscovery(false);
+        ASSERT_TRUE(pq.execute("SELECT HOST, PORT, TCP FROM 10.213.0.2-10.213.2.100 WHERE PORT = 22 OR PORT = 23"))
+            << pq.getErrorString();
+
+        ASSERT_EQ(2 * (last - first + 1), results.size());
+        for (uint32_t address = first; address <= last; address++) {
+
+            EXPECT_EQ(PQ_QUERY_RESULT::OPEN, (results[{address, 22}])) << formatIPv4Address(address);
+            EXPECT_EQ(PQ_QUERY_RESULT::REJECTED, (results[{address, 23}])) << formatIPv4Address(address);
+        }
+    }
+}
+
+
+TEST(RunScan, LoopbackLatency) {
+
+    EnvironmentFactory::resetGenerator();
+    LoopbackListener listener;
+
+    std::vector<PQ_ROW> rows;
+    auto callback = [] (std::any context, PQ_ROW row) { 
+        std::any_cast<std::vector<PQ_ROW>*>(context)->push_back(row);
+    };
+
+    const int rawFD = socket(AF_INET, SOCK_RAW, IPPROTO_TCP);
+    std::vector<PQ_BACKEND> backends = { PQ_BACKEND::CONNECT_EPOLL, PQ_BACKEND::CONNECT_IO_URING };
+    if (-1 != rawFD) {
+
+        close(rawFD);
+        backends.push_back(PQ_BACKEND::SYN_RAW);
+    }
+
+    // Every backend times the handshake on its own, a round trip over loopback is well under a second
+    for (const PQ_BACKEND backend : backends) {
+
+        rows.clear();
+        PQConn pq{callback, &rows, 1};
+        pq.setBackend(backend);
+        const std::string query = "SELECT PORT, LATENCY FROM 127.0.0.1 WHERE PORT = " +
+            std::to_string(listener.m_port) + " AND TCP = OPEN";
+        ASSERT_TRUE(pq.execute(query)) << pq.getErrorString();
+        ASSERT_EQ(1, rows.size());
+        const PQ_LATENCY latency = std::get<PQ_LATENCY>(rows[0][1]);
+        EXPECT_GT(latency, PQ_LATENCY::zero()) << static_cast<int>(backend);
+        EXPECT_LT(latency, std::chrono::seconds(1)) << static_cast<int>(backend);
+    }
+}
+
+
+// A LoopbackListener which greets every connection the way SSH or SMTP servers do, then hangs up
+struct GreetingServer : public LoopbackListener {
+
+    explicit GreetingServer(const std::string& greeting) : m_greeting(greeting) {
+
+        m_thread = std::thread([this] () {
+
+            while (m_running) {
+
+                struct pollfd pollDescriptor = { m_fd, POLLIN, 0 };
+                if (::poll(&pollDescriptor, 1, 10) > 0) {
+
+                    const int fd = accept(m_fd, nullptr, nullptr);
+                    send(fd, m_greeting.data(), m_greeting.size(), MSG_NOSIGNAL);
+                    close(fd);
+                }
+            }
+        });
+    }
+
+    ~GreetingServer() {
+
+        m_running = false;
+        m_thread.join();
+    }
+
+    const std::string m_greeting;
+    std::atomic<bool> m_running = true;
+    std::thread m_thread;
+};
+
+
+TEST(RunScan, TimeoutsFollowTheEstimate) {
+
+    // Every probe goes out before the first answer is back, so all of them start out on the ceiling and are moved
+    // up to the estimate by the first sample. Plenty more samples follow, and the silent ports then have to be
+    // given up on long before the ceiling
+    TunResponder responder("pqtest1", *parseIPv4Address("10.214.0.0"), { 22 }, std::chrono::milliseconds(20), { 24 });
+    if (-1 == responder.m_fd) {
+        GTEST_SKIP() << "The hosts to scan require CAP_NET_ADMIN";
+    }
+
+    EnvironmentFactory::resetGenerator();
+    std::map<std::pair<uint32_t, uint16_t>, PQ_QUERY_RESULT> results;
+    auto callback = [&] (std::any, PQ_ROW row) {
+        results[{std::get<PQ_HOST>(row[0]).m_address, std::get<uint16_t>(row[1])}] = std::get<PQ_QUERY_RESULT>(row[2]);
+    };
+
+    const uint32_t first = *parseIPv4Address("10.214.0.2");
+    const uint32_t last = *parseIPv4Address("10.214.0.33");
+    for (const PQ_BACKEND backend : { PQ_BACKEND::CONNECT_EPOLL, PQ_BACKEND::CONNECT_IO_URING }) {
+
+        results.clear();
+        PQConn pq{callback, nullptr, 30, 1};
+        pq.setBackend(backend);
+        pq.setHostDiscovery(false);
+        const auto start = std::chrono::steady_clock::now();
+        ASSERT_TRUE(pq.execute("SELECT HOST, PORT, TCP FROM 10.214.0.2-10.214.0.33 WHERE PORT BETWEEN 22 AND 24"))
+            << pq.getErrorString();
+        EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(10)) << static_cast<int>(backend);
+
+        ASSERT_EQ(3 * (last - first + 1), results.size());
+        for (uint32_t address = first; address <= last; address++) {
+
+            EXPECT_EQ(PQ_QUERY_RESULT::OPEN, (results[{address, 22}])) << formatIPv4Address(address);
+            EXPECT_EQ(PQ_QUERY_RESULT::REJECTED, (results[{address, 23}])) << formatIPv4Address(address);
+            EXPECT_EQ(PQ_QUERY_RESULT::CLOSED, (results[{address, 24}])) << formatIPv4Address(address);
+        }
+    }
+}
+
+
+TEST(RunScan, LoopbackBanner) {
+
+    EnvironmentFactory::resetGenerator();
+    GreetingServer greeter("SSH-2.0-PortQuery\r\n");
+    LoopbackListener silent;
+
+    std::map<uint16_t, std::string> banners;
+    auto callback = [] (std::any context, PQ_ROW row) {
+
+        // The banner is only valid for as long as the callback runs, so it is copied out
+        (*std::any_cast<std::map<uint16_t, std::string>*>(context))[std::get<uint16_t>(row[0])] =
+            std::string(std::get<PQ_BANNER>(row[1]));
+    };
+
+    for (const PQ_BACKEND backend : { PQ_BACKEND::CONNECT_EPOLL, PQ_BACKEND::CONNECT_IO_URING }) {
+
+        banners.clear();
+        PQConn pq{callback, &banners, 1};
+        pq.setBackend(backend);
+        pq.setBannerWait(200);
+        const std::string query = "SELECT PORT, BANNER FROM 127.0.0.1 WHERE PORT = " + std::to_string(greeter.m_port) +
+            " OR PORT = " + std::to_string(silent.m_port);
+        ASSERT_TRUE(pq.execute(query)) << pq.getErrorString();
+        ASSERT_EQ(2, banners.size());
+        EXPECT_EQ(greeter.m_greeting, banners[greeter.m_port]) << static_cast<int>(backend);
+        EXPECT_TRUE(banners[silent.m_port].empty()) << static_cast<int>(backend);
+
+        // Only as much as was asked for is kept
+        banners.clear();
+        pq.setBannerLength(3);
+        ASSERT_TRUE(pq.execute(query)) << pq.getErrorString();
+        EXPECT_EQ("SSH", banners[greeter.m_port]) << static_cast<int>(backend);
+    }
+}
+
+
+// Every probe times out, the way a host behind a firewall which drops everything looks
+class SilentEnvironment : public IEnvironment {
+
+    public:
+
+        virtual bool scanPort(void) override {
+
+            m_probed++;
+            m_pending.push_back(ScanRow{getAddress(), getPort(), NetworkProtocol::NONE});
+            return true;
+        }
+
+        virtual bool getNextScanResult(const bool) override {
+
+            if (m_pending.empty()) {
+                return false;
+            }
+
+            loadScanRow(m_pending.front());
+            m_pending.pop_front();
+            return true;
+        }
+
+        // Shards probe from threads of their own
+        static std::atomic<size_t> m_probed;
+
+    private:
+
+        std::deque<ScanRow> m_pending;
+};
+
+std::atomic<size_t> SilentEnvironment::m_probed = 0;
+
+
+TEST(RunScan, SilentHostIsInferred) {
+
+    EnvironmentFactory::setGenerator(+[] (const int) -> EnvironmentPtr {
+        return std::make_shared<SilentEnvironment>();
+    });
+
+    size_t rows = 0;
+    size_t inferred = 0;
+    auto callback = [&] (std::any, PQ_ROW row) {
+
+        rows++;
+        inferred += std::get<PQ_INFERRED>(row[2]) ? 1 : 0;
+        EXPECT_EQ(PQ_QUERY_RESULT::CLOSED, std::get<PQ_QUERY_RESULT>(row[1]));
+    };
+
+    // Every port is still reported, but only the run which tripped the breaker and the samples were probed.
+    // The host belongs to a single shard however many there are, so it trips just as soon
+    for (const int threadCount : { 1, 4 }) {
+
+        rows = 0;
+        inferred = 0;
+        SilentEnvironment::m_probed = 0;
+        PQConn pq{callback, nullptr, 2, threadCount};
+        pq.setBreakerThreshold(128);
+        pq.setBreakerSampling(256);
+        pq.setHostDiscovery(false);
+        ASSERT_TRUE(pq.execute("SELECT PORT, TCP, INFERRED FROM 192.0.2.1")) << pq.getErrorString();
+        EXPECT_EQ(65536u, rows) << threadCount;
+        EXPECT_EQ(128u + (65536u - 128u) / 256u, SilentEnvironment::m_probed) << threadCount;
+        EXPECT_EQ(65536u - SilentEnvironment::m_probed, inferred) << threadCount;
+        EXPECT_EQ(inferred, pq.getScanStatistics().m_inferredPorts) << threadCount;
+    }
+
+    // Turning the breaker off probes everything
+    rows = 0;
+    inferred = 0;
+    SilentEnvironment::m_probed = 0;
+    PQConn pq{callback, nullptr, 2, 1};
+    pq.setBreakerThreshold(0);
+    pq.setHostDiscovery(false);
+    ASSERT_TRUE(pq.execute("SELECT PORT, TCP, INFERRED FROM 192.0.2.1")) << pq.getErrorString();
+    EXPECT_EQ(65536u, SilentEnvironment::m_probed);
+    EXPECT_EQ(0u, inferred);
+
+    EnvironmentFactory::resetGenerator();
+}
+
+
+TEST(RunScan, DownHostIsSkipped) {
+
+    EnvironmentFactory::resetGenerator();
+
+    // Nothing can be sent to the broadcast address without asking for it, every liveness probe fails at once
+    size_t rows = 0;
+    auto callback = [&] (std::any, PQ_ROW) { rows++; };
+    PQConn pq{callback, nullptr};
+    ASSERT_TRUE(pq.execute("SELECT PORT FROM 255.255.255.255 WHERE PORT < 10")) << pq.getErrorString();
+    EXPECT_EQ(0u, rows);
+    EXPECT_EQ(1u, pq.getScanStatistics().m_hostsDown);
+}
+
+
+TEST(RunScan, ShardedLoopbackScan) {
+
+    EnvironmentFactory::resetGenerator();
+    LoopbackListener listener;
+
+    // Rows come from every shard, but only ever one at a time
+    std::map<uint16_t, PQ_QUERY_RESULT> results;
+    size_t rows = 0;
+    auto callback = [&] (std::any, PQ_ROW row) {
+
+        rows++;
+        results[std::get<uint16_t>(row[0])] = std::get<PQ_QUERY_RESULT>(row[1]);
+    };
+
+    const uint16_t first = listener.m_port > 100 ? listener.m_port - 100 : 1;
+    const uint16_t last = listener.m_port < 65435 ? listener.m_port + 100 : 65535;
+    for (const PQ_BACKEND backend : { PQ_BACKEND::CONNECT_EPOLL, PQ_BACKEND::CONNECT_IO_URING }) {
+
+        rows = 0;
+        results.clear();
+        PQConn pq{callback, nullptr, 2, 4};
+        pq.setBackend(backend);
+        ASSERT_TRUE(pq.execute("SELECT PORT, TCP FROM 127.0.0.1 WHERE PORT BETWEEN " + std::to_string(first) + " AND " +
+                    std::to_string(last))) << pq.getErrorString();
+
+        // Every port in the range once, no matter which shard had it
+        EXPECT_EQ(static_cast<size_t>(last - first + 1), rows) << static_cast<int>(backend);
+        EXPECT_EQ(rows, results.size()) << static_cast<int>(backend);
+        EXPECT_EQ(PQ_QUERY_RESULT::OPEN, results[listener.m_port]) << static_cast<int>(backend);
+        EXPECT_EQ(PQ_QUERY_RESULT::REJECTED, results[first == listener.m_port ? last : first]) << static_cast<int>(backend);
+    }
+}
+
+
+TEST(RunScan, TargetListWithHostColumn) {
+
+    EnvironmentFactory::resetGenerator();
+    LoopbackListener listener;
+
+    // The listener is only bound to 127.0.0.1, the rest of loopback resets the connect
+    std::map<uint32_t, PQ_QUERY_RESULT> results;
+    auto callback = [&] (std::any, PQ_ROW row) {
+
+        EXPECT_EQ(listener.m_port, std::get<uint16_t>(row[1]));
+        results[std::get<PQ_HOST>(row[0]).m_address] = std::get<PQ_QUERY_RESULT>(row[2]);
+    };
+
+    PQConn pq{callback, nullptr, 2, 2};
+    ASSERT_TRUE(pq.execute("SELECT HOST, PORT, TCP FROM 127.0.0.1, 127.0.0.2/31, 127.0.0.4-127.0.0.5 WHERE PORT = " +
+                std::to_string(listener.m_port))) << pq.getErrorString();
+
+    ASSERT_EQ(5u, results.size());
+    EXPECT_EQ(PQ_QUERY_RESULT::OPEN, results[*parseIPv4Address("127.0.0.1")]);
+    for (const char* const host : { "127.0.0.2", "127.0.0.3", "127.0.0.4", "127.0.0.5" }) {
+        EXPECT_EQ(PQ_QUERY_RESULT::REJECTED, results[*parseIPv4Address(host)]) << host;
+    }
+
+    EXPECT_FALSE(pq.execute("SELECT PORT FROM 127.0.0.1, 127.0.0.0/40"));
+    EXPECT_EQ("Unable to resolve table reference: 127.0.0.0/40", pq.getErrorString());
+}
+
+
+TEST(RunScan, ExcludedTargetsAreSkipped) {
+
+    EnvironmentFactory::resetGenerator();
+    LoopbackListener listener;
+
+    std::map<uint32_t, PQ_QUERY_RESULT> results;
+    auto callback = [&] (std::any, PQ_ROW row) {
+        results[std::get<PQ_HOST>(row[0]).m_address] = std::get<PQ_QUERY_RESULT>(row[1]);
+    };
+
+    char path[] = "/tmp/pqexcludeXXXXXX";
+    const int fd = mkstemp(path);
+    ASSERT_NE(-1, fd);
+    const std::string blocklist = "# loopback we keep away from\n127.0.0.2/31   # two of them\n\n 127.0.0.5\n";
+    ASSERT_EQ(static_cast<ssize_t>(blocklist.size()), write(fd, blocklist.data(), blocklist.size()));
+    close(fd);
+
+    PQConn pq{callback, nullptr};
+    const bool loaded = pq.addExclusionFile(path);
+    unlink(path);
+    ASSERT_TRUE(loaded) << pq.getErrorString();
+
+    ASSERT_TRUE(pq.execute("SELECT HOST, TCP FROM 127.0.0.1-127.0.0.5 WHERE PORT = " + std::to_string(listener.m_port)))
+        << pq.getErrorString();
+    ASSERT_EQ(2u, results.size());
+    EXPECT_EQ(PQ_QUERY_RESULT::OPEN, results[*parseIPv4Address("127.0.0.1")]);
+    EXPECT_EQ(PQ_QUERY_RESULT::REJECTED, results[*parseIPv4Address("127.0.0.4")]);
+
+    EXPECT_FALSE(pq.addExclusion("127.0.0.0/40"));
+    EXPECT_FALSE(pq.addExclusionFile("/nonexistent/blocklist"));
+}
+
+
+TEST(RunScan, HostnamesAreResolved) {
+
+    EnvironmentFactory::resetGenerator();
+    LoopbackListener listener;
+    StubNameServer server({
+            { "listener.test", { *parseIPv4Address("127.0.0.1"), 300 } },
+            { "other.test", { *parseIPv4Address("127.0.0.2"), 300 } } });
+
+    std::map<uint32_t, PQ_QUERY_RESULT> results;
+    auto callback = [&] (std::any, PQ_ROW row) {
+        results[std::get<PQ_HOST>(row[0]).m_address] = std::get<PQ_QUERY_RESULT>(row[1]);
+    };
+
+    PQConn pq{callback, nullptr};
+    EXPECT_FALSE(pq.setNameServer("not an address"));
+    ASSERT_TRUE(pq.setNameServer("127.0.0.1", server.m_port));
+    ASSERT_TRUE(pq.execute("SELECT HOST, TCP FROM Listener.test, other.test, 127.0.0.3 WHERE PORT = " +
+                std::to_string(listener.m_port))) << pq.getErrorString();
+
+    ASSERT_EQ(3u, results.size());
+    EXPECT_EQ(PQ_QUERY_RESULT::OPEN, results[*parseIPv4Address("127.0.0.1")]);
+    EXPECT_EQ(PQ_QUERY_RESULT::REJECTED, results[*parseIPv4Address("127.0.0.2")]);
+
+    // The second run is answered out of the cache
+    EXPECT_FALSE(pq.execute("SELECT PORT FROM listener.test, missing.test"));
+    EXPECT_EQ("Unable to resolve table reference: missing.test", pq.getErrorString());
+    EXPECT_EQ(3u, server.m_queries);
+}
+
+
+TEST(RunScan, HostnameFailures) {
+
+    EnvironmentFactory::resetGenerator();
+    PQConn pq{nullptr, nullptr};
+
+    // A name the server says doesn't exist
+    {
+        StubNameServer server({});
+        ASSERT_TRUE(pq.setNameServer("127.0.0.1", server.m_port));
+        EXPECT_FALSE(pq.execute("SELECT PORT FROM NOT.AN.ADDRESS"));
+        EXPECT_EQ("Unable to resolve table reference: NOT.AN.ADDRESS", pq.getErrorString());
+        pq.finalize();
+    }
+
+    // A server which isn't there at all, nothing is left listening on the stub's port
+    uint16_t closedPort = 0;
+    {
+        StubNameServer closed({});
+        closedPort = closed.m_port;
+    }
+
+    ASSERT_TRUE(pq.setNameServer("127.0.0.1", closedPort));
+    EXPECT_FALSE(pq.execute("SELECT PORT FROM other.test"));
+    EXPECT_EQ("Unable to reach name server: Connection refused", pq.getErrorString());
+}
+
+TEST(RunScan, PartitionsSplitTheSweep) {
+
+    EnvironmentFactory::resetGenerator();
+
+    std::set<uint16_t> ports;
+    auto callback = [&] (std::any, PQ_ROW row) {
+        EXPECT_TRUE(ports.insert(std::get<uint16_t>(row[0])).second);
+    };
+
+    // Every port is reported once over the partitions, whatever seed each of them runs with
+    PQConn pq{callback, nullptr, 2, 2};
+    pq.setHostDiscovery(false);
+    EXPECT_FALSE(pq.setPartition(3, 3));
+    std::vector<std::set<uint16_t>> partitions;
+    for (size_t partition = 0; partition < 3; partition++) {
+
+        ports.clear();
+        pq.setSeed(partition);
+        ASSERT_TRUE(pq.setPartition(partition, 3));
+        ASSERT_TRUE(pq.execute("SELECT PORT FROM 127.0.0.1 WHERE PORT BETWEEN 1 AND 600")) << pq.getErrorString();
+        EXPECT_GT(ports.size(), 150u);
+        EXPECT_LT(ports.size(), 250u);
+        partitions.push_back(ports);
+    }
+
+    ports.clear();
+    size_t total = 0;
+    for (const std::set<uint16_t>& partition : partitions) {
+
+        ports.insert(partition.begin(), partition.end());
+        total += partition.size();
+    }
+
+    EXPECT_EQ(600u, ports.size());
+    EXPECT_EQ(600u, total);
+
+    // The same partition sweeps the same pairs on another run
+    ports.clear();
+    pq.setSeed(42);
+    ASSERT_TRUE(pq.setPartition(1, 3));
+    ASSERT_TRUE(pq.execute("SELECT PORT FROM 127.0.0.1 WHERE PORT BETWEEN 1 AND 600")) << pq.getErrorString();
+    EXPECT_EQ(partitions[1], ports);
+}
@@ -0,0 +1,104 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../libportquery/source/ProbeScheduler.h"
+#include "../libportquery/source/Network.h"
+
+
+using namespace PortQuery;
+
+
+static uint32_t address(const char* const text) {
+
+    return *parseIPv4Address(text);
+}
+
+
+static std::vector<uint32_t> drain(ProbeScheduler& scheduler) {
+
+    std::vector<uint32_t> order;
+    for (std::optional<ProbeScheduler::Probe> probe; (probe = scheduler.nextProbe());) {
+        order.push_back(probe->m_address);
+    }
+
+    return order;
+}
+
+
+TEST(ProbeScheduler, HostsTakeTurns) {
+
+    ProbeScheduler scheduler(0, 0);
+    const uint32_t first = address("10.0.0.1");
+    const uint32_t second = address("10.0.0.2");
+    for (uint16_t port = 1; port <= 3; port++) {
+        scheduler.addProbe(first, port);
+    }
+
+    scheduler.addProbe(second, 1);
+    scheduler.addProbe(second, 2);
+    EXPECT_EQ(5u, scheduler.getPendingCount());
+
+    const std::vector<uint32_t> expected = { first, second, first, second, first };
+    EXPECT_EQ(expected, drain(scheduler));
+    EXPECT_EQ(0u, scheduler.getPendingCount());
+    EXPECT_EQ(5u, scheduler.getInFlight());
+}
+
+
+TEST(ProbeScheduler, HostLimit) {
+
+    ProbeScheduler scheduler(2, 0);
+    const uint32_t busy = address("10.0.0.1");
+    const uint32_t quiet = address("10.0.0.2");
+    for (uint16_t port = 1; port <= 5; port++) {
+        scheduler.addProbe(busy, port);
+    }
+
+    scheduler.addProbe(quiet, 1);
+
+    // The busy host sits out once it has two in flight, the other host still gets its turn
+    std::vector<uint32_t> expected = { busy, quiet, busy };
+    EXPECT_EQ(expected, drain(scheduler));
+    EXPECT_EQ(3u, scheduler.getPendingCount());
+
+    scheduler.completeProbe(quiet);
+    EXPECT_FALSE(scheduler.nextProbe());
+
+    scheduler.completeProbe(busy);
+    expected = { busy };
+    EXPECT_EQ(expected, drain(scheduler));
+
+    // Forgetting what was in flight lets the host go again
+    scheduler.clearInFlight();
+    EXPECT_EQ(0u, scheduler.getInFlight());
+    expected = { busy, busy };
+    EXPECT_EQ(expected, drain(scheduler));
+}
+
+
+TEST(ProbeScheduler, SubnetLimit) {
+
+    ProbeScheduler scheduler(0, 2);
+    const uint32_t first = address("10.0.0.1");
+    const uint32_t second = address("10.0.0.2");
+    const uint32_t other = address("10.0.1.1");
+    for (const uint32_t host : { first, second, other }) {
+
+        scheduler.addProbe(host, 1);
+        scheduler.addProbe(host, 2);
+    }
+
+    // 10.0.0.0/24 is full after a probe to each of its hosts, 10.0.1.0/24 carries on
+    std::vector<uint32_t> expected = { first, second, other, other };
+    EXPECT_EQ(expected, drain(scheduler));
+
+    // The slot goes to the host which has waited longest, whichever host it came from
+    scheduler.completeProbe(second);
+    expected = { first };
+    EXPECT_EQ(expected, drain(scheduler));
+
+    scheduler.completeProbe(first);
+    expected = { second };
+    EXPECT_EQ(expected, drain(scheduler));
+    EXPECT_EQ(0u, scheduler.getPendingCount());
+}
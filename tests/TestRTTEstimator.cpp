@@ -0,0 +1,65 @@
+#include "gtest/gtest.h"
+#include "../libportquery/source/RTTEstimator.h"
+
+
+using namespace PortQuery;
+using namespace std::chrono_literals;
+
+
+TEST(RTTEstimator, CeilingUntilFirstSample) {
+
+    RTTEstimator estimator(100ms, 2s);
+    EXPECT_EQ(2000ms, estimator.getTimeout(1));
+
+    estimator.setCeiling(5s);
+    EXPECT_EQ(5000ms, estimator.getTimeout(1));
+}
+
+
+TEST(RTTEstimator, FirstSample) {
+
+    // The first sample sets the deviation to half the sample, so the timeout is three times the sample
+    RTTEstimator estimator(1ms, 2s);
+    estimator.addSample(1, 100ms);
+    EXPECT_EQ(300ms, estimator.getTimeout(1));
+
+    // Hosts without samples of their own borrow from everything seen so far
+    EXPECT_EQ(300ms, estimator.getTimeout(2));
+}
+
+
+TEST(RTTEstimator, ConvergesAndClamps) {
+
+    RTTEstimator estimator(50ms, 2s);
+    for (int sample = 0; sample < 64; sample++) {
+
+        estimator.addSample(1, 10ms);
+    }
+
+    // A steady RTT leaves hardly any deviation, the clock granularity and then the floor take over
+    EXPECT_EQ(50ms, estimator.getTimeout(1));
+
+    estimator.setFloor(1ms);
+    EXPECT_EQ(11ms, estimator.getTimeout(1));
+
+    for (int sample = 0; sample < 64; sample++) {
+
+        estimator.addSample(2, 10s);
+    }
+
+    EXPECT_EQ(2000ms, estimator.getTimeout(2));
+}
+
+
+TEST(RTTEstimator, ForgottenHostsBorrowAgain) {
+
+    RTTEstimator estimator(1ms, 2s);
+    estimator.addSample(1, 100ms);
+    estimator.addSample(2, 10ms);
+    const std::chrono::milliseconds global = estimator.getTimeout(3);
+    EXPECT_NE(global, estimator.getTimeout(2));
+
+    estimator.forgetHost(2);
+    EXPECT_EQ(global, estimator.getTimeout(2));
+    EXPECT_EQ(300ms, estimator.getTimeout(1));
+}
@@ -0,0 +1,79 @@
+#include "gtest/gtest.h"
+#include "../libportquery/source/RateGovernor.h"
+
+
+using namespace PortQuery;
+
+
+TEST(RateGovernor, WindowLimitsInFlight) {
+
+    RateGovernor governor(16);
+    const auto now = RateGovernor::Clock::now();
+    EXPECT_TRUE(governor.tryAcquire(now, 15));
+    EXPECT_FALSE(governor.tryAcquire(now, 16));
+    EXPECT_EQ(RateGovernor::Clock::time_point::max(), governor.getNextSend(now, 16));
+}
+
+
+TEST(RateGovernor, LossHalvesWindow) {
+
+    RateGovernor governor(64);
+    const auto now = RateGovernor::Clock::now();
+    governor.addRTTSample(std::chrono::milliseconds(10));
+    governor.onLoss(now);
+    EXPECT_EQ(32u, governor.getWindow());
+
+    // Losses within a round trip of each other are the same congestion
+    governor.onLoss(now + std::chrono::milliseconds(1));
+    EXPECT_EQ(32u, governor.getWindow());
+
+    governor.onLoss(now + std::chrono::seconds(1));
+    EXPECT_EQ(16u, governor.getWindow());
+
+    // Two round trips worth of answers grow it back by about two
+    for (int reply = 0; reply < 34; reply++) {
+        governor.onReply();
+    }
+
+    EXPECT_EQ(18u, governor.getWindow());
+}
+
+
+TEST(RateGovernor, SilentHostKeepsWindow) {
+
+    RateGovernor governor(1024);
+    const auto now = RateGovernor::Clock::now();
+    for (int timeout = 0; timeout < 4096; timeout++) {
+        governor.onTimeout(now);
+    }
+
+    EXPECT_EQ(1024u, governor.getWindow());
+
+    // Once the host has answered, a long run of timeouts is taken as loss
+    governor.onReply();
+    for (int timeout = 0; timeout < 512; timeout++) {
+        governor.onTimeout(now);
+    }
+
+    EXPECT_EQ(512u, governor.getWindow());
+}
+
+
+TEST(RateGovernor, MaxRateCapsPacing) {
+
+    RateGovernor governor(1024);
+    governor.setMaxRate(10.0);
+    governor.addRTTSample(std::chrono::milliseconds(1));
+
+    const auto now = RateGovernor::Clock::now() + std::chrono::seconds(1);
+    EXPECT_TRUE(governor.tryAcquire(now, 0));
+    EXPECT_FALSE(governor.tryAcquire(now, 0));
+
+    const auto next = governor.getNextSend(now, 0);
+    EXPECT_EQ(std::chrono::milliseconds(100), std::chrono::round<std::chrono::milliseconds>(next - now));
+
+    // A token handed back can be used again straight away
+    governor.release();
+    EXPECT_TRUE(governor.tryAcquire(now, 0));
+    EXPECT_FALSE(governor.tryAcquire(now, 0));
+}
@@ -0,0 +1,132 @@
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/ip.h>
+#include <netinet/ip_icmp.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+
+#include "gtest/gtest.h"
+#include "../libportquery/source/ReplyFilter.h"
+
+
+using namespace PortQuery;
+
+
+// Just enough of a classic BPF interpreter to run what buildReplyFilter generates, returns how much of the packet
+// the socket would have been handed
+static uint32_t runFilter(const std::vector<struct sock_filter>& program, const std::vector<uint8_t>& packet) {
+
+    uint32_t accumulator = 0;
+    uint32_t index = 0;
+    const auto load = [&] (const uint32_t offset, const uint32_t size) {
+
+        uint32_t value = 0;
+        for (uint32_t byte = 0; byte < size; byte++) {
+            value = (value << 8) | packet.at(offset + byte);
+        }
+
+        return value;
+    };
+
+    for (size_t pc = 0; pc < program.size(); pc++) {
+
+        const struct sock_filter& instruction = program[pc];
+        const uint32_t size = BPF_W == BPF_SIZE(instruction.code) ? 4 : BPF_H == BPF_SIZE(instruction.code) ? 2 : 1;
+        switch (BPF_CLASS(instruction.code)) {
+
+            case BPF_LD:
+                accumulator = load((BPF_IND == BPF_MODE(instruction.code) ? index : 0) + instruction.k, size);
+                break;
+            case BPF_LDX:
+                index = 4 * (load(instruction.k, 1) & 0xF);
+                break;
+            case BPF_RET:
+                return instruction.k;
+            case BPF_JMP: {
+
+                bool taken = false;
+                switch (BPF_OP(instruction.code)) {
+                    case BPF_JA: pc += instruction.k; continue;
+                    case BPF_JEQ: taken = accumulator == instruction.k; break;
+                    case BPF_JGT: taken = accumulator > instruction.k; break;
+                    case BPF_JGE: taken = accumulator >= instruction.k; break;
+                    case BPF_JSET: taken = 0 != (accumulator & instruction.k); break;
+                }
+
+                pc += taken ? instruction.jt : instruction.jf;
+                break;
+            }
+        }
+    }
+
+    ADD_FAILURE() << "Filter ran off the end of the program";
+    return 0;
+}
+
+
+static std::vector<uint8_t> makePacket(const uint8_t protocol, const uint32_t source, const std::vector<uint8_t>& body) {
+
+    struct iphdr header = { };
+    header.version = 4;
+    header.ihl = 5;
+    header.protocol = protocol;
+    header.saddr = htonl(source);
+    header.daddr = htonl(0x0A000001);
+
+    std::vector<uint8_t> packet(sizeof(header));
+    std::memcpy(packet.data(), &header, sizeof(header));
+    packet.insert(packet.end(), body.begin(), body.end());
+    return packet;
+}
+
+
+static std::vector<uint8_t> makeTransport(const uint16_t destinationPort) {
+
+    struct tcphdr header = { };
+    header.dest = htons(destinationPort);
+    std::vector<uint8_t> body(sizeof(header));
+    std::memcpy(body.data(), &header, sizeof(header));
+    return body;
+}
+
+
+TEST(ReplyFilter, TCPFromTargetsToLocalPort) {
+
+    const auto program = buildReplyFilter(ReplyFilterSpec{NetworkProtocol::TCP, 0x0A000100, 0x0A0001FF, 40000});
+    EXPECT_NE(0u, runFilter(program, makePacket(IPPROTO_TCP, 0x0A000100, makeTransport(40000))));
+    EXPECT_NE(0u, runFilter(program, makePacket(IPPROTO_TCP, 0x0A0001FF, makeTransport(40000))));
+
+    // Outside the targets, the wrong port, or a protocol which isn't being scanned
+    EXPECT_EQ(0u, runFilter(program, makePacket(IPPROTO_TCP, 0x0A000200, makeTransport(40000))));
+    EXPECT_EQ(0u, runFilter(program, makePacket(IPPROTO_TCP, 0x0A000100, makeTransport(40001))));
+    EXPECT_EQ(0u, runFilter(program, makePacket(IPPROTO_UDP, 0x0A000100, makeTransport(40000))));
+
+    // A later fragment doesn't have a TCP header where one is expected
+    std::vector<uint8_t> fragment = makePacket(IPPROTO_TCP, 0x0A000100, makeTransport(40000));
+    fragment[7] = 0x01;
+    EXPECT_EQ(0u, runFilter(program, fragment));
+}
+
+
+TEST(ReplyFilter, ICMPErrorsMatchTheQuotedTarget) {
+
+    const auto program = buildReplyFilter(ReplyFilterSpec{NetworkProtocol::UDP, 0x0A000105, 0x0A000105, 0});
+    EXPECT_NE(0u, runFilter(program, makePacket(IPPROTO_UDP, 0x0A000105, makeTransport(53))));
+    EXPECT_EQ(0u, runFilter(program, makePacket(IPPROTO_TCP, 0x0A000105, makeTransport(53))));
+
+    // Port unreachable from a router along the way, quoting the datagram that was sent to the target
+    const auto makeError = [] (const uint8_t type, const uint32_t quotedTarget) {
+
+        std::vector<uint8_t> body = { type, ICMP_PORT_UNREACH, 0, 0, 0, 0, 0, 0 };
+        const std::vector<uint8_t> quoted = makePacket(IPPROTO_UDP, 0x0A000001, makeTransport(53));
+        body.insert(body.end(), quoted.begin(), quoted.end());
+        const uint32_t target = htonl(quotedTarget);
+        std::memcpy(body.data() + 8 + 16, &target, sizeof(target));
+        return makePacket(IPPROTO_ICMP, 0xC0A80001, body);
+    };
+
+    EXPECT_NE(0u, runFilter(program, makeError(ICMP_DEST_UNREACH, 0x0A000105)));
+    EXPECT_EQ(0u, runFilter(program, makeError(ICMP_DEST_UNREACH, 0x0A000106)));
+    EXPECT_EQ(0u, runFilter(program, makeError(ICMP_ECHOREPLY, 0x0A000105)));
+}
@@ -0,0 +1,246 @@
+#include <map>
+#include <set>
+
+#include "gtest/gtest.h"
+#include "../libportquery/source/ScanEngine.h"
+#include "LoopbackListener.h"
+
+
+using namespace PortQuery;
+
+
+TEST(ScanEngine, LoopbackOpenAndRejected) {
+
+    LoopbackListener listener;
+    const uint32_t loopback = *parseIPv4Address("127.0.0.1");
+
+    // Closing a listener releases its port, which should then be refused
+    uint16_t closedPort = 0;
+    {
+        LoopbackListener closed;
+        closedPort = closed.m_port;
+    }
+
+    ScanEngine engine;
+    engine.setTimeout(std::chrono::seconds(1));
+    engine.submitTCPProbe(loopback, listener.m_port);
+    engine.submitTCPProbe(loopback, closedPort);
+
+    std::map<uint16_t, PQ_QUERY_RESULT> results;
+    ProbeResult result;
+    while (results.size() < 2) {
+
+        engine.poll(true);
+        while (engine.popResult(result)) {
+
+            EXPECT_EQ(loopback, result.m_address);
+            results[result.m_port] = result.m_result;
+        }
+    }
+
+    EXPECT_EQ(PQ_QUERY_RESULT::OPEN, results[listener.m_port]);
+    EXPECT_EQ(PQ_QUERY_RESULT::REJECTED, results[closedPort]);
+    EXPECT_EQ(0, engine.getInFlight());
+}
+
+
+TEST(ScanEngine, WindowSmallerThanSubmissions) {
+
+    LoopbackListener listener;
+    const uint32_t loopback = *parseIPv4Address("127.0.0.1");
+
+    // Submitting more probes than the window allows forces the reactor to run from within submit
+    ScanEngine engine(4);
+    for (int probe = 0; probe < 64; probe++) {
+
+        engine.submitTCPProbe(loopback, listener.m_port);
+        EXPECT_GE(4, engine.getInFlight());
+    }
+
+    size_t completed = 0;
+    ProbeResult result;
+    while (completed < 64) {
+
+        engine.poll(true);
+        while (engine.popResult(result)) {
+
+            EXPECT_EQ(PQ_QUERY_RESULT::OPEN, result.m_result);
+            completed++;
+        }
+    }
+}
+
+
+TEST(ScanEngine, LoopbackUDPOpenAndRejected) {
+
+    const uint32_t loopback = *parseIPv4Address("127.0.0.1");
+
+    // A bound datagram socket which answers the probe by hand, and a port with nothing bound to it
+    const int server = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in address = makeSocketAddress(loopback, 0);
+    socklen_t length = sizeof(address);
+    bind(server, reinterpret_cast<sockaddr*>(&address), length);
+    getsockname(server, reinterpret_cast<sockaddr*>(&address), &length);
+    const uint16_t openPort = ntohs(address.sin_port);
+
+    const int closed = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in closedAddress = makeSocketAddress(loopback, 0);
+    bind(closed, reinterpret_cast<sockaddr*>(&closedAddress), length);
+    getsockname(closed, reinterpret_cast<sockaddr*>(&closedAddress), &length);
+    const uint16_t closedPort = ntohs(closedAddress.sin_port);
+    close(closed);
+
+    ScanEngine engine;
+    engine.setTimeout(std::chrono::seconds(1));
+    engine.submitUDPProbe(loopback, openPort);
+    engine.submitUDPProbe(loopback, closedPort);
+
+    // Datagrams are held back for a full burst, running the reactor sends them
+    engine.poll(false);
+
+    char buffer[16];
+    sockaddr_in peer;
+    socklen_t peerLength = sizeof(peer);
+    const ssize_t received = recvfrom(server, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&peer), &peerLength);
+    EXPECT_EQ(0, received);
+    sendto(server, "pong", 4, 0, reinterpret_cast<sockaddr*>(&peer), peerLength);
+
+    std::map<uint16_t, PQ_QUERY_RESULT> results;
+    ProbeResult result;
+    while (results.size() < 2) {
+
+        engine.poll(true);
+        while (engine.popResult(result)) {
+
+            EXPECT_EQ(NetworkProtocol::UDP, result.m_protocol);
+            results[result.m_port] = result.m_result;
+        }
+    }
+
+    close(server);
+    EXPECT_EQ(PQ_QUERY_RESULT::OPEN, results[openPort]);
+    EXPECT_EQ(PQ_QUERY_RESULT::REJECTED, results[closedPort]);
+    EXPECT_FALSE(engine.isRateLimited(loopback));
+}
+
+
+TEST(ScanEngine, LoopbackUDPAcrossBursts) {
+
+    const uint32_t loopback = *parseIPv4Address("127.0.0.1");
+
+    // More probes than fit in a burst, several sendmmsg calls and several ICMP errors per read
+    ScanEngine engine;
+    engine.setTimeout(std::chrono::seconds(1));
+    engine.setBurstSize(4);
+    for (uint16_t port = 1; port <= 10; port++) {
+        engine.submitUDPProbe(loopback, port);
+    }
+
+    size_t rejected = 0;
+    ProbeResult result;
+    while (0 != engine.getInFlight()) {
+
+        engine.poll(true);
+        while (engine.popResult(result)) {
+
+            rejected += PQ_QUERY_RESULT::REJECTED == result.m_result ? 1 : 0;
+        }
+    }
+
+    EXPECT_EQ(10u, rejected);
+}
+
+
+TEST(ScanEngine, RecycledSocketsKeepResultsApart) {
+
+    LoopbackListener listener;
+    const uint32_t loopback = *parseIPv4Address("127.0.0.1");
+    uint16_t closedPort = 0;
+    {
+        LoopbackListener closed;
+        closedPort = closed.m_port;
+    }
+
+    // With two slots every socket is reused many times, a reset left over from one probe must not show up as the
+    // result of the next
+    ScanEngine engine(2);
+    std::map<uint16_t, size_t> counts;
+    ProbeResult result;
+    for (int probe = 0; probe < 32; probe++) {
+
+        engine.submitTCPProbe(loopback, 0 == probe % 2 ? listener.m_port : closedPort);
+        while (engine.popResult(result)) {
+
+            EXPECT_EQ(result.m_port == listener.m_port ? PQ_QUERY_RESULT::OPEN : PQ_QUERY_RESULT::REJECTED, result.m_result);
+            counts[result.m_port]++;
+        }
+    }
+
+    while (0 != engine.getInFlight()) {
+
+        engine.poll(true);
+        while (engine.popResult(result)) {
+
+            EXPECT_EQ(result.m_port == listener.m_port ? PQ_QUERY_RESULT::OPEN : PQ_QUERY_RESULT::REJECTED, result.m_result);
+            counts[result.m_port]++;
+        }
+    }
+
+    EXPECT_EQ(16u, counts[listener.m_port]);
+    EXPECT_EQ(16u, counts[closedPort]);
+
+    const PQ_SCAN_STATS statistics = engine.getStatistics();
+    EXPECT_EQ(2u, statistics.m_maxInFlight);
+    EXPECT_LT(statistics.m_maxInFlight, statistics.m_descriptorLimit);
+}
+
+
+TEST(ScanEngine, ConnectsSpreadOverSourceAddresses) {
+
+    LoopbackListener listener;
+    const uint32_t loopback = *parseIPv4Address("127.0.0.1");
+
+    // The whole of 127/8 is local, so every one of these can be bound without any setup
+    ScanEngine engine(8);
+    engine.addSourceAddress(*parseIPv4Address("127.0.0.2"));
+    engine.addSourceAddress(*parseIPv4Address("127.0.0.3"));
+
+    for (int probe = 0; probe < 8; probe++) {
+        engine.submitTCPProbe(loopback, listener.m_port);
+    }
+
+    while (0 != engine.getInFlight()) {
+        engine.poll(true);
+    }
+
+    size_t open = 0;
+    ProbeResult result;
+    while (engine.popResult(result)) {
+
+        EXPECT_EQ(PQ_QUERY_RESULT::OPEN, result.m_result);
+        open++;
+    }
+
+    EXPECT_EQ(8u, open);
+
+    // Handshakes are completed by the kernel before the probes are reset, so they are all waiting to be accepted
+    std::set<uint32_t> sources;
+    for (int connection = 0; connection < 8; connection++) {
+
+        sockaddr_in peer = { };
+        socklen_t length = sizeof(peer);
+        const int fd = accept(listener.m_fd, reinterpret_cast<sockaddr*>(&peer), &length);
+        ASSERT_NE(-1, fd);
+        sources.insert(ntohl(peer.sin_addr.s_addr));
+        close(fd);
+    }
+
+    EXPECT_EQ((std::set<uint32_t>{*parseIPv4Address("127.0.0.2"), *parseIPv4Address("127.0.0.3")}), sources);
+
+    // Every connect held a port while it was in flight, and there were always plenty to go round
+    const PQ_SCAN_STATS statistics = engine.getStatistics();
+    EXPECT_EQ(0u, statistics.m_portStalls);
+    EXPECT_GE(statistics.m_peakPortsInUse, 1u);
+    EXPECT_LE(statistics.m_peakPortsInUse, 8u);
+    EXPECT_GT(statistics.m_portLimit, 0u);
+}
@@ -0,0 +1,61 @@
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../libportquery/source/TargetFeed.h"
+
+
+using namespace PortQuery;
+
+
+TEST(TargetFeed, EveryShardSeesEveryChunk) {
+
+    TargetSet targets;
+    ASSERT_TRUE(targets.addTarget("10.0.0.0-10.0.0.9"));
+    TargetFeed feed(targets.begin(), nullptr, 2, 4);
+
+    // Chunks stay around until both shards are done with them
+    const std::vector<uint32_t>* first = feed.getChunk(0);
+    ASSERT_NE(nullptr, first);
+    EXPECT_EQ(4u, first->size());
+    feed.releaseChunk(0);
+    EXPECT_EQ(first, feed.getChunk(0));
+    feed.releaseChunk(0);
+
+    std::vector<uint32_t> walked;
+    for (size_t chunk = 1; const std::vector<uint32_t>* chunkTargets = feed.getChunk(chunk); chunk++) {
+
+        walked.insert(walked.end(), chunkTargets->begin(), chunkTargets->end());
+        feed.releaseChunk(chunk);
+        feed.releaseChunk(chunk);
+    }
+
+    EXPECT_EQ((std::vector<uint32_t>{ 0x0A000004, 0x0A000005, 0x0A000006, 0x0A000007, 0x0A000008, 0x0A000009 }),
+            walked);
+    EXPECT_EQ(0u, feed.getHostsDown());
+}
+
+
+TEST(TargetFeed, StopWakesWaitingShards) {
+
+    TargetSet targets;
+    ASSERT_TRUE(targets.addTarget("10.0.0.0/16"));
+    TargetFeed feed(targets.begin(), nullptr, 2, 1);
+
+    // One shard runs ahead while the other never releases anything, it has to wait once the buffer is full
+    for (size_t chunk = 0; chunk < TargetFeed::MAX_CHUNKS_BUFFERED; chunk++) {
+
+        ASSERT_NE(nullptr, feed.getChunk(chunk));
+        feed.releaseChunk(chunk);
+    }
+
+    const std::vector<uint32_t>* waited = feed.getChunk(0);
+    ASSERT_NE(nullptr, waited);
+
+    std::thread ahead([&] () { waited = feed.getChunk(TargetFeed::MAX_CHUNKS_BUFFERED); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    feed.stop();
+    ahead.join();
+    EXPECT_EQ(nullptr, waited);
+}
@@ -0,0 +1,120 @@
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "../libportquery/source/TargetFile.h"
+#include "../libportquery/source/TargetSet.h"
+#include "../libportquery/source/Network.h"
+
+
+using namespace PortQuery;
+
+
+// A file in /tmp with the given contents, removed again when it goes out of scope
+struct TemporaryFile {
+
+    TemporaryFile(const std::string& contents) {
+
+        const int fd = mkstemp(m_path);
+        EXPECT_EQ(static_cast<ssize_t>(contents.size()), write(fd, contents.data(), contents.size()));
+        close(fd);
+    }
+
+    ~TemporaryFile() {
+
+        unlink(m_path);
+    }
+
+    char m_path[32] = "/tmp/pqtargetsXXXXXX";
+};
+
+
+static std::vector<std::string> readEntries(TargetFile& file) {
+
+    std::vector<std::string> entries;
+    for (std::optional<std::string_view> entry; (entry = file.nextEntry());) {
+        entries.emplace_back(*entry);
+    }
+
+    return entries;
+}
+
+
+TEST(TargetFile, ReadsMappedFile) {
+
+    // Comments, blank lines, CRLF line endings and no newline at the very end
+    const TemporaryFile temporary("# blocklist\n10.0.0.1\r\n\n   \n  10.0.1.0/24  # office\n10.0.2.1-10.0.2.9");
+    TargetFile file(temporary.m_path);
+    EXPECT_EQ((std::vector<std::string>{ "10.0.0.1", "10.0.1.0/24", "10.0.2.1-10.0.2.9" }), readEntries(file));
+    EXPECT_EQ(std::nullopt, file.nextEntry());
+
+    const TemporaryFile empty("");
+    TargetFile emptyFile(empty.m_path);
+    EXPECT_EQ(std::nullopt, emptyFile.nextEntry());
+
+    EXPECT_THROW(TargetFile("/nonexistent/targets.txt"), std::system_error);
+}
+
+
+TEST(TargetFile, ReadsPipeInBlocks) {
+
+    // A pipe can't be mapped. Far more than one read buffer goes through it, so lines get split across reads
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    std::thread writer([&] () {
+
+        std::string contents;
+        for (uint32_t line = 0; line < 20000; line++) {
+            contents += formatIPv4Address(0x0A000000 + line) + "\n";
+        }
+
+        for (size_t written = 0; written < contents.size();) {
+
+            const ssize_t count = write(fds[1], contents.data() + written, contents.size() - written);
+            if (count <= 0) {
+                break;
+            }
+
+            written += static_cast<size_t>(count);
+        }
+
+        close(fds[1]);
+    });
+
+    std::vector<std::string> entries;
+    {
+        TargetFile file("/dev/fd/" + std::to_string(fds[0]));
+        entries = readEntries(file);
+    }
+
+    writer.join();
+    close(fds[0]);
+
+    ASSERT_EQ(20000u, entries.size());
+    for (uint32_t line = 0; line < entries.size(); line++) {
+        ASSERT_EQ(formatIPv4Address(0x0A000000 + line), entries[line]);
+    }
+}
+
+
+TEST(TargetFile, TargetSetReadsFilesLast) {
+
+    const TemporaryFile temporary("10.0.0.8/31\nnot a target\n10.0.0.20\n");
+    TargetSet targets;
+    ASSERT_TRUE(targets.addTarget(std::string("@") + temporary.m_path));
+    ASSERT_TRUE(targets.addTarget("10.0.0.1"));
+    EXPECT_FALSE(targets.addTarget("@/nonexistent/targets.txt"));
+
+    std::vector<uint32_t> walked;
+    TargetSet::Iterator iterator = targets.begin();
+    for (std::optional<uint32_t> target; (target = iterator.next());) {
+        walked.push_back(*target);
+    }
+
+    EXPECT_EQ((std::vector<uint32_t>{ 0x0A000001, 0x0A000008, 0x0A000009, 0x0A000014 }), walked);
+    EXPECT_EQ(1u, targets.getMalformedCount());
+}
@@ -0,0 +1,72 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "../libportquery/source/TargetSet.h"
+#include "../libportquery/source/Network.h"
+
+
+using namespace PortQuery;
+
+
+static std::vector<uint32_t> walk(const TargetSet& targets) {
+
+    std::vector<uint32_t> addresses;
+    TargetSet::Iterator iterator = targets.begin();
+    for (std::optional<uint32_t> address; (address = iterator.next());) {
+        addresses.push_back(*address);
+    }
+
+    return addresses;
+}
+
+
+TEST(TargetSet, ParsesTargets) {
+
+    TargetSet targets;
+    EXPECT_TRUE(targets.addTarget("10.0.0.9"));
+    EXPECT_TRUE(targets.addTarget("192.168.1.7/30"));
+    EXPECT_TRUE(targets.addTarget("172.16.0.254-172.16.1.1"));
+    EXPECT_EQ(9u, targets.size());
+
+    // In the order they were added, host bits in a block are dropped
+    const std::vector<uint32_t> expected{
+        *parseIPv4Address("10.0.0.9"),
+        *parseIPv4Address("192.168.1.4"), *parseIPv4Address("192.168.1.5"),
+        *parseIPv4Address("192.168.1.6"), *parseIPv4Address("192.168.1.7"),
+        *parseIPv4Address("172.16.0.254"), *parseIPv4Address("172.16.0.255"),
+        *parseIPv4Address("172.16.1.0"), *parseIPv4Address("172.16.1.1") };
+    EXPECT_EQ(expected, walk(targets));
+}
+
+
+TEST(TargetSet, RejectsMalformedTargets) {
+
+    TargetSet targets;
+    EXPECT_FALSE(targets.addTarget("10.0.0.0/33"));
+    EXPECT_FALSE(targets.addTarget("10.0.0.0/"));
+    EXPECT_FALSE(targets.addTarget("10.0.0.0/+8"));
+    EXPECT_FALSE(targets.addTarget("10.0.0.0/8/8"));
+    EXPECT_FALSE(targets.addTarget("10.0.0.50-10.0.0.1"));
+    EXPECT_FALSE(targets.addTarget("10.0.0.1-"));
+    EXPECT_FALSE(targets.addTarget("10.0.0"));
+    EXPECT_FALSE(targets.addTarget("WWW.GOOGLE.COM"));
+    EXPECT_TRUE(targets.empty());
+}
+
+
+TEST(TargetSet, WalksWholeAddressSpaceLazily) {
+
+    // Nothing is laid out up front, a /0 is as cheap to hold as a single address
+    TargetSet targets;
+    ASSERT_TRUE(targets.addTarget("0.0.0.0/0"));
+    EXPECT_EQ(static_cast<uint64_t>(1) << 32, targets.size());
+
+    TargetSet::Iterator iterator = targets.begin();
+    EXPECT_EQ(0u, *iterator.next());
+    EXPECT_EQ(1u, *iterator.next());
+
+    // The last address in the space ends the walk instead of wrapping around
+    TargetSet edge;
+    ASSERT_TRUE(edge.addTarget("255.255.255.254/31"));
+    EXPECT_EQ((std::vector<uint32_t>{ 0xFFFFFFFE, 0xFFFFFFFF }), walk(edge));
+}
@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <random>
+
+#include "gtest/gtest.h"
+#include "../libportquery/source/TimingWheel.h"
+
+
+using namespace PortQuery;
+using namespace std::chrono_literals;
+
+
+TEST(TimingWheel, ExpiresInOrderAndNeverEarly) {
+
+    const auto start = TimingWheel::Clock::now();
+    TimingWheel wheel(1ms, start);
+    wheel.schedule(start + 5ms, 5);
+    wheel.schedule(start + 300ms, 300);
+    wheel.schedule(start + 70s, 70000);
+
+    std::vector<uint64_t> expired;
+    wheel.advance(start + 4ms, expired);
+    EXPECT_TRUE(expired.empty());
+
+    wheel.advance(start + 5ms, expired);
+    ASSERT_EQ(1u, expired.size());
+    EXPECT_EQ(5u, expired[0]);
+
+    // Far out timers are cascaded down the levels without firing on the way
+    wheel.advance(start + 69999ms, expired);
+    ASSERT_EQ(2u, expired.size());
+    EXPECT_EQ(300u, expired[1]);
+    EXPECT_EQ(1u, wheel.size());
+
+    wheel.advance(start + 70s, expired);
+    ASSERT_EQ(3u, expired.size());
+    EXPECT_EQ(70000u, expired[2]);
+    EXPECT_TRUE(wheel.empty());
+    EXPECT_EQ(TimingWheel::Clock::time_point::max(), wheel.getNextExpiry());
+}
+
+
+TEST(TimingWheel, CancelledTimersNeverFire) {
+
+    const auto start = TimingWheel::Clock::now();
+    TimingWheel wheel(1ms, start);
+    const TimingWheel::Handle first = wheel.schedule(start + 10ms, 1);
+    wheel.schedule(start + 10ms, 2);
+    const TimingWheel::Handle third = wheel.schedule(start + 1000ms, 3);
+    wheel.cancel(first);
+    wheel.cancel(third);
+
+    std::vector<uint64_t> expired;
+    wheel.advance(start + 2s, expired);
+    ASSERT_EQ(1u, expired.size());
+    EXPECT_EQ(2u, expired[0]);
+}
+
+
+TEST(TimingWheel, NextExpiryBoundsEveryTimer) {
+
+    const auto start = TimingWheel::Clock::now();
+    TimingWheel wheel(1ms, start);
+    std::mt19937 generator(7);
+    std::uniform_int_distribution<int> distribution(1, 100000);
+
+    std::vector<int> expiries;
+    for (int timer = 0; timer < 2000; timer++) {
+
+        expiries.push_back(distribution(generator));
+        wheel.schedule(start + std::chrono::milliseconds(expiries.back()), static_cast<uint64_t>(expiries.back()));
+    }
+
+    // Stepping from one wakeup to the next has to turn up every timer, in order and on time
+    std::sort(expiries.begin(), expiries.end());
+    std::vector<uint64_t> expired;
+    size_t next = 0;
+    while (!wheel.empty()) {
+
+        const auto wakeup = wheel.getNextExpiry();
+        ASSERT_LE(wakeup, start + std::chrono::milliseconds(expiries[next]));
+
+        wheel.advance(wakeup, expired);
+        for (; next < expired.size(); next++) {
+            EXPECT_EQ(static_cast<uint64_t>(expiries[next]), expired[next]);
+        }
+    }
+
+    EXPECT_EQ(expiries.size(), expired.size());
+}
@@ -0,0 +1,48 @@
+#include "gtest/gtest.h"
+#include "../libportquery/source/TokenBucket.h"
+
+
+using namespace PortQuery;
+
+
+TEST(TokenBucket, Unlimited) {
+
+    TokenBucket bucket;
+    const auto now = TokenBucket::Clock::now();
+    for (int event = 0; event < 1000; event++) {
+
+        EXPECT_TRUE(bucket.tryConsume(now));
+    }
+
+    EXPECT_EQ(now, bucket.getNextAvailable(now));
+}
+
+
+TEST(TokenBucket, BurstThenRate) {
+
+    TokenBucket bucket(10.0, 2.0);
+    const auto now = TokenBucket::Clock::now() + std::chrono::seconds(1);
+    EXPECT_TRUE(bucket.tryConsume(now));
+    EXPECT_TRUE(bucket.tryConsume(now));
+    EXPECT_FALSE(bucket.tryConsume(now));
+
+    // Ten tokens a second, the next one shows up a tenth of a second later
+    const auto next = bucket.getNextAvailable(now);
+    EXPECT_EQ(std::chrono::milliseconds(100), std::chrono::round<std::chrono::milliseconds>(next - now));
+    EXPECT_TRUE(bucket.tryConsume(next));
+}
+
+
+TEST(TokenBucket, RefundIsCappedAtBurst) {
+
+    TokenBucket bucket(10.0, 2.0);
+    const auto now = TokenBucket::Clock::now() + std::chrono::seconds(1);
+    EXPECT_TRUE(bucket.tryConsume(now));
+    bucket.refund();
+    bucket.refund();
+
+    // Refunds never take the bucket past a full burst
+    EXPECT_TRUE(bucket.tryConsume(now));
+    EXPECT_TRUE(bucket.tryConsume(now));
+    EXPECT_FALSE(bucket.tryConsume(now));
+}
@@ -0,0 +1,32 @@
+#include "gtest/gtest.h"
+#include "../libportquery/source/UDPPayloads.h"
+
+
+using namespace PortQuery;
+
+
+TEST(UDPPayloads, WellKnownPorts) {
+
+    for (const uint16_t port : { 53, 69, 111, 123, 137, 161, 177, 520, 1194, 1434, 1900, 2049, 3478, 5351, 5353, 
+            5355, 5683, 10001, 11211 }) {
+
+        EXPECT_FALSE(getUDPPayload(port).empty()) << "port " << port;
+    }
+
+    EXPECT_TRUE(getUDPPayload(0).empty());
+    EXPECT_TRUE(getUDPPayload(54).empty());
+    EXPECT_TRUE(getUDPPayload(65535).empty());
+}
+
+
+TEST(UDPPayloads, EmbeddedNullsArePreserved) {
+
+    // A DNS query is a twelve byte header followed by the root name, a type and a class
+    const std::string_view dns = getUDPPayload(53);
+    ASSERT_EQ(17, dns.size());
+    EXPECT_EQ('\x01', dns[5]);
+    EXPECT_EQ('\x02', dns[14]);
+
+    // An NTP packet is always 48 bytes, mostly zeros
+    EXPECT_EQ(48, getUDPPayload(123).size());
+}
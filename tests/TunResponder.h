@@ -0,0 +1,178 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/if.h>
+#include <linux/if_tun.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../libportquery/source/Network.h"
+
+
+// A network of hosts on a TUN device for the lifetime of the object, for replies which take a while to come back
+// (over loopback they are in the socket before the probe's send has even returned). Every address in the /16 but
+// the local one answers a SYN to an open port with a SYN-ACK, drops SYNs to a silent port and answers the rest
+// with a reset, after the delay. Needs CAP_NET_ADMIN, m_fd is -1 without it
+struct TunResponder {
+
+    TunResponder(const std::string& name, const uint32_t network, const std::set<uint16_t>& openPorts,
+            const std::chrono::milliseconds delay, const std::set<uint16_t>& silentPorts={}) : m_network(network),
+        m_openPorts(openPorts), m_silentPorts(silentPorts), m_delay(delay) {
+
+        m_fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (-1 == m_fd) {
+            return;
+        }
+
+        struct ifreq request = { };
+        std::strncpy(request.ifr_name, name.c_str(), IFNAMSIZ - 1);
+        request.ifr_flags = IFF_TUN | IFF_NO_PI;
+        const int control = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        bool configured = -1 != ioctl(m_fd, TUNSETIFF, &request);
+
+        // The local end of the network is .1, the rest of it is routed out through the device
+        sockaddr_in address = PortQuery::makeSocketAddress(network | 1, 0);
+        std::memcpy(&request.ifr_addr, &address, sizeof(address));
+        configured = configured && -1 != ioctl(control, SIOCSIFADDR, &request);
+        address = PortQuery::makeSocketAddress(NETMASK, 0);
+        std::memcpy(&request.ifr_netmask, &address, sizeof(address));
+        configured = configured && -1 != ioctl(control, SIOCSIFNETMASK, &request);
+        configured = configured && -1 != ioctl(control, SIOCGIFFLAGS, &request);
+        request.ifr_flags |= IFF_UP | IFF_RUNNING;
+        configured = configured && -1 != ioctl(control, SIOCSIFFLAGS, &request);
+        close(control);
+        if (!configured) {
+
+            close(m_fd);
+            m_fd = -1;
+            return;
+        }
+
+        m_thread = std::thread([this] () { serve(); });
+    }
+
+    ~TunResponder() {
+
+        if (-1 != m_fd) {
+
+            m_stopping = true;
+            m_thread.join();
+            close(m_fd);
+        }
+    }
+
+    // The one's complement sum of the data in 16 bit words, not yet folded
+    static uint32_t sum(const uint8_t* data, const size_t length, uint32_t total=0) {
+
+        for (size_t index = 0; index + 1 < length; index += 2) {
+            total += (static_cast<uint32_t>(data[index]) << 8) | data[index + 1];
+        }
+
+        if (length & 1) {
+            total += static_cast<uint32_t>(data[length - 1]) << 8;
+        }
+
+        return total;
+    }
+
+    static uint16_t fold(uint32_t total) {
+
+        while (total >> 16) {
+            total = (total & 0xFFFF) + (total >> 16);
+        }
+
+        return htons(static_cast<uint16_t>(~total));
+    }
+
+    void serve() {
+
+        std::deque<std::pair<std::chrono::steady_clock::time_point, std::vector<uint8_t>>> replies;
+        while (!m_stopping) {
+
+            while (!replies.empty() && replies.front().first <= std::chrono::steady_clock::now()) {
+
+                write(m_fd, replies.front().second.data(), replies.front().second.size());
+                replies.pop_front();
+            }
+
+            struct pollfd pollDescriptor = { m_fd, POLLIN, 0 };
+            if (1 != poll(&pollDescriptor, 1, 1)) {
+                continue;
+            }
+
+            uint8_t packet[2048];
+            const ssize_t length = read(m_fd, packet, sizeof(packet));
+            struct iphdr ip;
+            struct tcphdr tcp;
+            if (length < static_cast<ssize_t>(sizeof(ip) + sizeof(tcp))) {
+                continue;
+            }
+
+            std::memcpy(&ip, packet, sizeof(ip));
+            std::memcpy(&tcp, packet + ip.ihl * 4, sizeof(tcp));
+            const uint32_t target = ntohl(ip.daddr);
+            if (4 != ip.version || IPPROTO_TCP != ip.protocol || !tcp.syn || tcp.ack ||
+                    (target & NETMASK) != m_network || (m_network | 1) == target || m_silentPorts.count(ntohs(tcp.dest))) {
+                continue;
+            }
+
+            struct iphdr replyIP = { };
+            replyIP.version = 4;
+            replyIP.ihl = 5;
+            replyIP.ttl = 64;
+            replyIP.protocol = IPPROTO_TCP;
+            replyIP.tot_len = htons(sizeof(replyIP) + sizeof(tcp));
+            replyIP.saddr = ip.daddr;
+            replyIP.daddr = ip.saddr;
+            replyIP.check = fold(sum(reinterpret_cast<const uint8_t*>(&replyIP), sizeof(replyIP)));
+
+            struct tcphdr replyTCP = { };
+            replyTCP.source = tcp.dest;
+            replyTCP.dest = tcp.source;
+            replyTCP.ack_seq = htonl(ntohl(tcp.seq) + 1);
+            replyTCP.doff = sizeof(replyTCP) / 4;
+            replyTCP.ack = 1;
+            replyTCP.window = htons(1024);
+            if (m_openPorts.count(ntohs(tcp.dest))) {
+                replyTCP.syn = 1;
+            }
+
+            else {
+                replyTCP.rst = 1;
+            }
+
+            const uint32_t pseudoSum = sum(reinterpret_cast<const uint8_t*>(&replyIP.saddr), 8,
+                    IPPROTO_TCP + sizeof(replyTCP));
+            replyTCP.check = fold(sum(reinterpret_cast<const uint8_t*>(&replyTCP), sizeof(replyTCP), pseudoSum));
+
+            std::vector<uint8_t> reply(sizeof(replyIP) + sizeof(replyTCP));
+            std::memcpy(reply.data(), &replyIP, sizeof(replyIP));
+            std::memcpy(reply.data() + sizeof(replyIP), &replyTCP, sizeof(replyTCP));
+            replies.emplace_back(std::chrono::steady_clock::now() + m_delay, std::move(reply));
+        }
+    }
+
+    static constexpr uint32_t NETMASK = 0xFFFF0000;
+
+    uint32_t m_network;
+    std::set<uint16_t> m_openPorts;
+    std::set<uint16_t> m_silentPorts;
+    std::chrono::milliseconds m_delay;
+
+    int m_fd;
+    std::atomic<bool> m_stopping = false;
+    std::thread m_thread;
+};